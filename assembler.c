@@ -1,16 +1,69 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include "src/utils.h"
 #include "src/tables.h"
 #include "src/translate_utils.h"
 #include "src/translate.h"
+#include "src/intermediate.h"
+#include "src/object.h"
+#include "src/data.h"
+#include "src/elf_writer.h"
+#include "src/reloc.h"
+#include "src/backpatch.h"
+#include "src/ir.h"
+#include "src/program.h"
+#include "src/layout.h"
+#include "src/peephole.h"
+#include "src/schedule.h"
+#include "src/relax.h"
+#include "src/cfg.h"
+#include "src/jumps.h"
 #include "assembler.h"
 
-const int MAX_ARGS = 3;
-const int BUF_SIZE = 1024;
-const char* IGNORE_CHARS = " \f\n\r\t\v,()";
+static const int MAX_ARGS = 3;
+static const int BUF_SIZE = 1024;
+static const char* IGNORE_CHARS = " \f\n\r\t\v,()";
+static const size_t IO_BUF_SIZE = 64 * 1024;
+static const size_t MIN_IO_BUF_SIZE = 512;
+
+/* Tracks the tables and I/O buffers when a memory limit is in force. */
+static CountingAllocator* memory = NULL;
+
+/* Whether pass one writes the binary intermediate format. */
+static int binary_int = 0;
+
+/* Whether pass two writes an ELF object instead of the text format. */
+static int elf_output = 0;
+
+/* Whether to run the jump threading and peephole stages (-O). */
+static int optimize = 0;
+
+/* Profile for the block layout stage (--layout), or NULL to skip it. */
+static const char* layout_profile = NULL;
+
+/* Whether to run the scheduling stage (--schedule), and whether it also
+   fills branch delay slots (--delay-slots, which implies --schedule). */
+static int schedule = 0;
+static int delay_slots = 0;
+
+/* Whether --cfg writes Graphviz (--dot) instead of the text report. */
+static int cfg_dot = 0;
+
+/* Bytes of .text beyond which some branch may not reach its target. */
+static const uint32_t BRANCH_REACH = 32768 * 4;
+
+/* Receives the instructions found by pass one. Returns the number of
+   instructions the line accounts for, or 0 on error. */
+typedef unsigned (*PassOneSink)(void* ctx, uint32_t input_line, const char* name,
+    char** args, int num_args);
+
+/* Receives the instructions encoded by pass two. */
+typedef void (*PassTwoSink)(void* ctx, uint32_t word);
 
 /*******************************
  * Helper Functions
@@ -46,12 +99,55 @@ static void raise_inst_error(uint32_t input_line, const char* name, char** args,
     log_inst(name, args, num_args);
 }
 
-/* Truncates the string at the first occurrence of the '#' character. */
+/* Truncates the string at the first occurrence of the '#' character that
+   is not inside a string literal. */
 static void skip_comment(char* str) {
-    char* comment_start = strchr(str, '#');
-    if (comment_start) {
-        *comment_start = '\0';
+    char* p = strpbrk(str, "#\"");
+    while (p && *p == '"') {
+        /* Skip to the closing quote, past escaped characters. */
+        for (p++; *p && *p != '"'; p++) {
+            p += p[0] == '\\' && p[1];
+        }
+        p = *p ? strpbrk(p + 1, "#\"") : NULL;
+    }
+    if (p) {
+        *p = '\0';
+    }
+}
+
+/* Reads the next line of INPUT into *BUF, which holds *SIZE bytes and starts
+   out as SMALL. A line that does not fit moves to a larger buffer from the
+   table allocator, which the caller releases once *BUF is no longer SMALL,
+   so that data directives can list any number of values on one line.
+   Returns 0 at the end of INPUT.
+ */
+static int read_line(FILE* input, char** buf, size_t* size, char* small) {
+    if (!fgets(*buf, *size, input)) {
+        return 0;
+    }
+    size_t len = strlen(*buf);
+    while (len == *size - 1 && (*buf)[len - 1] != '\n') {
+        Allocator* alloc = get_table_allocator();
+        char* larger;
+        if (*buf == small) {
+            larger = alloc->alloc(alloc, *size * 2);
+            if (larger) {
+                memcpy(larger, small, len + 1);
+            }
+        } else {
+            larger = alloc->resize(alloc, *buf, *size, *size * 2);
+        }
+        if (!larger) {
+            allocation_failed();
+        }
+        *buf = larger;
+        *size *= 2;
+        if (!fgets(*buf + len, *size - len, input)) {
+            break;
+        }
+        len += strlen(*buf + len);
     }
+    return 1;
 }
 
 /* Reads STR and determines whether it is a label (ends in ':'), and if so,
@@ -117,62 +213,326 @@ static int add_if_label(uint32_t input_line, char* str, uint32_t byte_offset,
 
    Just like in pass_two(), if the function encounters an error it should NOT
    exit, but process the entire file and return -1. If no errors were encountered, 
-   it should return 0.
+   it should return 0. The bytes of .text laid out are stored in TEXT_SIZE
+   unless it is NULL.
  */
-int pass_one(FILE* input, FILE* output, SymbolTable* symtbl) {
-    uint32_t line_counter = 1;
-    int numValidInstructSoFar = 0;
-    char buf[BUF_SIZE];
-    int boolean = 0;
-    while (fgets(buf, sizeof(buf), input) ) {
-        char* args[MAX_ARGS + 1];
+static int scan_source(FILE* input, SymbolTable* symtbl, DataSegment* data, PassOneSink sink,
+    void* ctx, uint32_t* text_size) {
+    uint32_t line_counter = 0;
+    uint32_t byte_offset = 0;
+    int in_data = 0;
+    char small[BUF_SIZE];
+    char* buf = small;
+    size_t size = sizeof(small);
+    int err = 0;
+    while (read_line(input, &buf, &size, small)) {
+        char* args[MAX_ARGS];
         int num_args = 0;
+        line_counter += 1;
         skip_comment(buf);
-        int toWrite = 0;
-        char* currToken = strtok(buf, IGNORE_CHARS);
-        if(strcmp(buf, "") == 0){
-            line_counter += 1;
+
+        char* save;
+        char* token = strtok_r(buf, IGNORE_CHARS, &save);
+        if (!token) {
             continue;
         }
-        if (currToken == NULL) {
-            line_counter += 1;
-            continue;
+        uint32_t label_addr = in_data ? DATA_BASE + data->len : byte_offset;
+        int retval = add_if_label(line_counter, token, label_addr, symtbl);
+        if (retval == -1) {
+            err = 1;
         }
-        int retval = add_if_label(line_counter, currToken, numValidInstructSoFar * 4, symtbl);
-        if(retval != 0) {
-            currToken = strtok(NULL, IGNORE_CHARS);
-            if(strcmp(currToken, "") == 0){
-                line_counter += 1;
+        if (retval != 0) {
+            token = strtok_r(NULL, IGNORE_CHARS, &save);
+            if (!token) {
                 continue;
             }
-        } else {
-            char name[10];
-            strcpy(name, currToken);
-            // printf("%s\n", name);
-            currToken = strtok(NULL, IGNORE_CHARS);
-            while(currToken != NULL){
-                char* ptr = currToken;
-                args[num_args] = ptr;
-                num_args += 1;
-                currToken = strtok(NULL, IGNORE_CHARS);
-                if(num_args > MAX_ARGS) {
-                    boolean = 1;
-                    toWrite = 1;
-                    raise_extra_arg_error(line_counter, currToken);
-                    break;
+        }
+
+        const char* name = token;
+        if (name[0] == '.') {
+            if (strcmp(name, ".text") == 0 || strcmp(name, ".data") == 0) {
+                in_data = name[1] == 'd';
+                data->labels_from = symtbl->len;
+                if ((token = strtok_r(NULL, IGNORE_CHARS, &save)) != NULL) {
+                    raise_extra_arg_error(line_counter, token);
+                    err = 1;
                 }
+            } else if (!in_data) {
+                write_to_log("Error - data directive outside .data at line %d: %s\n",
+                    line_counter, name);
+                err = 1;
+            } else if (add_data(data, symtbl, name, save, line_counter) != 0) {
+                err = 1;
             }
-            int returnVal = write_pass_one(output, name, args, num_args);
-            if(!returnVal) {
-                boolean = 1;
+            continue;
+        }
+        while ((token = strtok_r(NULL, IGNORE_CHARS, &save)) != NULL) {
+            if (num_args == MAX_ARGS) {
+                raise_extra_arg_error(line_counter, token);
+                err = 1;
+                break;
             }
-            if(returnVal && toWrite == 0) {
-                numValidInstructSoFar += returnVal;
+            args[num_args++] = token;
+        }
+
+        if (in_data) {
+            write_to_log("Error - instruction in .data at line %d: ", line_counter);
+            log_inst(name, args, num_args);
+            err = 1;
+            continue;
+        }
+        unsigned count = sink(ctx, line_counter, name, args, num_args);
+        if (!count) {
+            raise_inst_error(line_counter, name, args, num_args);
+            err = 1;
+        }
+        byte_offset += count * 4;
+    }
+    if (buf != small) {
+        Allocator* alloc = get_table_allocator();
+        alloc->release(alloc, buf, size);
+    }
+    if (text_size) {
+        *text_size = byte_offset;
+    }
+    return err ? -1 : 0;
+}
+
+static unsigned write_text_inst(void* output, uint32_t input_line, const char* name,
+    char** args, int num_args) {
+    return write_pass_one(output, name, args, num_args);
+}
+
+/* Runs pass one over INPUT, writing the expanded instructions to OUTPUT.
+   Labels go into SYMTBL and the .data segment into DATA. */
+int pass_one(FILE* input, FILE* output, SymbolTable* symtbl, DataSegment* data) {
+    return scan_source(input, symtbl, data, write_text_inst, output, NULL);
+}
+
+/* Expands the instruction as write_pass_one() would, but decodes each result
+   and writes it as a binary intermediate record. Instructions that fail to
+   decode are kept as text so that pass two reports them as usual. */
+static unsigned write_binary_inst(void* writer, uint32_t input_line, const char* name,
+    char** args, int num_args) {
+    ExpandedInst insts[MAX_EXPANSION];
+    unsigned count = expand_pass_one(insts, name, args, num_args);
+    for (unsigned i = 0; i < count; i++) {
+        Instr inst;
+        if (decode_inst(&inst, insts[i].name, insts[i].args, insts[i].num_args) == 0) {
+            write_int_inst(writer, &inst, insts[i].args, insts[i].num_args, input_line);
+        } else {
+            write_int_invalid(writer, insts[i].name, insts[i].args, insts[i].num_args,
+                input_line);
+        }
+    }
+    return count;
+}
+
+/* Runs pass one over INPUT into the binary intermediate format, storing the
+   bytes of .text in TEXT_SIZE unless it is NULL. */
+static int scan_to_binary(FILE* input, FILE* output, SymbolTable* symtbl, DataSegment* data,
+    uint32_t* text_size) {
+    IntWriter writer;
+    if (open_int_writer(&writer, output) != 0) {
+        write_to_log("Error: unable to write intermediate file\n");
+        return -1;
+    }
+    int err = scan_source(input, symtbl, data, write_binary_inst, &writer, text_size);
+    if (close_int_writer(&writer) != 0) {
+        write_to_log("Error: unable to write intermediate file\n");
+        err = -1;
+    }
+    return err;
+}
+
+/* Same as pass_one(), but OUTPUT receives the binary intermediate format.
+   OUTPUT must be seekable. */
+int pass_one_binary(FILE* input, FILE* output, SymbolTable* symtbl, DataSegment* data) {
+    return scan_to_binary(input, output, symtbl, data, NULL);
+}
+
+typedef struct {
+    Program* prog;
+    SymbolTable* symtbl;
+    uint32_t labels_seen;
+} ProgramReader;
+
+/* Defines in the program the labels of .text scan_source() has added since
+   the last call, at the current end of the program. */
+static void collect_new_labels(ProgramReader* reader) {
+    const char* name;
+    uint32_t addr;
+    while (get_symbol(reader->symtbl, reader->labels_seen, &name, &addr) == 0) {
+        if (addr < DATA_BASE) {
+            add_program_label(reader->prog, name);
+        }
+        reader->labels_seen++;
+    }
+}
+
+static unsigned collect_inst(void* ctx, uint32_t input_line, const char* name,
+    char** args, int num_args) {
+    ProgramReader* reader = ctx;
+    collect_new_labels(reader);
+    ExpandedInst insts[MAX_EXPANSION];
+    unsigned count = expand_pass_one(insts, name, args, num_args);
+    for (unsigned i = 0; i < count; i++) {
+        add_program_inst(reader->prog, insts[i].name, insts[i].args, insts[i].num_args,
+            input_line);
+    }
+    return count;
+}
+
+/* Runs pass one over INPUT into PROG instead of an intermediate file. Labels
+   go into SYMTBL as pass_one() would add them and, for .text, into PROG by
+   instruction index. The .data segment goes into DATA. Returns 0 on success
+   and -1 on error.
+ */
+int read_program(FILE* input, Program* prog, SymbolTable* symtbl, DataSegment* data) {
+    ProgramReader reader;
+    reader.prog = prog;
+    reader.symtbl = symtbl;
+    reader.labels_seen = symtbl->len;
+    int err = scan_source(input, symtbl, data, collect_inst, &reader, NULL);
+    collect_new_labels(&reader);
+    return err;
+}
+
+/* Writes PROG to OUTPUT as pass one would have, in the binary intermediate
+   format if binary_int is set. Returns 0 on success and -1 on error. */
+static int write_program(FILE* output, const Program* prog) {
+    const ProgCode* code = &prog->code;
+    if (!binary_int) {
+        for (uint32_t i = 0; i < code->len; i++) {
+            write_prog_inst(output, &code->insts[i]);
+        }
+        return 0;
+    }
+    IntWriter writer;
+    if (open_int_writer(&writer, output) != 0) {
+        write_to_log("Error: unable to write intermediate file\n");
+        return -1;
+    }
+    for (uint32_t i = 0; i < code->len; i++) {
+        const ProgInst* inst = &code->insts[i];
+        ProgText text;
+        format_prog_inst(&text, inst);
+        if (inst->valid) {
+            write_int_inst(&writer, &inst->inst, text.args, text.num_args, inst->line);
+        } else {
+            write_int_invalid(&writer, text.name, text.args, text.num_args, inst->line);
+        }
+    }
+    if (close_int_writer(&writer) != 0) {
+        write_to_log("Error: unable to write intermediate file\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Runs the jump threading stage and reports what it changed. */
+static void run_jumps(Program* prog) {
+    JumpStats stats;
+    thread_jumps(prog, &stats);
+    printf("Jumps: %u retargeted, %u redundant removed; %u unreachable blocks "
+        "(%u instructions) removed\n", stats.retargeted, stats.jumps_removed,
+        stats.blocks_removed, stats.insts_removed);
+}
+
+/* Runs the peephole stage and reports what it removed. */
+static void run_peephole(Program* prog) {
+    PeepholeStats stats;
+    peephole_program(prog, &stats);
+    printf("Peephole: %u instructions removed\n", stats.total);
+    for (int i = 0; i < NUM_PEEPHOLE_PATTERNS; i++) {
+        if (stats.removed[i]) {
+            printf("  %-22s %u\n", peephole_pattern_name(i), stats.removed[i]);
+        }
+    }
+}
+
+/* Runs the block layout stage with the profile named by layout_profile. */
+static int run_layout(Program* prog) {
+    FILE* profile = fopen(layout_profile, "r");
+    if (!profile) {
+        write_to_log("Error: unable to open profile %s\n", layout_profile);
+        return -1;
+    }
+    LayoutStats stats;
+    int err = layout_program(prog, profile, &stats);
+    fclose(profile);
+    if (err == 0) {
+        printf("Layout: %u blocks, %u branches inverted, %u jumps removed, %u added; "
+            "estimated taken branches %llu -> %llu; hot code spans %u -> %u instructions\n",
+            stats.blocks, stats.inverted, stats.jumps_removed, stats.jumps_added,
+            (unsigned long long) stats.taken_before, (unsigned long long) stats.taken_after,
+            stats.hot_span_before, stats.hot_span_after);
+    }
+    return err;
+}
+
+/* Runs the scheduling stage and reports the estimated savings. */
+static void run_schedule(Program* prog) {
+    ScheduleStats stats;
+    schedule_program(prog, delay_slots, &stats);
+    printf("Schedule: load-use stalls %u -> %u", stats.stalls_before, stats.stalls_after);
+    if (delay_slots) {
+        printf("; %u of %u delay slots filled", stats.slots_filled, stats.delay_slots);
+    }
+    printf("; estimated cycles saved %d\n", stats.cycles_saved);
+}
+
+/* Runs the branch relaxation stage, which only reports when it rewrote
+   something. */
+static void run_relax(Program* prog) {
+    RelaxStats stats;
+    relax_program(prog, delay_slots, &stats);
+    if (stats.relaxed) {
+        printf("Relaxation: %u of %u long branches rewritten after %u checks\n",
+            stats.relaxed, stats.watched, stats.checks);
+    }
+}
+
+/* Pass one with the optional program stages: the expanded program is read
+   into memory, rewritten by each requested stage, and only then written to
+   OUTPUT. *SYMTBL is replaced by the addresses of the rewritten program and
+   the labels of .data, which the stages leave alone. Stages are skipped if
+   pass one itself failed. Branch relaxation always runs, before scheduling
+   so that delay slots are accounted for.
+ */
+static int pass_one_staged(FILE* input, FILE* output, SymbolTable** symtbl,
+    DataSegment* data) {
+    Program prog;
+    init_program(&prog);
+    int err = read_program(input, &prog, *symtbl, data);
+    if (err == 0) {
+        if (optimize) {
+            run_jumps(&prog);
+            run_peephole(&prog);
+        }
+        if (layout_profile && run_layout(&prog) != 0) {
+            err = -1;
+        }
+        run_relax(&prog);
+        if (schedule) {
+            run_schedule(&prog);
+        }
+        SymbolTable* rewritten = program_symbols(&prog);
+        const char* name;
+        uint32_t addr;
+        for (uint32_t i = 0; get_symbol(*symtbl, i, &name, &addr) == 0; i++) {
+            if (addr >= DATA_BASE) {
+                add_to_table(rewritten, name, addr);
             }
-            line_counter += 1;
         }
+        free_table(*symtbl);
+        *symtbl = rewritten;
     }
-    return boolean;
+    if (write_program(output, &prog) != 0) {
+        err = -1;
+    }
+    free_program(&prog);
+    return err;
 }
 
 /* Reads an intermediate file and translates it into machine code. You may assume:
@@ -184,37 +544,407 @@ int pass_one(FILE* input, FILE* output, SymbolTable* symtbl) {
 
    If an error is reached, DO NOT EXIT the function. Keep translating the rest of
    the document, and at the end, return -1. Return 0 if no errors were encountered. */
-int pass_two(FILE *input, FILE* output, SymbolTable* symtbl, SymbolTable* reltbl) {
+static int translate_text(FILE *input, PassTwoSink sink, void* ctx, SymbolTable* symtbl,
+    SymbolTable* reltbl) {
     char buf[BUF_SIZE];
-    int boolean = 0;
+    int err = 0;
     uint32_t line = 0;
-    char* args[MAX_ARGS];
+    char* args[MAX_ARGS + 1];
     while (fgets(buf, sizeof(buf), input)) {
-        char* currLine = strtok(buf, IGNORE_CHARS); //MAY NEED TO CHANGE THIS
+        char* save;
+        char* name = strtok_r(buf, IGNORE_CHARS, &save);
+        if (!name) {
+            continue;
+        }
         int num_args = 0;
-        char name[10];
-        strcpy(name, currLine);
-        currLine = strtok(NULL, IGNORE_CHARS);
-        while(currLine != NULL) {
-            char* pt = currLine;
-            args[num_args] = pt;
-            num_args += 1;
-            currLine = strtok(NULL, IGNORE_CHARS);
+        char* token;
+        while ((token = strtok_r(NULL, IGNORE_CHARS, &save)) != NULL && num_args <= MAX_ARGS) {
+            args[num_args++] = token;
         }
         uint32_t branchOff = line * 4;
-        int retval = translate_inst(output, name, args, num_args, branchOff, symtbl, reltbl);
-        if (retval == -1) {
+        Instr inst;
+        uint32_t word;
+        if (num_args <= MAX_ARGS && decode_inst(&inst, name, args, num_args) == 0
+            && encode_inst(&word, &inst, branchOff, symtbl, reltbl) == 0) {
+            sink(ctx, word);
+        } else {
             raise_inst_error(line + 1, name, args, num_args);
-            boolean = 1;
+            err = 1;
         }
         line += 1;
     }
-    if (boolean) {
+    if (err) {
+        return -1;
+    }
+    return 0;
+}
+
+static void write_hex_word(void* output, uint32_t word) {
+    write_inst_hex(output, word);
+}
+
+static void append_to_buffer(void* buffer, uint32_t word) {
+    append_word(buffer, word);
+}
+
+static void write_hex_words(void* output, const uint32_t* words, uint32_t n) {
+    write_insts_hex(output, words, n);
+}
+
+static void append_words(void* buffer, const uint32_t* words, uint32_t n) {
+    WordBuffer* text = buffer;
+    uint32_t len = text->len;
+    resize_word_buffer(text, len + n);
+    memcpy(text->words + len, words, n * sizeof(uint32_t));
+}
+
+int pass_two(FILE *input, FILE* output, SymbolTable* symtbl, SymbolTable* reltbl) {
+    return translate_text(input, write_hex_word, output, symtbl, reltbl);
+}
+
+/* Same as translate_text(), but for a mapped binary intermediate file. The
+   records are already decoded, so they are copied into an InstBlock a block
+   at a time and encoded together by encode_block(). */
+static int translate_records(const IntImage* image, WordFlush flush, void* ctx,
+    SymbolTable* symtbl, SymbolTable* reltbl) {
+    int err = 0;
+    uint32_t num_records = image->header->num_records;
+    InstBlock* block = create_block();
+    uint32_t words[IR_BLOCK_SIZE];
+    uint8_t bad[IR_BLOCK_SIZE];
+    if (!block) {
+        allocation_failed();
+    }
+    for (uint32_t first = 0; first < num_records; first += IR_BLOCK_SIZE) {
+        const IntRecord* records = image->records + first;
+        uint32_t n = num_records - first < IR_BLOCK_SIZE ? num_records - first : IR_BLOCK_SIZE;
+        block->len = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (records[i].id < NUM_INSTS) {
+                Instr inst;
+                record_to_inst(&inst, image, &records[i]);
+                add_to_block(block, &inst);
+            } else {
+                add_invalid_to_block(block);
+            }
+        }
+        if (encode_block(block, first * 4, words, bad, symtbl, reltbl) == 0) {
+            flush(ctx, words, n);
+            continue;
+        }
+        /* Leave out the words that failed, reporting them in order. */
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (bad[i]) {
+                write_to_log("Error - invalid instruction at line %d: %s\n", first + i + 1,
+                    record_text(image, &records[i]));
+                err = 1;
+            } else {
+                words[kept++] = words[i];
+            }
+        }
+        flush(ctx, words, kept);
+    }
+    free_block(block);
+    return err ? -1 : 0;
+}
+
+/* Same as pass_two(), but translates a mapped binary intermediate file. */
+int pass_two_binary(const IntImage* image, FILE* output, SymbolTable* symtbl,
+    SymbolTable* reltbl) {
+    return translate_records(image, write_hex_words, output, symtbl, reltbl);
+}
+
+/*******************************
+ * Single-Pass Assembly
+ *******************************/
+
+/* State of a single-pass run. LABELS_SEEN counts the entries of SYMTBL that
+   have already been passed to define_label(). START is where INPUT began,
+   or -1 if it is not to be read again. RESTAGE is set once the program
+   grows past BRANCH_REACH while it still can be: from then on instructions
+   are only checked, and the run is redone through the program stages. */
+typedef struct {
+    Backpatcher bp;
+    SymbolTable* symtbl;
+    SymbolTable* reltbl;
+    uint32_t labels_seen;
+    long start;
+    uint32_t out_of_range;
+    int restage;
+    int err;
+} OnePass;
+
+/* Resolves branches waiting for labels that scan_source() has added since
+   the last call. */
+static void define_new_labels(OnePass* op) {
+    const char* name;
+    uint32_t addr;
+    while (get_symbol(op->symtbl, op->labels_seen, &name, &addr) == 0) {
+        if (!op->restage) {
+            define_label(&op->bp, name, addr);
+        }
+        op->labels_seen++;
+    }
+}
+
+/* Expands, decodes and encodes one source line straight into the output.
+   Branches to labels that are not defined yet are left for the backpatcher.
+   Returns the instruction count scan_source() expects, as write_pass_one()
+   does, so that labels get the same addresses as in the two-pass mode. */
+static unsigned encode_one_pass(void* ctx, uint32_t input_line, const char* name,
+    char** args, int num_args) {
+    OnePass* op = ctx;
+    define_new_labels(op);
+    ExpandedInst insts[MAX_EXPANSION];
+    unsigned count = expand_pass_one(insts, name, args, num_args);
+    /* No branch can be out of range yet, and without a window nothing has
+       been flushed. */
+    if (!op->restage && op->start != -1 && op->bp.flushed == 0
+        && (uint64_t) (op->bp.len + count) * 4 > BRANCH_REACH) {
+        op->restage = 1;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        Instr inst;
+        uint32_t word;
+        uint32_t addr = op->bp.len * 4;
+        if (decode_inst(&inst, insts[i].name, insts[i].args, insts[i].num_args) == 0) {
+            if (op->restage) {
+                continue;
+            }
+            if (format_info(inst.fmt)->label == LABEL_BRANCH) {
+                int64_t target = get_addr_for_symbol(op->symtbl, inst.label);
+                if (target == -1) {
+                    emit_forward_branch(&op->bp, (uint32_t) inst.opcode << 26
+                        | inst.rs << 21 | inst.rt << 16, inst.label, input_line);
+                    continue;
+                }
+                if (target - addr - 4 < -32768 * 4) {
+                    write_to_log("Error - branch out of range at line %u: %s\n", input_line,
+                        inst.label);
+                    op->out_of_range++;
+                    op->err = 1;
+                    emit_word(&op->bp, 0);
+                    continue;
+                }
+            }
+            if (encode_inst(&word, &inst, addr, op->symtbl, op->reltbl) == 0) {
+                emit_word(&op->bp, word);
+                continue;
+            }
+        }
+        raise_inst_error(input_line, insts[i].name, insts[i].args, insts[i].num_args);
+        op->err = 1;
+        if (!op->restage) {
+            emit_word(&op->bp, 0);
+        }
+    }
+    return count;
+}
+
+/* Empties TABLE, keeping its mode. */
+static void reset_table(SymbolTable* table) {
+    SymbolTable* empty = create_table(table->mode);
+    SymbolTable old = *table;
+    *table = *empty;
+    *empty = old;
+    free_table(empty);
+}
+
+/* Assembles INPUT again from OP->START as the two-pass mode does a program
+   larger than BRANCH_REACH: it is read into memory, its out-of-range
+   branches are relaxed, and only then is it encoded into OP->BP. SYMTBL,
+   RELTBL and DATA are refilled, with the labels of the relaxed program.
+   Returns 0 on success and -1 on error.
+ */
+static int one_pass_relaxed(OnePass* op, FILE* input, DataSegment* data) {
+    reset_table(op->symtbl);
+    reset_table(op->reltbl);
+    free_data_segment(data);
+    init_data_segment(data);
+    if (fseek(input, op->start, SEEK_SET) != 0) {
+        write_to_log("Error: unable to read the input again\n");
+        return -1;
+    }
+    Program prog;
+    init_program(&prog);
+    int err = read_program(input, &prog, op->symtbl, data);
+    if (err == 0) {
+        RelaxStats stats;
+        relax_program(&prog, 0, &stats);
+        SymbolTable* rewritten = program_symbols(&prog);
+        const char* name;
+        uint32_t addr;
+        for (uint32_t i = 0; get_symbol(op->symtbl, i, &name, &addr) == 0; i++) {
+            if (addr >= DATA_BASE) {
+                add_to_table(rewritten, name, addr);
+            }
+        }
+        SymbolTable old = *op->symtbl;
+        *op->symtbl = *rewritten;
+        *rewritten = old;
+        free_table(rewritten);
+
+        const ProgCode* code = &prog.code;
+        for (uint32_t i = 0; i < code->len; i++) {
+            const ProgInst* inst = &code->insts[i];
+            uint32_t word = 0;
+            if (!inst->valid
+                || encode_inst(&word, &inst->inst, i * 4, op->symtbl, op->reltbl) != 0) {
+                ProgText text;
+                format_prog_inst(&text, inst);
+                raise_inst_error(inst->line, text.name, text.args, text.num_args);
+                err = -1;
+            }
+            emit_word(&op->bp, word);
+        }
+    }
+    free_program(&prog);
+    return err;
+}
+
+/* Assembles INPUT in a single pass, encoding each instruction as it is read
+   and backpatching forward branches. Words go to FLUSH(CTX, ...) through an
+   output window of WINDOW words (0 for unbounded, see backpatch.h). SYMTBL,
+   RELTBL and DATA are filled in as in the two-pass mode.
+
+   A program with more than BRANCH_REACH bytes of .text may have branches
+   that have to be relaxed, which changes the addresses of everything after
+   them. Without a window, and if INPUT is seekable, such a program is
+   assembled a second time through the same stages as in the two-pass mode,
+   so that the object is the same. That holds the whole program in memory,
+   so with a window, which bounds memory, out-of-range branches are errors,
+   as they are when INPUT cannot be read again. Returns 0 on success and -1
+   on error.
+ */
+int one_pass(FILE* input, uint32_t window, WordFlush flush, void* ctx, SymbolTable* symtbl,
+    SymbolTable* reltbl, DataSegment* data) {
+    OnePass op;
+    init_backpatcher(&op.bp, window, flush, ctx);
+    op.symtbl = symtbl;
+    op.reltbl = reltbl;
+    op.labels_seen = symtbl->len;
+    op.start = window ? -1 : ftell(input);
+    op.out_of_range = 0;
+    op.restage = 0;
+    op.err = 0;
+
+    if (scan_source(input, symtbl, data, encode_one_pass, &op, NULL) != 0) {
+        op.err = 1;
+    }
+    define_new_labels(&op);
+    if (op.restage) {
+        free_backpatcher(&op.bp);
+        init_backpatcher(&op.bp, window, flush, ctx);
+        if (!op.err && one_pass_relaxed(&op, input, data) != 0) {
+            op.err = 1;
+        }
+    }
+    if (finish_backpatcher(&op.bp) != 0) {
+        op.err = 1;
+    }
+    if ((op.out_of_range || op.bp.out_of_range) && window) {
+        write_to_log("Error: branches out of range cannot be relaxed in stream mode\n");
+    } else if (op.out_of_range || op.bp.out_of_range) {
+        write_to_log("Error: branches out of range cannot be relaxed in one pass unless "
+            "the input is seekable\n");
+    }
+    free_backpatcher(&op.bp);
+    return op.err ? -1 : 0;
+}
+
+/* Writes the .data section of the text object format, if there is one. */
+static void write_data_section(FILE* output, const DataSegment* data) {
+    if (data->len) {
+        fprintf(output, "\n.data\n");
+        write_section_hex(output, &data->words);
+    }
+}
+
+/* ELF output has no .data section. Returns -1, after saying so, if DATA or
+   SYMTBL needs one, and 0 otherwise. */
+static int check_elf_data(const DataSegment* data, SymbolTable* symtbl) {
+    const char* name;
+    uint32_t addr;
+    int used = data->len != 0;
+    for (uint32_t i = 0; !used && get_symbol(symtbl, i, &name, &addr) == 0; i++) {
+        used = addr >= DATA_BASE;
+    }
+    if (used) {
+        write_to_log("Error: --elf does not support .data\n");
         return -1;
     }
     return 0;
 }
 
+/* Assembles the source read from INPUT and writes the object to OUTPUT in
+   the text format, in one pass and in bounded memory: besides the symbol
+   and relocation tables and the .data segment, which follows .text in the
+   output, only the pending branches and a window of BACKPATCH_WINDOW words
+   are held. Neither stream needs to be seekable. Branches are not relaxed,
+   since that needs the whole program in memory, so a branch out of 16-bit
+   range is an error (see one_pass()). Returns 0 on success and -1 on
+   error.
+ */
+int assemble_stream(FILE* input, FILE* output) {
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    DataSegment data;
+    init_data_segment(&data);
+
+    fprintf(output, ".text\n");
+    int err = one_pass(input, BACKPATCH_WINDOW, write_hex_words, output, symtbl, reltbl,
+        &data);
+    write_data_section(output, &data);
+    fprintf(output, "\n.symbol\n");
+    write_table(symtbl, output);
+    fprintf(output, "\n.relocation\n");
+    write_relocs(reltbl, output);
+    if (fflush(output) != 0) {
+        write_to_log("Error: unable to write output\n");
+        err = -1;
+    }
+
+    free_data_segment(&data);
+    free_table(symtbl);
+    free_table(reltbl);
+    return err;
+}
+
+/* Assembles LEN bytes of SOURCE held in memory into OBJ, in one pass and
+   without touching the file system. Diagnostics go to LOG(CTX, ...) one line
+   at a time, or to the log file if LOG is NULL. The redirection only applies
+   to the calling thread, so several threads may assemble at once as long as
+   nobody calls set_table_allocator() meanwhile. OBJ must be released with
+   free_object(), also on error. Returns 0 on success and -1 on error.
+ */
+int assemble_buffer(ObjectFile* obj, const char* source, size_t len, LogCallback log,
+    void* ctx) {
+    init_word_buffer(&obj->text);
+    init_word_buffer(&obj->data);
+    obj->symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    obj->reltbl = create_table(SYMTBL_NON_UNIQUE);
+    if (len == 0) {
+        return 0;
+    }
+
+    set_log_callback(log, ctx);
+    int err = 0;
+    FILE* input = fmemopen((void*) source, len, "r");
+    if (!input) {
+        write_to_log("Error: unable to read source buffer\n");
+        err = -1;
+    } else {
+        DataSegment data;
+        init_data_segment(&data);
+        err = one_pass(input, 0, append_words, &obj->text, obj->symtbl, obj->reltbl, &data);
+        obj->data = data.words;
+        fclose(input);
+    }
+    set_log_callback(NULL, NULL);
+    return err;
+}
+
 /*******************************
  * Do Not Modify Code Below
  *******************************/
@@ -241,14 +971,132 @@ static void close_files(FILE* input, FILE* output) {
     fclose(output);
 }
 
+/* Gives FILE a stdio buffer drawn from the table allocator so that it counts
+   against the memory limit. When the remaining headroom is small the buffer
+   shrinks, which makes output flush earlier, and below MIN_IO_BUF_SIZE the
+   file is left unbuffered. Returns the buffer (NULL if none) and stores its
+   size in SIZE.
+ */
+static char* attach_io_buffer(FILE* file, size_t* size) {
+    size_t want = IO_BUF_SIZE;
+    if (memory) {
+        size_t headroom = allocator_headroom(memory);
+        while (want >= MIN_IO_BUF_SIZE && want > headroom / 4) {
+            want /= 2;
+        }
+    }
+    *size = 0;
+    if (want < MIN_IO_BUF_SIZE) {
+        setvbuf(file, NULL, _IONBF, 0);
+        return NULL;
+    }
+    Allocator* alloc = get_table_allocator();
+    char* buf = alloc->alloc(alloc, want);
+    if (!buf) {
+        allocation_failed();
+    }
+    setvbuf(file, buf, _IOFBF, want);
+    *size = want;
+    return buf;
+}
+
+/* Releases a buffer from attach_io_buffer(). Its file must be closed first. */
+static void release_io_buffer(char* buf, size_t size) {
+    if (buf) {
+        Allocator* alloc = get_table_allocator();
+        alloc->release(alloc, buf, size);
+    }
+}
+
+/* Stores the name of the sidecar with SUFFIX for TMP_NAME in BUF. */
+static int sidecar_name(char* buf, size_t size, const char* tmp_name, const char* suffix) {
+    return snprintf(buf, size, "%s%s", tmp_name, suffix) < (int) size ? 0 : -1;
+}
+
+/* Saves SYMTBL, and DATA if it is not empty, next to the intermediate file
+   so that pass two can run on its own. A data sidecar left by an earlier
+   run is removed. Returns 0 on success and -1 on error. */
+static int write_sidecar(const char* tmp_name, SymbolTable* symtbl, const DataSegment* data) {
+    char name[BUF_SIZE];
+    FILE* file;
+    if (sidecar_name(name, sizeof(name), tmp_name, ".sym") != 0
+        || !(file = fopen(name, "wb"))) {
+        write_to_log("Error: unable to write symbol table for %s\n", tmp_name);
+        return -1;
+    }
+    int err = write_table_image(symtbl, file);
+    if (fclose(file) != 0 || err) {
+        write_to_log("Error: unable to write symbol table for %s\n", tmp_name);
+        return -1;
+    }
+    if (sidecar_name(name, sizeof(name), tmp_name, ".data") != 0) {
+        write_to_log("Error: unable to write .data for %s\n", tmp_name);
+        return -1;
+    }
+    if (data->len == 0) {
+        remove(name);
+        return 0;
+    }
+    if (!(file = fopen(name, "wb"))) {
+        write_to_log("Error: unable to write .data for %s\n", tmp_name);
+        return -1;
+    }
+    err = write_data_image(data, file);
+    if (fclose(file) != 0 || err) {
+        write_to_log("Error: unable to write .data for %s\n", tmp_name);
+        return -1;
+    }
+    return 0;
+}
+
+/* Maps the symbol table saved by a previous pass one run, or returns NULL if
+   there is none. */
+static SymbolTable* map_sidecar(const char* tmp_name) {
+    char name[BUF_SIZE];
+    FILE* file;
+    if (sidecar_name(name, sizeof(name), tmp_name, ".sym") != 0
+        || !(file = fopen(name, "rb"))) {
+        return NULL;
+    }
+    SymbolTable* symtbl = map_table_image(file);
+    fclose(file);
+    if (!symtbl) {
+        write_to_log("Error: ignoring malformed symbol table %s\n", name);
+    }
+    return symtbl;
+}
+
+/* Reads the .data saved by a previous pass one run into DATA, which is left
+   empty if there is none. Returns 0 on success and -1 on error. */
+static int read_data_sidecar(const char* tmp_name, DataSegment* data) {
+    char name[BUF_SIZE];
+    FILE* file;
+    if (sidecar_name(name, sizeof(name), tmp_name, ".data") != 0
+        || !(file = fopen(name, "rb"))) {
+        return 0;
+    }
+    int err = read_data_image(data, file);
+    fclose(file);
+    if (err) {
+        write_to_log("Error: malformed .data sidecar %s\n", name);
+    }
+    return err;
+}
+
 /* Runs the two-pass assembler. Most of the actual work is done in pass_one()
-   and pass_two().
+   and pass_two(). When only pass one runs, the symbol table and the .data
+   segment are saved in sidecar files next to the intermediate file, and when
+   only pass two runs it reads them instead of starting out empty.
  */
 int assemble(const char* in_name, const char* tmp_name, const char* out_name) {
     FILE *src, *dst;
+    char *src_buf, *dst_buf;
+    size_t src_buf_size, dst_buf_size;
     int err = 0;
     SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
     SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    DataSegment data;
+    init_data_segment(&data);
 
     if (in_name) {
         printf("Running pass one: %s -> %s\n", in_name, tmp_name);
@@ -257,11 +1105,53 @@ int assemble(const char* in_name, const char* tmp_name, const char* out_name) {
             free_table(reltbl);
             exit(1);
         }
+        src_buf = attach_io_buffer(src, &src_buf_size);
+        dst_buf = attach_io_buffer(dst, &dst_buf_size);
 
-        if (pass_one(src, dst, symtbl) != 0) {
+        int result;
+        if (optimize || layout_profile || schedule) {
+            result = pass_one_staged(src, dst, &symtbl, &data);
+        } else {
+            uint32_t text_size = 0;
+            result = binary_int
+                ? scan_to_binary(src, dst, symtbl, &data, &text_size)
+                : scan_source(src, symtbl, &data, write_text_inst, dst, &text_size);
+            /* Branches can only fall out of range in a program this large,
+               so only then is pass one redone in memory to relax them. */
+            if (result == 0 && text_size > BRANCH_REACH) {
+                rewind(src);
+                fflush(dst);
+                if (ftruncate(fileno(dst), 0) != 0) {
+                    write_to_log("Error: unable to write intermediate file\n");
+                    result = -1;
+                } else {
+                    rewind(dst);
+                    free_table(symtbl);
+                    symtbl = create_table(SYMTBL_UNIQUE_NAME);
+                    free_data_segment(&data);
+                    result = pass_one_staged(src, dst, &symtbl, &data);
+                }
+            }
+        }
+        if (result != 0) {
             err = 1;
         }
         close_files(src, dst);
+        release_io_buffer(src_buf, src_buf_size);
+        release_io_buffer(dst_buf, dst_buf_size);
+
+        if (!out_name && write_sidecar(tmp_name, symtbl, &data) != 0) {
+            err = 1;
+        }
+    } else if (out_name) {
+        SymbolTable* saved = map_sidecar(tmp_name);
+        if (saved) {
+            free_table(symtbl);
+            symtbl = saved;
+        }
+        if (read_data_sidecar(tmp_name, &data) != 0) {
+            err = 1;
+        }
     }
 
     if (out_name) {
@@ -271,49 +1161,214 @@ int assemble(const char* in_name, const char* tmp_name, const char* out_name) {
             free_table(reltbl);
             exit(1);
         }
+        src_buf = attach_io_buffer(src, &src_buf_size);
+        dst_buf = attach_io_buffer(dst, &dst_buf_size);
+
+        PassTwoSink sink = write_hex_word;
+        WordFlush flush = write_hex_words;
+        void* ctx = dst;
+        WordBuffer text;
+        init_word_buffer(&text);
+        if (elf_output) {
+            sink = append_to_buffer;
+            flush = append_words;
+            ctx = &text;
+        } else {
+            fprintf(dst, ".text\n");
+        }
+
+        if (is_binary_int(src)) {
+            IntImage image;
+            if (map_int_file(&image, src) != 0
+                || translate_records(&image, flush, ctx, symtbl, reltbl) != 0) {
+                err = 1;
+            }
+            unmap_int_file(&image);
+        } else if (translate_text(src, sink, ctx, symtbl, reltbl) != 0) {
+            err = 1;
+        }
+
+        if (elf_output) {
+            if (check_elf_data(&data, symtbl) != 0
+                || write_elf_object(dst, text.words, text.len, symtbl, reltbl) != 0) {
+                err = 1;
+            }
+        } else {
+            write_data_section(dst, &data);
+
+            fprintf(dst, "\n.symbol\n");
+            write_table(symtbl, dst);
+
+            fprintf(dst, "\n.relocation\n");
+            write_relocs(reltbl, dst);
+        }
+        free_word_buffer(&text);
+
+        close_files(src, dst);
+        release_io_buffer(src_buf, src_buf_size);
+        release_io_buffer(dst_buf, dst_buf_size);
+    }
+    
+    free_data_segment(&data);
+    free_table(symtbl);
+    free_table(reltbl);
+    return err;
+}
+
+/* Runs the one-pass assembler. The source is read once and no intermediate
+   file is written: one_pass() keeps the whole .text in memory and patches
+   forward branches in place as their labels are defined. The output is the
+   same object the two passes write.
+ */
+int assemble_one_pass(const char* in_name, const char* out_name) {
+    FILE *src, *dst;
+    char *src_buf, *dst_buf;
+    size_t src_buf_size, dst_buf_size;
+    int err = 0;
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+
+    printf("Running one pass: %s -> %s\n", in_name, out_name);
+    if (open_files(&src, &dst, in_name, out_name) != 0) {
+        free_table(symtbl);
+        free_table(reltbl);
+        exit(1);
+    }
+    src_buf = attach_io_buffer(src, &src_buf_size);
+    dst_buf = attach_io_buffer(dst, &dst_buf_size);
 
+    WordBuffer text;
+    init_word_buffer(&text);
+    DataSegment data;
+    init_data_segment(&data);
+    if (elf_output) {
+        if (one_pass(src, 0, append_words, &text, symtbl, reltbl, &data) != 0) {
+            err = 1;
+        }
+        if (check_elf_data(&data, symtbl) != 0
+            || write_elf_object(dst, text.words, text.len, symtbl, reltbl) != 0) {
+            err = 1;
+        }
+    } else {
         fprintf(dst, ".text\n");
-        if (pass_two(src, dst, symtbl, reltbl) != 0) {
+        if (one_pass(src, 0, write_hex_words, dst, symtbl, reltbl, &data) != 0) {
             err = 1;
         }
-        
+        write_data_section(dst, &data);
         fprintf(dst, "\n.symbol\n");
         write_table(symtbl, dst);
 
         fprintf(dst, "\n.relocation\n");
-        write_table(reltbl, dst);
-
-        close_files(src, dst);
+        write_relocs(reltbl, dst);
     }
-    
+    free_word_buffer(&text);
+    free_data_segment(&data);
+
+    close_files(src, dst);
+    release_io_buffer(src_buf, src_buf_size);
+    release_io_buffer(dst_buf, dst_buf_size);
+
     free_table(symtbl);
     free_table(reltbl);
     return err;
 }
 
+/* Runs pass one into memory and writes the control-flow report of the
+   expanded program (see src/cfg.h) to OUT_NAME, as Graphviz if cfg_dot is
+   set. Nothing is assembled. Returns 0 on success and 1 on error.
+ */
+int analyze_cfg(const char* in_name, const char* out_name) {
+    FILE *src, *dst;
+    int err = 0;
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+
+    printf("Analyzing control flow: %s -> %s\n", in_name, out_name);
+    if (open_files(&src, &dst, in_name, out_name) != 0) {
+        free_table(symtbl);
+        exit(1);
+    }
+    Program prog;
+    DataSegment data;
+    init_program(&prog);
+    init_data_segment(&data);
+    if (read_program(src, &prog, symtbl, &data) != 0) {
+        err = 1;
+    }
+    Cfg cfg;
+    build_cfg(&cfg, &prog);
+    if (cfg_dot) {
+        write_cfg_dot(dst, &cfg, &prog);
+    } else {
+        write_cfg_report(dst, &cfg, &prog);
+    }
+    printf("%u blocks, %u loops\n", cfg.blocks.num_blocks, cfg.num_loops);
+    free_cfg(&cfg);
+    free_program(&prog);
+    free_data_segment(&data);
+
+    close_files(src, dst);
+    free_table(symtbl);
+    return err;
+}
+
+#if !defined(TESTING) && !defined(ASSEMBLER_LIBRARY)
+
 static void print_usage_and_exit() {
     printf("Usage:\n");
     printf("  Runs both passes: assembler <input file> <intermediate file> <output file>\n");
     printf("  Run pass #1:      assembler -p1 <input file> <intermediate file>\n");
     printf("  Run pass #2:      assembler -p2 <intermediate file> <output file>\n");
-    printf("Append -log <file name> after any option to save log files to a text file.\n");
+    printf("  Run in one pass:  assembler --one-pass <input file> <output file>\n");
+    printf("  Stream in one pass from stdin to stdout: assembler --stream\n");
+    printf("  Report control flow: assembler --cfg <input file> <report file>\n");
+    printf("Options, appended after any of the above:\n");
+    printf("  -log <file name>          save log files to a text file\n");
+    printf("  --memory-limit <bytes>    cap the assembler's heap (K, M or G suffix allowed)\n");
+    printf("  --binary-int              write the intermediate file in binary form\n");
+    printf("  --elf                     write an ELF32 MIPS relocatable object\n");
+    printf("  -O                        remove redundant instructions and jumps (two-pass mode only)\n");
+    printf("  --layout <profile>        reorder blocks by a profile (two-pass mode only)\n");
+    printf("  --schedule                separate loads from their uses (two-pass mode only)\n");
+    printf("  --delay-slots             schedule for branch delay slots (two-pass mode only)\n");
+    printf("  --dot                     write the --cfg report as a Graphviz graph\n");
     exit(0);
 }
 
+/* Prints the peak resident set size next to the assembler's own accounting. */
+static void report_memory_usage(FILE* output, const CountingAllocator* counter) {
+    struct rusage usage;
+    long peak_rss = 0;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        peak_rss = usage.ru_maxrss;
+    }
+    fprintf(output, "Memory: peak RSS %ld KiB; tracked heap peak %zu bytes in %zu allocations "
+        "(limit %zu bytes)\n", peak_rss, counter->peak_bytes, counter->num_allocs,
+        counter->limit);
+}
+
 int main(int argc, char **argv) {
-    if (argc != 4 && argc != 6) {
+    int stream = argc > 1 && strcmp(argv[1], "--stream") == 0;
+    if (argc < 4 && !stream) {
         print_usage_and_exit();
     }
 
     int mode = 0;
-    if (strcmp(argv[1], "-p1") == 0) {
+    if (stream) {
+        mode = 3;
+    } else if (strcmp(argv[1], "--one-pass") == 0) {
+        mode = 4;
+    } else if (strcmp(argv[1], "--cfg") == 0) {
+        mode = 5;
+    } else if (strcmp(argv[1], "-p1") == 0) {
         mode = 1;
     } else if (strcmp(argv[1], "-p2") == 0) {
         mode = 2;
     }
 
     char *input, *inter, *output;
-    if (mode == 1) {
+    if (mode == 3) {
+        input = inter = output = NULL;
+    } else if (mode == 1) {
         input = argv[2];
         inter = argv[3];
         output = NULL;
@@ -321,21 +1376,86 @@ int main(int argc, char **argv) {
         input = NULL;
         inter = argv[2];
         output = argv[3];
+    } else if (mode == 4 || mode == 5) {
+        input = argv[2];
+        inter = NULL;
+        output = argv[3];
     } else {
         input = argv[1];
         inter = argv[2];
         output = argv[3];
     }
 
-    if (argc == 6) {
-        if (strcmp(argv[4], "-log") == 0) {
-            set_log_file(argv[5]);
+    const char* log_name = NULL;
+    size_t memory_limit = 0;
+    for (int i = stream ? 2 : 4; i < argc; i += 2) {
+        if (strcmp(argv[i], "--binary-int") == 0) {
+            binary_int = 1;
+            i--;
+            continue;
+        }
+        if (strcmp(argv[i], "--elf") == 0) {
+            elf_output = 1;
+            i--;
+            continue;
+        }
+        if (strcmp(argv[i], "--dot") == 0) {
+            cfg_dot = 1;
+            i--;
+            continue;
+        }
+        if (strcmp(argv[i], "-O") == 0) {
+            optimize = 1;
+            i--;
+            continue;
+        }
+        if (strcmp(argv[i], "--schedule") == 0 || strcmp(argv[i], "--delay-slots") == 0) {
+            schedule = 1;
+            delay_slots |= argv[i][2] == 'd';
+            i--;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage_and_exit();
+        }
+        if (strcmp(argv[i], "-log") == 0) {
+            log_name = argv[i + 1];
+            set_log_file(log_name);
+        } else if (strcmp(argv[i], "--layout") == 0) {
+            layout_profile = argv[i + 1];
+        } else if (strcmp(argv[i], "--memory-limit") == 0) {
+            unsigned long long size;
+            if (parse_size(&size, argv[i + 1]) != 0 || size == 0 || size > SIZE_MAX) {
+                print_usage_and_exit();
+            }
+            memory_limit = size;
         } else {
             print_usage_and_exit();
         }
     }
 
-    int err = assemble(input, inter, output);
+    CountingAllocator counter;
+    if (memory_limit) {
+        init_counting_allocator(&counter, NULL);
+        counter.limit = memory_limit;
+        memory = &counter;
+        set_table_allocator(&counter.base);
+    }
+
+    if (stream && elf_output) {
+        write_to_log("Error: --elf needs a seekable output and cannot be streamed\n");
+        return 1;
+    }
+    int err;
+    if (mode == 3) {
+        err = assemble_stream(stdin, stdout);
+    } else if (mode == 4) {
+        err = assemble_one_pass(input, output);
+    } else if (mode == 5) {
+        err = analyze_cfg(input, output);
+    } else {
+        err = assemble(input, inter, output);
+    }
 
     if (err) {
         write_to_log("One or more errors encountered during assembly operation.\n");
@@ -343,9 +1463,17 @@ int main(int argc, char **argv) {
         write_to_log("Assembly operation completed successfully.\n");
     }
 
+    /* In stream mode stdout carries the object. */
+    FILE* info = stream ? stderr : stdout;
+    if (memory) {
+        report_memory_usage(info, memory);
+    }
+
     if (is_log_file_set()) {
-        printf("Results saved to %s\n", argv[5]);
+        fprintf(info, "Results saved to %s\n", log_name);
     }
 
     return err;
 }
+
+#endif
@@ -3,8 +3,27 @@
 
 int assemble(const char* in_name, const char* tmp_name, const char* out_name);
 
-int pass_one(FILE *input, FILE* output, SymbolTable* symtbl);
+int pass_one(FILE *input, FILE* output, SymbolTable* symtbl, DataSegment* data);
+
+int pass_one_binary(FILE* input, FILE* output, SymbolTable* symtbl, DataSegment* data);
+
+int read_program(FILE* input, Program* prog, SymbolTable* symtbl, DataSegment* data);
 
 int pass_two(FILE *input, FILE* output, SymbolTable* symtbl, SymbolTable* reltbl);
 
+int pass_two_binary(const IntImage* image, FILE* output, SymbolTable* symtbl,
+    SymbolTable* reltbl);
+
+int one_pass(FILE* input, uint32_t window, WordFlush flush, void* ctx, SymbolTable* symtbl,
+    SymbolTable* reltbl, DataSegment* data);
+
+int assemble_stream(FILE* input, FILE* output);
+
+int assemble_one_pass(const char* in_name, const char* out_name);
+
+int analyze_cfg(const char* in_name, const char* out_name);
+
+int assemble_buffer(ObjectFile* obj, const char* source, size_t len, LogCallback log,
+    void* ctx);
+
 #endif
@@ -0,0 +1,73 @@
+/* Measures decode_words() and disassemble_object().
+
+   Builds NUM_WORDS valid encodings of instructions drawn uniformly from the
+   instruction table, with random operands, and times decoding them to ids
+   and writing the whole object out as text (to /dev/null). Usage:
+   disasm_bench [num_words]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/utils.h"
+#include "../src/tables.h"
+#include "../src/translate.h"
+#include "../src/object.h"
+#include "../src/disasm.h"
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+    uint32_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 4000000;
+    Disassembler dis;
+    init_disassembler(&dis);
+
+    ObjectFile obj;
+    init_word_buffer(&obj.text);
+    init_word_buffer(&obj.data);
+    obj.symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    obj.reltbl = create_table(SYMTBL_NON_UNIQUE);
+    srand(1);
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t id = rand() % NUM_INSTS;
+        uint32_t operands = ((uint32_t) rand() << 16 ^ rand()) & ~dis.fixed_mask[id];
+        if (dis.same_rd_rt[id]) {
+            operands = (operands & ~(0x1F << 11)) | (operands >> 16 & 0x1F) << 11;
+        }
+        append_word(&obj.text, dis.fixed_bits[id] | operands);
+    }
+
+    uint8_t* ids = malloc(n ? n : 1);
+    if (!ids) {
+        return 1;
+    }
+    uint32_t invalid = 0;
+    double start = now();
+    for (int round = 0; round < 10; round++) {
+        decode_words(&dis, obj.text.words, n, ids);
+    }
+    double secs = now() - start;
+    for (uint32_t i = 0; i < n; i++) {
+        invalid += ids[i] == INST_INVALID;
+    }
+    printf("decode       %u words in %.3f s: %.1f M words/s (%u invalid)\n", 10 * n, secs,
+        10 * n / secs / 1e6, invalid);
+
+    FILE* sink = fopen("/dev/null", "w");
+    if (!sink) {
+        return 1;
+    }
+    start = now();
+    int err = disassemble_object(sink, &obj);
+    secs = now() - start;
+    fclose(sink);
+    printf("disassemble  %u words in %.3f s: %.1f M words/s\n", n, secs, n / secs / 1e6);
+
+    free(ids);
+    free_object(&obj);
+    return err != 0 || invalid != 0;
+}
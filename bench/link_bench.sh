@@ -0,0 +1,45 @@
+#!/bin/sh
+# Assembles NUM_OBJECTS generated sources and times linking them with one
+# thread and with every core. Each object defines LABELS labels and makes
+# a jal to a label in the next object after every one of them, so roughly
+# LABELS relocations per object cross object boundaries.
+set -e
+
+NUM_OBJECTS=${NUM_OBJECTS:-4000}
+LABELS=${LABELS:-32}
+THREADS=${THREADS:-$(nproc)}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+awk -v n="$NUM_OBJECTS" -v labels="$LABELS" -v dir="$dir" 'BEGIN {
+    for (i = 0; i < n; i++) {
+        file = sprintf("%s/obj%05d.s", dir, i);
+        next_obj = (i + 1) % n;
+        for (l = 0; l < labels; l++) {
+            printf "f%d_%d: addiu $t0, $t0, %d\n", i, l, l > file;
+            printf "ori $t1, $t0, 0xFF\n" > file;
+            printf "bne $t0, $t1, f%d_%d\n", i, l > file;
+            printf "jal f%d_%d\n", next_obj, l > file;
+        }
+        printf "jr $ra\n" > file;
+        close(file);
+    }
+}'
+
+echo "Assembling $NUM_OBJECTS objects..."
+ls "$dir"/*.s | sed 's/\.s$//' | xargs -P "$THREADS" -I{} \
+    "$ROOT/assembler" {}.s {}.int {}.out -log {}.log >/dev/null
+
+for threads in $(printf "1\n%s\n" "$THREADS" | sort -un); do
+    start=$(date +%s.%N)
+    "$ROOT/linker" "$dir/linked" "$dir"/*.out -j "$threads" -log "$dir/link.log" >/dev/null
+    end=$(date +%s.%N)
+    awk -v s="$start" -v e="$end" -v n="$NUM_OBJECTS" -v t="$threads" \
+        'BEGIN { printf "%d objects, %d thread(s): %.3f s\n", n, t, e - s }'
+done
+if ! grep -q "completed successfully" "$dir/link.log"; then
+    cat "$dir/link.log"
+    exit 1
+fi
@@ -0,0 +1,72 @@
+/* Measures how fast load_image() resolves and applies relocations.
+
+   Builds an object of NUM_WORDS jal instructions, each with a relocation
+   against one of NUM_WORDS / 64 labels, and loads it with the relocations in
+   order (as the assembler and linker emit them) and shuffled (the worst case
+   for the sort). Usage: load_bench [num_words]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/utils.h"
+#include "../src/tables.h"
+#include "../src/object.h"
+#include "../src/reloc.h"
+#include "../src/loader.h"
+
+static const uint32_t LABEL_SPACING = 64;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char* what, const ObjectFile* obj) {
+    WordBuffer image;
+    init_word_buffer(&image);
+    double start = now();
+    if (load_image(&image, obj, 0x00400000) != 0) {
+        exit(1);
+    }
+    double secs = now() - start;
+    printf("%-9s %u relocations in %.3f s: %.1f M relocations/s\n", what,
+        obj->reltbl->len, secs, obj->reltbl->len / secs / 1e6);
+    free_word_buffer(&image);
+}
+
+int main(int argc, char** argv) {
+    uint32_t num_words = argc > 1 ? strtoul(argv[1], NULL, 10) : 4000000;
+    uint32_t num_labels = (num_words + LABEL_SPACING - 1) / LABEL_SPACING;
+    char name[32];
+
+    ObjectFile obj;
+    init_word_buffer(&obj.text);
+    init_word_buffer(&obj.data);
+    obj.symtbl = create_table(SYMTBL_NON_UNIQUE);
+    obj.reltbl = create_table(SYMTBL_NON_UNIQUE);
+    for (uint32_t i = 0; i < num_labels; i++) {
+        sprintf(name, "label%u", i);
+        add_to_table(obj.symtbl, name, i * LABEL_SPACING * 4);
+    }
+    srand(1);
+    for (uint32_t i = 0; i < num_words; i++) {
+        append_word(&obj.text, 0x0c000000);
+        sprintf(name, "label%u", (uint32_t) rand() % num_labels);
+        add_to_table(obj.reltbl, name, i * 4);
+    }
+    run("in order", &obj);
+
+    /* Shuffle the relocations in place. */
+    for (uint32_t i = num_words - 1; i > 0; i--) {
+        uint32_t j = (uint32_t) rand() % (i + 1);
+        Symbol tmp = obj.reltbl->tbl[i];
+        obj.reltbl->tbl[i] = obj.reltbl->tbl[j];
+        obj.reltbl->tbl[j] = tmp;
+    }
+    run("shuffled", &obj);
+
+    free_object(&obj);
+    return 0;
+}
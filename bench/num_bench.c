@@ -0,0 +1,97 @@
+/* Measures translate_num() against the strtol() version it replaced.
+
+   Parses NUM_INPUTS immediates shaped like those in assembly source: small
+   decimals, negative offsets, 16-bit hex masks and 32-bit hex constants, each
+   against the range its instruction would check. Usage: num_bench
+   [num_inputs]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/translate_utils.h"
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* translate_num() as it was, calling strtol() with base 0. */
+static int strtol_num(long int* output, const char* str, long int lower_bound,
+    long int upper_bound) {
+    char* end;
+    long int result = strtol(str, &end, 0);
+    if (*str == '0') {
+        *output = result;
+        return 0;
+    }
+    if (*end != '\0' || result == 0 || result < lower_bound || result > upper_bound) {
+        return -1;
+    }
+    *output = result;
+    return 0;
+}
+
+typedef int (*ParseFn)(long int*, const char*, long int, long int);
+
+typedef struct {
+    char str[16];
+    long int lower;
+    long int upper;
+} Input;
+
+static void run(const char* what, ParseFn parse, const Input* inputs, uint32_t n) {
+    long int sum = 0;
+    double start = now();
+    for (int round = 0; round < 10; round++) {
+        for (uint32_t i = 0; i < n; i++) {
+            long int value;
+            if (parse(&value, inputs[i].str, inputs[i].lower, inputs[i].upper) == 0) {
+                sum += value;
+            }
+        }
+    }
+    double secs = now() - start;
+    printf("%-13s %u numbers in %.3f s: %.1f M numbers/s (checksum %ld)\n", what, 10 * n,
+        secs, 10 * n / secs / 1e6, sum);
+}
+
+int main(int argc, char** argv) {
+    uint32_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    Input* inputs = malloc(n * sizeof(Input));
+    if (!inputs) {
+        return 1;
+    }
+    srand(1);
+    for (uint32_t i = 0; i < n; i++) {
+        char* buf = inputs[i].str;
+        long int lower = -32768, upper = 32767;
+        switch (i % 4) {
+            case 0:
+                sprintf(buf, "%d", rand() % 1000 + 1);
+                break;
+            case 1:
+                sprintf(buf, "-%d", rand() % 32768 + 1);
+                break;
+            case 2:
+                sprintf(buf, "0x%04X", rand() & 0xFFFF);
+                lower = 0;
+                upper = 65535;
+                break;
+            default:
+                sprintf(buf, "0x%08x", (unsigned) rand() << 1 | 1);
+                lower = -2147483648;
+                upper = 4294967295;
+                break;
+        }
+        inputs[i].lower = lower;
+        inputs[i].upper = upper;
+    }
+
+    run("strtol", strtol_num, inputs, n);
+    run("translate_num", translate_num, inputs, n);
+
+    free(inputs);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/* Measures run_simulator() and run_jit() in simulated instructions per
+   second.
+
+   Runs two loops of ITERATIONS passes each, interpreted and then
+   translated: one of register arithmetic and one that also loads and
+   stores a word per pass. Usage: sim_bench [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "../src/utils.h"
+#include "../src/tables.h"
+#include "../src/translate.h"
+#include "../src/intermediate.h"
+#include "../src/object.h"
+#include "../src/data.h"
+#include "../src/backpatch.h"
+#include "../src/sim.h"
+#include "../src/jit.h"
+#include "../src/program.h"
+#include "../assembler.h"
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char* ALU_LOOP =
+    "li $t0, %u\n"
+    "loop: addu $t1, $t1, $t0\n"
+    "xor $t2, $t1, $t0\n"
+    "sll $t3, $t2, 3\n"
+    "sltu $t2, $t3, $t1\n"
+    "addiu $t0, $t0, -1\n"
+    "bne $t0, $zero, loop\n";
+
+static const char* MEMORY_LOOP =
+    "li $t0, %u\n"
+    "loop: lw $t1, -64($sp)\n"
+    "addu $t1, $t1, $t0\n"
+    "sw $t1, -64($sp)\n"
+    "andi $t2, $t1, 0xff\n"
+    "addiu $t0, $t0, -1\n"
+    "bne $t0, $zero, loop\n";
+
+static int run(const char* what, const char* format, uint32_t iterations, int use_jit) {
+    char source[512];
+    snprintf(source, sizeof(source), format, iterations);
+    ObjectFile obj;
+    Simulator sim;
+    if (assemble_buffer(&obj, source, strlen(source), NULL, NULL) != 0
+        || init_simulator(&sim, &obj, 4096) != 0) {
+        return -1;
+    }
+    Jit jit;
+    if (use_jit && init_jit(&jit, &sim) != 0) {
+        printf("%-8s native translation unavailable\n", what);
+    }
+    double start = now();
+    SimStatus status = use_jit ? run_jit(&jit, 0) : run_simulator(&sim, 0);
+    double secs = now() - start;
+    if (use_jit) {
+        free_jit(&jit);
+    }
+    uint64_t total = sim_instructions(&sim);
+    printf("%-8s %" PRIu64 " instructions in %.3f s: %.1f M instructions/s (%s)\n", what,
+        total, secs, total / secs / 1e6, sim_status_name(status));
+    free_simulator(&sim);
+    free_object(&obj);
+    return status == SIM_EXITED ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 50000000;
+    int err = run("alu", ALU_LOOP, iterations, 0);
+    err |= run("memory", MEMORY_LOOP, iterations, 0);
+    err |= run("alu-jit", ALU_LOOP, iterations, 1);
+    err |= run("mem-jit", MEMORY_LOOP, iterations, 1);
+    return err ? 1 : 0;
+}
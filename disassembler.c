@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/utils.h"
+#include "src/tables.h"
+#include "src/object.h"
+#include "src/disasm.h"
+
+static void print_usage_and_exit() {
+    printf("Usage:\n");
+    printf("  disassembler <object file> <output file> [options]\n");
+    printf("Options:\n");
+    printf("  -log <file name>          save log files to a text file\n");
+    exit(0);
+}
+
+/* Disassembles the object IN_NAME into OUT_NAME.
+   Returns 0 on success and -1 on error. */
+static int disassemble_file(const char* in_name, const char* out_name) {
+    FILE* src = fopen(in_name, "r");
+    if (!src) {
+        write_to_log("Error: unable to open object file: %s\n", in_name);
+        return -1;
+    }
+    ObjectFile obj;
+    int err = read_object_file(&obj, src, in_name) != 0;
+    fclose(src);
+    if (err) {
+        return -1;
+    }
+
+    FILE* dst = fopen(out_name, "w");
+    if (!dst) {
+        write_to_log("Error: unable to open output file: %s\n", out_name);
+        err = 1;
+    } else {
+        if (disassemble_object(dst, &obj) != 0) {
+            err = 1;
+        }
+        fclose(dst);
+    }
+    free_object(&obj);
+    return err ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        print_usage_and_exit();
+    }
+
+    const char* log_name = NULL;
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            print_usage_and_exit();
+        }
+        if (strcmp(argv[i], "-log") == 0) {
+            log_name = argv[i + 1];
+            set_log_file(log_name);
+        } else {
+            print_usage_and_exit();
+        }
+    }
+
+    int err = disassemble_file(argv[1], argv[2]);
+
+    if (err) {
+        write_to_log("One or more errors encountered during disassembly.\n");
+    } else {
+        write_to_log("Disassembly completed successfully.\n");
+    }
+
+    if (is_log_file_set()) {
+        printf("Results saved to %s\n", log_name);
+    }
+
+    return err;
+}
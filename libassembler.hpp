@@ -0,0 +1,160 @@
+#ifndef LIBASSEMBLER_HPP
+#define LIBASSEMBLER_HPP
+
+/* C++ interface to libassembler.a.
+
+   mips::assemble() assembles source held in memory, in one pass and without
+   temporary files, and returns an Object owning the encoded .text words, the
+   .data words and the symbol and relocation tables. Diagnostics are passed to
+   a callback one line at a time instead of going to the log file. Calls from
+   different threads are independent. Requires C++17.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include "src/utils.h"
+#include "src/tables.h"
+#include "src/translate.h"
+#include "src/intermediate.h"
+#include "src/object.h"
+#include "src/data.h"
+#include "src/reloc.h"
+#include "src/backpatch.h"
+#include "src/program.h"
+#include "assembler.h"
+}
+
+namespace mips {
+
+/* A label and its byte offset in .text, or DATA_BASE plus its offset in
+   .data. NAME points into the Object. */
+struct Symbol {
+    std::string_view name;
+    uint32_t addr;
+};
+
+/* An instruction at byte offset OFFSET waiting for the address of NAME. */
+struct Relocation {
+    std::string_view name;
+    uint32_t offset;
+    RelocType type;
+};
+
+using Diagnostic = std::function<void(std::string_view)>;
+
+/* Move-only. Symbol and relocation names stay valid until the Object is
+   destroyed, including across moves. */
+class Object {
+public:
+    Object() = default;
+
+    Object(Object&& other) noexcept
+        : text_(std::move(other.text_)), data_(std::move(other.data_)), symtbl_(std::exchange(other.symtbl_, nullptr)),
+          reltbl_(std::exchange(other.reltbl_, nullptr)), ok_(other.ok_) {}
+
+    Object& operator=(Object&& other) noexcept {
+        if (this != &other) {
+            release();
+            text_ = std::move(other.text_);
+            data_ = std::move(other.data_);
+            symtbl_ = std::exchange(other.symtbl_, nullptr);
+            reltbl_ = std::exchange(other.reltbl_, nullptr);
+            ok_ = other.ok_;
+        }
+        return *this;
+    }
+
+    Object(const Object&) = delete;
+    Object& operator=(const Object&) = delete;
+
+    ~Object() { release(); }
+
+    /* False if any diagnostic was an error; the words of failed instructions
+       are then zero. */
+    bool ok() const { return ok_; }
+
+    const std::vector<uint32_t>& text() const { return text_; }
+
+    /* The bytes of .data, packed big-endian into words. */
+    const std::vector<uint32_t>& data() const { return data_; }
+
+    std::vector<Symbol> symbols() const {
+        std::vector<Symbol> result;
+        for_each_entry(symtbl_, [&](uint32_t, const char* name, uint32_t addr) {
+            result.push_back(Symbol{name, addr});
+        });
+        return result;
+    }
+
+    std::vector<Relocation> relocations() const {
+        std::vector<Relocation> result;
+        for_each_entry(reltbl_, [&](uint32_t i, const char* name, uint32_t addr) {
+            result.push_back(Relocation{name, addr,
+                static_cast<RelocType>(get_reloc_type(reltbl_, i))});
+        });
+        return result;
+    }
+
+private:
+    friend Object assemble(std::string_view source, const Diagnostic& diagnostic);
+
+    template <typename Fn>
+    static void for_each_entry(SymbolTable* table, Fn fn) {
+        const char* name;
+        uint32_t addr;
+        for (uint32_t i = 0; table && get_symbol(table, i, &name, &addr) == 0; i++) {
+            fn(i, name, addr);
+        }
+    }
+
+    void release() {
+        if (symtbl_) {
+            free_table(symtbl_);
+        }
+        if (reltbl_) {
+            free_table(reltbl_);
+        }
+        symtbl_ = reltbl_ = nullptr;
+    }
+
+    std::vector<uint32_t> text_;
+    std::vector<uint32_t> data_;
+    SymbolTable* symtbl_ = nullptr;
+    SymbolTable* reltbl_ = nullptr;
+    bool ok_ = false;
+};
+
+/* Assembles SOURCE. DIAGNOSTIC, if set, receives each error message and must
+   not throw. */
+inline Object assemble(std::string_view source, const Diagnostic& diagnostic = {}) {
+    LogCallback forward = nullptr;
+    if (diagnostic) {
+        forward = [](void* ctx, const char* message) {
+            (*static_cast<const Diagnostic*>(ctx))(message);
+        };
+    }
+    ObjectFile obj;
+    int err = assemble_buffer(&obj, source.data(), source.size(), forward,
+        const_cast<Diagnostic*>(&diagnostic));
+
+    Object result;
+    result.text_.assign(obj.text.words, obj.text.words + obj.text.len);
+    free_word_buffer(&obj.text);
+    result.data_.assign(obj.data.words, obj.data.words + obj.data.len);
+    free_word_buffer(&obj.data);
+    result.symtbl_ = obj.symtbl;
+    result.reltbl_ = obj.reltbl;
+    result.ok_ = err == 0;
+    return result;
+}
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/utils.h"
+#include "src/tables.h"
+#include "src/object.h"
+#include "src/link.h"
+
+static void print_usage_and_exit() {
+    printf("Usage:\n");
+    printf("  linker <output file> <object file>... [options]\n");
+    printf("Options:\n");
+    printf("  -log <file name>          save log files to a text file\n");
+    printf("  -j <threads>              read and patch objects on this many threads\n");
+    exit(0);
+}
+
+/* Links the objects named in INPUTS into OUT_NAME. Returns 0 on success and
+   -1 on error. */
+static int link_files(const char* out_name, LinkInput* inputs, uint32_t n, int num_threads) {
+    int err = 0;
+    ObjectFile out;
+    memset(&out, 0, sizeof(out));
+    if (load_objects(inputs, n, num_threads) != 0
+        || link_objects(&out, inputs, n, num_threads) != 0) {
+        err = 1;
+    }
+
+    if (!err) {
+        FILE* dst = fopen(out_name, "w");
+        if (!dst) {
+            write_to_log("Error: unable to open output file: %s\n", out_name);
+            err = 1;
+        } else {
+            if (write_object(dst, &out) != 0) {
+                err = 1;
+            }
+            fclose(dst);
+        }
+    }
+    free_object(&out);
+    free_link_inputs(inputs, n);
+    return err ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    const char* log_name = NULL;
+    const char* out_name = NULL;
+    long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    LinkInput* inputs = calloc(argc, sizeof(LinkInput));
+    uint32_t num_inputs = 0;
+    if (!inputs) {
+        allocation_failed();
+    }
+
+    for (int i = 1; i < argc; i++) {
+        int is_log = strcmp(argv[i], "-log") == 0;
+        if (is_log || strcmp(argv[i], "-j") == 0) {
+            if (i + 1 >= argc) {
+                print_usage_and_exit();
+            }
+            if (is_log) {
+                log_name = argv[i + 1];
+                set_log_file(log_name);
+            } else {
+                num_threads = strtol(argv[i + 1], NULL, 10);
+                if (num_threads < 1) {
+                    print_usage_and_exit();
+                }
+            }
+            i++;
+        } else if (!out_name) {
+            out_name = argv[i];
+        } else {
+            inputs[num_inputs++].name = argv[i];
+        }
+    }
+    if (!out_name || num_inputs == 0) {
+        print_usage_and_exit();
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    int err = link_files(out_name, inputs, num_inputs, num_threads);
+    free(inputs);
+
+    if (err) {
+        write_to_log("One or more errors encountered during link operation.\n");
+    } else {
+        write_to_log("Link operation completed successfully.\n");
+    }
+
+    if (is_log_file_set()) {
+        printf("Results saved to %s\n", log_name);
+    }
+
+    return err;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/utils.h"
+#include "src/tables.h"
+#include "src/object.h"
+#include "src/reloc.h"
+#include "src/loader.h"
+
+static void print_usage_and_exit() {
+    printf("Usage:\n");
+    printf("  loader <object file> <image file> [options]\n");
+    printf("Options:\n");
+    printf("  -log <file name>          save log files to a text file\n");
+    printf("  -base <address>           load .text at this address (default 0x00400000)\n");
+    exit(0);
+}
+
+/* Loads the object IN_NAME at BASE and writes the flat image to OUT_NAME.
+   Returns 0 on success and -1 on error. */
+static int load_file(const char* in_name, const char* out_name, uint32_t base) {
+    FILE* src = fopen(in_name, "r");
+    if (!src) {
+        write_to_log("Error: unable to open object file: %s\n", in_name);
+        return -1;
+    }
+    ObjectFile obj;
+    int err = read_object_file(&obj, src, in_name) != 0;
+    fclose(src);
+    if (err) {
+        return -1;
+    }
+
+    WordBuffer image;
+    init_word_buffer(&image);
+    if (load_image(&image, &obj, base) != 0) {
+        err = 1;
+    } else {
+        FILE* dst = fopen(out_name, "wb");
+        if (!dst) {
+            write_to_log("Error: unable to open image file: %s\n", out_name);
+            err = 1;
+        } else {
+            if (write_flat_image(dst, &image) != 0) {
+                err = 1;
+            }
+            fclose(dst);
+        }
+    }
+    free_word_buffer(&image);
+    free_object(&obj);
+    return err ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        print_usage_and_exit();
+    }
+
+    const char* log_name = NULL;
+    unsigned long base = 0x00400000;
+    for (int i = 3; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            print_usage_and_exit();
+        }
+        if (strcmp(argv[i], "-log") == 0) {
+            log_name = argv[i + 1];
+            set_log_file(log_name);
+        } else if (strcmp(argv[i], "-base") == 0) {
+            char* end;
+            base = strtoul(argv[i + 1], &end, 0);
+            if (*end != '\0' || base > UINT32_MAX) {
+                print_usage_and_exit();
+            }
+        } else {
+            print_usage_and_exit();
+        }
+    }
+
+    int err = load_file(argv[1], argv[2], base);
+
+    if (err) {
+        write_to_log("One or more errors encountered during load operation.\n");
+    } else {
+        write_to_log("Load operation completed successfully.\n");
+    }
+
+    if (is_log_file_set()) {
+        printf("Results saved to %s\n", log_name);
+    }
+
+    return err;
+}
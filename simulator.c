@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/utils.h"
+#include "src/tables.h"
+#include "src/translate_utils.h"
+#include "src/translate.h"
+#include "src/object.h"
+#include "src/sim.h"
+#include "src/jit.h"
+
+static void print_usage_and_exit() {
+    printf("Usage:\n");
+    printf("  simulator <object file> [options]\n");
+    printf("Options:\n");
+    printf("  -log <file name>          save log files to a text file\n");
+    printf("  -profile <file name>      write execution counts and instruction mix\n");
+    printf("  -memory <bytes>           size of data memory (default 1M)\n");
+    printf("  -jumps <count>            stop after this many taken branches and jumps\n");
+    printf("  -jit                      translate to native code as the program runs\n");
+    exit(0);
+}
+
+/* Runs the object IN_NAME, translating it if USE_JIT is set, and writes its
+   profile to PROFILE_NAME if set. Returns the program's exit code, or -1 if
+   it did not exit normally. */
+static int simulate_file(const char* in_name, const char* profile_name, uint32_t mem_size,
+    uint64_t max_jumps, int use_jit) {
+    FILE* src = fopen(in_name, "r");
+    if (!src) {
+        write_to_log("Error: unable to open object file: %s\n", in_name);
+        return -1;
+    }
+    ObjectFile obj;
+    int err = read_object_file(&obj, src, in_name) != 0;
+    fclose(src);
+    if (err) {
+        return -1;
+    }
+
+    Simulator sim;
+    int result = -1;
+    if (init_simulator(&sim, &obj, mem_size) == 0) {
+        SimStatus status;
+        if (use_jit) {
+            Jit jit;
+            if (init_jit(&jit, &sim) != 0) {
+                write_to_log("Warning: native translation unavailable, interpreting\n");
+            }
+            status = run_jit(&jit, max_jumps);
+            free_jit(&jit);
+        } else {
+            status = run_simulator(&sim, max_jumps);
+        }
+        fflush(stdout);
+        if (status == SIM_EXITED) {
+            result = sim.exit_code;
+        } else {
+            write_to_log("Error: program stopped at 0x%08x: %s\n", sim.pc * 4,
+                sim_status_name(status));
+        }
+        if (profile_name) {
+            FILE* profile = fopen(profile_name, "w");
+            if (!profile) {
+                write_to_log("Error: unable to open profile file: %s\n", profile_name);
+                result = -1;
+            } else {
+                write_profile(profile, &sim);
+                fclose(profile);
+            }
+        }
+        free_simulator(&sim);
+    }
+    free_object(&obj);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        print_usage_and_exit();
+    }
+
+    const char* log_name = NULL;
+    const char* profile_name = NULL;
+    unsigned long long mem_size = SIM_DEFAULT_MEM_SIZE;
+    unsigned long long max_jumps = 0;
+    int use_jit = 0;
+    for (int i = 2; i < argc; i += 2) {
+        if (strcmp(argv[i], "-jit") == 0) {
+            use_jit = 1;
+            i--;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage_and_exit();
+        }
+        if (strcmp(argv[i], "-log") == 0) {
+            log_name = argv[i + 1];
+            set_log_file(log_name);
+        } else if (strcmp(argv[i], "-profile") == 0) {
+            profile_name = argv[i + 1];
+        } else if (strcmp(argv[i], "-memory") == 0) {
+            if (parse_size(&mem_size, argv[i + 1]) != 0 || mem_size == 0
+                || mem_size > UINT32_MAX - 3) {
+                print_usage_and_exit();
+            }
+        } else if (strcmp(argv[i], "-jumps") == 0) {
+            if (parse_size(&max_jumps, argv[i + 1]) != 0) {
+                print_usage_and_exit();
+            }
+        } else {
+            print_usage_and_exit();
+        }
+    }
+
+    int result = simulate_file(argv[1], profile_name, mem_size, max_jumps, use_jit);
+
+    if (is_log_file_set()) {
+        printf("Results saved to %s\n", log_name);
+    }
+
+    return result == -1 ? 1 : result;
+}
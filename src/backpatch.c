@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "backpatch.h"
+
+static const uint32_t INITIAL_BUCKETS = 64;
+static const uint32_t INITIAL_PENDING = 64;
+static const uint32_t INITIAL_UNBOUNDED_CAP = 1024;
+static const uint32_t NO_BRANCH = 0xFFFFFFFF;
+
+struct PendingLabel {
+    char* name;
+    uint32_t hash;
+    uint32_t head;
+    PendingLabel* next;
+};
+
+static void* bp_alloc(size_t size) {
+    Allocator* alloc = get_table_allocator();
+    void* ptr = alloc->alloc(alloc, size);
+    if (!ptr) {
+        allocation_failed();
+    }
+    return ptr;
+}
+
+static void* bp_resize(void* ptr, size_t old_size, size_t new_size) {
+    Allocator* alloc = get_table_allocator();
+    ptr = alloc->resize(alloc, ptr, old_size, new_size);
+    if (!ptr) {
+        allocation_failed();
+    }
+    return ptr;
+}
+
+static void bp_release(void* ptr, size_t size) {
+    Allocator* alloc = get_table_allocator();
+    alloc->release(alloc, ptr, size);
+}
+
+/* Sets up BP. WINDOW is the number of words held before flushing, a power of
+   two, or 0 to hold every word until finish_backpatcher(). Flushed words go
+   to FLUSH(CTX, ...). */
+void init_backpatcher(Backpatcher* bp, uint32_t window, WordFlush flush, void* ctx) {
+    memset(bp, 0, sizeof(Backpatcher));
+    bp->window = window;
+    bp->cap = window ? window : INITIAL_UNBOUNDED_CAP;
+    bp->words = bp_alloc(bp->cap * sizeof(uint32_t));
+    bp->flush = flush;
+    bp->ctx = ctx;
+    bp->pending_cap = INITIAL_PENDING;
+    bp->pending = bp_alloc(bp->pending_cap * sizeof(PendingBranch));
+    bp->num_buckets = INITIAL_BUCKETS;
+    bp->buckets = bp_alloc(bp->num_buckets * sizeof(PendingLabel*));
+    memset(bp->buckets, 0, bp->num_buckets * sizeof(PendingLabel*));
+}
+
+static uint32_t* word_at(Backpatcher* bp, uint32_t index) {
+    return &bp->words[index & (bp->cap - 1)];
+}
+
+static PendingBranch* branch_at(Backpatcher* bp, uint32_t seq) {
+    return &bp->pending[seq & (bp->pending_cap - 1)];
+}
+
+/* Hands the words below index END to the flush callback, reporting any
+   branch among them that is still pending. */
+static void flush_words(Backpatcher* bp, uint32_t end) {
+    while (bp->first < bp->end && branch_at(bp, bp->first)->index < end) {
+        PendingBranch* branch = branch_at(bp, bp->first);
+        if (!branch->resolved) {
+            write_to_log("Error - branch out of range at line %u: %s\n", branch->line,
+                branch->label->name);
+            bp->out_of_range++;
+            bp->err = 1;
+        }
+        bp->first++;
+    }
+    while (bp->flushed < end) {
+        uint32_t start = bp->flushed & (bp->cap - 1);
+        uint32_t n = end - bp->flushed;
+        if (n > bp->cap - start) {
+            n = bp->cap - start;
+        }
+        bp->flush(bp->ctx, bp->words + start, n);
+        bp->flushed += n;
+    }
+}
+
+/* Appends WORD to the output. */
+void emit_word(Backpatcher* bp, uint32_t word) {
+    if (bp->len - bp->flushed == bp->cap) {
+        if (bp->window) {
+            flush_words(bp, bp->flushed + bp->window / 2);
+        } else {
+            bp->words = bp_resize(bp->words, bp->cap * sizeof(uint32_t),
+                2 * bp->cap * sizeof(uint32_t));
+            bp->cap *= 2;
+        }
+    }
+    *word_at(bp, bp->len++) = word;
+}
+
+static PendingLabel** find_label(Backpatcher* bp, const char* name, uint32_t hash) {
+    PendingLabel** entry = &bp->buckets[hash & (bp->num_buckets - 1)];
+    while (*entry && ((*entry)->hash != hash || strcmp((*entry)->name, name) != 0)) {
+        entry = &(*entry)->next;
+    }
+    return entry;
+}
+
+static void grow_buckets(Backpatcher* bp) {
+    uint32_t num_buckets = bp->num_buckets * 2;
+    PendingLabel** buckets = bp_alloc(num_buckets * sizeof(PendingLabel*));
+    memset(buckets, 0, num_buckets * sizeof(PendingLabel*));
+    for (uint32_t i = 0; i < bp->num_buckets; i++) {
+        PendingLabel* label = bp->buckets[i];
+        while (label) {
+            PendingLabel* next = label->next;
+            PendingLabel** bucket = &buckets[label->hash & (num_buckets - 1)];
+            label->next = *bucket;
+            *bucket = label;
+            label = next;
+        }
+    }
+    bp_release(bp->buckets, bp->num_buckets * sizeof(PendingLabel*));
+    bp->buckets = buckets;
+    bp->num_buckets = num_buckets;
+}
+
+/* Grows the ring of pending branches, keeping sequence numbers valid. */
+static void grow_pending(Backpatcher* bp) {
+    uint32_t cap = bp->pending_cap * 2;
+    PendingBranch* pending = bp_alloc(cap * sizeof(PendingBranch));
+    for (uint32_t seq = bp->first; seq != bp->end; seq++) {
+        pending[seq & (cap - 1)] = *branch_at(bp, seq);
+    }
+    bp_release(bp->pending, bp->pending_cap * sizeof(PendingBranch));
+    bp->pending = pending;
+    bp->pending_cap = cap;
+}
+
+/* Appends WORD, a branch to LABEL that is not defined yet, from source line
+   LINE. Its offset field is filled in when LABEL is defined. */
+void emit_forward_branch(Backpatcher* bp, uint32_t word, const char* label, uint32_t line) {
+    emit_word(bp, word);
+    if (bp->end - bp->first == bp->pending_cap) {
+        grow_pending(bp);
+    }
+
+    uint32_t hash = symbol_hash(label);
+    PendingLabel** entry = find_label(bp, label, hash);
+    if (!*entry) {
+        PendingLabel* new_label = bp_alloc(sizeof(PendingLabel));
+        size_t len = strlen(label) + 1;
+        new_label->name = bp_alloc(len);
+        memcpy(new_label->name, label, len);
+        new_label->hash = hash;
+        new_label->head = NO_BRANCH;
+        new_label->next = NULL;
+        *entry = new_label;
+        if (++bp->num_labels > bp->num_buckets) {
+            grow_buckets(bp);
+            entry = find_label(bp, label, hash);
+        }
+    }
+
+    uint32_t seq = bp->end++;
+    PendingBranch* branch = branch_at(bp, seq);
+    branch->index = bp->len - 1;
+    branch->line = line;
+    branch->next = (*entry)->head;
+    branch->resolved = 0;
+    branch->label = *entry;
+    (*entry)->head = seq;
+}
+
+static void free_label(PendingLabel* label) {
+    bp_release(label->name, strlen(label->name) + 1);
+    bp_release(label, sizeof(PendingLabel));
+}
+
+/* Records that NAME is at byte address ADDR and patches the offset field of
+   every branch waiting for it. Out of range branches are reported. */
+void define_label(Backpatcher* bp, const char* name, uint32_t addr) {
+    PendingLabel** entry = find_label(bp, name, symbol_hash(name));
+    PendingLabel* label = *entry;
+    if (!label) {
+        return;
+    }
+    for (uint32_t seq = label->head; seq != NO_BRANCH; seq = branch_at(bp, seq)->next) {
+        if (seq - bp->first >= bp->end - bp->first) {
+            /* Already retired, and so everything older is too. */
+            break;
+        }
+        PendingBranch* branch = branch_at(bp, seq);
+        int64_t distance = ((int64_t) addr - branch->index * 4ll - 4) / 4;
+        if (distance > 32767) {
+            write_to_log("Error - branch out of range at line %u: %s\n", branch->line, name);
+            bp->out_of_range++;
+            bp->err = 1;
+        } else {
+            uint32_t* word = word_at(bp, branch->index);
+            *word = (*word & 0xFFFF0000) | ((uint32_t) distance & 0xFFFF);
+        }
+        branch->resolved = 1;
+    }
+    *entry = label->next;
+    bp->num_labels--;
+    free_label(label);
+}
+
+/* Flushes every remaining word and reports branches whose labels were never
+   defined. Returns 0 on success and -1 if any error was found while
+   backpatching. */
+int finish_backpatcher(Backpatcher* bp) {
+    for (uint32_t seq = bp->first; seq != bp->end; seq++) {
+        PendingBranch* branch = branch_at(bp, seq);
+        if (!branch->resolved) {
+            write_to_log("Error - undefined label at line %u: %s\n", branch->line,
+                branch->label->name);
+            branch->resolved = 1;
+            bp->err = 1;
+        }
+    }
+    flush_words(bp, bp->len);
+    return bp->err ? -1 : 0;
+}
+
+void free_backpatcher(Backpatcher* bp) {
+    for (uint32_t i = 0; i < bp->num_buckets; i++) {
+        PendingLabel* label = bp->buckets[i];
+        while (label) {
+            PendingLabel* next = label->next;
+            free_label(label);
+            label = next;
+        }
+    }
+    bp_release(bp->buckets, bp->num_buckets * sizeof(PendingLabel*));
+    bp_release(bp->pending, bp->pending_cap * sizeof(PendingBranch));
+    bp_release(bp->words, bp->cap * sizeof(uint32_t));
+    memset(bp, 0, sizeof(Backpatcher));
+}
@@ -0,0 +1,75 @@
+#ifndef BACKPATCH_H
+#define BACKPATCH_H
+
+#include <stdint.h>
+
+/* Single-pass encoding with backpatching.
+
+   Instructions are encoded as soon as they are read. A branch to a label
+   that is not defined yet is emitted with a zero offset and remembered as
+   pending; define_label() patches every pending branch to the label it
+   defines. Words are kept in an output window until they can no longer
+   change, then handed to a flush callback.
+
+   With a bounded window, words are flushed once WINDOW words are held, half
+   a window at a time. The window is at least twice the reach of a branch, so
+   a branch still pending when it is flushed can never be resolved in range
+   and is reported then. With an unbounded window (0) everything is held
+   until finish_backpatcher(). Branches found out of range are counted in
+   OUT_OF_RANGE, so that the caller can tell them from other errors.
+ */
+
+/* Large enough that no branch in range is flushed while pending. */
+#define BACKPATCH_WINDOW 65536
+
+typedef void (*WordFlush)(void* ctx, const uint32_t* words, uint32_t n);
+
+typedef struct PendingLabel PendingLabel;
+
+/* A forward branch waiting for LABEL. INDEX is the word it was emitted as,
+   LINE the source line it came from, and NEXT the sequence number of the
+   previous branch waiting for the same label. */
+typedef struct {
+    uint32_t index;
+    uint32_t line;
+    uint32_t next;
+    int resolved;
+    PendingLabel* label;
+} PendingBranch;
+
+typedef struct {
+    uint32_t* words;
+    uint32_t window;
+    uint32_t cap;
+    uint32_t len;
+    uint32_t flushed;
+    WordFlush flush;
+    void* ctx;
+
+    /* Pending branches in emission order; sequence numbers below FIRST have
+       been retired. */
+    PendingBranch* pending;
+    uint32_t pending_cap;
+    uint32_t first;
+    uint32_t end;
+
+    PendingLabel** buckets;
+    uint32_t num_buckets;
+    uint32_t num_labels;
+    uint32_t out_of_range;
+    int err;
+} Backpatcher;
+
+void init_backpatcher(Backpatcher* bp, uint32_t window, WordFlush flush, void* ctx);
+
+void emit_word(Backpatcher* bp, uint32_t word);
+
+void emit_forward_branch(Backpatcher* bp, uint32_t word, const char* label, uint32_t line);
+
+void define_label(Backpatcher* bp, const char* name, uint32_t addr);
+
+int finish_backpatcher(Backpatcher* bp);
+
+void free_backpatcher(Backpatcher* bp);
+
+#endif
@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate.h"
+#include "program.h"
+#include "cfg.h"
+
+static void* alloc_zeroed(size_t size) {
+    Allocator* alloc = get_table_allocator();
+    void* ptr = alloc->alloc(alloc, size);
+    if (!ptr) {
+        allocation_failed();
+    }
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static void release(void* ptr, size_t size) {
+    if (ptr) {
+        Allocator* alloc = get_table_allocator();
+        alloc->release(alloc, ptr, size);
+    }
+}
+
+/* Returns 1 if INST calls its target: control comes back after it. */
+static int is_call(const Instr* inst) {
+    return inst->id == INST_JAL || inst->id == INST_JALR || inst->id == INST_BLTZAL
+        || inst->id == INST_BGEZAL;
+}
+
+/* Returns the cycles one run of the instructions [START, END) of CODE takes
+   in the model of cfg.h, without the branch back. */
+static uint64_t block_cycles(const ProgCode* code, uint32_t start, uint32_t end) {
+    uint64_t cycles = end - start;
+    for (uint32_t i = start + 1; i < end; i++) {
+        const Instr* prev = &code->insts[i - 1].inst;
+        if (code->insts[i - 1].valid && is_load(prev)) {
+            uint64_t uses, defs, prev_uses, prev_defs;
+            inst_regs(prev, &prev_uses, &prev_defs);
+            inst_regs(&code->insts[i].inst, &uses, &defs);
+            cycles += (prev_defs & uses) != 0;
+        }
+    }
+    return cycles;
+}
+
+/* State of the loop search. POS is the depth of a block on the current
+   search path, counting from 1, or 0 if it is not on it. HEADER is the
+   innermost loop header found so far. */
+typedef struct {
+    uint32_t* pos;
+    uint32_t* header;
+    uint8_t* is_header;
+    uint8_t* irreducible;
+} LoopSearch;
+
+/* Records H as a loop header of B, keeping the chain of headers above B
+   ordered by their depth on the search path. */
+static void tag_header(LoopSearch* s, uint32_t b, uint32_t h) {
+    if (b == h || h == PROG_NONE) {
+        return;
+    }
+    uint32_t cur = b, up = h;
+    uint32_t ih;
+    while ((ih = s->header[cur]) != PROG_NONE) {
+        if (ih == up) {
+            return;
+        }
+        if (s->pos[ih] < s->pos[up]) {
+            s->header[cur] = up;
+            cur = up;
+            up = ih;
+        } else {
+            cur = ih;
+        }
+    }
+    s->header[cur] = up;
+}
+
+/* Follows the edge from block FROM on the search path to the visited block
+   TO. */
+static void visit_edge(LoopSearch* s, uint32_t from, uint32_t to) {
+    if (s->pos[to]) {
+        s->is_header[to] = 1;
+        tag_header(s, from, to);
+        return;
+    }
+    uint32_t h = s->header[to];
+    if (h == PROG_NONE) {
+        return;
+    }
+    if (s->pos[h]) {
+        tag_header(s, from, h);
+        return;
+    }
+    /* TO enters a loop whose header is off the path: some loop has more
+       than one entry. */
+    s->irreducible[h] = 1;
+    while ((h = s->header[h]) != PROG_NONE) {
+        if (s->pos[h]) {
+            tag_header(s, from, h);
+            break;
+        }
+        s->irreducible[h] = 1;
+    }
+}
+
+typedef struct {
+    uint32_t block;
+    uint32_t next;
+} SearchFrame;
+
+/* Builds the CFG of PROG and finds its loops, as described in cfg.h. */
+void build_cfg(Cfg* cfg, const Program* prog) {
+    memset(cfg, 0, sizeof(Cfg));
+    const ProgCode* code = &prog->code;
+    find_blocks(&cfg->blocks, prog);
+    uint32_t n = cfg->blocks.num_blocks;
+    uint32_t size = n ? n : 1;
+
+    cfg->succ_start = alloc_zeroed((n + 1) * sizeof(uint32_t));
+    cfg->succs = alloc_zeroed(2 * size * sizeof(uint32_t));
+    cfg->callee = alloc_zeroed(size * sizeof(uint32_t));
+    for (uint32_t b = 0; b < n; b++) {
+        const ProgBlock* block = &cfg->blocks.blocks[b];
+        const ProgInst* last = &code->insts[block->end - 1];
+        cfg->succ_start[b] = cfg->num_edges;
+        cfg->callee[b] = PROG_NONE;
+        if (block->taken != PROG_NONE) {
+            if (last->valid && is_call(&last->inst)) {
+                cfg->callee[b] = block->taken;
+                cfg->num_calls++;
+            } else {
+                cfg->succs[cfg->num_edges++] = block->taken;
+            }
+        }
+        if (block->fall != PROG_NONE && block->fall < n && block->fall != block->taken) {
+            cfg->succs[cfg->num_edges++] = block->fall;
+        }
+    }
+    cfg->succ_start[n] = cfg->num_edges;
+
+    /* The loop search, from the first block and then from every block it
+       did not reach, with an explicit stack since paths can be as long as
+       the program. */
+    LoopSearch s;
+    s.pos = alloc_zeroed(size * sizeof(uint32_t));
+    s.header = alloc_zeroed(size * sizeof(uint32_t));
+    s.is_header = alloc_zeroed(size);
+    s.irreducible = alloc_zeroed(size);
+    uint8_t* visited = alloc_zeroed(size);
+    uint32_t* preorder = alloc_zeroed(size * sizeof(uint32_t));
+    SearchFrame* stack = alloc_zeroed(size * sizeof(SearchFrame));
+    for (uint32_t b = 0; b < n; b++) {
+        s.header[b] = PROG_NONE;
+    }
+    uint32_t num_visited = 0;
+    for (uint32_t root = 0; root < n; root++) {
+        if (visited[root]) {
+            continue;
+        }
+        uint32_t depth = 0;
+        stack[depth++] = (SearchFrame) { root, cfg->succ_start[root] };
+        visited[root] = 1;
+        s.pos[root] = depth;
+        preorder[num_visited++] = root;
+        while (depth) {
+            SearchFrame* top = &stack[depth - 1];
+            uint32_t b = top->block;
+            if (top->next < cfg->succ_start[b + 1]) {
+                uint32_t succ = cfg->succs[top->next++];
+                if (!visited[succ]) {
+                    visited[succ] = 1;
+                    stack[depth++] = (SearchFrame) { succ, cfg->succ_start[succ] };
+                    s.pos[succ] = depth;
+                    preorder[num_visited++] = succ;
+                } else {
+                    visit_edge(&s, b, succ);
+                }
+                continue;
+            }
+            s.pos[b] = 0;
+            depth--;
+            if (depth) {
+                tag_header(&s, stack[depth - 1].block, s.header[b]);
+            }
+        }
+    }
+
+    /* Number the loops in preorder, so that every loop comes after the
+       loops around it. */
+    uint32_t* loop_index = s.pos;
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t b = preorder[k];
+        if (s.is_header[b]) {
+            loop_index[b] = cfg->num_loops++;
+        }
+    }
+    cfg->loops = alloc_zeroed((cfg->num_loops ? cfg->num_loops : 1) * sizeof(CfgLoop));
+    cfg->loop_of = alloc_zeroed(size * sizeof(uint32_t));
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t b = preorder[k];
+        if (s.is_header[b]) {
+            CfgLoop* loop = &cfg->loops[loop_index[b]];
+            loop->header = b;
+            loop->parent = s.header[b] == PROG_NONE ? PROG_NONE : loop_index[s.header[b]];
+            loop->depth = loop->parent == PROG_NONE ? 1 : cfg->loops[loop->parent].depth + 1;
+            loop->irreducible = s.irreducible[b];
+            loop->cycles = 1;
+        }
+    }
+    for (uint32_t b = 0; b < n; b++) {
+        uint32_t h = s.is_header[b] ? b : s.header[b];
+        uint32_t l = h == PROG_NONE ? PROG_NONE : loop_index[h];
+        cfg->loop_of[b] = l;
+        if (l != PROG_NONE) {
+            const ProgBlock* block = &cfg->blocks.blocks[b];
+            cfg->loops[l].num_blocks++;
+            cfg->loops[l].num_insts += block->end - block->start;
+            cfg->loops[l].cycles += block_cycles(code, block->start, block->end);
+        }
+    }
+    for (uint32_t l = cfg->num_loops; l-- > 0;) {
+        const CfgLoop* loop = &cfg->loops[l];
+        if (loop->parent != PROG_NONE) {
+            cfg->loops[loop->parent].num_blocks += loop->num_blocks;
+            cfg->loops[loop->parent].num_insts += loop->num_insts;
+            cfg->loops[loop->parent].cycles += loop->cycles;
+        }
+    }
+
+    release(stack, size * sizeof(SearchFrame));
+    release(preorder, size * sizeof(uint32_t));
+    release(visited, size);
+    release(s.irreducible, size);
+    release(s.is_header, size);
+    release(s.header, size * sizeof(uint32_t));
+    release(s.pos, size * sizeof(uint32_t));
+}
+
+void free_cfg(Cfg* cfg) {
+    uint32_t size = cfg->blocks.num_blocks ? cfg->blocks.num_blocks : 1;
+    release(cfg->loops, (cfg->num_loops ? cfg->num_loops : 1) * sizeof(CfgLoop));
+    release(cfg->loop_of, size * sizeof(uint32_t));
+    release(cfg->callee, size * sizeof(uint32_t));
+    release(cfg->succs, 2 * size * sizeof(uint32_t));
+    release(cfg->succ_start, (cfg->blocks.num_blocks + 1) * sizeof(uint32_t));
+    free_blocks(&cfg->blocks);
+    memset(cfg, 0, sizeof(Cfg));
+}
+
+/* Returns the first label of block B, or NULL if it has none. */
+static const char* block_label(const Cfg* cfg, const Program* prog, uint32_t b) {
+    const ProgBlock* block = &cfg->blocks.blocks[b];
+    return block->first_label < block->end_label ? prog->code.labels[block->first_label].name
+                                                 : NULL;
+}
+
+static uint32_t block_depth(const Cfg* cfg, uint32_t b) {
+    uint32_t l = cfg->loop_of[b];
+    return l == PROG_NONE ? 0 : cfg->loops[l].depth;
+}
+
+/* Writes one instruction mix line. */
+static void write_share(FILE* output, const char* name, uint64_t count, uint64_t total) {
+    double share = total ? 100.0 * count / total : 0;
+    fprintf(output, "%" PRIu64 "\t%5.1f%%\t%-16s ", count, share, name);
+    for (int i = 0; i < (int) (share / 2 + 0.5); i++) {
+        fputc('#', output);
+    }
+    fputc('\n', output);
+}
+
+/* Writes the report of CFG, built from PROG: a summary, every block with its
+   address, size, loop depth, successors and labels, the loops outermost
+   first with their nesting, sizes and cycle estimates, and the static
+   instruction mix by mnemonic (most frequent first) and by class. */
+void write_cfg_report(FILE* output, const Cfg* cfg, const Program* prog) {
+    const ProgCode* code = &prog->code;
+    uint32_t num_irreducible = 0;
+    for (uint32_t l = 0; l < cfg->num_loops; l++) {
+        num_irreducible += cfg->loops[l].irreducible;
+    }
+    fprintf(output, ".summary\n");
+    fprintf(output, "instructions\t%u\n", code->len);
+    fprintf(output, "blocks\t%u\n", cfg->blocks.num_blocks);
+    fprintf(output, "edges\t%u\n", cfg->num_edges);
+    fprintf(output, "calls\t%u\n", cfg->num_calls);
+    fprintf(output, "loops\t%u\n", cfg->num_loops);
+    fprintf(output, "irreducible loops\t%u\n", num_irreducible);
+
+    fprintf(output, "\n.blocks\n");
+    for (uint32_t b = 0; b < cfg->blocks.num_blocks; b++) {
+        const ProgBlock* block = &cfg->blocks.blocks[b];
+        fprintf(output, "B%u\t%u\t%u\t%u\t", b, block->start * 4, block->end - block->start,
+            block_depth(cfg, b));
+        if (cfg->succ_start[b] == cfg->succ_start[b + 1]) {
+            fputc('-', output);
+        }
+        for (uint32_t e = cfg->succ_start[b]; e < cfg->succ_start[b + 1]; e++) {
+            fprintf(output, "%sB%u", e > cfg->succ_start[b] ? " " : "", cfg->succs[e]);
+        }
+        if (cfg->callee[b] != PROG_NONE) {
+            fprintf(output, " call B%u", cfg->callee[b]);
+        }
+        fputc('\t', output);
+        for (uint32_t l = block->first_label; l < block->end_label; l++) {
+            fprintf(output, "%s%s", l > block->first_label ? " " : "", code->labels[l].name);
+        }
+        fputc('\n', output);
+    }
+
+    fprintf(output, "\n.loops\n");
+    for (uint32_t l = 0; l < cfg->num_loops; l++) {
+        const CfgLoop* loop = &cfg->loops[l];
+        const char* label = block_label(cfg, prog, loop->header);
+        fprintf(output, "%*sB%u\tdepth %u\t%u blocks\t%u instructions\t%" PRIu64 " cycles\t%s%s\n",
+            2 * (loop->depth - 1), "", loop->header, loop->depth, loop->num_blocks,
+            loop->num_insts, loop->cycles, label ? label : "-",
+            loop->irreducible ? "\tirreducible" : "");
+    }
+
+    uint64_t per_inst[NUM_INSTS] = { 0 };
+    uint64_t per_class[NUM_CLASSES] = { 0 };
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < code->len; i++) {
+        if (code->insts[i].valid && code->insts[i].inst.id < NUM_INSTS) {
+            per_inst[code->insts[i].inst.id]++;
+            total++;
+        }
+    }
+    fprintf(output, "\n.mix\n");
+    uint8_t order[NUM_INSTS];
+    uint32_t num_used = 0;
+    for (uint8_t id = 0; id < NUM_INSTS; id++) {
+        if (per_inst[id]) {
+            uint32_t k = num_used++;
+            for (; k > 0 && per_inst[order[k - 1]] < per_inst[id]; k--) {
+                order[k] = order[k - 1];
+            }
+            order[k] = id;
+        }
+        per_class[inst_class(id)] += per_inst[id];
+    }
+    for (uint32_t k = 0; k < num_used; k++) {
+        write_share(output, inst_name(order[k]), per_inst[order[k]], total);
+    }
+
+    fprintf(output, "\n.classes\n");
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        write_share(output, inst_class_name(c), per_class[c], total);
+    }
+}
+
+/* Writes the node of block B, indented by DEPTH levels. */
+static void write_dot_block(FILE* output, const Cfg* cfg, const Program* prog, uint32_t b,
+    uint32_t depth) {
+    const ProgBlock* block = &cfg->blocks.blocks[b];
+    const char* label = block_label(cfg, prog, b);
+    fprintf(output, "%*sB%u [label=\"B%u%s%s\\n%u: %u instructions\"];\n", 4 * (depth + 1), "",
+        b, b, label ? " " : "", label ? label : "", block->start * 4, block->end - block->start);
+}
+
+/* Writes CFG, built from PROG, as a Graphviz digraph. Calls are dotted
+   edges. */
+void write_cfg_dot(FILE* output, const Cfg* cfg, const Program* prog) {
+    uint32_t n = cfg->blocks.num_blocks;
+    uint32_t num_loops = cfg->num_loops;
+
+    /* The blocks directly in each loop and the loops directly inside it,
+       bucketed by loop, with the blocks outside every loop last. */
+    uint32_t* block_start = alloc_zeroed((num_loops + 2) * sizeof(uint32_t));
+    uint32_t* loop_blocks = alloc_zeroed((n ? n : 1) * sizeof(uint32_t));
+    uint32_t* child_start = alloc_zeroed((num_loops + 2) * sizeof(uint32_t));
+    uint32_t* children = alloc_zeroed((num_loops ? num_loops : 1) * sizeof(uint32_t));
+    for (uint32_t b = 0; b < n; b++) {
+        uint32_t l = cfg->loop_of[b];
+        block_start[(l == PROG_NONE ? num_loops : l) + 1]++;
+    }
+    for (uint32_t l = 0; l < num_loops; l++) {
+        uint32_t p = cfg->loops[l].parent;
+        child_start[(p == PROG_NONE ? num_loops : p) + 1]++;
+    }
+    for (uint32_t l = 0; l <= num_loops; l++) {
+        block_start[l + 1] += block_start[l];
+        child_start[l + 1] += child_start[l];
+    }
+    for (uint32_t b = 0; b < n; b++) {
+        uint32_t l = cfg->loop_of[b];
+        loop_blocks[block_start[l == PROG_NONE ? num_loops : l]++] = b;
+    }
+    for (uint32_t l = 0; l < num_loops; l++) {
+        uint32_t p = cfg->loops[l].parent;
+        children[child_start[p == PROG_NONE ? num_loops : p]++] = l;
+    }
+    /* The fills above moved every start to the next bucket's. */
+    for (uint32_t l = num_loops + 1; l > 0; l--) {
+        block_start[l] = block_start[l - 1];
+        child_start[l] = child_start[l - 1];
+    }
+    block_start[0] = child_start[0] = 0;
+
+    fprintf(output, "digraph cfg {\n");
+    fprintf(output, "    node [shape=box, fontname=\"monospace\"];\n");
+    for (uint32_t e = block_start[num_loops]; e < block_start[num_loops + 1]; e++) {
+        write_dot_block(output, cfg, prog, loop_blocks[e], 0);
+    }
+    /* Each loop is a cluster inside its parent's. The stack holds the
+       loops being written and the next child of each. */
+    uint32_t* stack = alloc_zeroed((num_loops ? num_loops : 1) * 2 * sizeof(uint32_t));
+    for (uint32_t c = child_start[num_loops]; c < child_start[num_loops + 1]; c++) {
+        uint32_t depth = 0;
+        uint32_t l = children[c];
+        for (;;) {
+            if (l != PROG_NONE) {
+                const CfgLoop* loop = &cfg->loops[l];
+                const char* label = block_label(cfg, prog, loop->header);
+                fprintf(output, "%*ssubgraph cluster_L%u {\n", 4 * (depth + 1), "", l);
+                fprintf(output, "%*slabel=\"loop B%u%s%s: depth %u, %" PRIu64 " cycles%s\";\n",
+                    4 * (depth + 2), "", loop->header, label ? " " : "", label ? label : "",
+                    loop->depth, loop->cycles, loop->irreducible ? ", irreducible" : "");
+                for (uint32_t e = block_start[l]; e < block_start[l + 1]; e++) {
+                    write_dot_block(output, cfg, prog, loop_blocks[e], depth + 1);
+                }
+                stack[2 * depth] = l;
+                stack[2 * depth + 1] = child_start[l];
+                depth++;
+            }
+            uint32_t top = stack[2 * (depth - 1)];
+            uint32_t next = stack[2 * (depth - 1) + 1];
+            if (next < child_start[top + 1]) {
+                stack[2 * (depth - 1) + 1]++;
+                l = children[next];
+                continue;
+            }
+            depth--;
+            fprintf(output, "%*s}\n", 4 * (depth + 1), "");
+            if (depth == 0) {
+                break;
+            }
+            l = PROG_NONE;
+        }
+    }
+    for (uint32_t b = 0; b < n; b++) {
+        for (uint32_t e = cfg->succ_start[b]; e < cfg->succ_start[b + 1]; e++) {
+            fprintf(output, "    B%u -> B%u;\n", b, cfg->succs[e]);
+        }
+        if (cfg->callee[b] != PROG_NONE) {
+            fprintf(output, "    B%u -> B%u [style=dotted];\n", b, cfg->callee[b]);
+        }
+    }
+    fprintf(output, "}\n");
+
+    release(stack, (num_loops ? num_loops : 1) * 2 * sizeof(uint32_t));
+    release(children, (num_loops ? num_loops : 1) * sizeof(uint32_t));
+    release(child_start, (num_loops + 2) * sizeof(uint32_t));
+    release(loop_blocks, (n ? n : 1) * sizeof(uint32_t));
+    release(block_start, (num_loops + 2) * sizeof(uint32_t));
+}
@@ -0,0 +1,71 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <stdint.h>
+
+/* Control-flow graph analysis of expanded programs.
+
+   build_cfg() splits a Program into basic blocks (find_blocks() in
+   program.h: at labels and after every branch and jump), takes the branch
+   or jump target and the fallthrough of each block as its successors, and
+   finds the loops. Linking instructions (jal, jalr, bltzal and bgezal) are
+   calls: their target is recorded as a call edge and control continues
+   after them. Blocks no path from the first block reaches, such as the
+   bodies of called functions, start their own search.
+
+   Loops are found in a single depth-first search that tags every block
+   with the header of its innermost loop (Wei, Mao, Zou and Chen, "A New
+   Algorithm for Identifying Loops in Decompilation"), so there is no
+   dominator tree to build and the analysis stays linear in practice. For
+   reducible code the loops are exactly the natural loops; a loop that can
+   be entered other than through its header is marked irreducible.
+
+   The cycle estimate of a loop charges one cycle per instruction of every
+   block in it, nested loops included once, one more per load followed by
+   a use of its result, and one for the taken branch back to the header:
+   the cost of one iteration down every path at once, which ranks loops
+   rather than predicting their time.
+
+   write_cfg_report() writes block sizes and successors, the loop nest with
+   sizes and cycle estimates, and the static instruction mix.
+   write_cfg_dot() writes the same graph for Graphviz, with every loop a
+   cluster inside the cluster of its parent loop.
+ */
+
+/* A loop: its header block, enclosing loop (or PROG_NONE) and nesting
+   depth, counting from 1. The sizes include nested loops. */
+typedef struct {
+    uint32_t header;
+    uint32_t parent;
+    uint32_t depth;
+    uint32_t num_blocks;
+    uint32_t num_insts;
+    uint64_t cycles;
+    uint8_t irreducible;
+} CfgLoop;
+
+/* SUCCS holds the successors of block B at [SUCC_START[B],
+   SUCC_START[B + 1]), and CALLEE the block a call at its end goes to, or
+   PROG_NONE. LOOP_OF is the innermost loop of each block, or PROG_NONE.
+   Loops are numbered in depth-first order, so parents come first. */
+typedef struct {
+    ProgBlocks blocks;
+    uint32_t* succ_start;
+    uint32_t* succs;
+    uint32_t* callee;
+    uint32_t* loop_of;
+    CfgLoop* loops;
+    uint32_t num_loops;
+    uint32_t num_edges;
+    uint32_t num_calls;
+} Cfg;
+
+void build_cfg(Cfg* cfg, const Program* prog);
+
+void free_cfg(Cfg* cfg);
+
+void write_cfg_report(FILE* output, const Cfg* cfg, const Program* prog);
+
+void write_cfg_dot(FILE* output, const Cfg* cfg, const Program* prog);
+
+#endif
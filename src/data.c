@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate_utils.h"
+#include "object.h"
+#include "data.h"
+
+static const char* SEPARATORS = " \f\n\r\t\v,";
+static const char* SPACES = " \f\n\r\t\v";
+
+void init_data_segment(DataSegment* data) {
+    init_word_buffer(&data->words);
+    data->len = 0;
+    data->labels_from = 0;
+}
+
+void free_data_segment(DataSegment* data) {
+    free_word_buffer(&data->words);
+    data->len = 0;
+    data->labels_from = 0;
+}
+
+static void raise_data_error(uint32_t input_line, const char* name, const char* operands) {
+    write_to_log("Error - invalid data at line %u: %s %s\n", input_line, name, operands);
+}
+
+/* Makes room for up to COUNT more bytes, as far as DATA_LIMIT allows. */
+static void reserve_bytes(DataSegment* data, uint64_t count) {
+    uint64_t room = DATA_LIMIT - data->len;
+    reserve_word_buffer(&data->words, (data->len + (count < room ? count : room) + 3) / 4);
+}
+
+/* Stores the low SIZE bytes of VALUE at byte OFFSET, which must be a
+   multiple of SIZE, in the big-endian WORDS. Every byte past the end of the
+   segment is zero, since the first byte stored in a word clears the rest. */
+static void put_bytes(uint32_t* words, uint32_t offset, uint32_t value, unsigned size) {
+    uint32_t bits = (value & (0xFFFFFFFFu >> (32 - 8 * size))) << (32 - 8 * (offset % 4 + size));
+    words[offset / 4] = offset % 4 ? words[offset / 4] | bits : bits;
+}
+
+/* Appends zero bytes up to LEN. Returns 0 on success and -1 if LEN is past
+   DATA_LIMIT. */
+static int pad_to(DataSegment* data, uint64_t len) {
+    if (len > DATA_LIMIT) {
+        return -1;
+    }
+    resize_word_buffer(&data->words, (len + 3) / 4);
+    data->len = len;
+    return 0;
+}
+
+/* Pads DATA to a multiple of ALIGNMENT bytes and moves the labels waiting
+   for this directive to where its data starts. Returns 0 on success and -1
+   if the padding does not fit. */
+static int start_directive(DataSegment* data, SymbolTable* symtbl, uint32_t alignment) {
+    if (pad_to(data, (data->len + alignment - 1) / alignment * alignment) != 0) {
+        return -1;
+    }
+    const char* name;
+    uint32_t addr;
+    for (uint32_t i = data->labels_from; get_symbol(symtbl, i, &name, &addr) == 0; i++) {
+        set_symbol_addr(symtbl, name, DATA_BASE + data->len);
+    }
+    data->labels_from = symtbl->len;
+    return 0;
+}
+
+/* Appends the SIZE-byte numbers listed in P, up to END. Values may be given
+   signed or unsigned. Returns 0 on success and -1 on error. */
+static int add_values(DataSegment* data, unsigned size, const char* p, const char* end) {
+    long int lower = size == 4 ? INT32_MIN : -(1l << (8 * size - 1));
+    long int upper = size == 4 ? UINT32_MAX : (1l << 8 * size) - 1;
+    /* Each value takes at least two characters with its separator. */
+    reserve_bytes(data, (uint64_t) (end - p + 1) / 2 * size);
+    uint32_t* words = data->words.words;
+    uint32_t len = data->len;
+    uint32_t count = 0;
+    int err = 0;
+    while ((p += strspn(p, SEPARATORS)) < end) {
+        long int value;
+        const char* next = scan_num(&value, p, end, lower, upper);
+        if (!next || (next < end && !strchr(SEPARATORS, *next)) || len + size > DATA_LIMIT) {
+            err = 1;
+            break;
+        }
+        put_bytes(words, len, (uint32_t) value, size);
+        len += size;
+        count++;
+        p = next;
+    }
+    data->len = len;
+    data->words.len = (len + 3) / 4;
+    return err || count == 0 ? -1 : 0;
+}
+
+/* Reads the number of bytes in P, up to END, for .space and .align. Returns
+   0 on success and -1 if it is not a single number in [0, UPPER]. */
+static int read_count(uint32_t* count, const char* p, const char* end, long int upper) {
+    long int value;
+    p += strspn(p, SPACES);
+    const char* next = scan_num(&value, p, end, 0, upper);
+    if (!next || next != end) {
+        return -1;
+    }
+    *count = value;
+    return 0;
+}
+
+/* Appends the quoted strings in P, up to END, separated by commas, each
+   followed by a NUL. Returns 0 on success and -1 on error. */
+static int add_strings(DataSegment* data, const char* p, const char* end) {
+    /* A string never takes more bytes than its quoted text. */
+    reserve_bytes(data, end - p);
+    uint32_t* words = data->words.words;
+    uint32_t len = data->len;
+    int err = 0;
+    for (;;) {
+        p += strspn(p, SPACES);
+        if (p == end || *p != '"') {
+            err = 1;
+            break;
+        }
+        for (p++; p < end && *p != '"' && len < DATA_LIMIT; len++) {
+            char c = *p++;
+            if (c == '\\' && p < end) {
+                switch (*p++) {
+                    case 'n':  c = '\n'; break;
+                    case 't':  c = '\t'; break;
+                    case '0':  c = '\0'; break;
+                    case '\\': c = '\\'; break;
+                    case '"':  c = '"'; break;
+                    default:   err = 1; break;
+                }
+            }
+            put_bytes(words, len, (uint8_t) c, 1);
+        }
+        if (err || p == end || len == DATA_LIMIT) {
+            err = 1;
+            break;
+        }
+        put_bytes(words, len++, 0, 1);
+        p++;
+        p += strspn(p, SPACES);
+        if (p == end) {
+            break;
+        }
+        if (*p++ != ',') {
+            err = 1;
+            break;
+        }
+    }
+    data->len = len;
+    data->words.len = (len + 3) / 4;
+    return err ? -1 : 0;
+}
+
+/* Appends the data directive NAME with OPERANDS, the rest of its source
+   line, to DATA. Labels in SYMTBL waiting for it are moved past any
+   alignment. Errors are reported with INPUT_LINE. Returns 0 on success and
+   -1 on error.
+ */
+int add_data(DataSegment* data, SymbolTable* symtbl, const char* name, char* operands,
+    uint32_t input_line) {
+    size_t n = strlen(operands);
+    while (n && strchr(SPACES, operands[n - 1])) {
+        operands[--n] = '\0';
+    }
+    const char* end = operands + n;
+    uint32_t count;
+    int err = -1;
+    if (strcmp(name, ".word") == 0 || strcmp(name, ".half") == 0
+        || strcmp(name, ".byte") == 0) {
+        unsigned size = name[1] == 'w' ? 4 : name[1] == 'h' ? 2 : 1;
+        if (start_directive(data, symtbl, size) == 0) {
+            err = add_values(data, size, operands, end);
+        }
+    } else if (strcmp(name, ".space") == 0) {
+        if (read_count(&count, operands, end, DATA_LIMIT) == 0
+            && start_directive(data, symtbl, 1) == 0) {
+            err = pad_to(data, (uint64_t) data->len + count);
+        }
+    } else if (strcmp(name, ".align") == 0) {
+        if (read_count(&count, operands, end, 2) == 0) {
+            err = start_directive(data, symtbl, 1u << count);
+        }
+    } else if (strcmp(name, ".asciiz") == 0) {
+        if (start_directive(data, symtbl, 1) == 0) {
+            err = add_strings(data, operands, end);
+        }
+    }
+    if (err) {
+        raise_data_error(input_line, name, operands);
+    }
+    return err;
+}
+
+/* Writes DATA to OUTPUT as read_data_image() reads it. Returns 0 on success
+   and -1 on error. */
+int write_data_image(const DataSegment* data, FILE* output) {
+    uint32_t n = data->words.len;
+    int err = fwrite(DATA_IMAGE_MAGIC, 1, sizeof(DATA_IMAGE_MAGIC), output)
+            != sizeof(DATA_IMAGE_MAGIC)
+        || fwrite(&data->len, sizeof(uint32_t), 1, output) != 1
+        || (n && fwrite(data->words.words, sizeof(uint32_t), n, output) != n);
+    return err ? -1 : 0;
+}
+
+/* Reads a segment saved by write_data_image() into DATA, which must be
+   empty. Returns 0 on success and -1 if INPUT is not such an image. */
+int read_data_image(DataSegment* data, FILE* input) {
+    char magic[sizeof(DATA_IMAGE_MAGIC)];
+    uint32_t len;
+    if (fread(magic, 1, sizeof(magic), input) != sizeof(magic)
+        || memcmp(magic, DATA_IMAGE_MAGIC, sizeof(magic)) != 0
+        || fread(&len, sizeof(uint32_t), 1, input) != 1 || len > DATA_LIMIT) {
+        return -1;
+    }
+    uint32_t n = (len + 3) / 4;
+    resize_word_buffer(&data->words, n);
+    if (n && fread(data->words.words, sizeof(uint32_t), n, input) != n) {
+        free_data_segment(data);
+        return -1;
+    }
+    data->len = len;
+    return 0;
+}
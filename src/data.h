@@ -0,0 +1,55 @@
+#ifndef DATA_H
+#define DATA_H
+
+#include <stdint.h>
+
+/* The .data segment.
+
+   Pass one hands every directive it finds after .data to add_data(), which
+   appends to a DataSegment:
+
+     .word, .half, .byte  numbers as translate_num() reads them, separated
+                          by commas or spaces, each aligned to its size
+     .space N             N zero bytes
+     .align N             zero bytes up to a multiple of 2^N, N at most 2
+     .asciiz "..."        each string and a NUL, with \n, \t, \0, \\ and \"
+
+   Initializers are parsed in place from the whole source line by
+   scan_num(), which finds and converts up to eight decimal digits at a time
+   with word operations, and the values are stored straight into the
+   segment, so a table of any length costs one pass over its text. The
+   segment is kept as the big-endian words the object's .data section holds,
+   so it is written out with a single write_section_hex() call.
+
+   Labels in .data are at DATA_BASE (see tables.h) plus their offset. A
+   label directly before a directive that aligns names the aligned address,
+   as in other MIPS assemblers: LABELS_FROM is the first symbol table entry
+   that is still waiting for the next directive.
+
+   write_data_image() saves a segment for a later pass two, as the magic
+   DATA_IMAGE_MAGIC, the length in bytes and the words, in host byte order.
+ */
+
+#define DATA_IMAGE_MAGIC "MIPSDAT"
+
+/* No segment grows past this many bytes. */
+#define DATA_LIMIT (1u << 28)
+
+typedef struct {
+    WordBuffer words;
+    uint32_t len;
+    uint32_t labels_from;
+} DataSegment;
+
+void init_data_segment(DataSegment* data);
+
+void free_data_segment(DataSegment* data);
+
+int add_data(DataSegment* data, SymbolTable* symtbl, const char* name, char* operands,
+    uint32_t input_line);
+
+int write_data_image(const DataSegment* data, FILE* output);
+
+int read_data_image(DataSegment* data, FILE* input);
+
+#endif
@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate.h"
+#include "object.h"
+#include "reloc.h"
+#include "disasm.h"
+
+/* Where the secondary tables start in Disassembler.ids. Ordinary opcodes
+   use the slot with their own number. */
+enum { SLOTS_SPECIAL = 64, SLOTS_SPECIAL2 = 128, SLOTS_REGIMM = 192 };
+
+static const char* const REG_NAMES[32] = {
+    "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+    "$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra",
+};
+
+/* Returns the bits of a word that operand KIND is stored in. LABEL is the
+   format's LabelUse. */
+static uint32_t operand_bits(uint8_t kind, uint8_t label) {
+    switch (kind) {
+        case OPERAND_RD:    return 0x1F << 11;
+        case OPERAND_RS:    return 0x1F << 21;
+        case OPERAND_RT:    return 0x1F << 16;
+        case OPERAND_RDT:   return 0x1F << 11 | 0x1F << 16;
+        case OPERAND_SHAMT: return 0x1F << 6;
+        case OPERAND_LABEL: return label == LABEL_JUMP ? 0x03FFFFFF : 0xFFFF;
+        case OPERAND_NONE:  return 0;
+        default:            return 0xFFFF;
+    }
+}
+
+/* Fills in the decode tables of DIS from the instruction table. */
+void init_disassembler(Disassembler* dis) {
+    memset(dis->ids, INST_INVALID, sizeof(dis->ids));
+    for (uint32_t op = 0; op < 64; op++) {
+        dis->base[op] = op;
+        dis->shift[op] = 0;
+        dis->mask[op] = 0;
+    }
+    dis->base[0x00] = SLOTS_SPECIAL;
+    dis->mask[0x00] = 0x3F;
+    dis->base[0x1c] = SLOTS_SPECIAL2;
+    dis->mask[0x1c] = 0x3F;
+    dis->base[0x01] = SLOTS_REGIMM;
+    dis->shift[0x01] = 16;
+    dis->mask[0x01] = 0x1F;
+
+    /* INST_INVALID and unused ids match no word. */
+    for (uint32_t id = 0; id < 256; id++) {
+        dis->fixed_mask[id] = 0;
+        dis->fixed_bits[id] = 1;
+        dis->same_rd_rt[id] = 0;
+    }
+    for (uint8_t id = 0; id < NUM_INSTS; id++) {
+        Instr inst;
+        init_inst(&inst, id);
+        const FormatInfo* info = format_info(inst.fmt);
+        uint32_t op = inst.opcode;
+        dis->ids[dis->base[op] + (op == 0x01 ? inst.rt : inst.funct & dis->mask[op])] = id;
+
+        uint32_t operands = 0;
+        for (int k = 0; k < 3; k++) {
+            operands |= operand_bits(info->operands[k], info->label);
+            dis->same_rd_rt[id] |= info->operands[k] == OPERAND_RDT;
+        }
+        dis->fixed_mask[id] = ~operands;
+        dis->fixed_bits[id] = (op << 26 | (uint32_t) inst.rt << 16 | inst.funct) & ~operands;
+    }
+}
+
+/* Stores the InstId of each of the N WORDS in IDS, or INST_INVALID if the
+   word is not the encoding of an instruction. */
+void decode_words(const Disassembler* dis, const uint32_t* restrict words, uint32_t n,
+    uint8_t* restrict ids) {
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t word = words[i];
+        uint32_t op = word >> 26;
+        uint8_t id = dis->ids[dis->base[op] + (word >> dis->shift[op] & dis->mask[op])];
+        int ok = (word & dis->fixed_mask[id]) == dis->fixed_bits[id]
+            && !(dis->same_rd_rt[id] && ((word >> 11 ^ word >> 16) & 0x1F));
+        ids[i] = ok ? id : INST_INVALID;
+    }
+}
+
+/*******************************
+ * Output
+ *******************************/
+
+/* Text is formatted by hand into BUF and written a buffer at a time, since
+   fprintf() would cost more than decoding. */
+typedef struct {
+    FILE* output;
+    size_t len;
+    int err;
+    char buf[64 * 1024];
+} TextOut;
+
+static void flush_text(TextOut* out) {
+    if (out->len && fwrite(out->buf, 1, out->len, out->output) != out->len) {
+        out->err = 1;
+    }
+    out->len = 0;
+}
+
+static void put_str(TextOut* out, const char* str) {
+    size_t len = strlen(str);
+    if (out->len + len > sizeof(out->buf)) {
+        flush_text(out);
+        if (len > sizeof(out->buf)) {
+            out->err |= fwrite(str, 1, len, out->output) != len;
+            return;
+        }
+    }
+    memcpy(out->buf + out->len, str, len);
+    out->len += len;
+}
+
+static void put_char(TextOut* out, char c) {
+    if (out->len == sizeof(out->buf)) {
+        flush_text(out);
+    }
+    out->buf[out->len++] = c;
+}
+
+static void put_dec(TextOut* out, int64_t value) {
+    char digits[24];
+    int n = 0;
+    uint64_t mag = value < 0 ? -(uint64_t) value : (uint64_t) value;
+    if (value < 0) {
+        put_char(out, '-');
+    }
+    do {
+        digits[n++] = '0' + mag % 10;
+        mag /= 10;
+    } while (mag);
+    while (n) {
+        put_char(out, digits[--n]);
+    }
+}
+
+static void put_hex(TextOut* out, uint32_t value, int min_digits) {
+    static const char HEX[] = "0123456789abcdef";
+    int n = 8;
+    while (n > min_digits && !(value >> (4 * (n - 1)))) {
+        n--;
+    }
+    put_char(out, '0');
+    put_char(out, 'x');
+    while (n--) {
+        put_char(out, HEX[value >> (4 * n) & 0xF]);
+    }
+}
+
+/* Writes the name of the label at byte offset ADDR: its first .symbol name,
+   or a made-up one. */
+static void put_label(TextOut* out, const char* const* label_at, uint32_t addr) {
+    if (label_at[addr / 4]) {
+        put_str(out, label_at[addr / 4]);
+    } else {
+        put_str(out, "_L");
+        put_dec(out, addr);
+    }
+}
+
+static void put_word(TextOut* out, uint32_t word) {
+    put_str(out, "\t.word ");
+    put_hex(out, word, 8);
+    put_char(out, '\n');
+}
+
+/* Writes the instruction ID encoded as WORD at word index I. RELOC is the
+   symbol relocated at it, or NULL. */
+static void put_inst(TextOut* out, uint8_t id, uint32_t word, uint32_t i, const char* reloc,
+    const char* const* label_at) {
+    Instr inst;
+    init_inst(&inst, id);
+    const FormatInfo* info = format_info(inst.fmt);
+    uint32_t rs = word >> 21 & 0x1F, rt = word >> 16 & 0x1F, rd = word >> 11 & 0x1F;
+    put_char(out, '\t');
+    put_str(out, inst_name(id));
+    if (inst.fmt == FMT_MEM) {
+        put_char(out, ' ');
+        put_str(out, REG_NAMES[rt]);
+        put_str(out, ", ");
+        put_dec(out, (int16_t) word);
+        put_char(out, '(');
+        put_str(out, REG_NAMES[rs]);
+        put_str(out, ")\n");
+        return;
+    }
+    for (int k = 0; k < info->num_operands; k++) {
+        put_str(out, k ? ", " : " ");
+        switch (info->operands[k]) {
+            case OPERAND_RD:
+            case OPERAND_RDT:
+                put_str(out, REG_NAMES[rd]);
+                break;
+            case OPERAND_RS:
+                put_str(out, REG_NAMES[rs]);
+                break;
+            case OPERAND_RT:
+                put_str(out, REG_NAMES[rt]);
+                break;
+            case OPERAND_SHAMT:
+                put_dec(out, word >> 6 & 0x1F);
+                break;
+            case OPERAND_SIMM:
+                put_dec(out, (int16_t) word);
+                break;
+            case OPERAND_LABEL:
+                if (info->label == LABEL_BRANCH) {
+                    put_label(out, label_at, (i + 1 + (int16_t) word) * 4);
+                } else if (reloc) {
+                    put_str(out, reloc);
+                } else {
+                    put_hex(out, (word & 0x03FFFFFF) << 2, 1);
+                }
+                break;
+            default:
+                if (reloc && info->label != LABEL_NONE) {
+                    put_str(out, reloc);
+                } else {
+                    put_hex(out, word & 0xFFFF, 1);
+                }
+                break;
+        }
+    }
+    put_char(out, '\n');
+}
+
+/* A .symbol entry, ordered by address and then by position in the table. */
+typedef struct {
+    const char* name;
+    uint32_t addr;
+    uint32_t index;
+} Label;
+
+static int compare_labels(const void* a, const void* b) {
+    const Label* x = a;
+    const Label* y = b;
+    if (x->addr != y->addr) {
+        return x->addr < y->addr ? -1 : 1;
+    }
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static void* alloc_zeroed(size_t size) {
+    Allocator* alloc = get_table_allocator();
+    void* ptr = alloc->alloc(alloc, size ? size : 1);
+    if (!ptr) {
+        allocation_failed();
+    }
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static void release(void* ptr, size_t size) {
+    Allocator* alloc = get_table_allocator();
+    alloc->release(alloc, ptr, size ? size : 1);
+}
+
+/* Writes DATA after a .data directive: .word lines, or .byte lines for a
+   word that a label points inside. LABELS are the NUM_LABELS labels of
+   .data in address order. */
+static void put_data(TextOut* out, const WordBuffer* data, const Label* labels,
+    uint32_t num_labels) {
+    put_str(out, "\t.data\n");
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < data->len; i++) {
+        uint32_t word = data->words[i];
+        for (uint32_t b = 0; b < 4; b++) {
+            for (; next < num_labels && labels[next].addr - DATA_BASE <= i * 4 + b; next++) {
+                put_str(out, labels[next].name);
+                put_str(out, ":\n");
+            }
+            if (b == 0 && (next == num_labels || labels[next].addr - DATA_BASE >= i * 4 + 4)) {
+                put_word(out, word);
+                break;
+            }
+            put_str(out, "\t.byte ");
+            put_hex(out, word >> (24 - 8 * b) & 0xFF, 2);
+            put_char(out, '\n');
+        }
+    }
+    for (; next < num_labels; next++) {
+        put_str(out, labels[next].name);
+        put_str(out, ":\n");
+    }
+}
+
+/* Returns the word index of the target of the branch at index I, or -1 if
+   it is outside .text (its end included). */
+static int64_t branch_target(uint32_t word, uint32_t i, uint32_t n) {
+    int64_t target = (int64_t) i + 1 + (int16_t) word;
+    return target < 0 || target > n ? -1 : target;
+}
+
+/* Writes OBJ to OUTPUT as assembly source.
+   Returns 0 on success and -1 if writing failed.
+ */
+int disassemble_object(FILE* output, const ObjectFile* obj) {
+    const uint32_t* words = obj->text.words;
+    uint32_t n = obj->text.len;
+    Disassembler dis;
+    init_disassembler(&dis);
+    uint8_t* ids = alloc_zeroed(n);
+    decode_words(&dis, words, n, ids);
+
+    /* Every .symbol entry, in address order. */
+    uint32_t num_labels = 0;
+    const char* name;
+    uint32_t addr;
+    while (obj->symtbl && get_symbol(obj->symtbl, num_labels, &name, &addr) == 0) {
+        num_labels++;
+    }
+    Label* labels = alloc_zeroed(num_labels * sizeof(Label));
+    for (uint32_t k = 0; k < num_labels; k++) {
+        get_symbol(obj->symtbl, k, &labels[k].name, &labels[k].addr);
+        labels[k].index = k;
+    }
+    qsort(labels, num_labels, sizeof(Label), compare_labels);
+
+    /* The first name at each instruction boundary, and the relocated name at
+       each instruction. */
+    const char** label_at = alloc_zeroed((n + 1) * sizeof(char*));
+    for (uint32_t k = num_labels; k-- > 0;) {
+        if (labels[k].addr % 4 == 0 && labels[k].addr / 4 <= n) {
+            label_at[labels[k].addr / 4] = labels[k].name;
+        }
+    }
+    const char** reloc_at = alloc_zeroed(n * sizeof(char*));
+    for (uint32_t k = 0; obj->reltbl && get_symbol(obj->reltbl, k, &name, &addr) == 0; k++) {
+        if (addr % 4 == 0 && addr / 4 < n) {
+            reloc_at[addr / 4] = name;
+        }
+    }
+
+    /* Branches leaving .text cannot be written as a label; the rest need one
+       at their target. */
+    uint8_t* needs_label = alloc_zeroed(n + 1);
+    for (uint32_t i = 0; i < n; i++) {
+        Instr inst;
+        init_inst(&inst, ids[i]);
+        if (ids[i] == INST_INVALID || format_info(inst.fmt)->label != LABEL_BRANCH) {
+            continue;
+        }
+        int64_t target = branch_target(words[i], i, n);
+        if (target == -1) {
+            ids[i] = INST_INVALID;
+        } else {
+            needs_label[target] = 1;
+        }
+    }
+
+    TextOut* out = alloc_zeroed(sizeof(TextOut));
+    out->output = output;
+    uint32_t next_label = 0;
+    for (uint32_t i = 0; i <= n; i++) {
+        int named = 0;
+        while (next_label < num_labels && labels[next_label].addr <= i * 4) {
+            put_str(out, labels[next_label].name);
+            put_str(out, ":\n");
+            named |= labels[next_label].addr == i * 4;
+            next_label++;
+        }
+        if (needs_label[i] && !named) {
+            put_label(out, label_at, i * 4);
+            put_str(out, ":\n");
+        }
+        if (i == n) {
+            break;
+        }
+        if (ids[i] == INST_INVALID) {
+            put_word(out, words[i]);
+        } else {
+            put_inst(out, ids[i], words[i], i, reloc_at[i], label_at);
+        }
+    }
+    /* Names past the end of .text, then .data and its names. */
+    for (; next_label < num_labels && labels[next_label].addr < DATA_BASE; next_label++) {
+        put_str(out, labels[next_label].name);
+        put_str(out, ":\n");
+    }
+    if (obj->data.len || next_label < num_labels) {
+        put_data(out, &obj->data, labels + next_label, num_labels - next_label);
+    }
+    flush_text(out);
+    int err = out->err;
+
+    release(out, sizeof(TextOut));
+    release(needs_label, n + 1);
+    release(reloc_at, n * sizeof(char*));
+    release(label_at, (n + 1) * sizeof(char*));
+    release(labels, num_labels * sizeof(Label));
+    release(ids, n);
+    if (err) {
+        write_to_log("Error: unable to write disassembly\n");
+        return -1;
+    }
+    return 0;
+}
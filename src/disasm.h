@@ -0,0 +1,44 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stdint.h>
+
+/* Disassembly.
+
+   decode_words() maps each word of .text to its InstId with two table
+   lookups: the primary opcode picks either the instruction directly or a
+   64-entry funct table (SPECIAL and SPECIAL2) or 32-entry rt table (REGIMM),
+   as an offset, shift and mask, so the lookup has no branches. A word is
+   then accepted only if every bit outside the operand fields of its format
+   matches the table, so each accepted word is the canonical encoding of
+   exactly one instruction and anything else decodes as INST_INVALID.
+
+   disassemble_object() prints an object as assembly the assembler reads
+   back into the same .text: labels come from .symbol, jump and lui/ori
+   operands from .relocation, and branch targets from their offset, with a
+   label of the form _L<byte offset> made up for targets .symbol does not
+   name. Words that do not decode, and branches leaving .text, are printed
+   as .word. A .data section follows as .word lines, with .byte lines for
+   any word a label points inside.
+ */
+
+#define DISASM_SLOTS (64 + 64 + 64 + 32)
+
+typedef struct {
+    uint8_t ids[DISASM_SLOTS];
+    uint16_t base[64];
+    uint8_t shift[64];
+    uint8_t mask[64];
+    uint32_t fixed_mask[256];
+    uint32_t fixed_bits[256];
+    uint8_t same_rd_rt[256];
+} Disassembler;
+
+void init_disassembler(Disassembler* dis);
+
+void decode_words(const Disassembler* dis, const uint32_t* restrict words, uint32_t n,
+    uint8_t* restrict ids);
+
+int disassemble_object(FILE* output, const ObjectFile* obj);
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <elf.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "object.h"
+#include "reloc.h"
+#include "elf_reader.h"
+
+static uint16_t get16(const uint8_t* p) {
+    return (uint16_t) (p[0] << 8 | p[1]);
+}
+
+static uint32_t get32(const uint8_t* p) {
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+/* Returns 1 if INPUT starts with the ELF magic number and 0 otherwise.
+   Leaves INPUT positioned at its start. */
+int is_elf_object(FILE* input) {
+    unsigned char magic[SELFMAG];
+    rewind(input);
+    size_t read = fread(magic, 1, SELFMAG, input);
+    rewind(input);
+    return read == SELFMAG && memcmp(magic, ELFMAG, SELFMAG) == 0;
+}
+
+/* Returns the RelocType matching ELF relocation type ELF_TYPE, or -1 if it
+   is not one this project handles. */
+static int reloc_type_for_elf(uint32_t elf_type) {
+    switch (elf_type) {
+        case R_MIPS_26:   return R_26;
+        case R_MIPS_HI16: return R_AHI16;
+        case R_MIPS_LO16: return R_LO16;
+        case R_MIPS_PC16: return R_PC16;
+        default:          return -1;
+    }
+}
+
+/* Returns the header of section INDEX, or NULL if it lies outside the file. */
+static const uint8_t* section_header(const uint8_t* image, size_t size, uint32_t index) {
+    uint32_t shoff = get32(image + 32);
+    uint16_t shnum = get16(image + 48);
+    if (index >= shnum || (uint64_t) shoff + (index + 1) * (uint64_t) sizeof(Elf32_Shdr) > size) {
+        return NULL;
+    }
+    return image + shoff + index * sizeof(Elf32_Shdr);
+}
+
+/* Checks that the contents of section SHDR lie within the file. */
+static int section_in_file(const uint8_t* shdr, size_t size) {
+    return (uint64_t) get32(shdr + 16) + get32(shdr + 20) <= size;
+}
+
+/* Returns the NUL-terminated string at OFFSET in string table STRTAB, or
+   NULL if it is out of range or unterminated. */
+static const char* elf_string(const uint8_t* image, const uint8_t* strtab, uint32_t offset) {
+    uint32_t size = get32(strtab + 20);
+    const char* str = (const char*) image + get32(strtab + 16);
+    if (offset >= size || !memchr(str + offset, '\0', size - offset)) {
+        return NULL;
+    }
+    return str + offset;
+}
+
+/* Fills OBJ from the ELF image IMAGE of SIZE bytes. Returns 0 on success and
+   -1 if the image is not an object this reader understands. */
+static int parse_elf(ObjectFile* obj, const uint8_t* image, size_t size) {
+    if (size < sizeof(Elf32_Ehdr) || image[EI_CLASS] != ELFCLASS32
+        || image[EI_DATA] != ELFDATA2MSB || get16(image + 16) != ET_REL
+        || get16(image + 18) != EM_MIPS || get16(image + 46) != sizeof(Elf32_Shdr)) {
+        return -1;
+    }
+
+    uint16_t shnum = get16(image + 48);
+    const uint8_t* text = NULL;
+    const uint8_t* rel = NULL;
+    const uint8_t* symtab = NULL;
+    uint32_t text_index = 0;
+    for (uint32_t i = 1; i < shnum; i++) {
+        const uint8_t* shdr = section_header(image, size, i);
+        if (!shdr || !section_in_file(shdr, size)) {
+            return -1;
+        }
+        uint32_t type = get32(shdr + 4);
+        if (type == SHT_PROGBITS && (get32(shdr + 8) & SHF_EXECINSTR) && !text) {
+            text = shdr;
+            text_index = i;
+        } else if (type == SHT_SYMTAB) {
+            symtab = shdr;
+        } else if (type == SHT_REL) {
+            rel = shdr;
+        }
+    }
+    if (!text || (rel && (!symtab || get32(rel + 28) != text_index))) {
+        return -1;
+    }
+
+    uint32_t text_size = get32(text + 20);
+    const uint8_t* words = image + get32(text + 16);
+    for (uint32_t i = 0; i + 4 <= text_size; i += 4) {
+        append_word(&obj->text, get32(words + i));
+    }
+    if (!symtab) {
+        return 0;
+    }
+
+    const uint8_t* strtab = section_header(image, size, get32(symtab + 24));
+    if (!strtab || get32(strtab + 4) != SHT_STRTAB) {
+        return -1;
+    }
+    const uint8_t* syms = image + get32(symtab + 16);
+    uint32_t num_syms = get32(symtab + 20) / sizeof(Elf32_Sym);
+    for (uint32_t i = 1; i < num_syms; i++) {
+        const uint8_t* sym = syms + i * sizeof(Elf32_Sym);
+        if (get16(sym + 14) != text_index || ELF32_ST_TYPE(sym[12]) == STT_SECTION) {
+            continue;
+        }
+        const char* sym_name = elf_string(image, strtab, get32(sym));
+        if (!sym_name || add_to_table(obj->symtbl, sym_name, get32(sym + 4)) != 0) {
+            return -1;
+        }
+    }
+
+    uint32_t num_rels = rel ? get32(rel + 20) / sizeof(Elf32_Rel) : 0;
+    const uint8_t* rels = rel ? image + get32(rel + 16) : NULL;
+    for (uint32_t i = 0; i < num_rels; i++) {
+        uint32_t offset = get32(rels + i * sizeof(Elf32_Rel));
+        uint32_t info = get32(rels + i * sizeof(Elf32_Rel) + 4);
+        uint32_t sym_index = ELF32_R_SYM(info);
+        int type = reloc_type_for_elf(ELF32_R_TYPE(info));
+        if (type < 0 || sym_index == 0 || sym_index >= num_syms
+            || offset / 4 >= obj->text.len) {
+            return -1;
+        }
+        const char* sym_name = elf_string(image, strtab,
+            get32(syms + sym_index * sizeof(Elf32_Sym)));
+        if (!sym_name || add_reloc(obj->reltbl, sym_name, offset, type) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Reads the ELF object in INPUT into OBJ. NAME is only used in error
+   messages. Returns 0 on success and -1 on error, in which case OBJ holds
+   nothing that needs freeing.
+ */
+int read_elf_object(ObjectFile* obj, FILE* input, const char* name) {
+    init_word_buffer(&obj->text);
+    init_word_buffer(&obj->data);
+    obj->symtbl = create_table(SYMTBL_NON_UNIQUE);
+    obj->reltbl = create_table(SYMTBL_NON_UNIQUE);
+
+    Allocator* alloc = get_table_allocator();
+    long size;
+    uint8_t* image = NULL;
+    if (fseek(input, 0, SEEK_END) != 0 || (size = ftell(input)) < 0
+        || fseek(input, 0, SEEK_SET) != 0) {
+        size = 0;
+    } else {
+        image = alloc->alloc(alloc, size ? size : 1);
+        if (!image) {
+            allocation_failed();
+        }
+    }
+
+    int err = !image || fread(image, 1, size, input) != (size_t) size
+        || parse_elf(obj, image, size) != 0;
+    if (image) {
+        alloc->release(alloc, image, size ? size : 1);
+    }
+    if (err) {
+        write_to_log("Error: malformed ELF object %s\n", name);
+        free_object(obj);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef ELF_READER_H
+#define ELF_READER_H
+
+#include <stdint.h>
+
+/* Reads back ELF32 big-endian MIPS relocatable objects, such as those
+   written by write_elf_object(), into the ObjectFile form the linker and
+   loader work on. Only a .text section with R_MIPS_26, R_MIPS_HI16,
+   R_MIPS_LO16 and R_MIPS_PC16 relocations is understood.
+ */
+
+int is_elf_object(FILE* input);
+
+int read_elf_object(ObjectFile* obj, FILE* input, const char* name);
+
+#endif
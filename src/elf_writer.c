@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <elf.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "reloc.h"
+#include "elf_writer.h"
+
+/* Section header indices. */
+enum { SEC_NULL, SEC_TEXT, SEC_REL_TEXT, SEC_SYMTAB, SEC_STRTAB, SEC_SHSTRTAB, NUM_SECTIONS };
+
+static const char SHSTRTAB[] = "\0.text\0.rel.text\0.symtab\0.strtab\0.shstrtab";
+static const uint32_t SHSTRTAB_TEXT = 1;
+static const uint32_t SHSTRTAB_REL_TEXT = 7;
+static const uint32_t SHSTRTAB_SYMTAB = 17;
+static const uint32_t SHSTRTAB_STRTAB = 25;
+static const uint32_t SHSTRTAB_SHSTRTAB = 33;
+
+/* ELF relocation type of each RelocType. R_HI16 is only written for a lui
+   whose ori has been turned into addiu, which makes it R_MIPS_HI16. */
+static const uint8_t ELF_RELOC_TYPES[NUM_RELOC_TYPES] = {
+    R_MIPS_26, R_MIPS_HI16, R_MIPS_LO16, R_MIPS_PC16, R_MIPS_HI16
+};
+
+/* Opcodes of the low half of a lui/ori pair and of the addiu replacing it. */
+static const uint32_t OPCODE_ORI = 0x0d;
+static const uint32_t OPCODE_ADDIU = 0x09;
+
+/* Marks in PAIRED of a relocation written after its upper half, and of one
+   whose ori becomes addiu. */
+enum { UNPAIRED, PAIRED, PAIRED_ADDIU };
+
+/* MIPS32, o32 ABI. */
+static const uint32_t ELF_MIPS_FLAGS = 0x50001000;
+
+static void put16(uint8_t* p, uint16_t value) {
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+static void put32(uint8_t* p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static uint32_t align4(uint32_t value) {
+    return (value + 3) & ~3u;
+}
+
+static void put_section(uint8_t* shdr, uint32_t name, uint32_t type, uint32_t flags,
+    uint32_t offset, uint32_t size, uint32_t link, uint32_t info, uint32_t align,
+    uint32_t entsize) {
+    put32(shdr + 0, name);
+    put32(shdr + 4, type);
+    put32(shdr + 8, flags);
+    put32(shdr + 12, 0);
+    put32(shdr + 16, offset);
+    put32(shdr + 20, size);
+    put32(shdr + 24, link);
+    put32(shdr + 28, info);
+    put32(shdr + 32, align);
+    put32(shdr + 36, entsize);
+}
+
+/* Open-addressed map from symbol name to .symtab index, used to point each
+   relocation at its symbol. */
+typedef struct {
+    uint32_t* slots;
+    const char** names;
+    uint32_t mask;
+} NameIndex;
+
+static uint32_t* find_slot(NameIndex* index, const char* name) {
+    uint32_t i = symbol_hash(name) & index->mask;
+    while (index->slots[i] && strcmp(index->names[index->slots[i]], name) != 0) {
+        i = (i + 1) & index->mask;
+    }
+    return &index->slots[i];
+}
+
+/* Returns the index of the R_LO16 in RELTBL, after entry I, that pairs with
+   the upper half at I, or RELTBL->len if there is none. A plain R_HI16 is
+   on a lui, and pairs with an ori of the same symbol reading the lui's
+   register. Entries already marked in PAIRED are skipped. */
+static uint32_t find_low_half(SymbolTable* reltbl, const uint32_t* text, uint32_t num_words,
+    const uint8_t* paired, uint32_t i) {
+    const char* name;
+    uint32_t offset;
+    get_symbol(reltbl, i, &name, &offset);
+    int plain = get_reloc_type(reltbl, i) == R_HI16;
+    uint32_t hi_reg = text[offset / 4] >> 16 & 0x1F;
+    const char* other;
+    uint32_t other_offset;
+    for (uint32_t j = i + 1; get_symbol(reltbl, j, &other, &other_offset) == 0; j++) {
+        if (paired[j] || get_reloc_type(reltbl, j) != R_LO16 || strcmp(other, name) != 0
+            || other_offset / 4 >= num_words) {
+            continue;
+        }
+        uint32_t word = text[other_offset / 4];
+        if (!plain || (word >> 26 == OPCODE_ORI && (word >> 21 & 0x1F) == hi_reg)) {
+            return j;
+        }
+    }
+    return reltbl->len;
+}
+
+/* Fills ORDER with the entries of RELTBL as .rel.text lists them: in table
+   order, except that the R_LO16 pairing with an upper half comes right after
+   it, as the ABI requires. R_MIPS_HI16 is adjusted for a sign-extended low
+   half, unlike our R_HI16, so each lui/ori pair is marked in PAIRED to be
+   written as the lui/addiu pair that a standard linker gets the same address
+   from. Returns 0 on success and -1, after saying so, if an upper half has
+   no low half.
+ */
+static int order_relocs(uint32_t* order, uint8_t* paired, SymbolTable* reltbl,
+    const uint32_t* text, uint32_t num_words) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < reltbl->len; i++) {
+        if (paired[i]) {
+            continue;
+        }
+        order[n++] = i;
+        uint8_t type = get_reloc_type(reltbl, i);
+        if (type != R_HI16 && type != R_AHI16) {
+            continue;
+        }
+        const char* name;
+        uint32_t offset;
+        get_symbol(reltbl, i, &name, &offset);
+        uint32_t j = offset / 4 < num_words
+            ? find_low_half(reltbl, text, num_words, paired, i) : reltbl->len;
+        if (j == reltbl->len) {
+            write_to_log("Error: lui of %s at %u has no matching ori for ELF output\n",
+                name, offset);
+            return -1;
+        }
+        paired[j] = type == R_HI16 ? PAIRED_ADDIU : PAIRED;
+        order[n++] = j;
+    }
+    return 0;
+}
+
+/* Writes an ELF32 big-endian MIPS relocatable object to OUTPUT holding the
+   NUM_WORDS instructions in TEXT. Every symbol in SYMTBL becomes a global
+   symbol defined in .text, and every entry of RELTBL a relocation of the
+   matching type against the symbol it names, which is added as an undefined
+   symbol if SYMTBL does not define it. Upper halves are each followed by
+   their low half, and the ori of a lui/ori pair is written as addiu (see
+   order_relocs()). Returns 0 on success and -1 on error.
+ */
+int write_elf_object(FILE* output, const uint32_t* text, uint32_t num_words,
+    SymbolTable* symtbl, SymbolTable* reltbl) {
+    Allocator* alloc = get_table_allocator();
+    uint32_t num_defined = symtbl->len;
+    uint32_t num_relocs = reltbl->len;
+    const char* name;
+    uint32_t addr;
+
+    /* Symbol 0 is the null symbol and 1 the .text section symbol. */
+    uint32_t max_syms = 2 + num_defined + num_relocs;
+    uint32_t num_slots = 1;
+    while (num_slots < 2 * max_syms) {
+        num_slots *= 2;
+    }
+    NameIndex index;
+    index.mask = num_slots - 1;
+    index.slots = alloc->alloc(alloc, num_slots * sizeof(uint32_t));
+    index.names = alloc->alloc(alloc, max_syms * sizeof(char*));
+    uint32_t* sym_values = alloc->alloc(alloc, max_syms * sizeof(uint32_t));
+    if (!index.slots || !index.names || !sym_values) {
+        allocation_failed();
+    }
+    memset(index.slots, 0, num_slots * sizeof(uint32_t));
+
+    uint32_t rel_cap = num_relocs ? num_relocs : 1;
+    uint32_t* order = alloc->alloc(alloc, rel_cap * sizeof(uint32_t));
+    uint8_t* paired = alloc->alloc(alloc, rel_cap);
+    if (!order || !paired) {
+        allocation_failed();
+    }
+    memset(paired, UNPAIRED, rel_cap);
+    if (order_relocs(order, paired, reltbl, text, num_words) != 0) {
+        alloc->release(alloc, paired, rel_cap);
+        alloc->release(alloc, order, rel_cap * sizeof(uint32_t));
+        alloc->release(alloc, sym_values, max_syms * sizeof(uint32_t));
+        alloc->release(alloc, index.names, max_syms * sizeof(char*));
+        alloc->release(alloc, index.slots, num_slots * sizeof(uint32_t));
+        return -1;
+    }
+
+    uint32_t num_syms = 2;
+    uint32_t strtab_size = 1;
+    for (uint32_t i = 0; i < num_defined; i++) {
+        get_symbol(symtbl, i, &name, &addr);
+        uint32_t* slot = find_slot(&index, name);
+        if (!*slot) {
+            *slot = num_syms;
+            index.names[num_syms] = name;
+            sym_values[num_syms++] = addr;
+            strtab_size += strlen(name) + 1;
+        }
+    }
+    uint32_t first_undefined = num_syms;
+    for (uint32_t i = 0; i < num_relocs; i++) {
+        get_symbol(reltbl, i, &name, &addr);
+        uint32_t* slot = find_slot(&index, name);
+        if (!*slot) {
+            *slot = num_syms;
+            index.names[num_syms] = name;
+            sym_values[num_syms++] = 0;
+            strtab_size += strlen(name) + 1;
+        }
+    }
+
+    uint32_t text_off = sizeof(Elf32_Ehdr);
+    uint32_t text_size = num_words * 4;
+    uint32_t rel_off = align4(text_off + text_size);
+    uint32_t rel_size = num_relocs * sizeof(Elf32_Rel);
+    uint32_t symtab_off = align4(rel_off + rel_size);
+    uint32_t symtab_size = num_syms * sizeof(Elf32_Sym);
+    uint32_t strtab_off = symtab_off + symtab_size;
+    uint32_t shstrtab_off = strtab_off + strtab_size;
+    uint32_t shdr_off = align4(shstrtab_off + sizeof(SHSTRTAB));
+    uint32_t file_size = shdr_off + NUM_SECTIONS * sizeof(Elf32_Shdr);
+
+    uint8_t* image = alloc->alloc(alloc, file_size);
+    if (!image) {
+        allocation_failed();
+    }
+    memset(image, 0, file_size);
+
+    uint8_t* ehdr = image;
+    memcpy(ehdr, ELFMAG, SELFMAG);
+    ehdr[EI_CLASS] = ELFCLASS32;
+    ehdr[EI_DATA] = ELFDATA2MSB;
+    ehdr[EI_VERSION] = EV_CURRENT;
+    ehdr[EI_OSABI] = ELFOSABI_SYSV;
+    put16(ehdr + 16, ET_REL);
+    put16(ehdr + 18, EM_MIPS);
+    put32(ehdr + 20, EV_CURRENT);
+    put32(ehdr + 32, shdr_off);
+    put32(ehdr + 36, ELF_MIPS_FLAGS);
+    put16(ehdr + 40, sizeof(Elf32_Ehdr));
+    put16(ehdr + 46, sizeof(Elf32_Shdr));
+    put16(ehdr + 48, NUM_SECTIONS);
+    put16(ehdr + 50, SEC_SHSTRTAB);
+
+    for (uint32_t i = 0; i < num_words; i++) {
+        put32(image + text_off + 4 * i, text[i]);
+    }
+
+    for (uint32_t i = 0; i < num_relocs; i++) {
+        uint32_t entry = order[i];
+        get_symbol(reltbl, entry, &name, &addr);
+        uint8_t* rel = image + rel_off + i * sizeof(Elf32_Rel);
+        put32(rel, addr);
+        put32(rel + 4, ELF32_R_INFO(*find_slot(&index, name),
+            ELF_RELOC_TYPES[get_reloc_type(reltbl, entry)]));
+        if (paired[entry] == PAIRED_ADDIU) {
+            uint8_t* word = image + text_off + addr;
+            put32(word, (text[addr / 4] & 0x03FFFFFF) | OPCODE_ADDIU << 26);
+        }
+    }
+
+    uint8_t* sym = image + symtab_off + sizeof(Elf32_Sym);
+    sym[12] = ELF32_ST_INFO(STB_LOCAL, STT_SECTION);
+    put16(sym + 14, SEC_TEXT);
+    char* strtab = (char*) image + strtab_off;
+    uint32_t str_pos = 1;
+    for (uint32_t i = 2; i < num_syms; i++) {
+        sym = image + symtab_off + i * sizeof(Elf32_Sym);
+        size_t len = strlen(index.names[i]) + 1;
+        memcpy(strtab + str_pos, index.names[i], len);
+        put32(sym, str_pos);
+        put32(sym + 4, sym_values[i]);
+        sym[12] = ELF32_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+        put16(sym + 14, i < first_undefined ? SEC_TEXT : SHN_UNDEF);
+        str_pos += len;
+    }
+
+    memcpy(image + shstrtab_off, SHSTRTAB, sizeof(SHSTRTAB));
+
+    uint8_t* shdr = image + shdr_off;
+    put_section(shdr + SEC_TEXT * sizeof(Elf32_Shdr), SHSTRTAB_TEXT, SHT_PROGBITS,
+        SHF_ALLOC | SHF_EXECINSTR, text_off, text_size, 0, 0, 4, 0);
+    put_section(shdr + SEC_REL_TEXT * sizeof(Elf32_Shdr), SHSTRTAB_REL_TEXT, SHT_REL,
+        SHF_INFO_LINK, rel_off, rel_size, SEC_SYMTAB, SEC_TEXT, 4, sizeof(Elf32_Rel));
+    put_section(shdr + SEC_SYMTAB * sizeof(Elf32_Shdr), SHSTRTAB_SYMTAB, SHT_SYMTAB, 0,
+        symtab_off, symtab_size, SEC_STRTAB, 2, 4, sizeof(Elf32_Sym));
+    put_section(shdr + SEC_STRTAB * sizeof(Elf32_Shdr), SHSTRTAB_STRTAB, SHT_STRTAB, 0,
+        strtab_off, strtab_size, 0, 0, 1, 0);
+    put_section(shdr + SEC_SHSTRTAB * sizeof(Elf32_Shdr), SHSTRTAB_SHSTRTAB, SHT_STRTAB, 0,
+        shstrtab_off, sizeof(SHSTRTAB), 0, 0, 1, 0);
+
+    int err = fwrite(image, 1, file_size, output) == file_size ? 0 : -1;
+    if (err) {
+        write_to_log("Error: unable to write object file\n");
+    }
+
+    alloc->release(alloc, image, file_size);
+    alloc->release(alloc, paired, rel_cap);
+    alloc->release(alloc, order, rel_cap * sizeof(uint32_t));
+    alloc->release(alloc, sym_values, max_syms * sizeof(uint32_t));
+    alloc->release(alloc, index.names, max_syms * sizeof(char*));
+    alloc->release(alloc, index.slots, num_slots * sizeof(uint32_t));
+    return err;
+}
@@ -0,0 +1,16 @@
+#ifndef ELF_WRITER_H
+#define ELF_WRITER_H
+
+#include <stdint.h>
+
+/* ELF32 big-endian MIPS relocatable objects.
+
+   write_elf_object() lays the whole file out in one buffer: the ELF header,
+   .text, .rel.text, .symtab, .strtab, .shstrtab and then the section header
+   table, each section aligned so the file can be mapped and used in place.
+ */
+
+int write_elf_object(FILE* output, const uint32_t* text, uint32_t num_words,
+    SymbolTable* symtbl, SymbolTable* reltbl);
+
+#endif
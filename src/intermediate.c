@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate.h"
+#include "intermediate.h"
+
+static const uint32_t INITIAL_STRTAB_CAP = 256;
+
+/* Returns 1 if INPUT starts with a binary intermediate header and 0
+   otherwise. Leaves INPUT positioned at its start.
+ */
+int is_binary_int(FILE* input) {
+    char magic[sizeof(INT_MAGIC)];
+    rewind(input);
+    size_t read = fread(magic, 1, sizeof(magic), input);
+    rewind(input);
+    return read == sizeof(magic) && memcmp(magic, INT_MAGIC, sizeof(magic)) == 0;
+}
+
+/* Appends LEN bytes of STR and a terminating NUL to the writer's string
+   table and returns the offset they were stored at. */
+static uint32_t add_string(IntWriter* writer, const char* str, size_t len) {
+    Allocator* alloc = get_table_allocator();
+    while (writer->strtab_len + len + 1 > writer->strtab_cap) {
+        uint32_t new_cap = writer->strtab_cap * 2;
+        char* new_strtab = alloc->resize(alloc, writer->strtab, writer->strtab_cap, new_cap);
+        if (!new_strtab) {
+            allocation_failed();
+        }
+        writer->strtab = new_strtab;
+        writer->strtab_cap = new_cap;
+    }
+    uint32_t offset = writer->strtab_len;
+    memcpy(writer->strtab + offset, str, len);
+    writer->strtab[offset + len] = '\0';
+    writer->strtab_len += len + 1;
+    return offset;
+}
+
+/* Starts a binary intermediate file on OUTPUT, which must be seekable since
+   the header is rewritten by close_int_writer(). Returns 0 on success and -1
+   on error.
+ */
+int open_int_writer(IntWriter* writer, FILE* output) {
+    IntHeader header;
+    memset(&header, 0, sizeof(header));
+    writer->output = output;
+    writer->num_records = 0;
+    writer->strtab_len = 0;
+    writer->strtab_cap = INITIAL_STRTAB_CAP;
+    Allocator* alloc = get_table_allocator();
+    writer->strtab = alloc->alloc(alloc, writer->strtab_cap);
+    if (!writer->strtab) {
+        allocation_failed();
+    }
+    return fwrite(&header, sizeof(header), 1, output) == 1 ? 0 : -1;
+}
+
+static int write_record(IntWriter* writer, const IntRecord* record) {
+    writer->num_records++;
+    return fwrite(record, sizeof(IntRecord), 1, writer->output) == 1 ? 0 : -1;
+}
+
+/* Appends the text of an instruction, in the form log_inst() prints it. */
+static uint32_t add_inst_text(IntWriter* writer, const char* name, char** args, int num_args) {
+    uint32_t offset = add_string(writer, name, strlen(name));
+    for (int i = 0; i < num_args; i++) {
+        writer->strtab[writer->strtab_len - 1] = ' ';
+        add_string(writer, args[i], strlen(args[i]));
+    }
+    return offset;
+}
+
+/* Writes the decoded instruction INST, which came from source line LINE.
+   ARGS and NUM_ARGS are the arguments it was decoded from; branches keep
+   their text after the target label since they can still fail in pass two. */
+int write_int_inst(IntWriter* writer, const Instr* inst, char** args, int num_args,
+    uint32_t line) {
+    IntRecord record;
+    record.id = inst->id;
+    record.rs = inst->rs;
+    record.rt = inst->rt;
+    record.rd = inst->rd;
+    record.imm = inst->imm;
+    record.sym = inst->label ? add_string(writer, inst->label, strlen(inst->label))
+                             : INT_NO_SYMBOL;
+    if (format_info(inst->fmt)->label == LABEL_BRANCH) {
+        add_inst_text(writer, inst_name(inst->id), args, num_args);
+    }
+    record.line = line;
+    return write_record(writer, &record);
+}
+
+/* Writes an instruction that failed to decode, keeping its text so that pass
+   two can report the error. */
+int write_int_invalid(IntWriter* writer, const char* name, char** args, int num_args,
+    uint32_t line) {
+    IntRecord record;
+    memset(&record, 0, sizeof(record));
+    record.id = INST_INVALID;
+    record.sym = add_inst_text(writer, name, args, num_args);
+    record.line = line;
+    return write_record(writer, &record);
+}
+
+/* Writes the string table, fills in the header and releases the writer's
+   memory. OUTPUT is left open. Returns 0 on success and -1 on error.
+ */
+int close_int_writer(IntWriter* writer) {
+    IntHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INT_MAGIC, sizeof(INT_MAGIC));
+    header.version = INT_VERSION;
+    header.num_records = writer->num_records;
+    header.strtab_offset = sizeof(IntHeader) + writer->num_records * sizeof(IntRecord);
+    header.strtab_size = writer->strtab_len;
+
+    int err = 0;
+    if (fwrite(writer->strtab, 1, writer->strtab_len, writer->output) != writer->strtab_len
+        || fseek(writer->output, 0, SEEK_SET) != 0
+        || fwrite(&header, sizeof(header), 1, writer->output) != 1
+        || fflush(writer->output) != 0) {
+        err = -1;
+    }
+    Allocator* alloc = get_table_allocator();
+    alloc->release(alloc, writer->strtab, writer->strtab_cap);
+    writer->strtab = NULL;
+    return err;
+}
+
+/* Returns 1 if every record of the mapped file at HEADER has a known ID and
+   its strings inside the string table, and 0 otherwise. The string table is
+   known to end in a NUL, so every string that starts in it ends in it. */
+static int records_valid(const IntHeader* header) {
+    const IntRecord* records = (const IntRecord*) (header + 1);
+    const char* strtab = (const char*) header + header->strtab_offset;
+    for (uint32_t i = 0; i < header->num_records; i++) {
+        const IntRecord* record = &records[i];
+        if (record->id >= NUM_INSTS && record->id != INST_INVALID) {
+            return 0;
+        }
+        if (record->sym == INT_NO_SYMBOL) {
+            continue;
+        }
+        if (record->sym >= header->strtab_size) {
+            return 0;
+        }
+        /* Branches keep their text after the target. */
+        Instr inst;
+        init_inst(&inst, record->id);
+        if (record->id != INST_INVALID && format_info(inst.fmt)->label == LABEL_BRANCH
+            && record->sym + strlen(strtab + record->sym) + 1 >= header->strtab_size) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Maps the binary intermediate file INPUT into IMAGE and checks that its
+   header and sections are consistent, and that every string offset in its
+   records lies inside the string table. Returns 0 on success and -1 on
+   error.
+ */
+int map_int_file(IntImage* image, FILE* input) {
+    struct stat st;
+    memset(image, 0, sizeof(IntImage));
+    if (fstat(fileno(input), &st) != 0 || st.st_size < (off_t) sizeof(IntHeader)) {
+        write_to_log("Error: truncated intermediate file\n");
+        return -1;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(input), 0);
+    if (map == MAP_FAILED) {
+        write_to_log("Error: unable to map intermediate file\n");
+        return -1;
+    }
+    const IntHeader* header = map;
+    uint64_t records_end = sizeof(IntHeader) + (uint64_t) header->num_records * sizeof(IntRecord);
+    if (memcmp(header->magic, INT_MAGIC, sizeof(INT_MAGIC)) != 0
+        || header->version != INT_VERSION
+        || records_end > header->strtab_offset
+        || (uint64_t) header->strtab_offset + header->strtab_size > (uint64_t) st.st_size
+        || (header->strtab_size && ((const char*) map)[header->strtab_offset
+            + header->strtab_size - 1] != '\0')
+        || !records_valid(header)) {
+        write_to_log("Error: malformed intermediate file\n");
+        munmap(map, st.st_size);
+        return -1;
+    }
+    image->map = map;
+    image->size = st.st_size;
+    image->header = header;
+    image->records = (const IntRecord*) (header + 1);
+    image->strtab = (const char*) map + header->strtab_offset;
+    return 0;
+}
+
+void unmap_int_file(IntImage* image) {
+    if (image->map) {
+        munmap(image->map, image->size);
+        image->map = NULL;
+    }
+}
+
+/* Rebuilds the instruction stored in RECORD, with its label pointing into
+   IMAGE's string table. */
+void record_to_inst(Instr* inst, const IntImage* image, const IntRecord* record) {
+    init_inst(inst, record->id);
+    inst->rs = record->rs;
+    inst->rt = record->rt;
+    inst->rd = record->rd;
+    inst->imm = record->imm;
+    inst->label = NULL;
+    if (record->sym != INT_NO_SYMBOL && record->sym < image->header->strtab_size) {
+        inst->label = image->strtab + record->sym;
+    }
+}
+
+/* Returns the text of the instruction stored in RECORD, for error messages.
+   Only invalid instructions and branches carry their text. */
+const char* record_text(const IntImage* image, const IntRecord* record) {
+    if (record->sym == INT_NO_SYMBOL || record->sym >= image->header->strtab_size) {
+        return "";
+    }
+    const char* str = image->strtab + record->sym;
+    if (record->id != INST_INVALID) {
+        str += strlen(str) + 1;
+    }
+    return str;
+}
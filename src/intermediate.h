@@ -0,0 +1,77 @@
+#ifndef INTERMEDIATE_H
+#define INTERMEDIATE_H
+
+#include <stdint.h>
+
+/* Binary intermediate format.
+
+   An alternative to the text .int file that carries instructions already
+   decoded by pass one, so that pass two can map the file and encode without
+   parsing. The layout, in host byte order, is an IntHeader, NUM_RECORDS
+   IntRecords, and then a string table of NUL-terminated names.
+ */
+
+#define INT_MAGIC "MIPSINT"
+#define INT_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_records;
+    uint32_t strtab_offset;
+    uint32_t strtab_size;
+} IntHeader;
+
+/* One expanded instruction. ID is an InstId, or INST_INVALID for a line that
+   failed to decode, in which case SYM locates the instruction's text so that
+   pass two can report it. Otherwise SYM locates the branch or jump target;
+   for branches the instruction's text follows the target in the string
+   table. IMM holds the immediate, memory offset or shift amount. LINE is the
+   source line the instruction came from. */
+typedef struct {
+    uint8_t id;
+    uint8_t rs, rt, rd;
+    int32_t imm;
+    uint32_t sym;
+    uint32_t line;
+} IntRecord;
+
+#define INT_NO_SYMBOL 0xFFFFFFFFu
+
+typedef struct {
+    FILE* output;
+    uint32_t num_records;
+    char* strtab;
+    uint32_t strtab_len;
+    uint32_t strtab_cap;
+} IntWriter;
+
+typedef struct {
+    void* map;
+    size_t size;
+    const IntHeader* header;
+    const IntRecord* records;
+    const char* strtab;
+} IntImage;
+
+int is_binary_int(FILE* input);
+
+int open_int_writer(IntWriter* writer, FILE* output);
+
+int write_int_inst(IntWriter* writer, const Instr* inst, char** args, int num_args,
+    uint32_t line);
+
+int write_int_invalid(IntWriter* writer, const char* name, char** args, int num_args,
+    uint32_t line);
+
+int close_int_writer(IntWriter* writer);
+
+int map_int_file(IntImage* image, FILE* input);
+
+void unmap_int_file(IntImage* image);
+
+void record_to_inst(Instr* inst, const IntImage* image, const IntRecord* record);
+
+const char* record_text(const IntImage* image, const IntRecord* record);
+
+#endif
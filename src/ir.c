@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "tables.h"
+#include "translate.h"
+#include "reloc.h"
+#include "ir.h"
+
+/* Allocates an empty block from the table allocator. Returns NULL if there is
+   not enough memory. */
+InstBlock* create_block() {
+    Allocator* alloc = get_table_allocator();
+    InstBlock* block = alloc->alloc(alloc, sizeof(InstBlock));
+    if (block) {
+        block->len = 0;
+    }
+    return block;
+}
+
+void free_block(InstBlock* block) {
+    Allocator* alloc = get_table_allocator();
+    alloc->release(alloc, block, sizeof(InstBlock));
+}
+
+/* Appends INST to BLOCK, which must not be full. A lui or ori with a label
+   keeps only the label, since its immediate comes from a relocation, and a
+   branch gets its immediate in encode_block(). */
+void add_to_block(InstBlock* block, const Instr* inst) {
+    uint32_t i = block->len++;
+    const FormatInfo* info = format_info(inst->fmt);
+    int shamt = info && info->shamt;
+    block->id[i] = inst->id;
+    block->fmt[i] = inst->fmt;
+    block->opcode[i] = inst->opcode;
+    block->funct[i] = inst->funct;
+    block->rs[i] = inst->rs;
+    block->rt[i] = inst->rt;
+    block->rd[i] = inst->rd;
+    block->shamt[i] = shamt ? inst->imm : 0;
+    block->imm[i] = shamt || inst->label ? 0 : inst->imm;
+    block->label[i] = inst->label;
+}
+
+/* Appends an instruction that failed to decode, so that encode_block()
+   reports it in order with the rest. */
+void add_invalid_to_block(InstBlock* block) {
+    Instr inst;
+    init_inst(&inst, INST_INVALID);
+    add_to_block(block, &inst);
+}
+
+/* Resolves the labels of BLOCK in instruction order: branches get their
+   offset from SYMTBL and every other label is added to RELTBL. Sets BAD[I]
+   for instructions that cannot be encoded. */
+static void resolve_labels(InstBlock* block, uint32_t addr, uint8_t* bad,
+    SymbolTable* symtbl, SymbolTable* reltbl) {
+    for (uint32_t i = 0; i < block->len; i++, addr += 4) {
+        bad[i] = block->id[i] >= NUM_INSTS;
+        const char* label = block->label[i];
+        if (!label || bad[i]) {
+            continue;
+        }
+        const FormatInfo* info = format_info(block->fmt[i]);
+        switch (info ? info->label : LABEL_NONE) {
+            case LABEL_BRANCH: {
+                int64_t target = get_addr_for_symbol(symtbl, label);
+                int64_t distance = (target - (int64_t) addr - 4) / 4;
+                if (target == -1 || (target - addr) % 4 != 0
+                    || distance < -32768 || distance > 32767) {
+                    bad[i] = 1;
+                } else {
+                    block->imm[i] = (int32_t) distance;
+                }
+                break;
+            }
+            case LABEL_HI16:
+            case LABEL_LO16:
+                bad[i] = !reltbl || add_reloc(reltbl, label, addr,
+                    info->label == LABEL_HI16 ? R_HI16 : R_LO16) != 0;
+                break;
+            case LABEL_JUMP:
+                bad[i] = !reltbl || add_reloc(reltbl, label, addr, R_26) != 0;
+                break;
+            default:
+                bad[i] = 1;
+                break;
+        }
+    }
+}
+
+/* Zeroes the slots after the last instruction of BLOCK up to a multiple of
+   IR_VECTOR and returns that length. The packing loop then runs a whole
+   number of vectors and needs no scalar tail, which -O2 requires before it
+   vectorizes a loop. */
+static uint32_t pad_block(InstBlock* block, uint8_t* bad) {
+    uint32_t padded = (block->len + IR_VECTOR - 1) & ~(IR_VECTOR - 1);
+    for (uint32_t i = block->len; i < padded; i++) {
+        block->opcode[i] = block->funct[i] = 0;
+        block->rs[i] = block->rt[i] = block->rd[i] = block->shamt[i] = 0;
+        block->imm[i] = 0;
+        bad[i] = 0;
+    }
+    return padded;
+}
+
+/* Encodes BLOCK, whose first instruction is at byte offset ADDR, into WORDS.
+   Labels are resolved as encode_inst() does. Each word is then packed in one
+   pass over the field arrays, which also checks that every field fits. BAD[I]
+   is set for each instruction that could not be encoded; its word is
+   meaningless. WORDS and BAD must have room for IR_BLOCK_SIZE entries.
+   Returns the number of such instructions.
+ */
+uint32_t encode_block(InstBlock* block, uint32_t addr, uint32_t* restrict words,
+    uint8_t* restrict bad, SymbolTable* symtbl, SymbolTable* reltbl) {
+    resolve_labels(block, addr, bad, symtbl, reltbl);
+
+    const uint8_t* restrict opcode = block->opcode;
+    const uint8_t* restrict funct = block->funct;
+    const uint8_t* restrict rs = block->rs;
+    const uint8_t* restrict rt = block->rt;
+    const uint8_t* restrict rd = block->rd;
+    const uint8_t* restrict shamt = block->shamt;
+    const int32_t* restrict imm = block->imm;
+    uint32_t len = pad_block(block, bad);
+    uint32_t num_bad = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        words[i] = (uint32_t) opcode[i] << 26 | (uint32_t) rs[i] << 21 | (uint32_t) rt[i] << 16
+            | (uint32_t) rd[i] << 11 | (uint32_t) shamt[i] << 6 | funct[i]
+            | ((uint32_t) imm[i] & 0xFFFF);
+        /* Immediates are signed or unsigned 16-bit values. */
+        uint32_t overflow = ((rs[i] | rt[i] | rd[i] | shamt[i]) >> 5 | funct[i] >> 6
+            | opcode[i] >> 6) != 0;
+        overflow |= (uint32_t) imm[i] + 32768 > 0x17FFF;
+        bad[i] |= overflow;
+        num_bad += bad[i];
+    }
+    return num_bad;
+}
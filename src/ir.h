@@ -0,0 +1,47 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdint.h>
+
+/* Struct-of-arrays instruction IR.
+
+   An InstBlock holds up to IR_BLOCK_SIZE decoded instructions, one array per
+   field, so that encode_block() can pack a whole block in one branch-free
+   loop that the compiler vectorizes. add_to_block() zeroes the fields an
+   instruction's format does not use, which makes every word the OR of all
+   fields shifted into place whatever the format. LABEL is the branch or
+   jump target, or the label of a lui/ori, and NULL otherwise.
+ */
+
+#define IR_BLOCK_SIZE 4096
+
+/* encode_block() packs a multiple of IR_VECTOR instructions at a time. Both
+   sizes are powers of two. */
+#define IR_VECTOR 16
+
+typedef struct {
+    uint8_t id[IR_BLOCK_SIZE];
+    uint8_t fmt[IR_BLOCK_SIZE];
+    uint8_t opcode[IR_BLOCK_SIZE];
+    uint8_t funct[IR_BLOCK_SIZE];
+    uint8_t rs[IR_BLOCK_SIZE];
+    uint8_t rt[IR_BLOCK_SIZE];
+    uint8_t rd[IR_BLOCK_SIZE];
+    uint8_t shamt[IR_BLOCK_SIZE];
+    int32_t imm[IR_BLOCK_SIZE];
+    const char* label[IR_BLOCK_SIZE];
+    uint32_t len;
+} InstBlock;
+
+InstBlock* create_block();
+
+void free_block(InstBlock* block);
+
+void add_to_block(InstBlock* block, const Instr* inst);
+
+void add_invalid_to_block(InstBlock* block);
+
+uint32_t encode_block(InstBlock* block, uint32_t addr, uint32_t* restrict words,
+    uint8_t* restrict bad, SymbolTable* symtbl, SymbolTable* reltbl);
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef ISA_H
+#define ISA_H
+
+/* The instruction set, as X-macros.
+
+   Every supported instruction is one ISA_INSTRUCTIONS row, and every operand
+   layout one ISA_FORMATS row. translate.h and translate.c expand these into
+   the InstId and InstFormat enums, the mnemonic table, one operand decoder
+   per format and the per-format encoding flags, so adding an instruction
+   only takes a new row here. Each list is expanded with a macro X supplied
+   by the includer.
+
+   X(ID, NAME, FORMAT, OPCODE, FUNCT, RT)
+
+     ID names INST_<ID>. IDs are stored in binary intermediate files, so only
+     ever append rows. OPCODE and FUNCT are the fixed fields of the encoding.
+     RT is a fixed rt field for REGIMM instructions (whose rt selects the
+     operation) and 0 otherwise.
+ */
+#define ISA_INSTRUCTIONS(X) \
+    X(ADDU,    "addu",    RTYPE,   0x00, 0x21, 0x00) \
+    X(OR,      "or",      RTYPE,   0x00, 0x25, 0x00) \
+    X(SLT,     "slt",     RTYPE,   0x00, 0x2a, 0x00) \
+    X(SLTU,    "sltu",    RTYPE,   0x00, 0x2b, 0x00) \
+    X(SLL,     "sll",     SHIFT,   0x00, 0x00, 0x00) \
+    X(JR,      "jr",      JR,      0x00, 0x08, 0x00) \
+    X(ADDIU,   "addiu",   ADDIU,   0x09, 0x00, 0x00) \
+    X(ORI,     "ori",     ORI,     0x0d, 0x00, 0x00) \
+    X(LUI,     "lui",     LUI,     0x0f, 0x00, 0x00) \
+    X(LB,      "lb",      MEM,     0x20, 0x00, 0x00) \
+    X(LBU,     "lbu",     MEM,     0x24, 0x00, 0x00) \
+    X(LW,      "lw",      MEM,     0x23, 0x00, 0x00) \
+    X(SB,      "sb",      MEM,     0x28, 0x00, 0x00) \
+    X(SW,      "sw",      MEM,     0x2b, 0x00, 0x00) \
+    X(BEQ,     "beq",     BRANCH,  0x04, 0x00, 0x00) \
+    X(BNE,     "bne",     BRANCH,  0x05, 0x00, 0x00) \
+    X(J,       "j",       JUMP,    0x02, 0x00, 0x00) \
+    X(JAL,     "jal",     JUMP,    0x03, 0x00, 0x00) \
+    X(ADD,     "add",     RTYPE,   0x00, 0x20, 0x00) \
+    X(SUB,     "sub",     RTYPE,   0x00, 0x22, 0x00) \
+    X(SUBU,    "subu",    RTYPE,   0x00, 0x23, 0x00) \
+    X(AND,     "and",     RTYPE,   0x00, 0x24, 0x00) \
+    X(XOR,     "xor",     RTYPE,   0x00, 0x26, 0x00) \
+    X(NOR,     "nor",     RTYPE,   0x00, 0x27, 0x00) \
+    X(MOVZ,    "movz",    RTYPE,   0x00, 0x0a, 0x00) \
+    X(MOVN,    "movn",    RTYPE,   0x00, 0x0b, 0x00) \
+    X(SRL,     "srl",     SHIFT,   0x00, 0x02, 0x00) \
+    X(SRA,     "sra",     SHIFT,   0x00, 0x03, 0x00) \
+    X(SLLV,    "sllv",    SHIFTV,  0x00, 0x04, 0x00) \
+    X(SRLV,    "srlv",    SHIFTV,  0x00, 0x06, 0x00) \
+    X(SRAV,    "srav",    SHIFTV,  0x00, 0x07, 0x00) \
+    X(JALR,    "jalr",    JALR,    0x00, 0x09, 0x00) \
+    X(SYSCALL, "syscall", NONE,    0x00, 0x0c, 0x00) \
+    X(BREAK,   "break",   NONE,    0x00, 0x0d, 0x00) \
+    X(SYNC,    "sync",    NONE,    0x00, 0x0f, 0x00) \
+    X(MFHI,    "mfhi",    MFHI,    0x00, 0x10, 0x00) \
+    X(MTHI,    "mthi",    JR,      0x00, 0x11, 0x00) \
+    X(MFLO,    "mflo",    MFHI,    0x00, 0x12, 0x00) \
+    X(MTLO,    "mtlo",    JR,      0x00, 0x13, 0x00) \
+    X(MULT,    "mult",    MULDIV,  0x00, 0x18, 0x00) \
+    X(MULTU,   "multu",   MULDIV,  0x00, 0x19, 0x00) \
+    X(DIV,     "div",     MULDIV,  0x00, 0x1a, 0x00) \
+    X(DIVU,    "divu",    MULDIV,  0x00, 0x1b, 0x00) \
+    X(TGE,     "tge",     MULDIV,  0x00, 0x30, 0x00) \
+    X(TGEU,    "tgeu",    MULDIV,  0x00, 0x31, 0x00) \
+    X(TLT,     "tlt",     MULDIV,  0x00, 0x32, 0x00) \
+    X(TLTU,    "tltu",    MULDIV,  0x00, 0x33, 0x00) \
+    X(TEQ,     "teq",     MULDIV,  0x00, 0x34, 0x00) \
+    X(TNE,     "tne",     MULDIV,  0x00, 0x36, 0x00) \
+    X(MADD,    "madd",    MULDIV,  0x1c, 0x00, 0x00) \
+    X(MADDU,   "maddu",   MULDIV,  0x1c, 0x01, 0x00) \
+    X(MUL,     "mul",     RTYPE,   0x1c, 0x02, 0x00) \
+    X(MSUB,    "msub",    MULDIV,  0x1c, 0x04, 0x00) \
+    X(MSUBU,   "msubu",   MULDIV,  0x1c, 0x05, 0x00) \
+    X(CLZ,     "clz",     CLZ,     0x1c, 0x20, 0x00) \
+    X(CLO,     "clo",     CLZ,     0x1c, 0x21, 0x00) \
+    X(ADDI,    "addi",    ADDIU,   0x08, 0x00, 0x00) \
+    X(SLTI,    "slti",    ADDIU,   0x0a, 0x00, 0x00) \
+    X(SLTIU,   "sltiu",   ADDIU,   0x0b, 0x00, 0x00) \
+    X(ANDI,    "andi",    LOGIC,   0x0c, 0x00, 0x00) \
+    X(XORI,    "xori",    LOGIC,   0x0e, 0x00, 0x00) \
+    X(LH,      "lh",      MEM,     0x21, 0x00, 0x00) \
+    X(LWL,     "lwl",     MEM,     0x22, 0x00, 0x00) \
+    X(LHU,     "lhu",     MEM,     0x25, 0x00, 0x00) \
+    X(LWR,     "lwr",     MEM,     0x26, 0x00, 0x00) \
+    X(SH,      "sh",      MEM,     0x29, 0x00, 0x00) \
+    X(SWL,     "swl",     MEM,     0x2a, 0x00, 0x00) \
+    X(SWR,     "swr",     MEM,     0x2e, 0x00, 0x00) \
+    X(LL,      "ll",      MEM,     0x30, 0x00, 0x00) \
+    X(SC,      "sc",      MEM,     0x38, 0x00, 0x00) \
+    X(BLEZ,    "blez",    BRANCHZ, 0x06, 0x00, 0x00) \
+    X(BGTZ,    "bgtz",    BRANCHZ, 0x07, 0x00, 0x00) \
+    X(BLTZ,    "bltz",    BRANCHZ, 0x01, 0x00, 0x00) \
+    X(BGEZ,    "bgez",    BRANCHZ, 0x01, 0x00, 0x01) \
+    X(BLTZAL,  "bltzal",  BRANCHZ, 0x01, 0x00, 0x10) \
+    X(BGEZAL,  "bgezal",  BRANCHZ, 0x01, 0x00, 0x11) \
+    X(TGEI,    "tgei",    TRAPI,   0x01, 0x00, 0x08) \
+    X(TGEIU,   "tgeiu",   TRAPI,   0x01, 0x00, 0x09) \
+    X(TLTI,    "tlti",    TRAPI,   0x01, 0x00, 0x0a) \
+    X(TLTIU,   "tltiu",   TRAPI,   0x01, 0x00, 0x0b) \
+    X(TEQI,    "teqi",    TRAPI,   0x01, 0x00, 0x0c) \
+    X(TNEI,    "tnei",    TRAPI,   0x01, 0x00, 0x0e)
+
+/* X(FORMAT, OPERAND1, OPERAND2, OPERAND3, LABEL)
+
+   The operands in source order, padded with NONE, and what a label operand
+   turns into (see LabelUse in translate.h). Operand kinds are RD, RS and RT
+   for a register stored in that field, RDT for one stored in both rd and rt,
+   LABEL for a branch or jump target, and the immediates of ISA_IMMEDIATES.
+ */
+#define ISA_FORMATS(X) \
+    X(RTYPE,   RD,    RS,    RT,    NONE) \
+    X(SHIFT,   RD,    RT,    SHAMT, NONE) \
+    X(SHIFTV,  RD,    RT,    RS,    NONE) \
+    X(JR,      RS,    NONE,  NONE,  NONE) \
+    X(JALR,    RD,    RS,    NONE,  NONE) \
+    X(MFHI,    RD,    NONE,  NONE,  NONE) \
+    X(MULDIV,  RS,    RT,    NONE,  NONE) \
+    X(CLZ,     RDT,   RS,    NONE,  NONE) \
+    X(NONE,    NONE,  NONE,  NONE,  NONE) \
+    X(ADDIU,   RT,    RS,    SIMM,  NONE) \
+    X(ORI,     RT,    RS,    UIMM,  LO16) \
+    X(LOGIC,   RT,    RS,    UIMM,  NONE) \
+    X(LUI,     RT,    HIMM,  NONE,  HI16) \
+    X(MEM,     RT,    SIMM,  RS,    NONE) \
+    X(BRANCH,  RS,    RT,    LABEL, BRANCH) \
+    X(BRANCHZ, RS,    LABEL, NONE,  BRANCH) \
+    X(TRAPI,   RS,    SIMM,  NONE,  NONE) \
+    X(JUMP,    LABEL, NONE,  NONE,  JUMP)
+
+/* X(KIND, LOWER, UPPER)
+
+   Immediate operand kinds and their inclusive ranges. SHAMT is placed in
+   the shift amount field and the others in the low 16 bits. An immediate
+   operand of a format whose LABEL is not NONE may be a label instead.
+   HIMM takes both signed and unsigned halves, since li splits negative
+   numbers into a negative upper half.
+ */
+#define ISA_IMMEDIATES(X) \
+    X(SHAMT, 0, 31) \
+    X(SIMM, -32768, 32767) \
+    X(UIMM, 0, 65535) \
+    X(HIMM, -32768, 65535)
+
+#endif
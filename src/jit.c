@@ -0,0 +1,661 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+#include "utils.h"
+#include "tables.h"
+#include "translate.h"
+#include "object.h"
+#include "sim.h"
+#include "jit.h"
+
+#if JIT_SUPPORTED
+
+/* Translated code is written to one buffer of this size plus a share per
+   instruction; once it is full, untranslated code is only interpreted. */
+static const size_t JIT_BASE_SIZE = 1 << 20;
+static const size_t JIT_BYTES_PER_INST = 256;
+
+/* Blocks stop after this many instructions, and before an instruction
+   unless the buffer has room for two of the largest translations plus a
+   stub for every side exit so far. */
+enum { MAX_BLOCK_INSTS = 256, MAX_INST_BYTES = 192, SIDE_EXIT_BYTES = 17,
+    MAX_SIDE_EXITS = 2 * MAX_BLOCK_INSTS };
+
+static void* alloc_zeroed(size_t size) {
+    Allocator* alloc = get_table_allocator();
+    void* ptr = alloc->alloc(alloc, size);
+    if (!ptr) {
+        allocation_failed();
+    }
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static void release(void* ptr, size_t size) {
+    if (ptr) {
+        Allocator* alloc = get_table_allocator();
+        alloc->release(alloc, ptr, size);
+    }
+}
+
+/* What translated code returns: the next instruction in the low half of PC,
+   with one more than the start of the block in the high half if it left
+   before that instruction, and the exit to patch in SITE (or NULL). */
+typedef struct {
+    uint64_t pc;
+    uint8_t* site;
+} JitExit;
+
+typedef JitExit (*JitEntry)(Simulator* sim, uint64_t* entries, uint8_t* mem,
+    uint64_t* budget, void* block);
+
+/*******************************
+ * x86-64 encoding
+ *******************************/
+
+/* x86 registers. Translated code keeps the Simulator in rbx, the block
+   entry counts in r12, data memory in r13, a pointer to the jump budget in
+   r14 and the budget itself in r15. */
+enum { EAX = 0, ECX = 1, EDX = 2 };
+
+/* Condition codes. */
+enum { CC_O = 0x0, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7,
+    CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+typedef struct {
+    uint8_t* buf;
+    size_t len;
+} Emitter;
+
+static void emit8(Emitter* e, uint8_t byte) {
+    e->buf[e->len++] = byte;
+}
+
+static void emit32(Emitter* e, uint32_t value) {
+    memcpy(e->buf + e->len, &value, 4);
+    e->len += 4;
+}
+
+static void emit_bytes(Emitter* e, const char* bytes, size_t n) {
+    memcpy(e->buf + e->len, bytes, n);
+    e->len += n;
+}
+
+/* Guest register numbers for hi and lo, after SIM_ZERO_SINK. */
+#define GUEST_HI (SIM_ZERO_SINK + 1)
+#define GUEST_LO (SIM_ZERO_SINK + 2)
+
+/* Byte offset of guest register REG from rbx. */
+static uint32_t reg_offset(uint32_t reg) {
+    if (reg == GUEST_HI) {
+        return offsetof(Simulator, hi);
+    }
+    if (reg == GUEST_LO) {
+        return offsetof(Simulator, lo);
+    }
+    return offsetof(Simulator, regs) + 4 * reg;
+}
+
+/* Emits OPCODE with a ModRM operand of [rbx + offset of guest REG] and X86
+   in the reg field. */
+static void emit_rm(Emitter* e, uint8_t opcode, int x86, uint32_t reg) {
+    uint32_t disp = reg_offset(reg);
+    emit8(e, opcode);
+    if (disp < 128) {
+        emit8(e, 0x43 | x86 << 3);
+        emit8(e, disp);
+    } else {
+        emit8(e, 0x83 | x86 << 3);
+        emit32(e, disp);
+    }
+}
+
+static void emit_0f_rm(Emitter* e, uint8_t opcode, int x86, uint32_t reg) {
+    emit8(e, 0x0F);
+    emit_rm(e, opcode, x86, reg);
+}
+
+static void load_guest(Emitter* e, int x86, uint32_t reg) {
+    emit_rm(e, 0x8B, x86, reg);
+}
+
+/* Stores X86 to guest register REG; writes to $zero are dropped. */
+static void store_guest(Emitter* e, uint32_t reg, int x86) {
+    if (reg != SIM_ZERO_SINK) {
+        emit_rm(e, 0x89, x86, reg);
+    }
+}
+
+/* mov dword [guest REG], VALUE */
+static void store_guest_imm(Emitter* e, uint32_t reg, uint32_t value) {
+    if (reg != SIM_ZERO_SINK) {
+        emit_rm(e, 0xC7, 0, reg);
+        emit32(e, value);
+    }
+}
+
+/* op eax, imm32 in its short form: add 05, or 0D, and 25, xor 35, cmp 3D. */
+static void alu_eax_imm(Emitter* e, uint8_t opcode, uint32_t imm) {
+    emit8(e, opcode);
+    emit32(e, imm);
+}
+
+/* setcc al; movzx eax, al */
+static void set_eax(Emitter* e, int cc) {
+    emit8(e, 0x0F);
+    emit8(e, 0x90 | cc);
+    emit8(e, 0xC0);
+    emit_bytes(e, "\x0F\xB6\xC0", 3);
+}
+
+/* Emits jcc rel32 (or jmp if CC is -1) with a zero offset and returns where
+   the offset goes. */
+static size_t emit_jump(Emitter* e, int cc) {
+    if (cc < 0) {
+        emit8(e, 0xE9);
+    } else {
+        emit8(e, 0x0F);
+        emit8(e, 0x80 | cc);
+    }
+    emit32(e, 0);
+    return e->len - 4;
+}
+
+/* Points the rel32 at FIXUP in E's buffer to TARGET. */
+static void patch_rel32(uint8_t* buf, size_t fixup, const uint8_t* target) {
+    int32_t rel = (int32_t) (target - (buf + fixup + 4));
+    memcpy(buf + fixup, &rel, 4);
+}
+
+/*******************************
+ * Translation
+ *******************************/
+
+/* The entry trampoline, called as a JitEntry, and the epilogue every exit
+   jumps to. */
+static const char TRAMPOLINE[] =
+    "\x53\x41\x54\x41\x55\x41\x56\x41\x57"  /* push rbx, r12, r13, r14, r15 */
+    "\x48\x89\xFB"                          /* mov rbx, rdi */
+    "\x49\x89\xF4"                          /* mov r12, rsi */
+    "\x49\x89\xD5"                          /* mov r13, rdx */
+    "\x49\x89\xCE"                          /* mov r14, rcx */
+    "\x4D\x8B\x3E"                          /* mov r15, [r14] */
+    "\x41\xFF\xE0"                          /* jmp r8 */
+    "\x4D\x89\x3E"                          /* epilogue: mov [r14], r15 */
+    "\x41\x5F\x41\x5E\x41\x5D\x41\x5C\x5B"  /* pop r15, r14, r13, r12, rbx */
+    "\xC3";                                 /* ret */
+
+enum { JIT_EPILOGUE = 27, JIT_PROLOGUE_SIZE = 64 };
+
+typedef struct {
+    size_t fixup;
+    uint32_t pc;
+} SideExit;
+
+typedef struct {
+    Jit* jit;
+    Emitter e;
+    uint8_t* epilogue;
+    uint32_t start;
+    SideExit side[MAX_SIDE_EXITS];
+    uint32_t num_side;
+} Block;
+
+/* Jumps to a side exit that leaves the block before instruction PC if
+   condition CC holds. */
+static void side_exit_if(Block* b, int cc, uint32_t pc) {
+    b->side[b->num_side].fixup = emit_jump(&b->e, cc);
+    b->side[b->num_side].pc = pc;
+    b->num_side++;
+}
+
+/* Emits an exit to instruction TARGET that the dispatcher may later patch
+   into a jump straight to TARGET's block:
+       mov eax, TARGET; lea rdx, [rip - 12]; jmp epilogue
+   The five bytes of the mov are what gets overwritten. */
+static void direct_exit(Block* b, uint32_t target) {
+    Emitter* e = &b->e;
+    emit8(e, 0xB8);
+    emit32(e, target);
+    emit_bytes(e, "\x48\x8D\x15\xF4\xFF\xFF\xFF", 7);
+    patch_rel32(e->buf, emit_jump(e, -1), b->epilogue);
+}
+
+/* Emits the exit of a taken branch or jump to TARGET, which spends one unit
+   of the jump budget and returns to the dispatcher if none is left. */
+static void taken_exit(Block* b, uint32_t target) {
+    Emitter* e = &b->e;
+    emit_bytes(e, "\x49\xFF\xCF", 3);               /* dec r15 */
+    size_t over = emit_jump(e, CC_NE);
+    emit8(e, 0xB8);                                 /* mov eax, TARGET */
+    emit32(e, target);
+    emit_bytes(e, "\x31\xD2", 2);                   /* xor edx, edx */
+    patch_rel32(e->buf, emit_jump(e, -1), b->epilogue);
+    patch_rel32(e->buf, over, e->buf + e->len);
+    direct_exit(b, target);
+}
+
+/* Emits a jump through the entry table to the instruction whose address is
+   in guest register RS, leaving before PC if it is not in .text. LINK is
+   the register jalr writes the return address to, or SIM_ZERO_SINK. */
+static void indirect_exit(Block* b, uint32_t pc, uint32_t rs, uint32_t link) {
+    Emitter* e = &b->e;
+    load_guest(e, EAX, rs);
+    emit_bytes(e, "\xA8\x03", 2);                   /* test al, 3 */
+    side_exit_if(b, CC_NE, pc);
+    emit_bytes(e, "\xC1\xE8\x02", 3);               /* shr eax, 2 */
+    alu_eax_imm(e, 0x3D, b->jit->sim->len);         /* cmp eax, len */
+    side_exit_if(b, CC_A, pc);
+    store_guest_imm(e, link, (pc + 1) * 4);
+    emit_bytes(e, "\x49\xFF\xCF", 3);               /* dec r15 */
+    size_t out = emit_jump(e, CC_E);
+    emit_bytes(e, "\x48\xB9", 2);                   /* mov rcx, entry table */
+    uint64_t table = (uint64_t) (uintptr_t) b->jit->entry;
+    memcpy(e->buf + e->len, &table, 8);
+    e->len += 8;
+    emit_bytes(e, "\x48\x8B\x0C\xC1", 4);           /* mov rcx, [rcx + rax * 8] */
+    emit_bytes(e, "\x48\x85\xC9", 3);               /* test rcx, rcx */
+    size_t miss = emit_jump(e, CC_E);
+    emit_bytes(e, "\xFF\xE1", 2);                   /* jmp rcx */
+    patch_rel32(e->buf, out, e->buf + e->len);
+    patch_rel32(e->buf, miss, e->buf + e->len);
+    emit_bytes(e, "\x31\xD2", 2);                   /* xor edx, edx */
+    patch_rel32(e->buf, emit_jump(e, -1), b->epilogue);
+}
+
+/* Leaves eax holding the effective address of INST, checked to be SIZE
+   aligned and inside data memory. */
+static void effective_address(Block* b, const SimInst* inst, uint32_t pc, uint32_t size) {
+    Emitter* e = &b->e;
+    load_guest(e, EAX, inst->rs);
+    alu_eax_imm(e, 0x05, inst->imm);                /* add eax, imm */
+    if (size > 1) {
+        emit8(e, 0xA8);                             /* test al, size - 1 */
+        emit8(e, size - 1);
+        side_exit_if(b, CC_NE, pc);
+    }
+    alu_eax_imm(e, 0x3D, b->jit->sim->mem_size - size);
+    side_exit_if(b, CC_A, pc);
+}
+
+/* Conditional branch on flags already set: taken if CC holds. */
+static void branch_exit(Block* b, int cc, uint32_t pc, uint32_t target) {
+    size_t not_taken = emit_jump(&b->e, cc ^ 1);
+    taken_exit(b, target);
+    patch_rel32(b->e.buf, not_taken, b->e.buf + b->e.len);
+    direct_exit(b, pc + 1);
+}
+
+/* Translates the instruction at PC. Returns 1 if it was translated, 2 if it
+   also ended the block, and 0 if it cannot be translated. */
+static int translate_one(Block* b, uint32_t pc) {
+    const SimInst* inst = &b->jit->sim->code[pc];
+    Emitter* e = &b->e;
+    uint32_t dst = inst->dst;
+    switch (inst->op) {
+        /* Register arithmetic. */
+        case INST_ADDU: case INST_SUBU: case INST_AND: case INST_OR: case INST_XOR:
+        case INST_NOR: case INST_ADD: case INST_SUB: {
+            static const uint8_t OPCODE[NUM_INSTS] = {
+                [INST_ADDU] = 0x03, [INST_ADD] = 0x03, [INST_SUBU] = 0x2B, [INST_SUB] = 0x2B,
+                [INST_AND] = 0x23, [INST_OR] = 0x0B, [INST_NOR] = 0x0B, [INST_XOR] = 0x33,
+            };
+            load_guest(e, EAX, inst->rs);
+            emit_rm(e, OPCODE[inst->op], EAX, inst->rt);
+            if (inst->op == INST_ADD || inst->op == INST_SUB) {
+                side_exit_if(b, CC_O, pc);
+            }
+            if (inst->op == INST_NOR) {
+                emit_bytes(e, "\xF7\xD0", 2);       /* not eax */
+            }
+            store_guest(e, dst, EAX);
+            return 1;
+        }
+        case INST_SLT:
+        case INST_SLTU:
+            load_guest(e, ECX, inst->rs);
+            emit_rm(e, 0x3B, ECX, inst->rt);        /* cmp ecx, rt */
+            set_eax(e, inst->op == INST_SLT ? CC_L : CC_B);
+            store_guest(e, dst, EAX);
+            return 1;
+        case INST_MUL:
+            load_guest(e, EAX, inst->rs);
+            emit_0f_rm(e, 0xAF, EAX, inst->rt);     /* imul eax, rt */
+            store_guest(e, dst, EAX);
+            return 1;
+        case INST_MOVZ:
+        case INST_MOVN: {
+            emit_rm(e, 0x83, 7, inst->rt);          /* cmp dword rt, 0 */
+            emit8(e, 0);
+            size_t skip = emit_jump(e, inst->op == INST_MOVZ ? CC_NE : CC_E);
+            load_guest(e, EAX, inst->rs);
+            store_guest(e, dst, EAX);
+            patch_rel32(e->buf, skip, e->buf + e->len);
+            return 1;
+        }
+
+        /* Shifts. */
+        case INST_SLL: case INST_SRL: case INST_SRA: {
+            static const uint8_t EXT[NUM_INSTS] = {
+                [INST_SLL] = 4, [INST_SRL] = 5, [INST_SRA] = 7,
+            };
+            load_guest(e, EAX, inst->rt);
+            emit8(e, 0xC1);
+            emit8(e, 0xC0 | EXT[inst->op] << 3);
+            emit8(e, inst->imm);
+            store_guest(e, dst, EAX);
+            return 1;
+        }
+        case INST_SLLV: case INST_SRLV: case INST_SRAV: {
+            static const uint8_t EXT[NUM_INSTS] = {
+                [INST_SLLV] = 4, [INST_SRLV] = 5, [INST_SRAV] = 7,
+            };
+            load_guest(e, EAX, inst->rt);
+            load_guest(e, ECX, inst->rs);
+            emit8(e, 0xD3);
+            emit8(e, 0xC0 | EXT[inst->op] << 3);
+            store_guest(e, dst, EAX);
+            return 1;
+        }
+
+        /* hi and lo. */
+        case INST_MULT:
+        case INST_MULTU:
+            load_guest(e, EAX, inst->rs);
+            emit_rm(e, 0xF7, inst->op == INST_MULT ? 5 : 4, inst->rt);
+            emit_rm(e, 0x89, EAX, GUEST_LO);
+            emit_rm(e, 0x89, EDX, GUEST_HI);
+            return 1;
+        case INST_MFHI:
+        case INST_MFLO:
+            load_guest(e, EAX, inst->op == INST_MFHI ? GUEST_HI : GUEST_LO);
+            store_guest(e, dst, EAX);
+            return 1;
+        case INST_MTHI:
+        case INST_MTLO:
+            load_guest(e, EAX, inst->rs);
+            emit_rm(e, 0x89, EAX, inst->op == INST_MTHI ? GUEST_HI : GUEST_LO);
+            return 1;
+
+        /* Immediates. */
+        case INST_ADDIU: case INST_ADDI: case INST_ANDI: case INST_ORI: case INST_XORI: {
+            static const uint8_t OPCODE[NUM_INSTS] = {
+                [INST_ADDIU] = 0x05, [INST_ADDI] = 0x05, [INST_ANDI] = 0x25,
+                [INST_ORI] = 0x0D, [INST_XORI] = 0x35,
+            };
+            load_guest(e, EAX, inst->rs);
+            alu_eax_imm(e, OPCODE[inst->op], inst->imm);
+            if (inst->op == INST_ADDI) {
+                side_exit_if(b, CC_O, pc);
+            }
+            store_guest(e, dst, EAX);
+            return 1;
+        }
+        case INST_SLTI:
+        case INST_SLTIU:
+            load_guest(e, ECX, inst->rs);
+            emit_bytes(e, "\x81\xF9", 2);           /* cmp ecx, imm */
+            emit32(e, inst->imm);
+            set_eax(e, inst->op == INST_SLTI ? CC_L : CC_B);
+            store_guest(e, dst, EAX);
+            return 1;
+        case INST_LUI:
+            store_guest_imm(e, dst, inst->imm);
+            return 1;
+
+        /* Loads and stores; memory is big-endian. */
+        case INST_LW:
+            effective_address(b, inst, pc, 4);
+            emit_bytes(e, "\x41\x8B\x44\x05\x00", 5);   /* mov eax, [r13 + rax] */
+            emit_bytes(e, "\x0F\xC8", 2);               /* bswap eax */
+            store_guest(e, dst, EAX);
+            return 1;
+        case INST_LH:
+        case INST_LHU:
+            effective_address(b, inst, pc, 2);
+            emit_bytes(e, "\x41\x0F\xB7\x44\x05\x00", 6);   /* movzx eax, word [r13 + rax] */
+            emit_bytes(e, "\x66\xC1\xC0\x08", 4);           /* rol ax, 8 */
+            emit_bytes(e, inst->op == INST_LH ? "\x0F\xBF\xC0" : "\x0F\xB7\xC0", 3);
+            store_guest(e, dst, EAX);
+            return 1;
+        case INST_LB:
+        case INST_LBU:
+            effective_address(b, inst, pc, 1);
+            emit_bytes(e, inst->op == INST_LB ? "\x41\x0F\xBE\x44\x05\x00"
+                                              : "\x41\x0F\xB6\x44\x05\x00", 6);
+            store_guest(e, dst, EAX);
+            return 1;
+        case INST_SW:
+            effective_address(b, inst, pc, 4);
+            load_guest(e, ECX, inst->rt);
+            emit_bytes(e, "\x0F\xC9", 2);               /* bswap ecx */
+            emit_bytes(e, "\x41\x89\x4C\x05\x00", 5);   /* mov [r13 + rax], ecx */
+            return 1;
+        case INST_SH:
+            effective_address(b, inst, pc, 2);
+            load_guest(e, ECX, inst->rt);
+            emit_bytes(e, "\x66\xC1\xC1\x08", 4);           /* rol cx, 8 */
+            emit_bytes(e, "\x66\x41\x89\x4C\x05\x00", 6);   /* mov [r13 + rax], cx */
+            return 1;
+        case INST_SB:
+            effective_address(b, inst, pc, 1);
+            load_guest(e, ECX, inst->rt);
+            emit_bytes(e, "\x41\x88\x4C\x05\x00", 5);   /* mov [r13 + rax], cl */
+            return 1;
+
+        /* Branches and jumps end the block. */
+        case INST_BEQ:
+        case INST_BNE:
+            load_guest(e, EAX, inst->rs);
+            emit_rm(e, 0x3B, EAX, inst->rt);
+            branch_exit(b, inst->op == INST_BEQ ? CC_E : CC_NE, pc, inst->imm);
+            return 2;
+        case INST_BLEZ: case INST_BGTZ: case INST_BLTZ: case INST_BGEZ: {
+            static const uint8_t CC[NUM_INSTS] = {
+                [INST_BLEZ] = CC_LE, [INST_BGTZ] = CC_G, [INST_BLTZ] = CC_L, [INST_BGEZ] = CC_GE,
+            };
+            emit_rm(e, 0x83, 7, inst->rs);          /* cmp dword rs, 0 */
+            emit8(e, 0);
+            branch_exit(b, CC[inst->op], pc, inst->imm);
+            return 2;
+        }
+        case INST_JAL:
+            store_guest_imm(e, 31, (pc + 1) * 4);
+            /* fall through */
+        case INST_J:
+            taken_exit(b, inst->imm);
+            return 2;
+        case INST_JR:
+            indirect_exit(b, pc, inst->rs, SIM_ZERO_SINK);
+            return 2;
+        case INST_JALR:
+            indirect_exit(b, pc, inst->rs, dst);
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+/* Translates the block starting at instruction START. Returns its entry
+   point, or NULL if its first instruction cannot be translated or the
+   buffer is full. */
+static uint8_t* translate_block(Jit* jit, uint32_t start) {
+    Block* b = alloc_zeroed(sizeof(Block));
+    b->jit = jit;
+    b->start = start;
+    b->epilogue = jit->code + JIT_EPILOGUE;
+    b->e.buf = jit->code + jit->used;
+    size_t room = jit->size - jit->used;
+
+    uint32_t pc = start;
+    uint32_t end = start;
+    int ended = 0;
+    if (room >= 2 * MAX_INST_BYTES) {
+        /* inc qword [r12 + 8 * start] */
+        emit_bytes(&b->e, "\x49\xFF\x84\x24", 4);
+        emit32(&b->e, 8 * start);
+        while (pc < jit->sim->len && pc - start < MAX_BLOCK_INSTS
+            && b->e.len + 2 * MAX_INST_BYTES + (b->num_side + 2) * SIDE_EXIT_BYTES <= room) {
+            size_t before = b->e.len;
+            uint32_t sides = b->num_side;
+            int result = translate_one(b, pc);
+            if (result == 0) {
+                b->e.len = before;
+                b->num_side = sides;
+                break;
+            }
+            pc++;
+            if (result == 2) {
+                ended = 1;
+                break;
+            }
+        }
+        end = pc;
+    }
+    uint8_t* entry = NULL;
+    if (end > start) {
+        if (!ended) {
+            direct_exit(b, end);
+        }
+        /* Side exits: mov rax, (start + 1) << 32 | pc; xor edx, edx; jmp epilogue */
+        for (uint32_t k = 0; k < b->num_side; k++) {
+            patch_rel32(b->e.buf, b->side[k].fixup, b->e.buf + b->e.len);
+            uint64_t value = (uint64_t) (start + 1) << 32 | b->side[k].pc;
+            emit_bytes(&b->e, "\x48\xB8", 2);
+            memcpy(b->e.buf + b->e.len, &value, 8);
+            b->e.len += 8;
+            emit_bytes(&b->e, "\x31\xD2", 2);
+            patch_rel32(b->e.buf, emit_jump(&b->e, -1), b->epilogue);
+        }
+        entry = b->e.buf;
+        jit->used += b->e.len;
+        jit->block_end[start] = end;
+        jit->blocks++;
+    }
+    release(b, sizeof(Block));
+    return entry;
+}
+
+/* Adds the entry counts of translated blocks to the simulator's counts. */
+static void fold_entries(Jit* jit) {
+    Simulator* sim = jit->sim;
+    for (uint32_t start = 0; start < sim->len; start++) {
+        uint64_t count = jit->entries[start];
+        if (count) {
+            for (uint32_t i = start; i < jit->block_end[start]; i++) {
+                sim->counts[i] += count;
+            }
+            jit->entries[start] = 0;
+        }
+    }
+}
+
+#endif
+
+/* Prepares JIT to run SIM, which must not have started. Returns 0 on
+   success, or -1 if translation is not available, in which case run_jit()
+   still works but only interprets.
+ */
+int init_jit(Jit* jit, Simulator* sim) {
+    memset(jit, 0, sizeof(Jit));
+    jit->sim = sim;
+#if JIT_SUPPORTED
+    size_t size = JIT_BASE_SIZE + (size_t) sim->len * JIT_BYTES_PER_INST;
+    void* code = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        return -1;
+    }
+    jit->code = code;
+    jit->size = size;
+    memcpy(jit->code, TRAMPOLINE, sizeof(TRAMPOLINE) - 1);
+    jit->used = JIT_PROLOGUE_SIZE;
+    jit->entry = alloc_zeroed((sim->len + 2) * sizeof(void*));
+    jit->untranslatable = alloc_zeroed(sim->len + 2);
+    jit->block_end = alloc_zeroed((sim->len + 2) * sizeof(uint32_t));
+    jit->entries = alloc_zeroed((sim->len + 2) * sizeof(uint64_t));
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+void free_jit(Jit* jit) {
+#if JIT_SUPPORTED
+    if (jit->code) {
+        uint32_t n = jit->sim->len + 2;
+        munmap(jit->code, jit->size);
+        release(jit->entry, n * sizeof(void*));
+        release(jit->untranslatable, n);
+        release(jit->block_end, n * sizeof(uint32_t));
+        release(jit->entries, n * sizeof(uint64_t));
+    }
+#endif
+    memset(jit, 0, sizeof(Jit));
+}
+
+/* Runs JIT's simulator like run_simulator(), translating blocks as they are
+   reached, and returns why it stopped. */
+SimStatus run_jit(Jit* jit, uint64_t max_jumps) {
+    Simulator* sim = jit->sim;
+    if (!jit->code) {
+        return run_simulator(sim, max_jumps);
+    }
+#if JIT_SUPPORTED
+    JitEntry enter = (JitEntry) (void*) jit->code;
+    jit->budget = max_jumps ? max_jumps : UINT64_MAX;
+    sim->status = SIM_RUNNING;
+    int interpret = 0;
+    while (sim->status == SIM_RUNNING) {
+        uint32_t pc = sim->pc;
+        uint8_t* block = interpret ? NULL : jit->entry[pc];
+        if (!block && !interpret && !jit->untranslatable[pc] && pc < sim->len) {
+            block = translate_block(jit, pc);
+            jit->entry[pc] = block;
+            jit->untranslatable[pc] = !block;
+        }
+        if (!block) {
+            /* Interpret up to the next taken branch or jump. */
+            interpret = 0;
+            if (run_simulator(sim, 1) == SIM_STEP_LIMIT && --jit->budget != 0) {
+                sim->status = SIM_RUNNING;
+            }
+            continue;
+        }
+        JitExit exit = enter(sim, jit->entries, sim->mem, &jit->budget, block);
+        uint32_t next = (uint32_t) exit.pc;
+        uint32_t side = exit.pc >> 32;
+        sim->pc = next;
+        if (side) {
+            /* The rest of the block did not run, and the interpreter runs
+               (and reports) the instruction it stopped before. */
+            for (uint32_t i = next; i < jit->block_end[side - 1]; i++) {
+                sim->counts[i]--;
+            }
+            interpret = 1;
+        }
+        if (exit.site && jit->entry[next]) {
+            /* Chain: jmp rel32 to the target block in place of the mov. */
+            exit.site[0] = 0xE9;
+            patch_rel32(exit.site, 1, jit->entry[next]);
+            jit->chained++;
+        }
+        if (jit->budget == 0) {
+            sim->status = SIM_STEP_LIMIT;
+        }
+    }
+    fold_entries(jit);
+    return sim->status;
+#else
+    return run_simulator(sim, max_jumps);
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+
+/* Binary translation.
+
+   run_jit() runs a Simulator like run_simulator(), but translates each
+   basic block of its pre-decoded .text into x86-64 code the first time the
+   block is reached. Guest registers, hi and lo stay in the Simulator, so the
+   interpreter and translated code can hand the machine back and forth at
+   any block boundary.
+
+   A block ends at a branch or jump, or before an instruction the translator
+   does not handle (division, multiply-accumulate, traps, syscalls and the
+   other rare ones), which the interpreter then runs up to its next taken
+   branch. Block exits to a known target first return to the dispatcher
+   and are then patched into a direct jump to the target's block, so hot
+   loops never leave translated code. jr and jalr look their target up in
+   a table of block entry points indexed by instruction. Loads, stores and
+   arithmetic that would fault or trap leave the block just before the
+   instruction, which the interpreter then runs and reports.
+
+   Each block counts how often it is entered, and the counts are added to
+   the Simulator's COUNTS when run_jit() returns, so profiles match those of
+   the interpreter. Translation needs x86-64 and memory that may be both
+   written and executed; without them init_jit() fails and run_jit() only
+   interprets.
+ */
+
+typedef struct {
+    uint8_t* code;
+    size_t size;
+    size_t used;
+    void** entry;
+    uint8_t* untranslatable;
+    uint32_t* block_end;
+    uint64_t* entries;
+    uint64_t budget;
+    uint64_t blocks;
+    uint64_t chained;
+    Simulator* sim;
+} Jit;
+
+int init_jit(Jit* jit, Simulator* sim);
+
+void free_jit(Jit* jit);
+
+SimStatus run_jit(Jit* jit, uint64_t max_jumps);
+
+#endif
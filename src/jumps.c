@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate.h"
+#include "program.h"
+#include "jumps.h"
+
+static void* alloc_zeroed(size_t size) {
+    Allocator* alloc = get_table_allocator();
+    void* ptr = alloc->alloc(alloc, size);
+    if (!ptr) {
+        allocation_failed();
+    }
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static void release(void* ptr, size_t size) {
+    if (ptr) {
+        Allocator* alloc = get_table_allocator();
+        alloc->release(alloc, ptr, size);
+    }
+}
+
+/* Returns 1 if INST always goes to its label. */
+static int is_unconditional(const ProgInst* inst) {
+    const Instr* in = &inst->inst;
+    return inst->valid && in->label
+        && (in->id == INST_J || (in->id == INST_BEQ && in->rs == in->rt));
+}
+
+/* Returns 1 if INST can be deleted when it goes to the next instruction:
+   a jump or branch that does not link. */
+static int is_plain_transfer(const ProgInst* inst) {
+    const Instr* in = &inst->inst;
+    return inst->valid && in->label
+        && (in->id == INST_J
+            || (is_branch(in) && in->id != INST_BLTZAL && in->id != INST_BGEZAL));
+}
+
+/* Follows the chain of unconditional jumps starting at the one at I and
+   stores, for every jump on it, the label the chain ends on in FINAL, or
+   NULL if the chain is a cycle. STATE is 1 for jumps on the chain being
+   followed and 2 for resolved ones; PATH has room for every instruction. */
+static void resolve_chain(const ProgCode* code, const uint32_t* targets, const char** final,
+    uint8_t* state, uint32_t* path, uint32_t i) {
+    uint32_t len = 0, cur = i;
+    while (cur < code->len && !state[cur] && is_unconditional(&code->insts[cur])
+        && targets[cur] != PROG_NONE) {
+        state[cur] = 1;
+        path[len++] = cur;
+        cur = targets[cur];
+    }
+    int cycle = cur < code->len && state[cur] == 1;
+    const char* name = cur < code->len && state[cur] == 2 ? final[cur] : NULL;
+    while (len) {
+        uint32_t p = path[--len];
+        if (!cycle && !name) {
+            name = code->insts[p].inst.label;
+        }
+        final[p] = cycle ? NULL : name;
+        state[p] = 2;
+    }
+}
+
+/* Retargets the branches and jumps of PROG through chains of unconditional
+   jumps. Returns how many were changed. */
+static uint32_t retarget(Program* prog) {
+    ProgCode* code = &prog->code;
+    uint32_t n = code->len;
+    uint32_t* targets = program_targets(prog);
+    const char** final = alloc_zeroed(n * sizeof(char*));
+    uint8_t* state = alloc_zeroed(n);
+    uint32_t* path = alloc_zeroed(n * sizeof(uint32_t));
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t t = targets[i];
+        if (t == PROG_NONE || t >= n || t == i || !is_unconditional(&code->insts[t])) {
+            continue;
+        }
+        if (!state[t]) {
+            resolve_chain(code, targets, final, state, path, t);
+        }
+        if (final[t]) {
+            code->insts[i].inst.label = final[t];
+            count++;
+        }
+    }
+    release(path, n * sizeof(uint32_t));
+    release(state, n);
+    release(final, n * sizeof(char*));
+    release(targets, (n + 1) * sizeof(uint32_t));
+    return count;
+}
+
+/* Rewrites PROG as described in jumps.h and counts the changes in STATS.
+   Programs with instructions that did not decode are left alone. */
+void thread_jumps(Program* prog, JumpStats* stats) {
+    memset(stats, 0, sizeof(JumpStats));
+    ProgCode* code = &prog->code;
+    uint32_t n = code->len;
+    if (prog->num_invalid || n == 0) {
+        return;
+    }
+    stats->retargeted = retarget(prog);
+
+    /* An unlabeled block is dead if the block before it cannot fall into
+       it, or is dead itself. */
+    uint8_t* removed = alloc_zeroed(n);
+    ProgBlocks blocks;
+    find_blocks(&blocks, prog);
+    int prev_dead = 0;
+    for (uint32_t b = 1; b < blocks.num_blocks; b++) {
+        const ProgBlock* block = &blocks.blocks[b];
+        int dead = block->first_label == block->end_label
+            && (prev_dead || blocks.blocks[b - 1].fall == PROG_NONE);
+        if (dead) {
+            memset(&removed[block->start], 1, block->end - block->start);
+            stats->blocks_removed++;
+            stats->insts_removed += block->end - block->start;
+        }
+        prev_dead = dead;
+    }
+    free_blocks(&blocks);
+
+    /* Going backwards, NEXT_LIVE[I] is the first instruction at or after I
+       that stays, which is where a label at I ends up. A jump is redundant
+       if its label ends up where control would go anyway. */
+    uint32_t* targets = program_targets(prog);
+    uint32_t* next_live = alloc_zeroed((n + 1) * sizeof(uint32_t));
+    next_live[n] = n;
+    for (uint32_t i = n; i-- > 0;) {
+        uint32_t t = targets[i];
+        if (!removed[i] && is_plain_transfer(&code->insts[i]) && t != PROG_NONE && t > i
+            && next_live[t] == next_live[i + 1]) {
+            removed[i] = 1;
+            stats->jumps_removed++;
+        }
+        next_live[i] = removed[i] ? next_live[i + 1] : i;
+    }
+    release(next_live, (n + 1) * sizeof(uint32_t));
+    release(targets, (n + 1) * sizeof(uint32_t));
+
+    if (stats->jumps_removed || stats->insts_removed) {
+        ProgCode out;
+        memset(&out, 0, sizeof(ProgCode));
+        uint32_t l = 0;
+        for (uint32_t i = 0; i <= n; i++) {
+            for (; l < code->num_labels && code->labels[l].index == i; l++) {
+                push_label(&out, code->labels[l].name);
+            }
+            if (i < n && !removed[i]) {
+                push_inst(&out, &code->insts[i]);
+            }
+        }
+        replace_code(prog, &out);
+    }
+    release(removed, n);
+}
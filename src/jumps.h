@@ -0,0 +1,35 @@
+#ifndef JUMPS_H
+#define JUMPS_H
+
+#include <stdint.h>
+
+/* Jump threading and unreachable code elimination.
+
+   thread_jumps() cleans up the control flow of a Program in three steps:
+
+     - every branch or jump to an unconditional jump (j, or beq of a
+       register with itself) is retargeted to where the chain of such
+       jumps finally leads, so it is taken once instead of once per hop;
+     - blocks that control cannot reach are deleted: a block without a
+       label can only be entered from the block before it, so it is dead
+       if that block ends in j or jr, or is dead itself;
+     - a jump or a branch without a link to the instruction that now
+       follows it is deleted.
+
+   Labeled blocks are always kept, even when nothing in the program jumps
+   to them any more, since another object may. Cycles of jumps are left as
+   they are. Addresses are recomputed from the shorter program afterwards,
+   and since relocations are only made in pass two from the rewritten
+   program, .symbol and .relocation stay consistent with it.
+ */
+
+typedef struct {
+    uint32_t retargeted;
+    uint32_t jumps_removed;
+    uint32_t blocks_removed;
+    uint32_t insts_removed;
+} JumpStats;
+
+void thread_jumps(Program* prog, JumpStats* stats);
+
+#endif
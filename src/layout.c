@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate.h"
+#include "program.h"
+#include "layout.h"
+
+static const int BUF_SIZE = 1024;
+static const char* PROFILE_SEPARATORS = " \t\r\n";
+
+static void* alloc_zeroed(size_t size) {
+    Allocator* alloc = get_table_allocator();
+    void* ptr = alloc->alloc(alloc, size);
+    if (!ptr) {
+        allocation_failed();
+    }
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static void release(void* ptr, size_t size) {
+    if (ptr) {
+        Allocator* alloc = get_table_allocator();
+        alloc->release(alloc, ptr, size);
+    }
+}
+
+/* Parses a count of at least one digit. Returns 0 on success. */
+static int parse_count(const char* str, uint64_t* count) {
+    char* end;
+    if (*str < '0' || *str > '9') {
+        return -1;
+    }
+    *count = strtoull(str, &end, 10);
+    return *end == '\0' ? 0 : -1;
+}
+
+/* Reads PROFILE and stores the count of every labeled block it names in
+   WEIGHT. Returns 0 on success and -1 if a line is malformed. */
+static int read_profile(FILE* profile, const Program* prog, const ProgBlocks* blocks,
+    uint64_t* weight) {
+    const ProgCode* code = &prog->code;
+    LabelIndex index;
+    index_labels(&index, code);
+    char buf[BUF_SIZE];
+    uint32_t line = 0;
+    int in_labels = 1;
+    int err = 0;
+    while (fgets(buf, sizeof(buf), profile)) {
+        line++;
+        char* save;
+        char* first = strtok_r(buf, PROFILE_SEPARATORS, &save);
+        if (!first) {
+            continue;
+        }
+        if (first[0] == '.') {
+            in_labels = strcmp(first, ".labels") == 0;
+            continue;
+        }
+        if (!in_labels) {
+            continue;
+        }
+        char* second = strtok_r(NULL, PROFILE_SEPARATORS, &save);
+        uint64_t count;
+        const char* name;
+        if (second && !strtok_r(NULL, PROFILE_SEPARATORS, &save)
+            && (parse_count(first, &count) == 0 || parse_count(second, &count) == 0)) {
+            name = first[0] >= '0' && first[0] <= '9' ? second : first;
+        } else {
+            write_to_log("Error: malformed profile line %u\n", line);
+            err = 1;
+            continue;
+        }
+        uint32_t label = lookup_label(&index, code, name);
+        if (label != PROG_NONE && code->labels[label].index < code->len) {
+            uint32_t b = blocks->block_of[code->labels[label].index];
+            if (count > weight[b]) {
+                weight[b] = count;
+            }
+        }
+    }
+    free_label_index(&index);
+    return err ? -1 : 0;
+}
+
+/* Returns 1 if INST writes a return address, so that the instruction after
+   it must stay there. */
+static int links(const Instr* inst) {
+    return inst->id == INST_JAL || inst->id == INST_JALR || inst->id == INST_BLTZAL
+        || inst->id == INST_BGEZAL;
+}
+
+/* How a block's last instruction changes when block NEXT is placed after
+   it. */
+typedef enum {
+    EXIT_KEEP, EXIT_INVERT, EXIT_DROP_JUMP, EXIT_ADD_JUMP
+} ExitAction;
+
+static ExitAction exit_action(const ProgInst* last, const ProgBlock* block, uint32_t next) {
+    if (is_branch(&last->inst)) {
+        Instr inverted = last->inst;
+        if (block->fall == next) {
+            return EXIT_KEEP;
+        }
+        if (block->taken == next && invert_branch(&inverted) == 0) {
+            return EXIT_INVERT;
+        }
+        return EXIT_ADD_JUMP;
+    }
+    if (last->inst.id == INST_J) {
+        return block->taken == next ? EXIT_DROP_JUMP : EXIT_KEEP;
+    }
+    return block->fall != PROG_NONE && block->fall != next ? EXIT_ADD_JUMP : EXIT_KEEP;
+}
+
+/* Estimated taken branches and jumps at the end of a block whose own count
+   is WEIGHT, whose branch is taken TAKEN times, given ACTION. */
+static uint64_t taken_cost(const ProgInst* last, ExitAction action, uint64_t weight,
+    uint64_t taken) {
+    if (is_branch(&last->inst)) {
+        switch (action) {
+            case EXIT_KEEP:   return taken;
+            case EXIT_INVERT: return weight - taken;
+            default:          return weight;
+        }
+    }
+    if (last->inst.id == INST_J || last->inst.id == INST_JR) {
+        return action == EXIT_DROP_JUMP ? 0 : weight;
+    }
+    return action == EXIT_ADD_JUMP ? weight : 0;
+}
+
+typedef struct {
+    uint32_t from, to;
+    uint64_t weight;
+} Edge;
+
+/* Heaviest first; on ties fallthrough edges first, then in program order,
+   so that cold code keeps its original order. */
+static int compare_edges(const void* a, const void* b) {
+    const Edge* x = a;
+    const Edge* y = b;
+    if (x->weight != y->weight) {
+        return x->weight > y->weight ? -1 : 1;
+    }
+    int x_fall = x->to == x->from + 1, y_fall = y->to == y->from + 1;
+    if (x_fall != y_fall) {
+        return y_fall - x_fall;
+    }
+    if (x->from != y->from) {
+        return x->from < y->from ? -1 : 1;
+    }
+    return x->to < y->to ? -1 : x->to > y->to;
+}
+
+static uint32_t find_root(uint32_t* parent, uint32_t b) {
+    while (parent[b] != b) {
+        parent[b] = parent[parent[b]];
+        b = parent[b];
+    }
+    return b;
+}
+
+typedef struct {
+    uint32_t head;
+    uint64_t weight;
+    int rank;
+} Chain;
+
+/* The entry chain first and the chain that runs off the end of the program
+   last, the rest hottest first and otherwise in program order. */
+static int compare_chains(const void* a, const void* b) {
+    const Chain* x = a;
+    const Chain* y = b;
+    if (x->rank != y->rank) {
+        return x->rank - y->rank;
+    }
+    if (x->weight != y->weight) {
+        return x->weight > y->weight ? -1 : 1;
+    }
+    return x->head < y->head ? -1 : x->head > y->head;
+}
+
+/* Reorders the blocks of PROG by the counts in PROFILE and records what
+   changed in STATS. Programs with instructions that did not decode are left
+   alone. Returns 0 on success and -1 if the profile is malformed.
+ */
+int layout_program(Program* prog, FILE* profile, LayoutStats* stats) {
+    memset(stats, 0, sizeof(LayoutStats));
+    ProgBlocks blocks;
+    find_blocks(&blocks, prog);
+    uint32_t n = blocks.num_blocks;
+    stats->blocks = n;
+    uint64_t* weight = alloc_zeroed((n + 1) * sizeof(uint64_t));
+    if (read_profile(profile, prog, &blocks, weight) != 0) {
+        release(weight, (n + 1) * sizeof(uint64_t));
+        free_blocks(&blocks);
+        return -1;
+    }
+    if (n < 2 || prog->num_invalid) {
+        release(weight, (n + 1) * sizeof(uint64_t));
+        free_blocks(&blocks);
+        return 0;
+    }
+
+    const ProgCode* code = &prog->code;
+    const ProgBlock* bl = blocks.blocks;
+    uint32_t* preds = alloc_zeroed(n * sizeof(uint32_t));
+    for (uint32_t b = 0; b < n; b++) {
+        const Instr* last = &code->insts[bl[b].end - 1].inst;
+        if (bl[b].taken < n && last->id != INST_JAL) {
+            preds[bl[b].taken]++;
+        }
+        if (bl[b].fall < n) {
+            preds[bl[b].fall]++;
+        }
+    }
+
+    /* Estimate the counts the profile cannot give: a block without a label
+       is only entered from the one before it, and a branch is taken as
+       often as its target runs less what the edges into it estimated so
+       far account for, shared among its remaining predecessors. */
+    uint64_t* taken = alloc_zeroed(n * sizeof(uint64_t));
+    uint64_t* fall = alloc_zeroed(n * sizeof(uint64_t));
+    uint64_t* known_in = alloc_zeroed(n * sizeof(uint64_t));
+    if (weight[0] == 0) {
+        weight[0] = 1;
+    }
+    Edge* edges = alloc_zeroed(2 * n * sizeof(Edge));
+    uint32_t num_edges = 0;
+    for (uint32_t b = 0; b < n; b++) {
+        if (b > 0 && bl[b].first_label == bl[b].end_label) {
+            weight[b] = fall[b - 1];
+        }
+        const Instr* last = &code->insts[bl[b].end - 1].inst;
+        if (is_branch(last)) {
+            uint32_t t = bl[b].taken;
+            uint64_t share = 0;
+            if (t < n && weight[t] > known_in[t]) {
+                share = (weight[t] - known_in[t]) / (preds[t] ? preds[t] : 1);
+            }
+            taken[b] = share < weight[b] ? share : weight[b];
+            fall[b] = weight[b] - taken[b];
+        } else if (last->id == INST_J) {
+            taken[b] = weight[b];
+        } else if (last->id != INST_JR) {
+            fall[b] = weight[b];
+        }
+        if (bl[b].taken < n && last->id != INST_JAL) {
+            edges[num_edges++] = (Edge) { b, bl[b].taken, taken[b] };
+            known_in[bl[b].taken] += taken[b];
+            preds[bl[b].taken]--;
+        }
+        if (bl[b].fall < n) {
+            edges[num_edges++] = (Edge) { b, bl[b].fall, links(last) ? UINT64_MAX : fall[b] };
+            known_in[bl[b].fall] += fall[b];
+            preds[bl[b].fall]--;
+        }
+    }
+    qsort(edges, num_edges, sizeof(Edge), compare_edges);
+
+    /* Join chains along the heaviest edges. Edges that never ran only keep
+       blocks that fell through to each other together. */
+    uint32_t* parent = alloc_zeroed(n * sizeof(uint32_t));
+    uint32_t* next = alloc_zeroed(n * sizeof(uint32_t));
+    uint32_t* prev = alloc_zeroed(n * sizeof(uint32_t));
+    for (uint32_t b = 0; b < n; b++) {
+        parent[b] = b;
+        next[b] = prev[b] = PROG_NONE;
+    }
+    for (uint32_t i = 0; i < num_edges; i++) {
+        uint32_t from = edges[i].from, to = edges[i].to;
+        if (edges[i].weight == 0 && to != from + 1) {
+            break;
+        }
+        if (to == 0 || next[from] != PROG_NONE || prev[to] != PROG_NONE) {
+            continue;
+        }
+        uint32_t root_from = find_root(parent, from), root_to = find_root(parent, to);
+        if (root_from == root_to) {
+            continue;
+        }
+        next[from] = to;
+        prev[to] = from;
+        parent[root_to] = root_from;
+    }
+
+    /* Order the chains. */
+    Chain* chains = alloc_zeroed(n * sizeof(Chain));
+    uint32_t num_chains = 0;
+    for (uint32_t b = 0; b < n; b++) {
+        if (prev[b] != PROG_NONE) {
+            continue;
+        }
+        Chain* chain = &chains[num_chains++];
+        chain->head = b;
+        for (uint32_t c = b; c != PROG_NONE; c = next[c]) {
+            chain->weight = weight[c] > chain->weight ? weight[c] : chain->weight;
+            if (c == n - 1 && bl[c].fall == n) {
+                chain->rank = 2;
+            }
+        }
+        if (b == 0) {
+            chain->rank = 0;
+        } else if (chain->rank != 2) {
+            chain->rank = 1;
+        }
+    }
+    qsort(chains, num_chains, sizeof(Chain), compare_chains);
+    uint32_t* order = alloc_zeroed(n * sizeof(uint32_t));
+    uint32_t num_ordered = 0;
+    for (uint32_t i = 0; i < num_chains; i++) {
+        for (uint32_t c = chains[i].head; c != PROG_NONE; c = next[c]) {
+            order[num_ordered++] = c;
+        }
+    }
+
+    /* Decide each block's exit, giving a label to every block a new jump or
+       inverted branch has to name. Index N stands for the end. */
+    ExitAction* action = alloc_zeroed(n * sizeof(ExitAction));
+    const char** label_of = alloc_zeroed((n + 1) * sizeof(char*));
+    uint8_t* new_label = alloc_zeroed(n + 1);
+    for (uint32_t b = 0; b < n; b++) {
+        if (bl[b].first_label < bl[b].end_label) {
+            label_of[b] = code->labels[bl[b].first_label].name;
+        }
+    }
+    for (uint32_t l = 0; l < code->num_labels; l++) {
+        if (code->labels[l].index == code->len && !label_of[n]) {
+            label_of[n] = code->labels[l].name;
+        }
+    }
+    for (uint32_t pos = 0; pos < n; pos++) {
+        uint32_t b = order[pos];
+        uint32_t following = pos + 1 < n ? order[pos + 1] : n;
+        const ProgInst* last = &code->insts[bl[b].end - 1];
+        action[b] = exit_action(last, &bl[b], following);
+        stats->taken_before += taken_cost(last, exit_action(last, &bl[b], b + 1), weight[b],
+            taken[b]);
+        stats->taken_after += taken_cost(last, action[b], weight[b], taken[b]);
+        if ((action[b] == EXIT_INVERT || action[b] == EXIT_ADD_JUMP) && !label_of[bl[b].fall]) {
+            label_of[bl[b].fall] = new_program_label(prog);
+            new_label[bl[b].fall] = 1;
+        }
+    }
+
+    /* Emit the blocks in their new order. */
+    ProgCode out;
+    memset(&out, 0, sizeof(ProgCode));
+    uint32_t hot_first = PROG_NONE, hot_end = 0;
+    for (uint32_t b = 0; b < n; b++) {
+        if (weight[b]) {
+            hot_first = hot_first == PROG_NONE ? bl[b].start : hot_first;
+            hot_end = bl[b].end;
+        }
+    }
+    stats->hot_span_before = hot_first == PROG_NONE ? 0 : hot_end - hot_first;
+    hot_first = PROG_NONE;
+    hot_end = 0;
+    for (uint32_t pos = 0; pos < n; pos++) {
+        uint32_t b = order[pos];
+        if (new_label[b]) {
+            push_label(&out, label_of[b]);
+        }
+        for (uint32_t l = bl[b].first_label; l < bl[b].end_label; l++) {
+            push_label(&out, code->labels[l].name);
+        }
+        uint32_t start = out.len;
+        for (uint32_t i = bl[b].start; i + 1 < bl[b].end; i++) {
+            push_inst(&out, &code->insts[i]);
+        }
+        ProgInst last = code->insts[bl[b].end - 1];
+        ProgInst jump;
+        switch (action[b]) {
+            case EXIT_KEEP:
+                push_inst(&out, &last);
+                break;
+            case EXIT_INVERT:
+                invert_branch(&last.inst);
+                last.inst.label = label_of[bl[b].fall];
+                push_inst(&out, &last);
+                stats->inverted++;
+                break;
+            case EXIT_DROP_JUMP:
+                stats->jumps_removed++;
+                break;
+            case EXIT_ADD_JUMP:
+                push_inst(&out, &last);
+                make_jump(&jump, &last, label_of[bl[b].fall]);
+                push_inst(&out, &jump);
+                stats->jumps_added++;
+                break;
+        }
+        if (weight[b]) {
+            hot_first = hot_first == PROG_NONE ? start : hot_first;
+            hot_end = out.len;
+        }
+    }
+    stats->hot_span_after = hot_first == PROG_NONE ? 0 : hot_end - hot_first;
+    if (new_label[n]) {
+        push_label(&out, label_of[n]);
+    }
+    for (uint32_t l = 0; l < code->num_labels; l++) {
+        if (code->labels[l].index == code->len) {
+            push_label(&out, code->labels[l].name);
+        }
+    }
+    replace_code(prog, &out);
+
+    release(new_label, n + 1);
+    release(label_of, (n + 1) * sizeof(char*));
+    release(action, n * sizeof(ExitAction));
+    release(order, n * sizeof(uint32_t));
+    release(chains, n * sizeof(Chain));
+    release(prev, n * sizeof(uint32_t));
+    release(next, n * sizeof(uint32_t));
+    release(parent, n * sizeof(uint32_t));
+    release(edges, 2 * n * sizeof(Edge));
+    release(known_in, n * sizeof(uint64_t));
+    release(fall, n * sizeof(uint64_t));
+    release(taken, n * sizeof(uint64_t));
+    release(preds, n * sizeof(uint32_t));
+    release(weight, (n + 1) * sizeof(uint64_t));
+    free_blocks(&blocks);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdint.h>
+
+/* Profile-guided block layout.
+
+   layout_program() reorders the basic blocks of a Program so that the
+   paths a profile says are hot fall through. The profile gives execution
+   counts per label, either as the .labels section of a simulator -profile
+   file or as a plain file of label and count pairs (in either order, one
+   pair per line); other sections of a simulator profile are skipped.
+   Counts of unlabeled blocks are estimated from their predecessor.
+
+   Blocks are joined into chains along their heaviest edges (Pettis and
+   Hansen's bottom-up positioning), with a block after a jal or other
+   linking instruction always kept right behind it. The chain holding the
+   first block comes first, then the others hottest first, so cold blocks
+   collect at the end. Branches are then fixed up for the new order: a
+   branch whose target now follows it is inverted to branch to its old
+   fallthrough instead, a j to the next block is dropped, and a j is added
+   where a block no longer falls into its successor. Blocks that need a new
+   label for that get a _B<n> one.
+
+   Code that computes addresses of instructions other than through labels
+   (jr to a register loaded with a number, say) is not supported.
+ */
+
+typedef struct {
+    uint32_t blocks;
+    uint32_t inverted;
+    uint32_t jumps_removed;
+    uint32_t jumps_added;
+    uint64_t taken_before;
+    uint64_t taken_after;
+    uint32_t hot_span_before;
+    uint32_t hot_span_after;
+} LayoutStats;
+
+int layout_program(Program* prog, FILE* profile, LayoutStats* stats);
+
+#endif
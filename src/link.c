@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "object.h"
+#include "reloc.h"
+#include "link.h"
+
+/*******************************
+ * Global Symbol Index
+ *******************************/
+
+/* Sets up INDEX to hold up to MAX_SYMBOLS symbols, keeping the load factor
+   at or below one half. Returns 0 on success and -1 on error. */
+int init_symbol_index(SymbolIndex* index, uint32_t max_symbols) {
+    Allocator* alloc = get_table_allocator();
+    uint32_t num_slots = 16;
+    while (num_slots < 2 * (uint64_t) max_symbols) {
+        num_slots *= 2;
+    }
+    index->mask = num_slots - 1;
+    index->len = 0;
+    index->cap = max_symbols + 1;
+    index->slots = alloc->alloc(alloc, num_slots * sizeof(uint32_t));
+    index->names = alloc->alloc(alloc, index->cap * sizeof(char*));
+    index->addrs = alloc->alloc(alloc, index->cap * sizeof(uint32_t));
+    index->owners = alloc->alloc(alloc, index->cap * sizeof(uint32_t));
+    if (!index->slots || !index->names || !index->addrs || !index->owners) {
+        allocation_failed();
+    }
+    memset(index->slots, 0, num_slots * sizeof(uint32_t));
+    return 0;
+}
+
+static uint32_t* find_index_slot(const SymbolIndex* index, const char* name) {
+    uint32_t i = symbol_hash(name) & index->mask;
+    while (index->slots[i] && strcmp(index->names[index->slots[i] - 1], name) != 0) {
+        i = (i + 1) & index->mask;
+    }
+    return &index->slots[i];
+}
+
+/* Adds NAME at ADDR, defined by object OWNER. NAME is not copied. Returns 0
+   on success, or the one-based owner of the earlier definition if NAME is
+   already in the index. The caller must not exceed the capacity INDEX was
+   set up with. */
+int add_to_index(SymbolIndex* index, const char* name, uint32_t addr, uint32_t owner) {
+    uint32_t* slot = find_index_slot(index, name);
+    if (*slot) {
+        return index->owners[*slot - 1] + 1;
+    }
+    index->names[index->len] = name;
+    index->addrs[index->len] = addr;
+    index->owners[index->len] = owner;
+    *slot = ++index->len;
+    return 0;
+}
+
+/* Returns the address of NAME, or -1 if it is not in INDEX. Safe to call from
+   several threads once the index is built. */
+int64_t lookup_index(const SymbolIndex* index, const char* name) {
+    uint32_t slot = *find_index_slot(index, name);
+    if (!slot) {
+        return -1;
+    }
+    return index->addrs[slot - 1];
+}
+
+void free_symbol_index(SymbolIndex* index) {
+    Allocator* alloc = get_table_allocator();
+    alloc->release(alloc, index->slots, (index->mask + 1) * sizeof(uint32_t));
+    alloc->release(alloc, index->names, index->cap * sizeof(char*));
+    alloc->release(alloc, index->addrs, index->cap * sizeof(uint32_t));
+    alloc->release(alloc, index->owners, index->cap * sizeof(uint32_t));
+    memset(index, 0, sizeof(SymbolIndex));
+}
+
+/*******************************
+ * Parallel Driver
+ *******************************/
+
+typedef struct {
+    void (*fn)(void* ctx, uint32_t i);
+    void* ctx;
+    uint32_t n;
+    uint32_t next;
+} WorkQueue;
+
+static void* run_worker(void* arg) {
+    WorkQueue* queue = arg;
+    uint32_t i;
+    while ((i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->n) {
+        queue->fn(queue->ctx, i);
+    }
+    return NULL;
+}
+
+/* Calls FN(CTX, I) for every I below N, handing items out to NUM_THREADS
+   threads as they become free. Runs on the calling thread alone if
+   NUM_THREADS is 1 or threads cannot be started, including when the table
+   allocator has no room for their handles. */
+void run_parallel(void (*fn)(void* ctx, uint32_t i), void* ctx, uint32_t n, int num_threads) {
+    WorkQueue queue = { fn, ctx, n, 0 };
+    if (num_threads > (int) n) {
+        num_threads = n;
+    }
+    Allocator* alloc = get_table_allocator();
+    pthread_t* threads = NULL;
+    size_t threads_size = 0;
+    int started = 0;
+    if (num_threads > 1) {
+        threads_size = (num_threads - 1) * sizeof(pthread_t);
+        threads = alloc->alloc(alloc, threads_size);
+        while (threads && started < num_threads - 1
+            && pthread_create(&threads[started], NULL, run_worker, &queue) == 0) {
+            started++;
+        }
+    }
+    run_worker(&queue);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (threads) {
+        alloc->release(alloc, threads, threads_size);
+    }
+}
+
+/*******************************
+ * Linking
+ *******************************/
+
+static void load_one(void* ctx, uint32_t i) {
+    LinkInput* input = (LinkInput*) ctx + i;
+    FILE* file = fopen(input->name, "r");
+    if (!file) {
+        write_to_log("Error: unable to open object %s\n", input->name);
+        input->err = 1;
+        return;
+    }
+    if (read_object_file(&input->obj, file, input->name) != 0) {
+        input->err = 1;
+    }
+    fclose(file);
+}
+
+/* Reads the objects named by each of the N INPUTS. Returns 0 on success and
+   -1 if any of them could not be read. */
+int load_objects(LinkInput* inputs, uint32_t n, int num_threads) {
+    for (uint32_t i = 0; i < n; i++) {
+        memset(&inputs[i].obj, 0, sizeof(ObjectFile));
+        inputs[i].base = 0;
+        inputs[i].data_offset = 0;
+        inputs[i].err = 0;
+        inputs[i].missing = NULL;
+    }
+    run_parallel(load_one, inputs, n, num_threads);
+    for (uint32_t i = 0; i < n; i++) {
+        if (inputs[i].err) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    LinkInput* inputs;
+    const SymbolIndex* index;
+    uint32_t* text;
+    uint32_t* data;
+} PatchJob;
+
+/* Copies one object's .text and .data into place and applies its
+   relocations. Each distinct symbol is looked up once, then every type is
+   patched in its own loop. */
+static void patch_one(void* ctx, uint32_t i) {
+    PatchJob* job = ctx;
+    LinkInput* input = &job->inputs[i];
+    const ObjectFile* obj = &input->obj;
+    uint32_t* text = job->text + input->base / 4;
+    memcpy(text, obj->text.words, obj->text.len * sizeof(uint32_t));
+    if (obj->data.len) {
+        memcpy(job->data + input->data_offset / 4, obj->data.words,
+            obj->data.len * sizeof(uint32_t));
+    }
+
+    RelocBatch batch;
+    pack_relocs(&batch, obj->reltbl);
+    Allocator* alloc = get_table_allocator();
+    uint32_t* targets = alloc->alloc(alloc, (batch.num_names + 1) * sizeof(uint32_t));
+    if (!targets) {
+        allocation_failed();
+    }
+    for (uint32_t s = 0; s < batch.num_names; s++) {
+        int64_t target = lookup_index(job->index, batch.names[s]);
+        if (target < 0) {
+            if (!input->missing) {
+                input->missing = batch.names[s];
+            }
+            input->err = 1;
+        }
+        targets[s] = target;
+    }
+    for (int type = 0; type < NUM_RELOC_TYPES && !input->err; type++) {
+        uint32_t start = batch.start[type];
+        if (patch_relocs(text, input->base, type, batch.records + start,
+            batch.start[type + 1] - start, targets) != 0) {
+            input->err = 1;
+        }
+    }
+    alloc->release(alloc, targets, (batch.num_names + 1) * sizeof(uint32_t));
+    free_relocs(&batch);
+}
+
+/* Links the N loaded INPUTS into OUT, which is left holding the combined
+   .text and .data, every symbol at its linked address and the relocations,
+   rebased, so that the result can itself be relocated by a loader. Returns
+   0 on success and -1 on error.
+ */
+int link_objects(ObjectFile* out, LinkInput* inputs, uint32_t n, int num_threads) {
+    uint64_t num_words = 0;
+    uint64_t num_data_words = 0;
+    uint64_t num_symbols = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        inputs[i].base = num_words * 4;
+        inputs[i].data_offset = num_data_words * 4;
+        num_words += inputs[i].obj.text.len;
+        num_data_words += inputs[i].obj.data.len;
+        num_symbols += inputs[i].obj.symtbl->len;
+    }
+    if (num_words > (1 << 26)) {
+        write_to_log("Error: linked .text exceeds the 256 MB a jump can reach\n");
+        return -1;
+    }
+    /* The symbol index keeps its load factor at one half in 32-bit slots. */
+    if (num_symbols > UINT32_MAX / 2) {
+        write_to_log("Error: linked objects define %llu symbols, more than the %u the "
+            "symbol index holds\n", (unsigned long long) num_symbols, UINT32_MAX / 2);
+        return -1;
+    }
+    if (num_data_words > (1 << 26)) {
+        write_to_log("Error: linked .data exceeds 256 MB\n");
+        return -1;
+    }
+
+    int err = 0;
+    SymbolIndex index;
+    init_symbol_index(&index, num_symbols);
+    for (uint32_t i = 0; i < n; i++) {
+        const char* name;
+        uint32_t addr;
+        SymbolTable* symtbl = inputs[i].obj.symtbl;
+        for (uint32_t s = 0; get_symbol(symtbl, s, &name, &addr) == 0; s++) {
+            uint32_t linked = place_symbol(addr, inputs[i].base,
+                DATA_BASE + inputs[i].data_offset);
+            int prev = add_to_index(&index, name, linked, i);
+            if (prev) {
+                write_to_log("Error: symbol %s defined in both %s and %s\n", name,
+                    inputs[prev - 1].name, inputs[i].name);
+                err = 1;
+            }
+        }
+    }
+
+    init_word_buffer(&out->text);
+    resize_word_buffer(&out->text, num_words);
+    init_word_buffer(&out->data);
+    resize_word_buffer(&out->data, num_data_words);
+    PatchJob job = { inputs, &index, out->text.words, out->data.words };
+    if (!err) {
+        run_parallel(patch_one, &job, n, num_threads);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (inputs[i].missing) {
+            write_to_log("Error: undefined symbol %s referenced in %s\n",
+                inputs[i].missing, inputs[i].name);
+        }
+        if (inputs[i].err) {
+            err = 1;
+        }
+    }
+
+    out->symtbl = create_table(SYMTBL_NON_UNIQUE);
+    out->reltbl = create_table(SYMTBL_NON_UNIQUE);
+    for (uint32_t i = 0; i < index.len; i++) {
+        add_to_table(out->symtbl, index.names[i], index.addrs[i]);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        const char* name;
+        uint32_t offset;
+        SymbolTable* reltbl = inputs[i].obj.reltbl;
+        for (uint32_t r = 0; get_symbol(reltbl, r, &name, &offset) == 0; r++) {
+            add_reloc(out->reltbl, name, inputs[i].base + offset, get_reloc_type(reltbl, r));
+        }
+    }
+    free_symbol_index(&index);
+    return err ? -1 : 0;
+}
+
+void free_link_inputs(LinkInput* inputs, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        free_object(&inputs[i].obj);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdint.h>
+
+/* Linking.
+
+   Objects are laid out back to back in the order given, their .text
+   sections in the linked .text and their .data sections in the linked
+   .data. Every label becomes a global symbol at its section's base plus its
+   offset, and every relocation is applied according to its type (see
+   reloc.h) with the address of the symbol it names. Reading and patching
+   run on up to NUM_THREADS threads, one object at a time each.
+ */
+
+/* Open-addressed hash index over the global symbols. Slots hold one more
+   than the index of their entry, so 0 marks an empty slot. */
+typedef struct {
+    uint32_t* slots;
+    uint32_t mask;
+    const char** names;
+    uint32_t* addrs;
+    uint32_t* owners;
+    uint32_t len;
+    uint32_t cap;
+} SymbolIndex;
+
+/* One object being linked. BASE is its byte offset in the linked .text,
+   DATA_OFFSET its offset in the linked .data, and MISSING the first symbol
+   it references that no object defines. */
+typedef struct {
+    const char* name;
+    ObjectFile obj;
+    uint32_t base;
+    uint32_t data_offset;
+    int err;
+    const char* missing;
+} LinkInput;
+
+int init_symbol_index(SymbolIndex* index, uint32_t max_symbols);
+
+int add_to_index(SymbolIndex* index, const char* name, uint32_t addr, uint32_t owner);
+
+int64_t lookup_index(const SymbolIndex* index, const char* name);
+
+void free_symbol_index(SymbolIndex* index);
+
+void run_parallel(void (*fn)(void* ctx, uint32_t i), void* ctx, uint32_t n, int num_threads);
+
+int load_objects(LinkInput* inputs, uint32_t n, int num_threads);
+
+int link_objects(ObjectFile* out, LinkInput* inputs, uint32_t n, int num_threads);
+
+void free_link_inputs(LinkInput* inputs, uint32_t n);
+
+#endif
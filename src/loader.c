@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "object.h"
+#include "link.h"
+#include "reloc.h"
+#include "loader.h"
+
+/* Radix sort digit width. Three passes cover any word offset. */
+#define RADIX_BITS 11
+
+/* Below this many records an insertion sort beats clearing the counts. */
+static const uint32_t SMALL_SORT = 64;
+
+/* Stores in TARGETS a freshly allocated array holding the address of each
+   symbol named in BATCH, which was packed from the relocations of OBJ, when
+   OBJ is loaded at BASE with its .data right after its .text. Returns 0 on
+   success and -1 if a symbol is undefined.
+ */
+int resolve_targets(uint32_t** targets, const RelocBatch* batch, const ObjectFile* obj,
+    uint32_t base) {
+    const char* name;
+    uint32_t addr;
+    SymbolIndex index;
+    init_symbol_index(&index, obj->symtbl->len);
+    for (uint32_t i = 0; get_symbol(obj->symtbl, i, &name, &addr) == 0; i++) {
+        add_to_index(&index, name, place_symbol(addr, base, base + obj->text.len * 4), 0);
+    }
+
+    Allocator* alloc = get_table_allocator();
+    *targets = alloc->alloc(alloc, (batch->num_names + 1) * sizeof(uint32_t));
+    if (!*targets) {
+        allocation_failed();
+    }
+    int err = 0;
+    for (uint32_t i = 0; i < batch->num_names; i++) {
+        int64_t target = lookup_index(&index, batch->names[i]);
+        if (target < 0) {
+            write_to_log("Error: undefined symbol %s\n", batch->names[i]);
+            err = 1;
+        }
+        (*targets)[i] = target;
+    }
+    free_symbol_index(&index);
+    return err ? -1 : 0;
+}
+
+static void insertion_sort(Reloc* records, uint32_t n) {
+    for (uint32_t i = 1; i < n; i++) {
+        Reloc record = records[i];
+        uint32_t j = i;
+        while (j > 0 && records[j - 1].offset > record.offset) {
+            records[j] = records[j - 1];
+            j--;
+        }
+        records[j] = record;
+    }
+}
+
+/* Sorts RECORDS by offset. Relocations from the assembler and the linker
+   already arrive in order, so that case is detected and costs one scan;
+   anything else is radix sorted on the word offset, which is stable. */
+void sort_relocs(Reloc* records, uint32_t n) {
+    uint32_t i = 1;
+    while (i < n && records[i - 1].offset <= records[i].offset) {
+        i++;
+    }
+    if (i >= n) {
+        return;
+    }
+    if (n <= SMALL_SORT) {
+        insertion_sort(records, n);
+        return;
+    }
+
+    Allocator* alloc = get_table_allocator();
+    Reloc* tmp = alloc->alloc(alloc, n * sizeof(Reloc));
+    if (!tmp) {
+        allocation_failed();
+    }
+    uint32_t counts[1 << RADIX_BITS];
+    const uint32_t digit_mask = (1 << RADIX_BITS) - 1;
+    Reloc* src = records;
+    Reloc* dst = tmp;
+    for (int shift = 2; shift < 32; shift += RADIX_BITS) {
+        memset(counts, 0, sizeof(counts));
+        for (uint32_t j = 0; j < n; j++) {
+            counts[(src[j].offset >> shift) & digit_mask]++;
+        }
+        uint32_t total = 0;
+        for (uint32_t b = 0; b <= digit_mask; b++) {
+            uint32_t count = counts[b];
+            counts[b] = total;
+            total += count;
+        }
+        for (uint32_t j = 0; j < n; j++) {
+            dst[counts[(src[j].offset >> shift) & digit_mask]++] = src[j];
+        }
+        Reloc* swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != records) {
+        memcpy(records, src, n * sizeof(Reloc));
+    }
+    alloc->release(alloc, tmp, n * sizeof(Reloc));
+}
+
+/* Builds in IMAGE the .text of OBJ as it must appear at BASE, followed by
+   its .data, with every relocation applied. IMAGE must be initialized.
+   Returns 0 on success and -1 on error.
+ */
+int load_image(WordBuffer* image, const ObjectFile* obj, uint32_t base) {
+    if (base % 4 != 0) {
+        write_to_log("Error: base address 0x%08x is not word aligned\n", base);
+        return -1;
+    }
+    uint64_t num_words = (uint64_t) obj->text.len + obj->data.len;
+    if (base + num_words * 4 > 0x100000000ull) {
+        write_to_log("Error: image does not fit above base address 0x%08x\n", base);
+        return -1;
+    }
+    resize_word_buffer(image, num_words);
+    memcpy(image->words, obj->text.words, obj->text.len * sizeof(uint32_t));
+    if (obj->data.len) {
+        memcpy(image->words + obj->text.len, obj->data.words, obj->data.len * sizeof(uint32_t));
+    }
+
+    RelocBatch batch;
+    uint32_t* targets;
+    pack_relocs(&batch, obj->reltbl);
+    int err = resolve_targets(&targets, &batch, obj, base) != 0;
+    for (int type = 0; type < NUM_RELOC_TYPES && !err; type++) {
+        Reloc* records = batch.records + batch.start[type];
+        uint32_t n = batch.start[type + 1] - batch.start[type];
+        sort_relocs(records, n);
+        if (patch_relocs(image->words, base, type, records, n, targets) != 0) {
+            err = 1;
+        }
+    }
+    Allocator* alloc = get_table_allocator();
+    alloc->release(alloc, targets, (batch.num_names + 1) * sizeof(uint32_t));
+    free_relocs(&batch);
+    return err ? -1 : 0;
+}
+
+/* Writes IMAGE to OUTPUT as big-endian words. Returns 0 on success and -1 on
+   error. */
+int write_flat_image(FILE* output, const WordBuffer* image) {
+    uint8_t buf[4096];
+    uint32_t i = 0;
+    while (i < image->len) {
+        size_t len = 0;
+        for (; i < image->len && len < sizeof(buf); i++) {
+            uint32_t word = image->words[i];
+            buf[len++] = word >> 24;
+            buf[len++] = word >> 16;
+            buf[len++] = word >> 8;
+            buf[len++] = word;
+        }
+        if (fwrite(buf, 1, len, output) != len) {
+            write_to_log("Error: unable to write image\n");
+            return -1;
+        }
+    }
+    return 0;
+}
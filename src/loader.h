@@ -0,0 +1,26 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdint.h>
+
+/* Loading.
+
+   load_image() places an object's .text at a base address, followed by its
+   .data, and resolves its relocations into a flat image of host-order
+   words. Relocations are packed
+   by type, each distinct symbol is resolved once through a hashed index, and
+   each type's records are sorted by offset and applied in a single forward
+   sweep over the image. write_flat_image() stores the image big-endian, as
+   the MIPS target reads it, so it can be mapped directly.
+ */
+
+int resolve_targets(uint32_t** targets, const RelocBatch* batch, const ObjectFile* obj,
+    uint32_t base);
+
+void sort_relocs(Reloc* records, uint32_t n);
+
+int load_image(WordBuffer* image, const ObjectFile* obj, uint32_t base);
+
+int write_flat_image(FILE* output, const WordBuffer* image);
+
+#endif
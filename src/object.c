@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate_utils.h"
+#include "object.h"
+#include "elf_reader.h"
+#include "reloc.h"
+
+static const uint32_t INITIAL_WORD_CAP = 256;
+
+void init_word_buffer(WordBuffer* buffer) {
+    buffer->words = NULL;
+    buffer->len = 0;
+    buffer->cap = 0;
+}
+
+/* Grows BUFFER to hold at least MIN_CAP words, doubling its capacity as
+   needed. Calls allocation_failed() if the buffer cannot grow. */
+void reserve_word_buffer(WordBuffer* buffer, uint32_t min_cap) {
+    if (min_cap <= buffer->cap) {
+        return;
+    }
+    uint32_t new_cap = buffer->cap ? buffer->cap : INITIAL_WORD_CAP;
+    while (new_cap < min_cap) {
+        new_cap *= 2;
+    }
+    Allocator* alloc = get_table_allocator();
+    uint32_t* words = alloc->resize(alloc, buffer->words, buffer->cap * sizeof(uint32_t),
+        new_cap * sizeof(uint32_t));
+    if (!words) {
+        allocation_failed();
+    }
+    buffer->words = words;
+    buffer->cap = new_cap;
+}
+
+/* Appends WORD to BUFFER. */
+void append_word(WordBuffer* buffer, uint32_t word) {
+    reserve_word_buffer(buffer, buffer->len + 1);
+    buffer->words[buffer->len++] = word;
+}
+
+/* Sets the length of BUFFER to LEN words. Words added this way are zero. */
+void resize_word_buffer(WordBuffer* buffer, uint32_t len) {
+    reserve_word_buffer(buffer, len);
+    if (len > buffer->len) {
+        memset(buffer->words + buffer->len, 0, (len - buffer->len) * sizeof(uint32_t));
+    }
+    buffer->len = len;
+}
+
+void free_word_buffer(WordBuffer* buffer) {
+    if (buffer->words) {
+        Allocator* alloc = get_table_allocator();
+        alloc->release(alloc, buffer->words, buffer->cap * sizeof(uint32_t));
+    }
+    init_word_buffer(buffer);
+}
+
+/*******************************
+ * Object Files
+ *******************************/
+
+static const int OBJ_BUF_SIZE = 1024;
+
+enum { SECTION_NONE, SECTION_TEXT, SECTION_DATA, SECTION_SYMBOL, SECTION_RELOCATION };
+
+/* Returns where the label at ADDR in an object ends up when its .text is
+   placed at TEXT_BASE and its .data at DATA_ADDR. */
+uint32_t place_symbol(uint32_t addr, uint32_t text_base, uint32_t data_addr) {
+    return addr >= DATA_BASE ? data_addr + (addr - DATA_BASE) : text_base + addr;
+}
+
+/* Parses a "<addr>\t<name>" line into TABLE. Relocation lines may carry
+   their type in a third column, as written by write_relocs(). Only labels
+   in .data may be unaligned. Returns 0 on success and -1 if the line is
+   malformed. */
+static int read_table_line(SymbolTable* table, char* line, int relocations) {
+    char* save;
+    char* addr_str = strtok_r(line, " \t\n\r", &save);
+    char* name = strtok_r(NULL, " \t\n\r", &save);
+    char* type_str = strtok_r(NULL, " \t\n\r", &save);
+    if (!addr_str || !name || (type_str && !relocations)) {
+        return -1;
+    }
+    char* end;
+    unsigned long addr = strtoul(addr_str, &end, 10);
+    if (*end != '\0' || addr > UINT32_MAX
+        || (addr % 4 != 0 && (relocations || addr < DATA_BASE))) {
+        return -1;
+    }
+    int type = type_str ? parse_reloc_type(type_str) : R_26;
+    if (type < 0) {
+        return -1;
+    }
+    return relocations ? add_reloc(table, name, addr, type) : add_to_table(table, name, addr);
+}
+
+/* Reads the object in INPUT, which is in the format pass two writes, into
+   OBJ. NAME is only used in error messages. Only reentrant functions are
+   used so that several objects can be read at once. Returns 0 on success and
+   -1 on error, in which case OBJ holds nothing that needs freeing.
+ */
+int read_object(ObjectFile* obj, FILE* input, const char* name) {
+    char buf[OBJ_BUF_SIZE];
+    int section = SECTION_NONE;
+    uint32_t line = 0;
+
+    init_word_buffer(&obj->text);
+    init_word_buffer(&obj->data);
+    obj->symtbl = create_table(SYMTBL_NON_UNIQUE);
+    obj->reltbl = create_table(SYMTBL_NON_UNIQUE);
+    while (fgets(buf, sizeof(buf), input)) {
+        line++;
+        char* start = buf + strspn(buf, " \t\r\n");
+        if (*start == '\0') {
+            continue;
+        }
+        if (*start == '.') {
+            start[strcspn(start, " \t\r\n")] = '\0';
+            if (strcmp(start, ".text") == 0) {
+                section = SECTION_TEXT;
+            } else if (strcmp(start, ".data") == 0) {
+                section = SECTION_DATA;
+            } else if (strcmp(start, ".symbol") == 0) {
+                section = SECTION_SYMBOL;
+            } else if (strcmp(start, ".relocation") == 0) {
+                section = SECTION_RELOCATION;
+            } else {
+                goto malformed;
+            }
+            continue;
+        }
+        if (section == SECTION_TEXT || section == SECTION_DATA) {
+            char* end;
+            unsigned long word = strtoul(start, &end, 16);
+            if (end == start || strspn(end, " \t\r\n") != strlen(end) || word > UINT32_MAX) {
+                goto malformed;
+            }
+            append_word(section == SECTION_TEXT ? &obj->text : &obj->data, word);
+        } else if (section == SECTION_SYMBOL) {
+            if (read_table_line(obj->symtbl, start, 0) != 0) {
+                goto malformed;
+            }
+        } else if (section == SECTION_RELOCATION) {
+            if (read_table_line(obj->reltbl, start, 1) != 0) {
+                goto malformed;
+            }
+        } else {
+            goto malformed;
+        }
+    }
+
+    /* Every relocation must land on a word of .text. */
+    const char* sym;
+    uint32_t offset;
+    for (uint32_t i = 0; get_symbol(obj->reltbl, i, &sym, &offset) == 0; i++) {
+        if (offset / 4 >= obj->text.len) {
+            write_to_log("Error: relocation for %s in %s is outside .text\n", sym, name);
+            free_object(obj);
+            return -1;
+        }
+    }
+    return 0;
+
+malformed:
+    write_to_log("Error: malformed object %s at line %u\n", name, line);
+    free_object(obj);
+    return -1;
+}
+
+/* Reads INPUT into OBJ whichever object format it is in. Returns 0 on
+   success and -1 on error. */
+int read_object_file(ObjectFile* obj, FILE* input, const char* name) {
+    if (is_elf_object(input)) {
+        return read_elf_object(obj, input, name);
+    }
+    return read_object(obj, input, name);
+}
+
+/* Writes OBJ to OUTPUT in the format pass two writes. Returns 0 on success
+   and -1 on error. */
+int write_object(FILE* output, const ObjectFile* obj) {
+    fprintf(output, ".text\n");
+    for (uint32_t i = 0; i < obj->text.len; i++) {
+        write_inst_hex(output, obj->text.words[i]);
+    }
+    if (obj->data.len) {
+        fprintf(output, "\n.data\n");
+        write_section_hex(output, &obj->data);
+    }
+    fprintf(output, "\n.symbol\n");
+    write_table(obj->symtbl, output);
+    fprintf(output, "\n.relocation\n");
+    write_relocs(obj->reltbl, output);
+    return ferror(output) ? -1 : 0;
+}
+
+/* Writes WORDS to OUTPUT in hexadecimal, one per line as write_inst_hex()
+   would, but formatted into one buffer and written with a single call.
+   Returns 0 on success and -1 on error. */
+int write_section_hex(FILE* output, const WordBuffer* words) {
+    static const char digits[] = "0123456789abcdef";
+    if (words->len == 0) {
+        return 0;
+    }
+    size_t size = (size_t) words->len * 9;
+    Allocator* alloc = get_table_allocator();
+    char* buf = alloc->alloc(alloc, size);
+    if (!buf) {
+        allocation_failed();
+    }
+    char* p = buf;
+    for (uint32_t i = 0; i < words->len; i++) {
+        uint32_t word = words->words[i];
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            *p++ = digits[word >> shift & 0xF];
+        }
+        *p++ = '\n';
+    }
+    int err = fwrite(buf, 1, size, output) != size;
+    alloc->release(alloc, buf, size);
+    return err ? -1 : 0;
+}
+
+void free_object(ObjectFile* obj) {
+    free_word_buffer(&obj->text);
+    free_word_buffer(&obj->data);
+    if (obj->symtbl) {
+        free_table(obj->symtbl);
+        obj->symtbl = NULL;
+    }
+    if (obj->reltbl) {
+        free_table(obj->reltbl);
+        obj->reltbl = NULL;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdint.h>
+
+/* A growable array of encoded instructions, allocated from the table
+   allocator. */
+typedef struct {
+    uint32_t* words;
+    uint32_t len;
+    uint32_t cap;
+} WordBuffer;
+
+void init_word_buffer(WordBuffer* buffer);
+
+void reserve_word_buffer(WordBuffer* buffer, uint32_t min_cap);
+
+void append_word(WordBuffer* buffer, uint32_t word);
+
+void resize_word_buffer(WordBuffer* buffer, uint32_t len);
+
+void free_word_buffer(WordBuffer* buffer);
+
+/* An assembled object read back from the text output format: its encoded
+   .text words, its .data as big-endian words, the labels it defines and the
+   jumps waiting on relocation. Addresses are byte offsets from the start of
+   TEXT, or from DATA_BASE for labels in DATA. */
+typedef struct {
+    WordBuffer text;
+    WordBuffer data;
+    SymbolTable* symtbl;
+    SymbolTable* reltbl;
+} ObjectFile;
+
+uint32_t place_symbol(uint32_t addr, uint32_t text_base, uint32_t data_base);
+
+int read_object(ObjectFile* obj, FILE* input, const char* name);
+
+int read_object_file(ObjectFile* obj, FILE* input, const char* name);
+
+int write_object(FILE* output, const ObjectFile* obj);
+
+int write_section_hex(FILE* output, const WordBuffer* words);
+
+void free_object(ObjectFile* obj);
+
+#endif
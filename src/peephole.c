@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate.h"
+#include "program.h"
+#include "peephole.h"
+
+static const char* PATTERN_NAMES[NUM_PEEPHOLE_PATTERNS] = {
+    [PEEP_SELF_MOVE] = "self moves",
+    [PEEP_ZERO_WRITE] = "writes to $zero",
+    [PEEP_LUI_PAIR] = "back-to-back lui",
+    [PEEP_DEAD_CONSTANT] = "dead constant loads",
+    [PEEP_DEAD_WRITE] = "dead writes",
+    [PEEP_FOLDED_LUI] = "folded lui 0",
+};
+
+/* Returns the name of PATTERN for reports. */
+const char* peephole_pattern_name(int pattern) {
+    return pattern >= 0 && pattern < NUM_PEEPHOLE_PATTERNS ? PATTERN_NAMES[pattern] : NULL;
+}
+
+/* Returns 1 if INST leaves every register as it was. None of these can
+   trap, since adding or subtracting $zero never overflows. */
+static int is_self_move(const Instr* inst) {
+    if (inst->label) {
+        return 0;
+    }
+    switch (inst->id) {
+        case INST_ADDIU:
+        case INST_ADDI:
+        case INST_ORI:
+        case INST_XORI:
+            return inst->rt == inst->rs && inst->imm == 0;
+        case INST_ADDU:
+        case INST_ADD:
+        case INST_OR:
+        case INST_XOR:
+            return (inst->rd == inst->rs && inst->rt == 0)
+                || (inst->rd == inst->rt && inst->rs == 0);
+        case INST_SUBU:
+        case INST_SUB:
+            return inst->rd == inst->rs && inst->rt == 0;
+        case INST_AND:
+            return inst->rd == inst->rs && inst->rt == inst->rs;
+        case INST_SLL:
+        case INST_SRL:
+        case INST_SRA:
+            return inst->rd == inst->rt && inst->imm == 0;
+        case INST_SLLV:
+        case INST_SRLV:
+        case INST_SRAV:
+            return inst->rd == inst->rt && inst->rs == 0;
+        case INST_MOVZ:
+        case INST_MOVN:
+            return inst->rd == inst->rs || (inst->id == INST_MOVN && inst->rt == 0);
+        default:
+            return 0;
+    }
+}
+
+/* Returns the index of the first instruction after I and before END that is
+   not REMOVED, or END. */
+static uint32_t next_live(const uint8_t* removed, uint32_t i, uint32_t end) {
+    do {
+        i++;
+    } while (i < end && removed[i]);
+    return i;
+}
+
+/* Returns the index of the last instruction before I and at or after START
+   that is not REMOVED, or PROG_NONE. */
+static uint32_t prev_live(const uint8_t* removed, uint32_t i, uint32_t start) {
+    while (i > start) {
+        i--;
+        if (!removed[i]) {
+            return i;
+        }
+    }
+    return PROG_NONE;
+}
+
+/* Returns 1 if DEF, written by the instruction at I, is written again
+   within the window and before END without being read first. */
+static int overwritten(const ProgCode* code, const uint8_t* removed, uint32_t i, uint32_t end,
+    uint64_t def) {
+    unsigned seen = 0;
+    for (uint32_t j = next_live(removed, i, end); j < end && seen < PEEPHOLE_WINDOW;
+        j = next_live(removed, j, end), seen++) {
+        uint64_t uses, defs;
+        inst_regs(&code->insts[j].inst, &uses, &defs);
+        if (uses & def) {
+            return 0;
+        }
+        if (defs & def) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Returns 1 if the instruction at I loads a constant, as li expands to. */
+static int is_constant_load(const ProgCode* code, const uint8_t* removed, uint32_t i,
+    uint32_t start) {
+    const Instr* inst = &code->insts[i].inst;
+    switch (inst->id) {
+        case INST_LUI:
+            return 1;
+        case INST_ADDIU:
+        case INST_ORI:
+        case INST_XORI:
+            if (inst->rs == 0) {
+                return 1;
+            }
+            if (inst->id == INST_ORI && inst->rs == inst->rt) {
+                uint32_t prev = prev_live(removed, i, start);
+                return prev != PROG_NONE && code->insts[prev].inst.id == INST_LUI
+                    && code->insts[prev].inst.rt == inst->rt;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+/* Looks for a pattern at I, in the block [START, END). Returns the pattern
+   if the instruction at I goes, and -1 otherwise. */
+static int match_pattern(ProgCode* code, const uint8_t* removed, uint32_t i, uint32_t start,
+    uint32_t end) {
+    Instr* inst = &code->insts[i].inst;
+    uint64_t uses, defs;
+    inst_regs(inst, &uses, &defs);
+    int pure = is_pure(inst);
+    if (pure && defs == 0) {
+        return PEEP_ZERO_WRITE;
+    }
+    if (is_self_move(inst)) {
+        return PEEP_SELF_MOVE;
+    }
+    if (!pure) {
+        return -1;
+    }
+    uint32_t next = next_live(removed, i, end);
+    const Instr* follower = next < end ? &code->insts[next].inst : NULL;
+    if (overwritten(code, removed, i, end, defs)) {
+        if (inst->id == INST_LUI && follower->id == INST_LUI && follower->rt == inst->rt) {
+            return PEEP_LUI_PAIR;
+        }
+        return is_constant_load(code, removed, i, start) ? PEEP_DEAD_CONSTANT
+                                                         : PEEP_DEAD_WRITE;
+    }
+    if (inst->id == INST_LUI && !inst->label && inst->imm == 0 && follower
+        && (follower->id == INST_ORI || follower->id == INST_ADDIU) && !follower->label
+        && follower->rs == inst->rt && follower->rt == inst->rt) {
+        code->insts[next].inst.rs = 0;
+        return PEEP_FOLDED_LUI;
+    }
+    return -1;
+}
+
+/* Applies the patterns of peephole.h to PROG and counts what they removed
+   in STATS. Programs with instructions that did not decode are left alone.
+ */
+void peephole_program(Program* prog, PeepholeStats* stats) {
+    memset(stats, 0, sizeof(PeepholeStats));
+    ProgCode* code = &prog->code;
+    if (prog->num_invalid || code->len == 0) {
+        return;
+    }
+    ProgBlocks blocks;
+    find_blocks(&blocks, prog);
+    Allocator* alloc = get_table_allocator();
+    uint8_t* removed = alloc->alloc(alloc, code->len);
+    if (!removed) {
+        allocation_failed();
+    }
+    memset(removed, 0, code->len);
+
+    /* Removing an instruction can expose another pattern before it, so
+       each block is rescanned until nothing changes. */
+    for (uint32_t b = 0; b < blocks.num_blocks; b++) {
+        uint32_t start = blocks.blocks[b].start, end = blocks.blocks[b].end;
+        int changed;
+        do {
+            changed = 0;
+            for (uint32_t i = start; i < end; i++) {
+                if (removed[i]) {
+                    continue;
+                }
+                int pattern = match_pattern(code, removed, i, start, end);
+                if (pattern >= 0) {
+                    removed[i] = 1;
+                    stats->removed[pattern]++;
+                    stats->total++;
+                    changed = 1;
+                }
+            }
+        } while (changed);
+    }
+    free_blocks(&blocks);
+
+    if (stats->total) {
+        ProgCode out;
+        memset(&out, 0, sizeof(ProgCode));
+        uint32_t l = 0;
+        for (uint32_t i = 0; i <= code->len; i++) {
+            for (; l < code->num_labels && code->labels[l].index == i; l++) {
+                push_label(&out, code->labels[l].name);
+            }
+            if (i < code->len && !removed[i]) {
+                push_inst(&out, &code->insts[i]);
+            }
+        }
+        alloc->release(alloc, removed, code->len);
+        replace_code(prog, &out);
+    } else {
+        alloc->release(alloc, removed, code->len);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdint.h>
+
+/* Peephole optimization of expanded programs.
+
+   peephole_program() slides a window of PEEPHOLE_WINDOW instructions over
+   each basic block of a Program and removes or combines:
+
+     - moves of a register to itself, such as addiu $x, $x, 0, or $x, $x,
+       $zero or sll $x, $x, 0;
+     - instructions whose only effect is a write to $zero, such as the
+       canonical nop sll $zero, $zero, 0;
+     - a lui immediately overwritten by another lui to the same register;
+     - constant loads (li, and the halves of its lui and ori expansion)
+       whose register is written again before it is read;
+     - other register computations whose result is overwritten unread;
+     - a lui of 0 followed by an ori or addiu of the same register, which
+       becomes a single ori or addiu from $zero.
+
+   Labels are barriers: blocks start at every label, and nothing is looked
+   at across a block boundary, so code reached by a jump sees exactly the
+   registers it did before. Registers are assumed live at the end of every
+   block. Only instructions without memory accesses, control flow or traps
+   are ever removed. Addresses are recomputed from the shorter program
+   afterwards.
+ */
+
+#define PEEPHOLE_WINDOW 16
+
+typedef enum {
+    PEEP_SELF_MOVE,
+    PEEP_ZERO_WRITE,
+    PEEP_LUI_PAIR,
+    PEEP_DEAD_CONSTANT,
+    PEEP_DEAD_WRITE,
+    PEEP_FOLDED_LUI,
+    NUM_PEEPHOLE_PATTERNS
+} PeepholePattern;
+
+typedef struct {
+    uint32_t removed[NUM_PEEPHOLE_PATTERNS];
+    uint32_t total;
+} PeepholeStats;
+
+const char* peephole_pattern_name(int pattern);
+
+void peephole_program(Program* prog, PeepholeStats* stats);
+
+#endif
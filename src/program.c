@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tables.h"
+#include "translate_utils.h"
+#include "translate.h"
+#include "program.h"
+
+static const size_t STRING_CHUNK_SIZE = 64 * 1024;
+
+static void* grow(void* ptr, uint32_t* cap, uint32_t want, size_t elem) {
+    if (want <= *cap) {
+        return ptr;
+    }
+    uint32_t new_cap = *cap ? *cap : 64;
+    while (new_cap < want) {
+        new_cap *= 2;
+    }
+    Allocator* alloc = get_table_allocator();
+    void* resized = alloc->resize(alloc, ptr, *cap * elem, new_cap * elem);
+    if (!resized) {
+        allocation_failed();
+    }
+    *cap = new_cap;
+    return resized;
+}
+
+static void* alloc_zeroed(size_t size) {
+    Allocator* alloc = get_table_allocator();
+    void* ptr = alloc->alloc(alloc, size);
+    if (!ptr) {
+        allocation_failed();
+    }
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static void release(void* ptr, size_t size) {
+    if (ptr) {
+        Allocator* alloc = get_table_allocator();
+        alloc->release(alloc, ptr, size);
+    }
+}
+
+static char* copy_string(Program* prog, const char* str) {
+    size_t size = strlen(str) + 1;
+    char* copy = prog->strings.base.alloc(&prog->strings.base, size);
+    if (!copy) {
+        allocation_failed();
+    }
+    memcpy(copy, str, size);
+    return copy;
+}
+
+void init_program(Program* prog) {
+    memset(prog, 0, sizeof(Program));
+    init_arena_allocator(&prog->strings, get_table_allocator(), STRING_CHUNK_SIZE);
+}
+
+void free_code(ProgCode* code) {
+    release(code->insts, code->cap * sizeof(ProgInst));
+    release(code->labels, code->labels_cap * sizeof(ProgLabel));
+    memset(code, 0, sizeof(ProgCode));
+}
+
+void free_program(Program* prog) {
+    free_code(&prog->code);
+    destroy_arena_allocator(&prog->strings);
+}
+
+/* Appends a copy of INST to CODE. */
+void push_inst(ProgCode* code, const ProgInst* inst) {
+    code->insts = grow(code->insts, &code->cap, code->len + 1, sizeof(ProgInst));
+    code->insts[code->len++] = *inst;
+}
+
+/* Defines label NAME, which must belong to the program, at the end of
+   CODE, so that it names the next instruction pushed. */
+void push_label(ProgCode* code, const char* name) {
+    code->labels = grow(code->labels, &code->labels_cap, code->num_labels + 1,
+        sizeof(ProgLabel));
+    code->labels[code->num_labels].name = name;
+    code->labels[code->num_labels].index = code->len;
+    code->num_labels++;
+}
+
+/* Makes CODE, built by a stage, the program's code and leaves CODE empty. */
+void replace_code(Program* prog, ProgCode* code) {
+    free_code(&prog->code);
+    prog->code = *code;
+    memset(code, 0, sizeof(ProgCode));
+}
+
+/* Appends the expanded instruction NAME with ARGS from source line LINE,
+   decoding it if possible. Returns 0 if it decoded and -1 if it is kept as
+   text. */
+int add_program_inst(Program* prog, const char* name, char** args, int num_args,
+    uint32_t line) {
+    ProgInst inst;
+    memset(&inst, 0, sizeof(ProgInst));
+    inst.line = line;
+    if (decode_inst(&inst.inst, name, args, num_args) == 0) {
+        inst.valid = 1;
+        if (inst.inst.label) {
+            inst.inst.label = copy_string(prog, inst.inst.label);
+        }
+    } else {
+        inst.name = copy_string(prog, name);
+        inst.args = prog->strings.base.alloc(&prog->strings.base,
+            (num_args ? num_args : 1) * sizeof(char*));
+        if (!inst.args) {
+            allocation_failed();
+        }
+        for (int i = 0; i < num_args; i++) {
+            inst.args[i] = copy_string(prog, args[i]);
+        }
+        inst.num_args = num_args;
+        prog->num_invalid++;
+    }
+    push_inst(&prog->code, &inst);
+    return inst.valid ? 0 : -1;
+}
+
+/* Defines label NAME at the end of the program. Returns the program's copy
+   of the name. */
+const char* add_program_label(Program* prog, const char* name) {
+    const char* copy = copy_string(prog, name);
+    push_label(&prog->code, copy);
+    return copy;
+}
+
+/* Returns a label name not used by the program, for a stage that has to
+   refer to an instruction nobody named. The caller defines it. Names are
+   _B<n>, numbered past any the source already uses. */
+const char* new_program_label(Program* prog) {
+    if (prog->next_label == 0) {
+        prog->next_label = 1;
+        for (uint32_t i = 0; i < prog->code.num_labels; i++) {
+            unsigned n;
+            char rest;
+            if (sscanf(prog->code.labels[i].name, "_B%u%c", &n, &rest) == 1
+                && n >= prog->next_label) {
+                prog->next_label = n + 1;
+            }
+        }
+    }
+    char name[24];
+    snprintf(name, sizeof(name), "_B%u", prog->next_label++);
+    return copy_string(prog, name);
+}
+
+/*******************************
+ * Control flow
+ *******************************/
+
+/* Returns 1 if INST is a conditional branch. */
+int is_branch(const Instr* inst) {
+    const FormatInfo* info = format_info(inst->fmt);
+    return info && info->label == LABEL_BRANCH;
+}
+
+/* Turns the branch INST into the branch taken exactly when INST is not.
+   Returns 0 on success and -1 if it has no such counterpart (bltzal and
+   bgezal, which link either way). */
+int invert_branch(Instr* inst) {
+    static const uint8_t INVERSE[NUM_INSTS] = {
+        [INST_BEQ] = INST_BNE, [INST_BNE] = INST_BEQ,
+        [INST_BLEZ] = INST_BGTZ, [INST_BGTZ] = INST_BLEZ,
+        [INST_BLTZ] = INST_BGEZ, [INST_BGEZ] = INST_BLTZ,
+    };
+    uint8_t id = inst->id < NUM_INSTS ? INVERSE[inst->id] : 0;
+    if (!id) {
+        return -1;
+    }
+    Instr inverted;
+    init_inst(&inverted, id);
+    inverted.rs = inst->rs;
+    inverted.rt = inst->fmt == FMT_BRANCH ? inst->rt : inverted.rt;
+    inverted.label = inst->label;
+    *inst = inverted;
+    return 0;
+}
+
+/* Stores in OUT a j to LABEL that takes its source line from LIKE. */
+void make_jump(ProgInst* out, const ProgInst* like, const char* label) {
+    memset(out, 0, sizeof(ProgInst));
+    init_inst(&out->inst, INST_J);
+    out->inst.label = label;
+    out->line = like->line;
+    out->valid = 1;
+}
+
+/* Returns 1 if control never continues past INST. */
+static int ends_flow(const Instr* inst) {
+    return inst->id == INST_J || inst->id == INST_JR;
+}
+
+/* Returns 1 if INST ends a basic block. */
+int ends_block(const Instr* inst) {
+    return is_branch(inst) || inst->id == INST_J || inst->id == INST_JAL
+        || inst->id == INST_JR || inst->id == INST_JALR;
+}
+
+/* Builds a hash index of the labels of CODE, for lookup_label(). */
+void index_labels(LabelIndex* index, const ProgCode* code) {
+    index->num_buckets = 16;
+    while (index->num_buckets < 2 * code->num_labels) {
+        index->num_buckets *= 2;
+    }
+    index->buckets = alloc_zeroed(index->num_buckets * sizeof(uint32_t));
+    uint32_t mask = index->num_buckets - 1;
+    for (uint32_t i = 0; i < code->num_labels; i++) {
+        uint32_t b = symbol_hash(code->labels[i].name) & mask;
+        while (index->buckets[b]) {
+            b = (b + 1) & mask;
+        }
+        index->buckets[b] = i + 1;
+    }
+}
+
+/* Returns the position in CODE's labels of the label NAME, or PROG_NONE if
+   CODE does not define it. */
+uint32_t lookup_label(const LabelIndex* index, const ProgCode* code, const char* name) {
+    uint32_t mask = index->num_buckets - 1;
+    for (uint32_t b = symbol_hash(name) & mask; index->buckets[b]; b = (b + 1) & mask) {
+        uint32_t label = index->buckets[b] - 1;
+        if (strcmp(code->labels[label].name, name) == 0) {
+            return label;
+        }
+    }
+    return PROG_NONE;
+}
+
+void free_label_index(LabelIndex* index) {
+    release(index->buckets, index->num_buckets * sizeof(uint32_t));
+    index->buckets = NULL;
+}
+
+/* Returns, for each instruction of PROG, the index of the instruction its
+   branch or jump label names, or PROG_NONE if it has no label operand or
+   the label is not defined in PROG (an external jump target). An index of
+   LEN is the end of the program. Runs in linear time. The array has LEN + 1
+   entries and is released with the table allocator.
+ */
+uint32_t* program_targets(const Program* prog) {
+    const ProgCode* code = &prog->code;
+    LabelIndex index;
+    index_labels(&index, code);
+    uint32_t* targets = alloc_zeroed((code->len + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < code->len; i++) {
+        const Instr* inst = &code->insts[i].inst;
+        targets[i] = PROG_NONE;
+        if (!code->insts[i].valid || !inst->label) {
+            continue;
+        }
+        LabelUse use = format_info(inst->fmt)->label;
+        if (use == LABEL_BRANCH || use == LABEL_JUMP) {
+            uint32_t label = lookup_label(&index, code, inst->label);
+            targets[i] = label == PROG_NONE ? PROG_NONE : code->labels[label].index;
+        }
+    }
+    targets[code->len] = PROG_NONE;
+    free_label_index(&index);
+    return targets;
+}
+
+/* Splits PROG into basic blocks, which start at the first instruction, at
+   every label and after every branch and jump, and resolves their
+   successors. Runs in linear time. */
+void find_blocks(ProgBlocks* blocks, const Program* prog) {
+    const ProgCode* code = &prog->code;
+    uint32_t len = code->len;
+    blocks->len = len;
+    blocks->block_of = alloc_zeroed((len + 1) * sizeof(uint32_t));
+
+    /* Mark leaders in BLOCK_OF, then number them. */
+    uint8_t* leader = alloc_zeroed(len + 1);
+    leader[0] = 1;
+    for (uint32_t i = 0; i < code->num_labels; i++) {
+        leader[code->labels[i].index] = 1;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        if (ends_block(&code->insts[i].inst)) {
+            leader[i + 1] = 1;
+        }
+    }
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        n += leader[i];
+        blocks->block_of[i] = n - 1;
+    }
+    blocks->block_of[len] = n;
+    blocks->num_blocks = n;
+    blocks->blocks = alloc_zeroed((n ? n : 1) * sizeof(ProgBlock));
+
+    uint32_t* targets = program_targets(prog);
+    uint32_t label = 0;
+    for (uint32_t b = 0, i = 0; b < n; b++) {
+        ProgBlock* block = &blocks->blocks[b];
+        block->start = i;
+        do {
+            i++;
+        } while (i < len && !leader[i]);
+        block->end = i;
+        while (label < code->num_labels && code->labels[label].index < block->start) {
+            label++;
+        }
+        block->first_label = label;
+        while (label < code->num_labels && code->labels[label].index == block->start) {
+            label++;
+        }
+        block->end_label = label;
+
+        const ProgInst* last = &code->insts[block->end - 1];
+        uint32_t target = targets[block->end - 1];
+        block->taken = PROG_NONE;
+        if (last->valid && ends_block(&last->inst) && target != PROG_NONE) {
+            block->taken = blocks->block_of[target];
+        }
+        block->fall = last->valid && ends_flow(&last->inst) ? PROG_NONE : b + 1;
+    }
+    release(targets, (len + 1) * sizeof(uint32_t));
+    release(leader, len + 1);
+}
+
+void free_blocks(ProgBlocks* blocks) {
+    release(blocks->blocks, (blocks->num_blocks ? blocks->num_blocks : 1) * sizeof(ProgBlock));
+    release(blocks->block_of, (blocks->len + 1) * sizeof(uint32_t));
+    memset(blocks, 0, sizeof(ProgBlocks));
+}
+
+/*******************************
+ * Register use
+ *******************************/
+
+/* Stores in USES and DEFS the registers INST reads and writes, as bit N for
+   register N and PROG_HI and PROG_LO for hi and lo. $zero is never in
+   either. Instructions that reach outside the registers (syscall, break and
+   sync) use and define everything, so nothing moves across them. */
+void inst_regs(const Instr* inst, uint64_t* uses, uint64_t* defs) {
+    uint64_t rs = 1ull << inst->rs, rt = 1ull << inst->rt, rd = 1ull << inst->rd;
+    uint64_t u = 0, d = 0;
+    switch (inst->fmt) {
+        case FMT_RTYPE:
+            u = rs | rt;
+            d = rd;
+            if (inst->id == INST_MOVZ || inst->id == INST_MOVN) {
+                u |= rd;
+            }
+            break;
+        case FMT_SHIFT:  u = rt;      d = rd; break;
+        case FMT_SHIFTV: u = rs | rt; d = rd; break;
+        case FMT_JALR:   u = rs;      d = rd; break;
+        case FMT_CLZ:    u = rs;      d = rd; break;
+        case FMT_ADDIU:
+        case FMT_ORI:
+        case FMT_LOGIC:  u = rs;      d = rt; break;
+        case FMT_LUI:    d = rt; break;
+        case FMT_BRANCH: u = rs | rt; break;
+        case FMT_BRANCHZ:
+            u = rs;
+            d = inst->id == INST_BLTZAL || inst->id == INST_BGEZAL ? 1ull << 31 : 0;
+            break;
+        case FMT_TRAPI:  u = rs; break;
+        case FMT_JUMP:   d = inst->id == INST_JAL ? 1ull << 31 : 0; break;
+        case FMT_JR:
+            u = rs;
+            d = inst->id == INST_MTHI ? PROG_HI : inst->id == INST_MTLO ? PROG_LO : 0;
+            break;
+        case FMT_MFHI:
+            u = inst->id == INST_MFHI ? PROG_HI : PROG_LO;
+            d = rd;
+            break;
+        case FMT_MULDIV:
+            u = rs | rt;
+            if (inst->id == INST_MADD || inst->id == INST_MADDU || inst->id == INST_MSUB
+                || inst->id == INST_MSUBU) {
+                u |= PROG_HI | PROG_LO;
+            }
+            if (inst->id == INST_MULT || inst->id == INST_MULTU || inst->id == INST_DIV
+                || inst->id == INST_DIVU || u & PROG_HI) {
+                d = PROG_HI | PROG_LO;
+            }
+            break;
+        case FMT_MEM:
+            u = rs;
+            if (is_store(inst) || inst->id == INST_LWL || inst->id == INST_LWR) {
+                u |= rt;
+            }
+            if (!is_store(inst) || inst->id == INST_SC) {
+                d = rt;
+            }
+            break;
+        default:
+            u = d = ~0ull;
+            break;
+    }
+    *uses = u & ~1ull;
+    *defs = d & ~1ull;
+}
+
+/* Returns 1 if INST is a store. */
+int is_store(const Instr* inst) {
+    switch (inst->id) {
+        case INST_SB: case INST_SH: case INST_SW: case INST_SWL: case INST_SWR: case INST_SC:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Returns 1 if INST is a load. */
+int is_load(const Instr* inst) {
+    return inst->fmt == FMT_MEM && (!is_store(inst) || inst->id == INST_SC);
+}
+
+/* Returns 1 if INST does nothing but compute a register from registers, so
+   that it can be removed or moved as long as the registers it reads and
+   writes allow: no memory, no control flow and no traps. */
+int is_pure(const Instr* inst) {
+    switch (inst->fmt) {
+        case FMT_RTYPE:
+            return inst->id != INST_ADD && inst->id != INST_SUB;
+        case FMT_SHIFT:
+        case FMT_SHIFTV:
+        case FMT_CLZ:
+        case FMT_ORI:
+        case FMT_LOGIC:
+        case FMT_LUI:
+        case FMT_MFHI:
+            return 1;
+        case FMT_ADDIU:
+            return inst->id != INST_ADDI;
+        default:
+            return 0;
+    }
+}
+
+/*******************************
+ * Output
+ *******************************/
+
+/* Stores the text of INST in TEXT, as pass one would have written it. */
+void format_prog_inst(ProgText* text, const ProgInst* inst) {
+    if (!inst->valid) {
+        text->name = inst->name;
+        text->num_args = inst->num_args;
+        for (int i = 0; i < inst->num_args; i++) {
+            text->args[i] = inst->args[i];
+        }
+        return;
+    }
+    const Instr* in = &inst->inst;
+    const FormatInfo* info = format_info(in->fmt);
+    text->name = inst_name(in->id);
+    text->num_args = info->num_operands;
+    for (int i = 0; i < info->num_operands; i++) {
+        switch (info->operands[i]) {
+            case OPERAND_RD:
+            case OPERAND_RDT:
+                text->args[i] = (char*) reg_name(in->rd);
+                break;
+            case OPERAND_RS:
+                text->args[i] = (char*) reg_name(in->rs);
+                break;
+            case OPERAND_RT:
+                text->args[i] = (char*) reg_name(in->rt);
+                break;
+            case OPERAND_LABEL:
+                text->args[i] = (char*) in->label;
+                break;
+            default:
+                if (in->label) {
+                    text->args[i] = (char*) in->label;
+                } else {
+                    snprintf(text->nums[i], sizeof(text->nums[i]), "%d", in->imm);
+                    text->args[i] = text->nums[i];
+                }
+                break;
+        }
+    }
+}
+
+/* Writes INST to OUTPUT in the text intermediate format. */
+void write_prog_inst(FILE* output, const ProgInst* inst) {
+    ProgText text;
+    format_prog_inst(&text, inst);
+    write_inst_string(output, text.name, text.args, text.num_args);
+}
+
+/* Returns a new symbol table giving every label of PROG its address. */
+SymbolTable* program_symbols(const Program* prog) {
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    for (uint32_t i = 0; i < prog->code.num_labels; i++) {
+        add_to_table(symtbl, prog->code.labels[i].name, prog->code.labels[i].index * 4);
+    }
+    return symtbl;
+}
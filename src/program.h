@@ -0,0 +1,150 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <stdint.h>
+
+/* Expanded programs.
+
+   A Program holds what pass one would write to the intermediate file, in
+   memory, so that optional stages can rewrite it before pass two: every
+   instruction after pseudoinstruction expansion, decoded, and every label
+   as the index of the instruction it names instead of an address. Stages
+   build a new instruction and label sequence with push_inst() and
+   push_label() and then swap it in with replace_code(); addresses only come
+   back into existence when program_symbols() numbers the result.
+
+   Label names live in the program's arena for as long as the program, so
+   Instr.label always points at a name that stays valid across rewrites.
+   Instructions that failed to decode are kept as text (VALID is 0), and
+   stages leave programs containing any alone, so that pass two reports
+   them exactly as it would have.
+ */
+
+#define PROG_NONE 0xFFFFFFFFu
+
+/* Register set bits for hi and lo, next to the 32 general registers. */
+#define PROG_HI (1ull << 32)
+#define PROG_LO (1ull << 33)
+
+/* One expanded instruction. NAME, ARGS and NUM_ARGS keep the text of an
+   instruction that failed to decode and are unused otherwise. LINE is the
+   source line it came from. */
+typedef struct {
+    Instr inst;
+    uint32_t line;
+    uint8_t valid;
+    uint8_t num_args;
+    const char* name;
+    char** args;
+} ProgInst;
+
+/* The operands of an instruction as pass one writes them. NUMS holds the
+   text of numeric operands. */
+typedef struct {
+    const char* name;
+    char* args[4];
+    int num_args;
+    char nums[3][16];
+} ProgText;
+
+/* A label naming the instruction at INDEX (or the end of the program). */
+typedef struct {
+    const char* name;
+    uint32_t index;
+} ProgLabel;
+
+/* An instruction sequence with labels in nondecreasing INDEX order. */
+typedef struct {
+    ProgInst* insts;
+    uint32_t len;
+    uint32_t cap;
+    ProgLabel* labels;
+    uint32_t num_labels;
+    uint32_t labels_cap;
+} ProgCode;
+
+typedef struct {
+    ProgCode code;
+    ArenaAllocator strings;
+    uint32_t num_invalid;
+    uint32_t next_label;
+} Program;
+
+/* A basic block: instructions [START, END) and labels [FIRST_LABEL,
+   END_LABEL). TAKEN is the block a branch or jump at its end goes to, and
+   FALL the block that runs next if control can continue past its end, with
+   NUM_BLOCKS standing for the end of the program and PROG_NONE for
+   neither. */
+typedef struct {
+    uint32_t start, end;
+    uint32_t first_label, end_label;
+    uint32_t taken;
+    uint32_t fall;
+} ProgBlock;
+
+typedef struct {
+    uint32_t* buckets;
+    uint32_t num_buckets;
+} LabelIndex;
+
+typedef struct {
+    ProgBlock* blocks;
+    uint32_t num_blocks;
+    uint32_t* block_of;
+    uint32_t len;
+} ProgBlocks;
+
+void init_program(Program* prog);
+
+void free_program(Program* prog);
+
+int add_program_inst(Program* prog, const char* name, char** args, int num_args,
+    uint32_t line);
+
+const char* add_program_label(Program* prog, const char* name);
+
+const char* new_program_label(Program* prog);
+
+void push_inst(ProgCode* code, const ProgInst* inst);
+
+void push_label(ProgCode* code, const char* name);
+
+void replace_code(Program* prog, ProgCode* code);
+
+void free_code(ProgCode* code);
+
+int is_branch(const Instr* inst);
+
+int invert_branch(Instr* inst);
+
+int ends_block(const Instr* inst);
+
+void make_jump(ProgInst* out, const ProgInst* like, const char* label);
+
+void index_labels(LabelIndex* index, const ProgCode* code);
+
+uint32_t lookup_label(const LabelIndex* index, const ProgCode* code, const char* name);
+
+void free_label_index(LabelIndex* index);
+
+uint32_t* program_targets(const Program* prog);
+
+void find_blocks(ProgBlocks* blocks, const Program* prog);
+
+void free_blocks(ProgBlocks* blocks);
+
+void inst_regs(const Instr* inst, uint64_t* uses, uint64_t* defs);
+
+int is_store(const Instr* inst);
+
+int is_load(const Instr* inst);
+
+int is_pure(const Instr* inst);
+
+void format_prog_inst(ProgText* text, const ProgInst* inst);
+
+void write_prog_inst(FILE* output, const ProgInst* inst);
+
+SymbolTable* program_symbols(const Program* prog);
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate.h"
+#include "program.h"
+#include "relax.h"
+
+static const int32_t MIN_BRANCH_OFFSET = -32768;
+static const int32_t MAX_BRANCH_OFFSET = 32767;
+
+static void* alloc_zeroed(size_t size) {
+    Allocator* alloc = get_table_allocator();
+    void* ptr = alloc->alloc(alloc, size);
+    if (!ptr) {
+        allocation_failed();
+    }
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static void release(void* ptr, size_t size) {
+    if (ptr) {
+        Allocator* alloc = get_table_allocator();
+        alloc->release(alloc, ptr, size);
+    }
+}
+
+/* Adds DELTA to the size of instruction I in the Fenwick tree TREE of N
+   instructions. */
+static void grow(uint32_t* tree, uint32_t n, uint32_t i, uint32_t delta) {
+    for (uint32_t k = i + 1; k <= n; k += k & -k) {
+        tree[k] += delta;
+    }
+}
+
+/* Returns the address, in words, of instruction I: the total size of the
+   instructions before it. */
+static uint32_t address_of(const uint32_t* tree, uint32_t i) {
+    uint32_t sum = 0;
+    for (uint32_t k = i; k > 0; k -= k & -k) {
+        sum += tree[k];
+    }
+    return sum;
+}
+
+/* The instructions whose growth moves the target of the branch at I to
+   TARGET, [LO, HI). */
+static void span_of(uint32_t i, uint32_t target, uint32_t* lo, uint32_t* hi) {
+    if (target > i) {
+        *lo = i + 1;
+        *hi = target;
+    } else {
+        *lo = target;
+        *hi = i;
+    }
+}
+
+/* Rewrites the out-of-range branches of PROG as described in relax.h and
+   counts the work in STATS. Programs with instructions that did not decode
+   are left alone. */
+void relax_program(Program* prog, int delay_slots, RelaxStats* stats) {
+    memset(stats, 0, sizeof(RelaxStats));
+    ProgCode* code = &prog->code;
+    uint32_t n = code->len;
+    if (prog->num_invalid || n == 0) {
+        return;
+    }
+    uint32_t* targets = program_targets(prog);
+    uint32_t* tree = alloc_zeroed((n + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < n; i++) {
+        grow(tree, n, i, 1 + (delay_slots && ends_block(&code->insts[i].inst)));
+    }
+
+    /* A relaxed branch takes two instructions (four with delay slots). A
+       branch that stays in range even if everything it spans is relaxed is
+       not watched. */
+    uint32_t max_size = delay_slots ? 4 : 2;
+    uint32_t num_chunks = n / RELAX_CHUNK + 1;
+    uint32_t* chunk_start = alloc_zeroed((num_chunks + 1) * sizeof(uint32_t));
+    uint8_t* watched = alloc_zeroed(n);
+    for (uint32_t i = 0; i < n; i++) {
+        Instr inverted = code->insts[i].inst;
+        if (!is_branch(&inverted) || targets[i] == PROG_NONE || invert_branch(&inverted) != 0) {
+            continue;
+        }
+        uint32_t lo, hi;
+        span_of(i, targets[i], &lo, &hi);
+        if ((uint64_t) (hi - lo + 1) * max_size <= (uint64_t) MAX_BRANCH_OFFSET) {
+            continue;
+        }
+        watched[i] = 1;
+        stats->watched++;
+        for (uint32_t c = lo / RELAX_CHUNK; c <= (hi - 1) / RELAX_CHUNK; c++) {
+            chunk_start[c + 1]++;
+        }
+    }
+    for (uint32_t c = 0; c < num_chunks; c++) {
+        chunk_start[c + 1] += chunk_start[c];
+    }
+    uint32_t num_entries = chunk_start[num_chunks];
+    uint32_t* chunk_branches = alloc_zeroed((num_entries ? num_entries : 1) * sizeof(uint32_t));
+    uint32_t* fill = alloc_zeroed(num_chunks * sizeof(uint32_t));
+    uint32_t* worklist = alloc_zeroed((stats->watched ? stats->watched : 1) * sizeof(uint32_t));
+    uint32_t num_work = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (!watched[i]) {
+            continue;
+        }
+        uint32_t lo, hi;
+        span_of(i, targets[i], &lo, &hi);
+        for (uint32_t c = lo / RELAX_CHUNK; c <= (hi - 1) / RELAX_CHUNK; c++) {
+            chunk_branches[chunk_start[c] + fill[c]++] = i;
+        }
+        worklist[num_work++] = i;
+    }
+
+    /* WATCHED is 1 for a branch waiting to be checked, 2 for one that is
+       not on the worklist and 3 for a relaxed one. */
+    uint32_t growth = delay_slots ? 2 : 1;
+    while (num_work) {
+        uint32_t i = worklist[--num_work];
+        watched[i] = 2;
+        stats->checks++;
+        int64_t offset = (int64_t) address_of(tree, targets[i]) - address_of(tree, i) - 1;
+        if (offset >= MIN_BRANCH_OFFSET && offset <= MAX_BRANCH_OFFSET) {
+            continue;
+        }
+        watched[i] = 3;
+        stats->relaxed++;
+        grow(tree, n, i, growth);
+        uint32_t c = i / RELAX_CHUNK;
+        for (uint32_t e = chunk_start[c]; e < chunk_start[c + 1]; e++) {
+            uint32_t other = chunk_branches[e];
+            uint32_t lo, hi;
+            span_of(other, targets[other], &lo, &hi);
+            if (watched[other] == 2 && lo <= i && i < hi) {
+                watched[other] = 1;
+                worklist[num_work++] = other;
+            }
+        }
+    }
+
+    if (stats->relaxed) {
+        ProgCode out;
+        memset(&out, 0, sizeof(ProgCode));
+        uint32_t l = 0;
+        for (uint32_t i = 0; i <= n; i++) {
+            for (; l < code->num_labels && code->labels[l].index == i; l++) {
+                push_label(&out, code->labels[l].name);
+            }
+            if (i == n) {
+                break;
+            }
+            if (watched[i] != 3) {
+                push_inst(&out, &code->insts[i]);
+                continue;
+            }
+            const char* skip = new_program_label(prog);
+            ProgInst inverted = code->insts[i];
+            invert_branch(&inverted.inst);
+            inverted.inst.label = skip;
+            ProgInst jump;
+            make_jump(&jump, &code->insts[i], code->insts[i].inst.label);
+            push_inst(&out, &inverted);
+            push_inst(&out, &jump);
+            push_label(&out, skip);
+        }
+        replace_code(prog, &out);
+    }
+
+    release(worklist, (stats->watched ? stats->watched : 1) * sizeof(uint32_t));
+    release(fill, num_chunks * sizeof(uint32_t));
+    release(chunk_branches, (num_entries ? num_entries : 1) * sizeof(uint32_t));
+    release(watched, n);
+    release(chunk_start, (num_chunks + 1) * sizeof(uint32_t));
+    release(tree, (n + 1) * sizeof(uint32_t));
+    release(targets, (n + 1) * sizeof(uint32_t));
+}
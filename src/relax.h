@@ -0,0 +1,43 @@
+#ifndef RELAX_H
+#define RELAX_H
+
+#include <stdint.h>
+
+/* Branch relaxation.
+
+   A conditional branch encodes its target as a signed 16-bit word offset,
+   so it reaches at most 32768 instructions back or 32767 forward.
+   relax_program() rewrites every conditional branch of a Program that
+   cannot reach its target as the inverted branch over a j:
+
+       beq $a, $b, far          bne $a, $b, _B<n>
+                        ->      j far
+                              _B<n>:
+
+   Each rewrite moves everything after it one instruction further, which
+   can push other branches out of range in turn. Rather than recomputing
+   every address until nothing changes, addresses are kept in a Fenwick
+   tree of instruction sizes, and only branches long enough to ever go out
+   of range are watched: each is filed under the chunks of
+   RELAX_CHUNK instructions its span covers, and when an instruction
+   grows only the watched branches of its chunk are checked again. Since
+   instructions only ever grow, this reaches the same fixpoint as repeated
+   passes.
+
+   With DELAY_SLOTS set, every branch and jump is counted with a delay
+   slot, as the scheduler adds one after it, so that the program stays in
+   range once scheduled. bltzal and bgezal link either way and have no
+   inverse; they are left for pass two to report if out of range.
+ */
+
+#define RELAX_CHUNK 1024
+
+typedef struct {
+    uint32_t watched;
+    uint32_t checks;
+    uint32_t relaxed;
+} RelaxStats;
+
+void relax_program(Program* prog, int delay_slots, RelaxStats* stats);
+
+#endif
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "reloc.h"
+
+static const char* RELOC_TYPE_NAMES[NUM_RELOC_TYPES] = { "R_26", "HI16", "LO16", "PC16", "AHI16" };
+
+/* Bits of an instruction kept when each type of relocation is applied. */
+static const uint32_t JUMP_KEEP_MASK = 0xFC000000;
+static const uint32_t IMM_KEEP_MASK = 0xFFFF0000;
+
+/* A jump can only reach targets in the 256 MB region holding its delay
+   slot. */
+static const uint32_t JUMP_REGION_MASK = 0xF0000000;
+
+const char* reloc_type_name(uint8_t type) {
+    return type < NUM_RELOC_TYPES ? RELOC_TYPE_NAMES[type] : NULL;
+}
+
+/* Returns the RelocType called NAME, or -1 if there is none. */
+int parse_reloc_type(const char* name) {
+    for (int type = 0; type < NUM_RELOC_TYPES; type++) {
+        if (strcmp(name, RELOC_TYPE_NAMES[type]) == 0) {
+            return type;
+        }
+    }
+    return -1;
+}
+
+/* Open-addressed map from symbol name to id, used while packing. */
+typedef struct {
+    uint32_t* slots;
+    uint32_t mask;
+} NameIds;
+
+static uint32_t* find_name_slot(NameIds* ids, const char** names, const char* name) {
+    uint32_t i = symbol_hash(name) & ids->mask;
+    while (ids->slots[i] && strcmp(names[ids->slots[i] - 1], name) != 0) {
+        i = (i + 1) & ids->mask;
+    }
+    return &ids->slots[i];
+}
+
+/* Fills BATCH with the relocations in RELTBL, grouped by type with a counting
+   sort so each group keeps the table's order. Symbol names are numbered in
+   order of first use. */
+void pack_relocs(RelocBatch* batch, SymbolTable* reltbl) {
+    Allocator* alloc = get_table_allocator();
+    uint32_t n = reltbl->len;
+    uint32_t cap = n ? n : 1;
+    uint32_t num_slots = 16;
+    while (num_slots < 2 * (uint64_t) n) {
+        num_slots *= 2;
+    }
+    NameIds ids;
+    ids.mask = num_slots - 1;
+    ids.slots = alloc->alloc(alloc, num_slots * sizeof(uint32_t));
+    batch->records = alloc->alloc(alloc, cap * sizeof(Reloc));
+    batch->names = alloc->alloc(alloc, cap * sizeof(char*));
+    if (!ids.slots || !batch->records || !batch->names) {
+        allocation_failed();
+    }
+    memset(ids.slots, 0, num_slots * sizeof(uint32_t));
+    memset(batch->start, 0, sizeof(batch->start));
+    batch->len = n;
+    batch->num_names = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        batch->start[get_reloc_type(reltbl, i) + 1]++;
+    }
+    for (int type = 0; type < NUM_RELOC_TYPES; type++) {
+        batch->start[type + 1] += batch->start[type];
+    }
+    uint32_t next[NUM_RELOC_TYPES];
+    memcpy(next, batch->start, sizeof(next));
+
+    const char* name;
+    uint32_t offset;
+    for (uint32_t i = 0; get_symbol(reltbl, i, &name, &offset) == 0; i++) {
+        uint32_t* slot = find_name_slot(&ids, batch->names, name);
+        if (!*slot) {
+            batch->names[batch->num_names++] = name;
+            *slot = batch->num_names;
+        }
+        uint8_t type = get_reloc_type(reltbl, i);
+        Reloc* record = &batch->records[next[type]++];
+        record->offset = offset;
+        record->info = RELOC_INFO(*slot - 1, type);
+    }
+    alloc->release(alloc, ids.slots, num_slots * sizeof(uint32_t));
+}
+
+void free_relocs(RelocBatch* batch) {
+    Allocator* alloc = get_table_allocator();
+    uint32_t cap = batch->len ? batch->len : 1;
+    alloc->release(alloc, batch->records, cap * sizeof(Reloc));
+    alloc->release(alloc, batch->names, cap * sizeof(char*));
+    memset(batch, 0, sizeof(RelocBatch));
+}
+
+/* Applies the N relocation RECORDS, all of type TYPE, to TEXT, which is
+   loaded at BASE. TARGETS holds the absolute address of each symbol id.
+   Each type gets its own loop so that the common case is a tight one.
+   Returns 0 on success and -1 if a target is out of reach, which is logged.
+ */
+int patch_relocs(uint32_t* text, uint32_t base, uint8_t type, const Reloc* records,
+    uint32_t n, const uint32_t* targets) {
+    int err = 0;
+    switch (type) {
+        case R_26:
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t pc = base + records[i].offset;
+                uint32_t target = targets[RELOC_SYM(records[i].info)];
+                uint32_t* word = &text[records[i].offset / 4];
+                if (((pc + 4) & JUMP_REGION_MASK) != (target & JUMP_REGION_MASK)) {
+                    write_to_log("Error: jump at 0x%08x cannot reach 0x%08x\n", pc, target);
+                    err = 1;
+                    continue;
+                }
+                *word = (*word & JUMP_KEEP_MASK) | (target >> 2 & ~JUMP_KEEP_MASK);
+            }
+            break;
+        case R_HI16:
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t* word = &text[records[i].offset / 4];
+                *word = (*word & IMM_KEEP_MASK) | targets[RELOC_SYM(records[i].info)] >> 16;
+            }
+            break;
+        case R_AHI16:
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t* word = &text[records[i].offset / 4];
+                *word = (*word & IMM_KEEP_MASK)
+                    | (targets[RELOC_SYM(records[i].info)] + 0x8000) >> 16;
+            }
+            break;
+        case R_LO16:
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t* word = &text[records[i].offset / 4];
+                *word = (*word & IMM_KEEP_MASK)
+                    | (targets[RELOC_SYM(records[i].info)] & ~IMM_KEEP_MASK);
+            }
+            break;
+        case R_PC16:
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t pc = base + records[i].offset;
+                int64_t distance = ((int64_t) targets[RELOC_SYM(records[i].info)] - pc - 4) / 4;
+                uint32_t* word = &text[records[i].offset / 4];
+                if (distance < -32768 || distance > 32767) {
+                    write_to_log("Error: branch at 0x%08x cannot reach 0x%08x\n", pc,
+                        targets[RELOC_SYM(records[i].info)]);
+                    err = 1;
+                    continue;
+                }
+                *word = (*word & IMM_KEEP_MASK) | ((uint32_t) distance & ~IMM_KEEP_MASK);
+            }
+            break;
+        default:
+            write_to_log("Error: unknown relocation type %u\n", type);
+            return -1;
+    }
+    return err ? -1 : 0;
+}
+
+/* Writes the relocation table RELTBL to OUTPUT, grouped by type. Entries of
+   type R_26 are written as write_table() would; the others carry their type
+   name in a third column. */
+void write_relocs(SymbolTable* reltbl, FILE* output) {
+    RelocBatch batch;
+    pack_relocs(&batch, reltbl);
+    for (uint32_t i = 0; i < batch.len; i++) {
+        const Reloc* record = &batch.records[i];
+        const char* name = batch.names[RELOC_SYM(record->info)];
+        if (RELOC_TYPE(record->info) == R_26) {
+            write_symbol(output, record->offset, name);
+        } else {
+            fprintf(output, "%u\t%s\t%s\n", record->offset, name,
+                reloc_type_name(RELOC_TYPE(record->info)));
+        }
+    }
+    free_relocs(&batch);
+}
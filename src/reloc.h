@@ -0,0 +1,53 @@
+#ifndef RELOC_H
+#define RELOC_H
+
+#include <stdint.h>
+
+/* Relocation types. R_26 fills the target field of j/jal, R_HI16 and R_LO16
+   the immediates of a lui/ori pair loading an address (so R_HI16 is the plain
+   upper half, since ori does not sign-extend), and R_PC16 the offset field of
+   a branch. R_AHI16 is the upper half adjusted for a sign-extended low half,
+   as R_MIPS_HI16 is in ELF objects, where the R_LO16 goes into addiu or a load
+   or store. Stored in objects, so only ever append to this list. */
+typedef enum {
+    R_26, R_HI16, R_LO16, R_PC16, R_AHI16,
+    NUM_RELOC_TYPES
+} RelocType;
+
+/* A compact relocation record: the byte offset of the instruction and, in
+   INFO, the symbol id and the type, packed like ELF32_R_INFO. */
+typedef struct {
+    uint32_t offset;
+    uint32_t info;
+} Reloc;
+
+#define RELOC_INFO(sym, type) ((uint32_t) (sym) << 8 | (type))
+#define RELOC_SYM(info) ((info) >> 8)
+#define RELOC_TYPE(info) ((info) & 0xFF)
+
+/* The relocations of a table grouped by type. The records of type T are
+   RECORDS[START[T]] up to RECORDS[START[T + 1]], in the order they were
+   added, and their symbol ids index NAMES, which has one entry per distinct
+   symbol. NAMES point into the table the batch was built from. */
+typedef struct {
+    Reloc* records;
+    uint32_t len;
+    uint32_t start[NUM_RELOC_TYPES + 1];
+    const char** names;
+    uint32_t num_names;
+} RelocBatch;
+
+const char* reloc_type_name(uint8_t type);
+
+int parse_reloc_type(const char* name);
+
+void pack_relocs(RelocBatch* batch, SymbolTable* reltbl);
+
+void free_relocs(RelocBatch* batch);
+
+int patch_relocs(uint32_t* text, uint32_t base, uint8_t type, const Reloc* records,
+    uint32_t n, const uint32_t* targets);
+
+void write_relocs(SymbolTable* reltbl, FILE* output);
+
+#endif
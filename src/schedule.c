@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate.h"
+#include "program.h"
+#include "schedule.h"
+
+/* What an instruction reads and writes. EFFECT is set for instructions
+   that touch memory, trap or leave the registers, which keep their order. */
+typedef struct {
+    uint64_t uses, defs;
+    uint8_t effect;
+    uint8_t load;
+} RegUse;
+
+static void get_reg_use(RegUse* ru, const Instr* inst) {
+    inst_regs(inst, &ru->uses, &ru->defs);
+    ru->effect = !is_pure(inst);
+    ru->load = is_load(inst);
+}
+
+/* Returns 1 if B must stay after A. */
+static int depends(const RegUse* a, const RegUse* b) {
+    return (a->defs & (b->uses | b->defs)) || (a->uses & b->defs) || (a->effect && b->effect);
+}
+
+/* Returns 1 if NEXT stalls when issued right after PREV. */
+static int load_stall(const RegUse* prev, const RegUse* next) {
+    return prev->load && (prev->defs & next->uses);
+}
+
+/* Counts the loads in CODE that are followed by a use of their result. */
+static uint32_t count_stalls(const ProgCode* code) {
+    uint32_t stalls = 0;
+    for (uint32_t i = 1; i < code->len; i++) {
+        const Instr* prev = &code->insts[i - 1].inst;
+        if (ends_block(prev)) {
+            continue;
+        }
+        RegUse a, b;
+        get_reg_use(&a, prev);
+        get_reg_use(&b, &code->insts[i].inst);
+        stalls += load_stall(&a, &b);
+    }
+    return stalls;
+}
+
+/* List-schedules the N instructions of IN onto the end of OUT. If LAST_FIXED
+   is set the last instruction is a branch or jump and stays last. */
+static void schedule_window(ProgCode* out, const ProgInst* in, uint32_t n, int last_fixed) {
+    RegUse ru[SCHEDULE_WINDOW];
+    uint64_t succs[SCHEDULE_WINDOW];
+    uint32_t num_preds[SCHEDULE_WINDOW];
+    uint32_t height[SCHEDULE_WINDOW];
+    for (uint32_t i = 0; i < n; i++) {
+        get_reg_use(&ru[i], &in[i].inst);
+        succs[i] = 0;
+        num_preds[i] = 0;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        for (uint32_t j = i + 1; j < n; j++) {
+            if (depends(&ru[i], &ru[j]) || (last_fixed && j == n - 1)) {
+                succs[i] |= 1ull << j;
+                num_preds[j]++;
+            }
+        }
+    }
+    /* Height: the latency of the longest path from an instruction to the
+       end of the window, with loads taking two cycles. */
+    for (uint32_t i = n; i-- > 0;) {
+        uint32_t below = 0;
+        for (uint32_t j = i + 1; j < n; j++) {
+            if (succs[i] >> j & 1 && height[j] > below) {
+                below = height[j];
+            }
+        }
+        height[i] = below + (ru[i].load ? 2 : 1);
+    }
+
+    uint64_t done = 0;
+    uint32_t last = PROG_NONE;
+    for (uint32_t step = 0; step < n; step++) {
+        uint32_t best = PROG_NONE;
+        int best_stall = 1;
+        for (uint32_t i = 0; i < n; i++) {
+            if (done >> i & 1 || num_preds[i]) {
+                continue;
+            }
+            int stall = last != PROG_NONE && load_stall(&ru[last], &ru[i]);
+            if (best == PROG_NONE || stall < best_stall
+                || (stall == best_stall && height[i] > height[best])) {
+                best = i;
+                best_stall = stall;
+            }
+        }
+        done |= 1ull << best;
+        for (uint32_t j = best + 1; j < n; j++) {
+            if (succs[best] >> j & 1) {
+                num_preds[j]--;
+            }
+        }
+        push_inst(out, &in[best]);
+        last = best;
+    }
+}
+
+/* Returns the position of the latest instruction at or after LOW and before
+   BRANCH in OUT that can move past BRANCH into its delay slot, or PROG_NONE.
+   Unless LOOSE is set, instructions whose move would leave a load right
+   before a use of its result are passed over. */
+static uint32_t find_slot_filler(const ProgCode* out, uint32_t low, uint32_t branch,
+    int loose) {
+    RegUse control;
+    get_reg_use(&control, &out->insts[branch].inst);
+    for (uint32_t p = branch; p-- > low;) {
+        RegUse cand;
+        get_reg_use(&cand, &out->insts[p].inst);
+        if (cand.effect) {
+            continue;
+        }
+        int free = !(cand.defs & (control.uses | control.defs)) && !(cand.uses & control.defs);
+        for (uint32_t q = p + 1; q < branch && free; q++) {
+            RegUse later;
+            get_reg_use(&later, &out->insts[q].inst);
+            free = !depends(&cand, &later);
+        }
+        if (free && !loose && p > low) {
+            RegUse before, after;
+            get_reg_use(&before, &out->insts[p - 1].inst);
+            get_reg_use(&after, &out->insts[p + 1].inst);
+            free = !load_stall(&before, &after);
+        }
+        if (free) {
+            return p;
+        }
+    }
+    return PROG_NONE;
+}
+
+/* Moves an instruction of the block starting at index START of OUT into the
+   delay slot after its last instruction, a branch or jump, or appends a nop.
+   Returns 1 if the slot holds useful work. */
+static int fill_delay_slot(ProgCode* out, uint32_t start) {
+    uint32_t branch = out->len - 1;
+    uint32_t low = branch > start + SCHEDULE_WINDOW ? branch - SCHEDULE_WINDOW : start;
+    uint32_t p = find_slot_filler(out, low, branch, 0);
+    if (p == PROG_NONE) {
+        p = find_slot_filler(out, low, branch, 1);
+    }
+    if (p != PROG_NONE) {
+        ProgInst moved = out->insts[p];
+        memmove(&out->insts[p], &out->insts[p + 1], (branch - p) * sizeof(ProgInst));
+        out->insts[branch] = moved;
+        return 1;
+    }
+    ProgInst nop;
+    memset(&nop, 0, sizeof(ProgInst));
+    init_inst(&nop.inst, INST_SLL);
+    nop.line = out->insts[branch].line;
+    nop.valid = 1;
+    push_inst(out, &nop);
+    return 0;
+}
+
+/* Schedules PROG as described in schedule.h and records the estimate in
+   STATS. Programs with instructions that did not decode are left alone. */
+void schedule_program(Program* prog, int delay_slots, ScheduleStats* stats) {
+    memset(stats, 0, sizeof(ScheduleStats));
+    ProgCode* code = &prog->code;
+    if (prog->num_invalid || code->len == 0) {
+        return;
+    }
+    stats->stalls_before = count_stalls(code);
+    ProgBlocks blocks;
+    find_blocks(&blocks, prog);
+    ProgCode out;
+    memset(&out, 0, sizeof(ProgCode));
+    for (uint32_t b = 0; b < blocks.num_blocks; b++) {
+        const ProgBlock* block = &blocks.blocks[b];
+        for (uint32_t l = block->first_label; l < block->end_label; l++) {
+            push_label(&out, code->labels[l].name);
+        }
+        uint32_t block_start = out.len;
+        int control = ends_block(&code->insts[block->end - 1].inst);
+        for (uint32_t i = block->start; i < block->end; i += SCHEDULE_WINDOW) {
+            uint32_t n = block->end - i < SCHEDULE_WINDOW ? block->end - i : SCHEDULE_WINDOW;
+            schedule_window(&out, &code->insts[i], n, control && i + n == block->end);
+        }
+        if (delay_slots && control) {
+            stats->delay_slots++;
+            stats->slots_filled += fill_delay_slot(&out, block_start);
+        }
+    }
+    for (uint32_t l = 0; l < code->num_labels; l++) {
+        if (code->labels[l].index == code->len) {
+            push_label(&out, code->labels[l].name);
+        }
+    }
+    free_blocks(&blocks);
+    replace_code(prog, &out);
+    stats->stalls_after = count_stalls(&prog->code);
+    stats->cycles_saved = (int32_t) stats->stalls_before - (int32_t) stats->stalls_after
+        + (int32_t) stats->slots_filled;
+}
@@ -0,0 +1,43 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+
+/* Instruction scheduling for a classic five-stage MIPS pipeline.
+
+   schedule_program() list-schedules every basic block of a Program over a
+   dependency DAG built from the registers each instruction reads and
+   writes (inst_regs() in program.h). Instructions that touch memory, trap
+   or leave the registers keep their relative order; everything else may
+   move as far as its register dependences allow. The scheduler favors the
+   longest path to the end of the block and avoids issuing an instruction
+   right after a load it depends on, so that loads are separated from their
+   first use (a one-cycle stall on such a pipeline). Blocks are scheduled in
+   windows of SCHEDULE_WINDOW instructions.
+
+   With DELAY_SLOTS set, the program is also rewritten for an architecture
+   with branch delay slots: every branch and jump gets the instruction after
+   it executed unconditionally. The latest instruction of its block that
+   neither the branch nor anything after it depends on moves into the slot,
+   and a nop fills it if there is none. Loads stay out of delay slots, since
+   the stall they could cause lands in another block. The simulator has no
+   delay slots, so such output only runs correctly on a pipeline that does.
+
+   Savings are estimated statically, counting every instruction once: one
+   cycle per load-use stall avoided and per delay slot filled with useful
+   work instead of a nop.
+ */
+
+#define SCHEDULE_WINDOW 64
+
+typedef struct {
+    uint32_t stalls_before;
+    uint32_t stalls_after;
+    uint32_t delay_slots;
+    uint32_t slots_filled;
+    int32_t cycles_saved;
+} ScheduleStats;
+
+void schedule_program(Program* prog, int delay_slots, ScheduleStats* stats);
+
+#endif
@@ -0,0 +1,520 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "translate.h"
+#include "object.h"
+#include "reloc.h"
+#include "loader.h"
+#include "disasm.h"
+#include "sim.h"
+
+static void* alloc_zeroed(size_t size) {
+    Allocator* alloc = get_table_allocator();
+    void* ptr = alloc->alloc(alloc, size);
+    if (!ptr) {
+        allocation_failed();
+    }
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+static void release(void* ptr, size_t size) {
+    if (ptr) {
+        Allocator* alloc = get_table_allocator();
+        alloc->release(alloc, ptr, size);
+    }
+}
+
+/* Register numbers written as SIM_ZERO_SINK when they are $zero. */
+static uint8_t dst_reg(uint32_t reg) {
+    return reg ? reg : SIM_ZERO_SINK;
+}
+
+/* Decodes WORD, instruction ID at index I of N, into INST. */
+static void predecode(SimInst* inst, uint8_t id, uint32_t word, uint32_t i, uint32_t n) {
+    memset(inst, 0, sizeof(SimInst));
+    inst->op = id;
+    if (id == INST_INVALID) {
+        return;
+    }
+    Instr decoded;
+    init_inst(&decoded, id);
+    const FormatInfo* info = format_info(decoded.fmt);
+    uint32_t rs = word >> 21 & 0x1F, rt = word >> 16 & 0x1F, rd = word >> 11 & 0x1F;
+    inst->rs = rs;
+    inst->rt = rt;
+    switch (info->operands[0]) {
+        case OPERAND_RD:
+        case OPERAND_RDT:
+            inst->dst = dst_reg(rd);
+            break;
+        default:
+            inst->dst = dst_reg(rt);
+            break;
+    }
+    if (id == INST_JAL || id == INST_BLTZAL || id == INST_BGEZAL) {
+        inst->dst = 31;
+    }
+
+    int64_t target = -1;
+    if (info->label == LABEL_BRANCH) {
+        target = (int64_t) i + 1 + (int16_t) word;
+    } else if (info->label == LABEL_JUMP) {
+        target = (((i + 1) * 4 & 0xF0000000) | (word & 0x03FFFFFF) << 2) / 4;
+    }
+    if (info->label == LABEL_BRANCH || info->label == LABEL_JUMP) {
+        inst->imm = target < 0 || target > n ? n + 1 : target;
+    } else if (info->shamt) {
+        inst->imm = word >> 6 & 0x1F;
+    } else if (id == INST_LUI) {
+        inst->imm = word << 16;
+    } else if (info->operands[2] == OPERAND_UIMM) {
+        inst->imm = word & 0xFFFF;
+    } else {
+        inst->imm = (int16_t) word;
+    }
+}
+
+static uint32_t load_word(const uint8_t* p) {
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static void store_word(uint8_t* p, uint32_t word) {
+    p[0] = word >> 24;
+    p[1] = word >> 16;
+    p[2] = word >> 8;
+    p[3] = word;
+}
+
+/* Prepares SIM to run OBJ, which must stay alive while SIM is used, with
+   MEM_SIZE bytes of data memory. Returns 0 on success and -1 if the object
+   cannot be loaded.
+ */
+int init_simulator(Simulator* sim, const ObjectFile* obj, uint32_t mem_size) {
+    memset(sim, 0, sizeof(Simulator));
+    if (mem_size < 4 || mem_size % 4 != 0) {
+        write_to_log("Error: memory size must be a positive multiple of 4\n");
+        return -1;
+    }
+    WordBuffer image;
+    init_word_buffer(&image);
+    if (load_image(&image, obj, 0) != 0) {
+        free_word_buffer(&image);
+        return -1;
+    }
+    uint32_t n = obj->text.len;
+    if (image.len > n && (uint64_t) image.len * 4 > mem_size) {
+        write_to_log("Error: .data does not fit in %u bytes of memory\n", mem_size);
+        free_word_buffer(&image);
+        return -1;
+    }
+    uint8_t* ids = alloc_zeroed(n + 1);
+    Disassembler dis;
+    init_disassembler(&dis);
+    decode_words(&dis, image.words, n, ids);
+
+    sim->len = n;
+    sim->code = alloc_zeroed((n + 2) * sizeof(SimInst));
+    sim->counts = alloc_zeroed((n + 2) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < n; i++) {
+        predecode(&sim->code[i], ids[i], image.words[i], i, n);
+    }
+    sim->code[n].op = SIM_OP_END;
+    sim->code[n + 1].op = SIM_OP_BAD_TARGET;
+    release(ids, n + 1);
+
+    sim->mem = alloc_zeroed(mem_size);
+    sim->mem_size = mem_size;
+    for (uint32_t i = n; i < image.len; i++) {
+        store_word(sim->mem + i * 4, image.words[i]);
+    }
+    free_word_buffer(&image);
+    sim->regs[29] = mem_size;
+    sim->regs[31] = n * 4;
+    sim->obj = obj;
+    sim->output = stdout;
+    sim->status = SIM_RUNNING;
+    return 0;
+}
+
+void free_simulator(Simulator* sim) {
+    release(sim->code, (sim->len + 2) * sizeof(SimInst));
+    release(sim->counts, (sim->len + 2) * sizeof(uint64_t));
+    release(sim->mem, sim->mem_size);
+    sim->code = NULL;
+    sim->counts = NULL;
+    sim->mem = NULL;
+}
+
+/* Runs SIM from its current state until the program stops, or until
+   MAX_JUMPS branches and jumps have been taken (0 for no limit), and returns
+   why it stopped. Only taken branches and jumps are counted against the
+   limit since only they can repeat instructions. A stopped program can be
+   resumed after SIM_STEP_LIMIT.
+ */
+SimStatus run_simulator(Simulator* sim, uint64_t max_jumps) {
+    static const void* const handlers[] = {
+#define X(id, name, fmt, opcode, funct, rt) [INST_##id] = &&op_##id,
+        ISA_INSTRUCTIONS(X)
+#undef X
+        [SIM_OP_END] = &&op_end,
+        [SIM_OP_BAD_TARGET] = &&op_bad_target,
+        [INST_INVALID] = &&op_invalid,
+    };
+    if (!sim->threaded) {
+        for (uint32_t i = 0; i < sim->len + 2; i++) {
+            sim->code[i].handler = handlers[sim->code[i].op];
+        }
+        sim->threaded = 1;
+    }
+
+    uint32_t* restrict R = sim->regs;
+    uint8_t* restrict mem = sim->mem;
+    uint64_t* restrict counts = sim->counts;
+    const SimInst* code = sim->code;
+    const SimInst* inst;
+    uint32_t mem_size = sim->mem_size;
+    uint32_t pc = sim->pc;
+    uint32_t hi = sim->hi, lo = sim->lo;
+    uint64_t budget = max_jumps ? max_jumps : UINT64_MAX;
+    SimStatus status = SIM_RUNNING;
+    uint32_t addr = 0;
+    int32_t sum;
+    int64_t acc;
+
+#define DISPATCH() do { inst = &code[pc]; counts[pc]++; goto *inst->handler; } while (0)
+#define NEXT() do { pc++; DISPATCH(); } while (0)
+#define JUMP(target) do { \
+        pc = (target); \
+        if (--budget == 0) { status = SIM_STEP_LIMIT; goto stop; } \
+        DISPATCH(); \
+    } while (0)
+#define BRANCH(cond) do { if (cond) JUMP(inst->imm); NEXT(); } while (0)
+#define STOP(why) do { status = (why); goto stop; } while (0)
+#define RS R[inst->rs]
+#define RT R[inst->rt]
+#define DST R[inst->dst]
+#define SRS ((int32_t) R[inst->rs])
+#define SRT ((int32_t) R[inst->rt])
+/* Sets ADDR to the effective address, stopping if SIZE bytes there are not
+   aligned or not in memory. */
+#define ADDRESS(size) do { \
+        addr = RS + inst->imm; \
+        if (addr % (size) != 0 || addr > mem_size - (size)) STOP(SIM_BAD_ADDRESS); \
+    } while (0)
+
+    DISPATCH();
+
+    /* Register arithmetic. */
+op_ADDU: DST = RS + RT; NEXT();
+op_SUBU: DST = RS - RT; NEXT();
+op_ADD:  if (__builtin_add_overflow(SRS, SRT, &sum)) STOP(SIM_TRAP); DST = sum; NEXT();
+op_SUB:  if (__builtin_sub_overflow(SRS, SRT, &sum)) STOP(SIM_TRAP); DST = sum; NEXT();
+op_AND:  DST = RS & RT; NEXT();
+op_OR:   DST = RS | RT; NEXT();
+op_XOR:  DST = RS ^ RT; NEXT();
+op_NOR:  DST = ~(RS | RT); NEXT();
+op_SLT:  DST = SRS < SRT; NEXT();
+op_SLTU: DST = RS < RT; NEXT();
+op_MOVZ: if (RT == 0) DST = RS; NEXT();
+op_MOVN: if (RT != 0) DST = RS; NEXT();
+op_MUL:  DST = (uint32_t) ((int64_t) SRS * SRT); NEXT();
+op_CLZ:  DST = RS ? __builtin_clz(RS) : 32; NEXT();
+op_CLO:  DST = ~RS ? __builtin_clz(~RS) : 32; NEXT();
+
+    /* Shifts. */
+op_SLL:  DST = RT << inst->imm; NEXT();
+op_SRL:  DST = RT >> inst->imm; NEXT();
+op_SRA:  DST = SRT >> inst->imm; NEXT();
+op_SLLV: DST = RT << (RS & 31); NEXT();
+op_SRLV: DST = RT >> (RS & 31); NEXT();
+op_SRAV: DST = SRT >> (RS & 31); NEXT();
+
+    /* hi and lo. */
+op_MFHI: DST = hi; NEXT();
+op_MFLO: DST = lo; NEXT();
+op_MTHI: hi = RS; NEXT();
+op_MTLO: lo = RS; NEXT();
+op_MULT:  acc = (int64_t) SRS * SRT; hi = acc >> 32; lo = acc; NEXT();
+op_MULTU: acc = (uint64_t) RS * RT; hi = (uint64_t) acc >> 32; lo = acc; NEXT();
+op_DIV:
+    /* The result of dividing by zero is unpredictable; hi and lo are kept. */
+    if (RT != 0) {
+        if (SRS == INT32_MIN && SRT == -1) {
+            lo = INT32_MIN;
+            hi = 0;
+        } else {
+            lo = SRS / SRT;
+            hi = SRS % SRT;
+        }
+    }
+    NEXT();
+op_DIVU:
+    if (RT != 0) {
+        lo = RS / RT;
+        hi = RS % RT;
+    }
+    NEXT();
+op_MADD:
+    acc = (int64_t) ((uint64_t) hi << 32 | lo) + (int64_t) SRS * SRT;
+    hi = (uint64_t) acc >> 32;
+    lo = acc;
+    NEXT();
+op_MADDU:
+    acc = ((uint64_t) hi << 32 | lo) + (uint64_t) RS * RT;
+    hi = (uint64_t) acc >> 32;
+    lo = acc;
+    NEXT();
+op_MSUB:
+    acc = (int64_t) ((uint64_t) hi << 32 | lo) - (int64_t) SRS * SRT;
+    hi = (uint64_t) acc >> 32;
+    lo = acc;
+    NEXT();
+op_MSUBU:
+    acc = ((uint64_t) hi << 32 | lo) - (uint64_t) RS * RT;
+    hi = (uint64_t) acc >> 32;
+    lo = acc;
+    NEXT();
+
+    /* Immediates. */
+op_ADDIU: DST = RS + inst->imm; NEXT();
+op_ADDI:  if (__builtin_add_overflow(SRS, inst->imm, &sum)) STOP(SIM_TRAP); DST = sum; NEXT();
+op_SLTI:  DST = SRS < inst->imm; NEXT();
+op_SLTIU: DST = RS < (uint32_t) inst->imm; NEXT();
+op_ANDI:  DST = RS & inst->imm; NEXT();
+op_ORI:   DST = RS | inst->imm; NEXT();
+op_XORI:  DST = RS ^ inst->imm; NEXT();
+op_LUI:   DST = inst->imm; NEXT();
+
+    /* Loads and stores. ll and sc act alone, so sc always succeeds. */
+op_LB:  ADDRESS(1); DST = (int8_t) mem[addr]; NEXT();
+op_LBU: ADDRESS(1); DST = mem[addr]; NEXT();
+op_LH:  ADDRESS(2); DST = (int16_t) (mem[addr] << 8 | mem[addr + 1]); NEXT();
+op_LHU: ADDRESS(2); DST = mem[addr] << 8 | mem[addr + 1]; NEXT();
+op_LW:
+op_LL:  ADDRESS(4); DST = load_word(mem + addr); NEXT();
+op_LWL:
+    addr = RS + inst->imm;
+    if (addr > mem_size - 1) STOP(SIM_BAD_ADDRESS);
+    {
+        uint32_t shift = 8 * (addr & 3);
+        uint32_t word = load_word(mem + (addr & ~3u));
+        DST = word << shift | (RT & ((1u << shift) - 1));
+    }
+    NEXT();
+op_LWR:
+    addr = RS + inst->imm;
+    if (addr > mem_size - 1) STOP(SIM_BAD_ADDRESS);
+    {
+        uint32_t shift = 8 * (3 - (addr & 3));
+        uint32_t word = load_word(mem + (addr & ~3u));
+        DST = word >> shift | (RT & ~(0xFFFFFFFFu >> shift));
+    }
+    NEXT();
+op_SB:  ADDRESS(1); mem[addr] = RT; NEXT();
+op_SH:  ADDRESS(2); mem[addr] = RT >> 8; mem[addr + 1] = RT; NEXT();
+op_SW:  ADDRESS(4); store_word(mem + addr, RT); NEXT();
+op_SC:  ADDRESS(4); store_word(mem + addr, RT); DST = 1; NEXT();
+op_SWL:
+    addr = RS + inst->imm;
+    if (addr > mem_size - 1) STOP(SIM_BAD_ADDRESS);
+    for (uint32_t j = 0; j <= 3 - (addr & 3); j++) {
+        mem[addr + j] = RT >> (24 - 8 * j);
+    }
+    NEXT();
+op_SWR:
+    addr = RS + inst->imm;
+    if (addr > mem_size - 1) STOP(SIM_BAD_ADDRESS);
+    for (uint32_t j = 0; j <= (addr & 3); j++) {
+        mem[(addr & ~3u) + j] = RT >> (8 * ((addr & 3) - j));
+    }
+    NEXT();
+
+    /* Branches and jumps. */
+op_BEQ:  BRANCH(RS == RT);
+op_BNE:  BRANCH(RS != RT);
+op_BLEZ: BRANCH(SRS <= 0);
+op_BGTZ: BRANCH(SRS > 0);
+op_BLTZ: BRANCH(SRS < 0);
+op_BGEZ: BRANCH(SRS >= 0);
+op_BLTZAL: sum = SRS; R[31] = (pc + 1) * 4; BRANCH(sum < 0);
+op_BGEZAL: sum = SRS; R[31] = (pc + 1) * 4; BRANCH(sum >= 0);
+op_J:    JUMP(inst->imm);
+op_JAL:  R[31] = (pc + 1) * 4; JUMP(inst->imm);
+op_JR:
+    addr = RS;
+    if (addr % 4 != 0 || addr / 4 > sim->len) STOP(SIM_BAD_TARGET);
+    JUMP(addr / 4);
+op_JALR:
+    addr = RS;
+    DST = (pc + 1) * 4;
+    if (addr % 4 != 0 || addr / 4 > sim->len) STOP(SIM_BAD_TARGET);
+    JUMP(addr / 4);
+
+    /* Traps. */
+op_TEQ:   if (RS == RT) STOP(SIM_TRAP); NEXT();
+op_TNE:   if (RS != RT) STOP(SIM_TRAP); NEXT();
+op_TGE:   if (SRS >= SRT) STOP(SIM_TRAP); NEXT();
+op_TGEU:  if (RS >= RT) STOP(SIM_TRAP); NEXT();
+op_TLT:   if (SRS < SRT) STOP(SIM_TRAP); NEXT();
+op_TLTU:  if (RS < RT) STOP(SIM_TRAP); NEXT();
+op_TEQI:  if (SRS == inst->imm) STOP(SIM_TRAP); NEXT();
+op_TNEI:  if (SRS != inst->imm) STOP(SIM_TRAP); NEXT();
+op_TGEI:  if (SRS >= inst->imm) STOP(SIM_TRAP); NEXT();
+op_TGEIU: if (RS >= (uint32_t) inst->imm) STOP(SIM_TRAP); NEXT();
+op_TLTI:  if (SRS < inst->imm) STOP(SIM_TRAP); NEXT();
+op_TLTIU: if (RS < (uint32_t) inst->imm) STOP(SIM_TRAP); NEXT();
+
+    /* System. */
+op_SYNC: NEXT();
+op_BREAK: STOP(SIM_BREAK);
+op_SYSCALL:
+    switch (R[2]) {
+        case 1:
+            if (sim->output) fprintf(sim->output, "%d", (int32_t) R[4]);
+            break;
+        case 4:
+            for (addr = R[4]; addr < mem_size && mem[addr]; addr++) {
+                if (sim->output) fputc(mem[addr], sim->output);
+            }
+            if (addr >= mem_size) STOP(SIM_BAD_ADDRESS);
+            break;
+        case 10:
+            sim->exit_code = 0;
+            pc++;
+            STOP(SIM_EXITED);
+        case 11:
+            if (sim->output) fputc((uint8_t) R[4], sim->output);
+            break;
+        case 17:
+            sim->exit_code = (int32_t) R[4];
+            pc++;
+            STOP(SIM_EXITED);
+        default:
+            STOP(SIM_BAD_SYSCALL);
+    }
+    NEXT();
+
+    /* Leaving .text. */
+op_end:
+    STOP(SIM_EXITED);
+op_bad_target:
+    STOP(SIM_BAD_TARGET);
+op_invalid:
+    STOP(SIM_INVALID_INST);
+
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef BRANCH
+#undef STOP
+#undef RS
+#undef RT
+#undef DST
+#undef SRS
+#undef SRT
+#undef ADDRESS
+
+stop:
+    sim->pc = pc;
+    sim->hi = hi;
+    sim->lo = lo;
+    sim->bad_addr = addr;
+    sim->status = status;
+    return status;
+}
+
+/* Returns the number of instructions SIM has executed. */
+uint64_t sim_instructions(const Simulator* sim) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < sim->len; i++) {
+        total += sim->counts[i];
+    }
+    return total;
+}
+
+const char* sim_status_name(SimStatus status) {
+    switch (status) {
+        case SIM_RUNNING:      return "running";
+        case SIM_EXITED:       return "exited";
+        case SIM_TRAP:         return "trap";
+        case SIM_BREAK:        return "break";
+        case SIM_BAD_SYSCALL:  return "unsupported syscall";
+        case SIM_BAD_ADDRESS:  return "bad address";
+        case SIM_BAD_TARGET:   return "jump outside .text";
+        case SIM_INVALID_INST: return "invalid instruction";
+        case SIM_STEP_LIMIT:   return "step limit";
+        default:               return "unknown";
+    }
+}
+
+/* Writes one histogram line. */
+static void write_bar(FILE* output, const char* name, uint64_t count, uint64_t total) {
+    double share = total ? 100.0 * count / total : 0;
+    fprintf(output, "%" PRIu64 "\t%5.1f%%\t%-16s ", count, share, name);
+    for (int i = 0; i < (int) (share / 2 + 0.5); i++) {
+        fputc('#', output);
+    }
+    fputc('\n', output);
+}
+
+/* Writes the execution profile of SIM: how it stopped, the count of each
+   executed instruction and of each label, and the dynamic instruction mix by
+   mnemonic (most frequent first) and by class. */
+void write_profile(FILE* output, const Simulator* sim) {
+    uint64_t total = sim_instructions(sim);
+    fprintf(output, ".summary\n");
+    fprintf(output, "status\t%s\n", sim_status_name(sim->status));
+    if (sim->status == SIM_EXITED) {
+        fprintf(output, "exit code\t%d\n", sim->exit_code);
+    } else {
+        fprintf(output, "pc\t%u\n", sim->pc * 4);
+    }
+    fprintf(output, "instructions\t%" PRIu64 "\n", total);
+
+    fprintf(output, "\n.labels\n");
+    const char* name;
+    uint32_t addr;
+    for (uint32_t i = 0; sim->obj->symtbl && get_symbol(sim->obj->symtbl, i, &name, &addr) == 0;
+        i++) {
+        uint64_t count = addr % 4 == 0 && addr / 4 < sim->len ? sim->counts[addr / 4] : 0;
+        fprintf(output, "%" PRIu64 "\t%s\n", count, name);
+    }
+
+    uint64_t per_inst[NUM_INSTS] = { 0 };
+    uint64_t per_class[NUM_CLASSES] = { 0 };
+    fprintf(output, "\n.instructions\n");
+    for (uint32_t i = 0; i < sim->len; i++) {
+        uint8_t op = sim->code[i].op;
+        if (sim->counts[i] && op < NUM_INSTS) {
+            fprintf(output, "%u\t%" PRIu64 "\t%s\n", i * 4, sim->counts[i], inst_name(op));
+            per_inst[op] += sim->counts[i];
+        }
+    }
+
+    fprintf(output, "\n.mix\n");
+    uint8_t order[NUM_INSTS];
+    uint32_t num_used = 0;
+    for (uint8_t id = 0; id < NUM_INSTS; id++) {
+        if (per_inst[id]) {
+            uint32_t k = num_used++;
+            for (; k > 0 && per_inst[order[k - 1]] < per_inst[id]; k--) {
+                order[k] = order[k - 1];
+            }
+            order[k] = id;
+        }
+        per_class[inst_class(id)] += per_inst[id];
+    }
+    for (uint32_t k = 0; k < num_used; k++) {
+        write_bar(output, inst_name(order[k]), per_inst[order[k]], total);
+    }
+
+    fprintf(output, "\n.classes\n");
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        write_bar(output, inst_class_name(c), per_class[c], total);
+    }
+}
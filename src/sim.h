@@ -0,0 +1,89 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+/* Simulation.
+
+   init_simulator() loads an object at address 0 (resolving its relocations
+   as the loader does) and decodes each word of .text once into a SimInst
+   holding its handler, register numbers and sign- or zero-extended
+   immediate, with branch and jump targets turned into instruction indices.
+   run_simulator() then executes them with a computed-goto interpreter,
+   jumping from one handler straight to the next. Branches have no delay
+   slot, as in MARS.
+
+   Data memory is a separate zeroed array covering addresses 0 to MEM_SIZE,
+   accessed big-endian, with $sp starting at its top. The object's .data is
+   copied in right after the end of .text, where the loader places it and
+   where its labels point. $ra starts at the end
+   of .text, so returning from the top level, like running off the end,
+   stops the program normally. syscall supports print integer (1), print
+   string (4), exit (10), print character (11) and exit with code (17).
+
+   Every instruction executed is counted in COUNTS, indexed by word, which
+   write_profile() reports per instruction, per .symbol label (the count
+   of the instruction it names) and as dynamic instruction mix histograms.
+ */
+
+typedef enum {
+    SIM_RUNNING,
+    SIM_EXITED,
+    SIM_TRAP,
+    SIM_BREAK,
+    SIM_BAD_SYSCALL,
+    SIM_BAD_ADDRESS,
+    SIM_BAD_TARGET,
+    SIM_INVALID_INST,
+    SIM_STEP_LIMIT
+} SimStatus;
+
+/* One pre-decoded instruction. OP is an InstId or one of the SIM_OP_*
+   values below. DST is the register written, or SIM_ZERO_SINK in place of
+   $zero so that handlers never need to restore it. IMM is the immediate,
+   shift amount or, for branches and jumps, the index of the target. */
+typedef struct {
+    const void* handler;
+    uint8_t op;
+    uint8_t dst, rs, rt;
+    int32_t imm;
+} SimInst;
+
+/* Past the end of .text, and a branch or jump target outside it. */
+#define SIM_OP_END (NUM_INSTS)
+#define SIM_OP_BAD_TARGET (NUM_INSTS + 1)
+
+#define SIM_ZERO_SINK 32
+
+#define SIM_DEFAULT_MEM_SIZE (1u << 20)
+
+typedef struct {
+    uint32_t regs[SIM_ZERO_SINK + 1];
+    uint32_t hi, lo;
+    uint32_t pc;
+    SimStatus status;
+    int exit_code;
+    uint32_t bad_addr;
+    uint8_t* mem;
+    uint32_t mem_size;
+    SimInst* code;
+    uint32_t len;
+    uint64_t* counts;
+    const ObjectFile* obj;
+    FILE* output;
+    int threaded;
+} Simulator;
+
+int init_simulator(Simulator* sim, const ObjectFile* obj, uint32_t mem_size);
+
+void free_simulator(Simulator* sim);
+
+SimStatus run_simulator(Simulator* sim, uint64_t max_jumps);
+
+uint64_t sim_instructions(const Simulator* sim);
+
+const char* sim_status_name(SimStatus status);
+
+void write_profile(FILE* output, const Simulator* sim);
+
+#endif
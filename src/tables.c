@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "utils.h"
 #include "tables.h"
@@ -31,26 +33,231 @@ void write_symbol(FILE* output, uint32_t addr, const char* name) {
     fprintf(output, "%u\t%s\n", addr, name);
 }
 
+/*******************************
+ * Allocators
+ *******************************/
+
+static void* heap_alloc(Allocator* self, size_t size) {
+    return malloc(size);
+}
+
+static void* heap_resize(Allocator* self, void* ptr, size_t old_size, size_t new_size) {
+    return realloc(ptr, new_size);
+}
+
+static void heap_release(Allocator* self, void* ptr, size_t size) {
+    free(ptr);
+}
+
+static Allocator heap = { heap_alloc, heap_resize, heap_release };
+
+/* Allocator used by create_table(). */
+static Allocator* table_allocator = &heap;
+
+Allocator* heap_allocator() {
+    return &heap;
+}
+
+Allocator* get_table_allocator() {
+    return table_allocator;
+}
+
+/* Sets the allocator used by subsequent calls to create_table(). Passing NULL
+   restores the plain heap allocator. Existing tables keep the allocator they
+   were created with.
+ */
+void set_table_allocator(Allocator* alloc) {
+    table_allocator = alloc ? alloc : &heap;
+}
+
+/* Logs and returns 1 if growing the live heap by SIZE bytes would break the
+   counter's limit. */
+static int over_limit(CountingAllocator* counter, size_t size) {
+    if (counter->limit && size > allocator_headroom(counter)) {
+        write_to_log("Error: memory limit of %zu bytes exceeded (%zu bytes live, "
+            "%zu more requested)\n", counter->limit, counter->live_bytes, size);
+        return 1;
+    }
+    return 0;
+}
+
+static void* counting_alloc(Allocator* self, size_t size) {
+    CountingAllocator* counter = (CountingAllocator*) self;
+    if (over_limit(counter, size)) {
+        return NULL;
+    }
+    void* ptr = counter->parent->alloc(counter->parent, size);
+    if (ptr) {
+        counter->num_allocs++;
+        counter->total_bytes += size;
+        counter->live_bytes += size;
+        if (counter->live_bytes > counter->peak_bytes) {
+            counter->peak_bytes = counter->live_bytes;
+        }
+    }
+    return ptr;
+}
+
+static void* counting_resize(Allocator* self, void* ptr, size_t old_size, size_t new_size) {
+    CountingAllocator* counter = (CountingAllocator*) self;
+    if (new_size > old_size && over_limit(counter, new_size - old_size)) {
+        return NULL;
+    }
+    void* new_ptr = counter->parent->resize(counter->parent, ptr, old_size, new_size);
+    if (new_ptr) {
+        counter->num_allocs++;
+        counter->total_bytes += new_size;
+        counter->live_bytes += new_size - old_size;
+        if (counter->live_bytes > counter->peak_bytes) {
+            counter->peak_bytes = counter->live_bytes;
+        }
+    }
+    return new_ptr;
+}
+
+static void counting_release(Allocator* self, void* ptr, size_t size) {
+    CountingAllocator* counter = (CountingAllocator*) self;
+    if (!ptr) {
+        return;
+    }
+    counter->parent->release(counter->parent, ptr, size);
+    counter->num_frees++;
+    counter->live_bytes -= size;
+}
+
+/* Initializes COUNTER so that it forwards to PARENT (the heap if NULL) and
+   starts with all statistics at zero.
+ */
+void init_counting_allocator(CountingAllocator* counter, Allocator* parent) {
+    memset(counter, 0, sizeof(CountingAllocator));
+    counter->base.alloc = counting_alloc;
+    counter->base.resize = counting_resize;
+    counter->base.release = counting_release;
+    counter->parent = parent ? parent : &heap;
+}
+
+/* Returns how many more bytes COUNTER will hand out before reaching its limit,
+   or SIZE_MAX if it has none.
+ */
+size_t allocator_headroom(const CountingAllocator* counter) {
+    if (!counter->limit) {
+        return SIZE_MAX;
+    }
+    return counter->limit > counter->live_bytes ? counter->limit - counter->live_bytes : 0;
+}
+
+struct ArenaChunk {
+    ArenaChunk* next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+static const size_t ARENA_ALIGN = sizeof(void*) > sizeof(uint64_t) ? sizeof(void*) : sizeof(uint64_t);
+
+static void* arena_alloc(Allocator* self, size_t size) {
+    ArenaAllocator* arena = (ArenaAllocator*) self;
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    ArenaChunk* chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+        chunk = arena->parent->alloc(arena->parent, sizeof(ArenaChunk) + chunk_size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->next = arena->head;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        arena->head = chunk;
+    }
+    void* ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+/* Grows in place when PTR is the most recent allocation and the chunk has
+   room; otherwise copies into a fresh block. */
+static void* arena_resize(Allocator* self, void* ptr, size_t old_size, size_t new_size) {
+    ArenaAllocator* arena = (ArenaAllocator*) self;
+    ArenaChunk* chunk = arena->head;
+    size_t old_rounded = (old_size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    size_t new_rounded = (new_size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (ptr && chunk && (char*) ptr + old_rounded == chunk->data + chunk->used
+        && chunk->used - old_rounded + new_rounded <= chunk->size) {
+        chunk->used = chunk->used - old_rounded + new_rounded;
+        return ptr;
+    }
+    void* new_ptr = arena_alloc(self, new_size);
+    if (new_ptr && ptr) {
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return new_ptr;
+}
+
+static void arena_release(Allocator* self, void* ptr, size_t size) {
+    /* Memory is reclaimed all at once by destroy_arena_allocator(). */
+}
+
+/* Initializes ARENA to hand out memory from chunks of CHUNK_SIZE bytes taken
+   from PARENT (the heap if NULL).
+ */
+void init_arena_allocator(ArenaAllocator* arena, Allocator* parent, size_t chunk_size) {
+    arena->base.alloc = arena_alloc;
+    arena->base.resize = arena_resize;
+    arena->base.release = arena_release;
+    arena->parent = parent ? parent : &heap;
+    arena->head = NULL;
+    arena->chunk_size = chunk_size;
+}
+
+/* Returns every chunk owned by ARENA to its parent allocator. */
+void destroy_arena_allocator(ArenaAllocator* arena) {
+    ArenaChunk* chunk = arena->head;
+    while (chunk) {
+        ArenaChunk* next = chunk->next;
+        arena->parent->release(arena->parent, chunk, sizeof(ArenaChunk) + chunk->size);
+        chunk = next;
+    }
+    arena->head = NULL;
+}
+
 /*******************************
  * Symbol Table Functions
  *******************************/
 
+static const uint32_t INITIAL_TABLE_CAP = 8;
+
+/* Unique-name tables get a hash index once they hold this many entries.
+   Below it a linear scan is as fast and the index would only cost memory. */
+static const uint32_t INDEX_MIN_LEN = 32;
+
 /* Creates a new SymbolTable containg 0 elements and returns a pointer to that
    table. Multiple SymbolTables may exist at the same time. 
    If memory allocation fails, it calls allocation_failed(). 
    Mode will be either SYMTBL_NON_UNIQUE or SYMTBL_UNIQUE_NAME. You will need
    to store this value for use during add_to_table().
+   The table draws its memory from the allocator set by set_table_allocator().
  */
-
 SymbolTable* create_table(int mode) {
-    SymbolTable* myTable = (SymbolTable*)malloc(sizeof(SymbolTable)); //DO WE NEED TO USE CALLOC HERE ? OR SHOULD WE?
+    return create_table_with_allocator(mode, table_allocator);
+}
+
+/* Same as create_table(), but all of the table's memory comes from ALLOC. */
+SymbolTable* create_table_with_allocator(int mode, Allocator* alloc) {
+    SymbolTable* myTable = alloc->alloc(alloc, sizeof(SymbolTable));
     if(!myTable) {
       allocation_failed();
     }
     myTable -> len = 0;
+    myTable -> types = NULL;
     myTable -> mode = mode;
-    myTable -> cap = 5;
-    myTable -> tbl = malloc(100 * sizeof(Symbol));
+    myTable -> cap = INITIAL_TABLE_CAP;
+    myTable -> alloc = alloc;
+    myTable -> image = NULL;
+    myTable -> image_size = 0;
+    myTable -> index = NULL;
+    myTable -> index_size = 0;
+    myTable -> tbl = alloc->alloc(alloc, INITIAL_TABLE_CAP * sizeof(Symbol));
     if(!(myTable -> tbl)) {
       allocation_failed();
     }
@@ -59,12 +266,58 @@ SymbolTable* create_table(int mode) {
 
 /* Frees the given SymbolTable and all associated memory. */
 void free_table(SymbolTable* table) {
+  Allocator* alloc = table -> alloc;
   int size_table = table -> len;
+  if (table -> image) {
+    munmap((void*) table -> image, table -> image_size);
+    size_table = 0;
+  }
   for(int i = 0; i < size_table; i++) {
-    free( (table-> tbl)[i].name);
+    char* name = (table-> tbl)[i].name;
+    alloc->release(alloc, name, strlen(name) + 1);
+  }
+  if (table -> types) {
+    alloc->release(alloc, table -> types, table -> cap);
+  }
+  if (table -> index) {
+    alloc->release(alloc, table -> index, (table -> index_size) * sizeof(uint32_t));
   }
-  free(table -> tbl);
-  free(table);
+  alloc->release(alloc, table -> tbl, (table -> cap) * sizeof(Symbol));
+  alloc->release(alloc, table, sizeof(SymbolTable));
+}
+
+/* Returns the position in TABLE's index of NAME, or of the empty slot where
+   it would go. */
+static uint32_t index_slot(const SymbolTable* table, const char* name) {
+    uint32_t mask = table->index_size - 1;
+    uint32_t slot = symbol_hash(name) & mask;
+    while (table->index[slot] && strcmp(table->tbl[table->index[slot] - 1].name, name) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/* Rebuilds TABLE's index with room for four times its entries. The old
+   index is released rather than resized, since it is rebuilt anyway. */
+static void rebuild_index(SymbolTable* table) {
+    Allocator* alloc = table->alloc;
+    uint32_t size = 64;
+    while (size < 4 * table->len) {
+        size *= 2;
+    }
+    uint32_t* index = alloc->alloc(alloc, size * sizeof(uint32_t));
+    if (!index) {
+        allocation_failed();
+    }
+    memset(index, 0, size * sizeof(uint32_t));
+    if (table->index) {
+        alloc->release(alloc, table->index, table->index_size * sizeof(uint32_t));
+    }
+    table->index = index;
+    table->index_size = size;
+    for (uint32_t i = 0; i < table->len; i++) {
+        index[index_slot(table, table->tbl[i].name)] = i + 1;
+    }
 }
 
 /* Adds a new symbol and its address to the SymbolTable pointed to by TABLE. 
@@ -73,62 +326,198 @@ void free_table(SymbolTable* table) {
    Note that NAME may point to a temporary array, so it is not safe to simply
    store the NAME pointer. It stores a copy of the given string.
 
-   If ADDR is not word-aligned, it calls addr_alignment_incorrect() and
-   return -1. If the table's mode is SYMTBL_UNIQUE_NAME and NAME already exists 
+   If ADDR is in .text (below DATA_BASE) and not word-aligned, it calls
+   addr_alignment_incorrect() and return -1. If the table's mode is SYMTBL_UNIQUE_NAME and NAME already exists 
    in the table, it calls name_already_exists() and return -1. If memory
    allocation fails, it calls allocation_failed(). 
    Otherwise, it stores the symbol name and address and return 0.
  */
 int add_to_table(SymbolTable* table, const char* name, uint32_t addr) {
-    if(addr % 4 != 0) {
+    if (table -> image) {
+      write_to_log("Error: cannot add '%s' to a mapped table.\n", name);
+      return -1;
+    }
+    if(addr % 4 != 0 && addr < DATA_BASE) {
       addr_alignment_incorrect();
       return -1;
     }
-    char newName[strlen(name) + 1];
-    strcpy(newName, name);
-    if ( (table -> mode) == SYMTBL_UNIQUE_NAME){
+    if (table -> index) {
+      if (table -> index[index_slot(table, name)]) {
+        name_already_exists(name);
+        return -1;
+      }
+    } else if ( (table -> mode) == SYMTBL_UNIQUE_NAME){
       int size_table = table -> len;
       for (int i = 0; i < size_table; i++) {
-        if(strcmp(newName, ((table -> tbl)[i]).name) == 0) {
+        if(strcmp(name, ((table -> tbl)[i]).name) == 0) {
           name_already_exists(name);
           return -1;
         }
       }
     }
+    Allocator* alloc = table -> alloc;
     if(table -> len == table -> cap) {
-      table -> cap = (table -> cap) * 5;
-      table -> tbl = realloc(table->tbl, (table->cap) * sizeof(Symbol));
-      uint32_t new_size_needed = strlen(name) + 1; //Also need to make sure you can add one to a uint32_t
-      table->tbl[(table->len)].name = malloc(new_size_needed * sizeof(char));
-      strcpy(table->tbl[(table->len)].name, newName);
-      table->tbl[(table->len)].addr = addr;
-      table -> len = table->len + 1;      
-    } else {
-        uint32_t new_size_needed = strlen(newName) + 1;
-        table->tbl[(table->len)].name = malloc(new_size_needed * sizeof(char));
-        strcpy(table->tbl[(table->len)].name, newName);
-        table->tbl[(table->len)].addr = addr;
-        table ->len = table -> len + 1;
+      uint32_t new_cap = (table -> cap) * 2;
+      Symbol* new_tbl = alloc->resize(alloc, table->tbl, (table->cap) * sizeof(Symbol),
+          new_cap * sizeof(Symbol));
+      if(!new_tbl) {
+        allocation_failed();
+      }
+      table -> tbl = new_tbl;
+      if (table -> types) {
+        uint8_t* new_types = alloc->resize(alloc, table->types, table->cap, new_cap);
+        if (!new_types) {
+          allocation_failed();
+        }
+        memset(new_types + table->cap, 0, new_cap - table->cap);
+        table -> types = new_types;
+      }
+      table -> cap = new_cap;
+    }
+    size_t new_size_needed = strlen(name) + 1;
+    char* copy = alloc->alloc(alloc, new_size_needed);
+    if(!copy) {
+      allocation_failed();
+    }
+    memcpy(copy, name, new_size_needed);
+    table->tbl[(table->len)].name = copy;
+    table->tbl[(table->len)].addr = addr;
+    table ->len = table -> len + 1;
+    if (table -> index && 2 * table -> len <= table -> index_size) {
+      table -> index[index_slot(table, copy)] = table -> len;
+    } else if (table -> mode == SYMTBL_UNIQUE_NAME && table -> len >= INDEX_MIN_LEN) {
+      rebuild_index(table);
     }
     return 0;
 }
 
+/* Same as add_to_table(), but records TYPE, a RelocType, with the entry.
+   Returns 0 on success and -1 on error.
+ */
+int add_reloc(SymbolTable* table, const char* name, uint32_t addr, uint8_t type) {
+    if (add_to_table(table, name, addr) != 0) {
+      return -1;
+    }
+    if (!table -> types && type) {
+      Allocator* alloc = table -> alloc;
+      table -> types = alloc->alloc(alloc, table -> cap);
+      if (!table -> types) {
+        allocation_failed();
+      }
+      memset(table -> types, 0, table -> cap);
+    }
+    if (table -> types) {
+      table -> types[table -> len - 1] = type;
+    }
+    return 0;
+}
+
+static const SymbolImageEntry* image_entries(const SymbolImageHeader* image) {
+    return (const SymbolImageEntry*) (image + 1);
+}
+
+static const uint32_t* image_buckets(const SymbolImageHeader* image) {
+    return (const uint32_t*) (image_entries(image) + image->count);
+}
+
+static const char* image_strtab(const SymbolImageHeader* image) {
+    return (const char*) (image_buckets(image) + image->num_buckets);
+}
+
 /* Returns the address (byte offset) of the given symbol. If a symbol with name
    NAME is not present in TABLE, return -1.
  */
 int64_t get_addr_for_symbol(SymbolTable* table, const char* name) {
+    if (table -> image) {
+      const SymbolImageHeader* image = table -> image;
+      const SymbolImageEntry* entries = image_entries(image);
+      const char* strtab = image_strtab(image);
+      uint32_t hash = symbol_hash(name);
+      uint32_t link = image_buckets(image)[hash & (image->num_buckets - 1)];
+      while (link) {
+        const SymbolImageEntry* entry = &entries[link - 1];
+        if (entry->hash == hash && strcmp(name, strtab + entry->name) == 0) {
+          return entry->addr;
+        }
+        link = entry->next;
+      }
+      return -1;
+    }
+    if (table -> index) {
+      uint32_t entry = table -> index[index_slot(table, name)];
+      return entry ? (int64_t) table->tbl[entry - 1].addr : -1;
+    }
     for(int i = 0; i< table -> len; i++) {
       if(strcmp(name, table->tbl[i].name) == 0) {
-        return table->tbl[i].addr; //IS IT A PROBLEM THAT ADDR IS A uint32_t and this func expects a int64_t
+        return table->tbl[i].addr;
       }
     }
     return -1;   
 }
+/* Moves the symbol NAME in TABLE to ADDR. In a table of non-unique names the
+   first entry called NAME moves. Returns 0 on success and -1 if NAME is not
+   in TABLE or TABLE is a read-only image.
+ */
+int set_symbol_addr(SymbolTable* table, const char* name, uint32_t addr) {
+    if (table -> image) {
+      return -1;
+    }
+    if (table -> index) {
+      uint32_t entry = table -> index[index_slot(table, name)];
+      if (!entry) {
+        return -1;
+      }
+      table->tbl[entry - 1].addr = addr;
+      return 0;
+    }
+    for (uint32_t i = 0; i < table -> len; i++) {
+      if (strcmp(name, table->tbl[i].name) == 0) {
+        table->tbl[i].addr = addr;
+        return 0;
+      }
+    }
+    return -1;
+}
+
+/* Stores the name and address of the INDEX-th symbol of TABLE, counting in
+   the order write_table() prints them. Returns 0 on success and -1 if INDEX
+   is out of range.
+ */
+int get_symbol(SymbolTable* table, uint32_t index, const char** name, uint32_t* addr) {
+    if (index >= table -> len) {
+      return -1;
+    }
+    if (table -> image) {
+      const SymbolImageEntry* entry = &image_entries(table -> image)[index];
+      *name = image_strtab(table -> image) + entry->name;
+      *addr = entry->addr;
+    } else {
+      *name = table->tbl[index].name;
+      *addr = table->tbl[index].addr;
+    }
+    return 0;
+}
+
+/* Returns the relocation type of the INDEX-th entry of TABLE. */
+uint8_t get_reloc_type(SymbolTable* table, uint32_t index) {
+    if (!table -> types || index >= table -> len) {
+      return 0;
+    }
+    return table -> types[index];
+}
 
 /* Writes the SymbolTable TABLE to OUTPUT. You should use write_symbol() to
    perform the write. Do not print any additional whitespace or characters.
  */
 void write_table(SymbolTable* table, FILE* output) {
+    if (table -> image) {
+      const SymbolImageEntry* entries = image_entries(table -> image);
+      const char* strtab = image_strtab(table -> image);
+      for (uint32_t i = 0; i < table -> image -> count; i++) {
+        write_symbol(output, entries[i].addr, strtab + entries[i].name);
+      }
+      return;
+    }
     for (int i = 0; i < table -> len; i++) {
       Symbol* ptHead = table -> tbl;
       Symbol currSymbol = ptHead[i];
@@ -137,3 +526,146 @@ void write_table(SymbolTable* table, FILE* output) {
       write_symbol(output, currAddr, currName);
     }
 }
+
+/*******************************
+ * Symbol Table Images
+ *******************************/
+
+/* FNV-1a hash of NAME. */
+uint32_t symbol_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (uint8_t) *name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int compare_by_addr(const void* a, const void* b) {
+    const SymbolImageEntry* x = a;
+    const SymbolImageEntry* y = b;
+    if (x->addr != y->addr) {
+        return x->addr < y->addr ? -1 : 1;
+    }
+    /* Keep symbols at the same address in insertion order; NEXT still holds
+       the insertion index at this point. */
+    return x->next < y->next ? -1 : x->next > y->next;
+}
+
+/* Writes TABLE to OUTPUT in the image format described in tables.h. The
+   table itself is left unchanged. Returns 0 on success and -1 on error.
+ */
+int write_table_image(SymbolTable* table, FILE* output) {
+    Allocator* alloc = table -> alloc;
+    uint32_t count = table -> len;
+    uint32_t num_buckets = 1;
+    while (num_buckets < 2 * count) {
+        num_buckets *= 2;
+    }
+    size_t entries_size = count * sizeof(SymbolImageEntry);
+    size_t buckets_size = num_buckets * sizeof(uint32_t);
+    SymbolImageEntry* entries = alloc->alloc(alloc, entries_size ? entries_size : 1);
+    uint32_t* buckets = alloc->alloc(alloc, buckets_size);
+    if (!entries || !buckets) {
+      allocation_failed();
+    }
+
+    uint32_t strtab_size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i].name = strtab_size;
+        entries[i].addr = table->tbl[i].addr;
+        entries[i].hash = symbol_hash(table->tbl[i].name);
+        entries[i].next = i;
+        strtab_size += strlen(table->tbl[i].name) + 1;
+    }
+    qsort(entries, count, sizeof(SymbolImageEntry), compare_by_addr);
+
+    /* Chain in reverse so that each chain lists its entries by address. */
+    memset(buckets, 0, buckets_size);
+    for (uint32_t i = count; i-- > 0; ) {
+        uint32_t* bucket = &buckets[entries[i].hash & (num_buckets - 1)];
+        entries[i].next = *bucket;
+        *bucket = i + 1;
+    }
+
+    SymbolImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SYMTBL_IMAGE_MAGIC, sizeof(SYMTBL_IMAGE_MAGIC));
+    header.version = SYMTBL_IMAGE_VERSION;
+    header.mode = table -> mode;
+    header.count = count;
+    header.num_buckets = num_buckets;
+    header.strtab_size = strtab_size;
+
+    int err = 0;
+    if (fwrite(&header, sizeof(header), 1, output) != 1
+        || fwrite(entries, 1, entries_size, output) != entries_size
+        || fwrite(buckets, 1, buckets_size, output) != buckets_size) {
+        err = -1;
+    }
+    for (uint32_t i = 0; i < count && !err; i++) {
+        const char* name = table->tbl[i].name;
+        if (fwrite(name, 1, strlen(name) + 1, output) != strlen(name) + 1) {
+            err = -1;
+        }
+    }
+    alloc->release(alloc, entries, entries_size ? entries_size : 1);
+    alloc->release(alloc, buckets, buckets_size);
+    return err;
+}
+
+/* Returns 1 if every name offset in IMAGE lies in its string table and
+   every bucket and chain link names an entry, and 0 otherwise. Links must
+   also point further down the entries, as write_table_image() chains them,
+   so that a corrupt image cannot make a lookup loop. */
+static int image_offsets_valid(const SymbolImageHeader* image) {
+    const SymbolImageEntry* entries = image_entries(image);
+    const uint32_t* buckets = image_buckets(image);
+    for (uint32_t i = 0; i < image->count; i++) {
+        if (entries[i].name >= image->strtab_size
+            || (entries[i].next && (entries[i].next <= i + 1
+                || entries[i].next > image->count))) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < image->num_buckets; i++) {
+        if (buckets[i] > image->count) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Maps a table written by write_table_image() from INPUT. The returned table
+   answers lookups straight from the mapping and must be released with
+   free_table(). Returns NULL if INPUT is not a valid image.
+ */
+SymbolTable* map_table_image(FILE* input) {
+    struct stat st;
+    if (fstat(fileno(input), &st) != 0 || st.st_size < (off_t) sizeof(SymbolImageHeader)) {
+        return NULL;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(input), 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    const SymbolImageHeader* image = map;
+    uint64_t expected = sizeof(SymbolImageHeader)
+        + (uint64_t) image->count * sizeof(SymbolImageEntry)
+        + (uint64_t) image->num_buckets * sizeof(uint32_t) + image->strtab_size;
+    if (memcmp(image->magic, SYMTBL_IMAGE_MAGIC, sizeof(SYMTBL_IMAGE_MAGIC)) != 0
+        || image->version != SYMTBL_IMAGE_VERSION
+        || image->num_buckets == 0 || (image->num_buckets & (image->num_buckets - 1))
+        || expected != (uint64_t) st.st_size
+        || (image->strtab_size && image_strtab(image)[image->strtab_size - 1] != '\0')
+        || !image_offsets_valid(image)) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    SymbolTable* table = create_table(image->mode);
+    table -> image = image;
+    table -> image_size = st.st_size;
+    table -> len = image->count;
+    return table;
+}
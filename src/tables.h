@@ -1,11 +1,85 @@
 #ifndef TABLES_H
 #define TABLES_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 extern const int SYMTBL_NON_UNIQUE;
 extern const int SYMTBL_UNIQUE_NAME;
 
+/* Labels in .data are at DATA_BASE plus their byte offset in the section,
+   so they can never be taken for .text offsets: .text stays below 256 MB,
+   the most a jump can reach. */
+#define DATA_BASE 0x10000000u
+
+/* Allocator interface. Every allocation made by the tables module goes through
+   one of these, so the heap can be swapped for an arena or wrapped in a
+   counting allocator. RESIZE and RELEASE are passed the size the block was
+   allocated with. All three return NULL (or do nothing) on failure; callers
+   are responsible for reporting it.
+ */
+
+typedef struct Allocator Allocator;
+
+struct Allocator {
+    void* (*alloc)(Allocator* self, size_t size);
+    void* (*resize)(Allocator* self, void* ptr, size_t old_size, size_t new_size);
+    void (*release)(Allocator* self, void* ptr, size_t size);
+};
+
+/* Forwards to PARENT and records what passes through it. If LIMIT is nonzero,
+   requests that would take LIVE_BYTES above it are refused. */
+typedef struct {
+    Allocator base;
+    Allocator* parent;
+    size_t num_allocs;
+    size_t num_frees;
+    size_t total_bytes;
+    size_t live_bytes;
+    size_t peak_bytes;
+    size_t limit;
+} CountingAllocator;
+
+/* Bump allocator. Memory is carved out of chunks obtained from PARENT and is
+   only given back when the arena is destroyed. */
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+    Allocator base;
+    Allocator* parent;
+    ArenaChunk* head;
+    size_t chunk_size;
+} ArenaAllocator;
+
+/* Symbol table image.
+
+   A SymbolTable saved by write_table_image() so that a later process can map
+   it with map_table_image() instead of rebuilding it. The layout, in host
+   byte order, is a SymbolImageHeader, COUNT entries sorted by address,
+   NUM_BUCKETS hash buckets and a string table of NUL-terminated names. Each
+   bucket holds one more than the index of the first entry in its chain (0
+   for an empty bucket) and NEXT links the chain the same way.
+ */
+
+#define SYMTBL_IMAGE_MAGIC "MIPSSYM"
+#define SYMTBL_IMAGE_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t mode;
+    uint32_t count;
+    uint32_t num_buckets;
+    uint32_t strtab_size;
+} SymbolImageHeader;
+
+typedef struct {
+    uint32_t name;
+    uint32_t addr;
+    uint32_t hash;
+    uint32_t next;
+} SymbolImageEntry;
+
 /* Signature of the SymbolTable data structure. */
 
 typedef struct {
@@ -13,13 +87,41 @@ typedef struct {
     uint32_t addr;
 } Symbol;
 
+/* A table is either built in memory (TBL) or backed by a mapped image
+   (IMAGE), in which case it is read-only. Relocation tables also record a
+   RelocType per entry in TYPES, which stays NULL while every entry is R_26.
+   Tables of unique names index their entries by name hash in INDEX, an
+   open-addressed array of INDEX_SIZE slots holding one more than an entry
+   (0 for an empty slot), once they are large enough for it to pay off. */
 typedef struct {
     Symbol* tbl;
+    uint8_t* types;
     uint32_t len;
     uint32_t cap;
+    uint32_t* index;
+    uint32_t index_size;
     int mode;
+    Allocator* alloc;
+    const SymbolImageHeader* image;
+    size_t image_size;
 } SymbolTable;
 
+/* Allocator functions: */
+
+Allocator* heap_allocator();
+
+Allocator* get_table_allocator();
+
+void set_table_allocator(Allocator* alloc);
+
+void init_counting_allocator(CountingAllocator* counter, Allocator* parent);
+
+size_t allocator_headroom(const CountingAllocator* counter);
+
+void init_arena_allocator(ArenaAllocator* arena, Allocator* parent, size_t chunk_size);
+
+void destroy_arena_allocator(ArenaAllocator* arena);
+
 /* Helper functions: */
 
 void allocation_failed();
@@ -30,14 +132,30 @@ void name_already_exists(const char* name);
 
 void write_symbol(FILE* output, uint32_t addr, const char* name);
 
-SymbolTable* create_table();
+SymbolTable* create_table(int mode);
+
+SymbolTable* create_table_with_allocator(int mode, Allocator* alloc);
 
 void free_table(SymbolTable* table);
 
 int add_to_table(SymbolTable* table, const char* name, uint32_t addr);
 
+int add_reloc(SymbolTable* table, const char* name, uint32_t addr, uint8_t type);
+
 int64_t get_addr_for_symbol(SymbolTable* table, const char* name);
 
+int set_symbol_addr(SymbolTable* table, const char* name, uint32_t addr);
+
+int get_symbol(SymbolTable* table, uint32_t index, const char** name, uint32_t* addr);
+
+uint8_t get_reloc_type(SymbolTable* table, uint32_t index);
+
 void write_table(SymbolTable* table, FILE* output);
 
+uint32_t symbol_hash(const char* name);
+
+int write_table_image(SymbolTable* table, FILE* output);
+
+SymbolTable* map_table_image(FILE* input);
+
 #endif
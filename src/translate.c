@@ -1,32 +1,82 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "tables.h"
 #include "translate_utils.h"
 #include "translate.h"
+#include "reloc.h"
 
-/* Writes instructions during the assembler's first pass to OUTPUT.
-   Translates the li and blt pseudoinstructions without any side effects.
+typedef struct {
+    const char* name;
+    uint8_t fmt;
+    uint8_t opcode;
+    uint8_t funct;
+    uint8_t rt;
+} InstInfo;
+
+/* Indexed by InstId. */
+static const InstInfo inst_table[NUM_INSTS] = {
+#define X(id, name, fmt, opcode, funct, rt) { name, FMT_##fmt, opcode, funct, rt },
+    ISA_INSTRUCTIONS(X)
+#undef X
+};
+
+#define IS_OPERAND(kind) (OPERAND_##kind != OPERAND_NONE)
+
+/* Indexed by InstFormat. */
+static const FormatInfo format_table[NUM_FORMATS] = {
+#define X(fmt, op1, op2, op3, label) \
+    { IS_OPERAND(op1) + IS_OPERAND(op2) + IS_OPERAND(op3), \
+      { OPERAND_##op1, OPERAND_##op2, OPERAND_##op3 }, \
+      OPERAND_##op1 == OPERAND_SHAMT || OPERAND_##op2 == OPERAND_SHAMT \
+          || OPERAND_##op3 == OPERAND_SHAMT, \
+      LABEL_##label },
+    ISA_FORMATS(X)
+#undef X
+};
+
+static const int MAX_EXPANDED_ARGS = sizeof(((ExpandedInst*) 0)->args) / sizeof(char*);
+
+static void set_expansion(ExpandedInst* inst, const char* name, int num_args,
+    char* arg0, char* arg1, char* arg2) {
+    inst->name = name;
+    inst->num_args = num_args;
+    inst->args[0] = arg0;
+    inst->args[1] = arg1;
+    inst->args[2] = arg2;
+    inst->args[3] = NULL;
+}
+
+/* Expands one pass one instruction into the instructions written to the
+   intermediate file, storing them in OUT (which must have room for
+   MAX_EXPANSION entries). The arguments in OUT may point into ARGS.
+   Translates the li, la and blt pseudoinstructions without any side effects.
    NAME is the name of the instruction, ARGS is an array of the arguments, and
    NUM_ARGS specifies the number of items in ARGS.
    Error checking for regular instructions are done in pass two. However, for
    pseudoinstructions, it makes sure that ARGS contains the correct number
-   of arguments. This does not check whether the registers / label are 
+   of arguments. This does not check whether the registers / label are
    valid, since that will be checked in part two.
    Also for li:
     - the number is representable by 32 bits.
-    - if the immediate can fit in the imm field of an addiu instruction, then
-      li expands into a single addiu instruction. Otherwise, it expand into 
-        a lui-ori pair.
+    - it expands into the shortest sequence that loads its 32 bits (so
+      0xFFFFFFFF loads as -1): a single addiu from $zero if it fits a
+      signed 16-bit immediate, a single ori from $zero if it fits an
+      unsigned one, a single lui if its low half is zero, and a lui-ori
+      pair otherwise.
+   And for la:
+    - it always expands into a lui-ori pair naming the label, which pass two
+      turns into a pair of R_HI16 and R_LO16 relocations.
    And for blt:
     - this expansion uses the fewest number of instructions possible.
    MARS has slightly different translation rules for li, and it allows numbers
    larger than the largest 32 bit number to be loaded with li. You should follow
    the above rules if MARS behaves differently.
-   Returns the number of instructions written (so 0 if there were any errors).
+   Returns the number of instructions stored (so 0 if there were any errors).
  */
-unsigned write_pass_one(FILE* output, const char* name, char** args, int num_args) {
+unsigned expand_pass_one(ExpandedInst* out, const char* name, char** args, int num_args) {
     if (strcmp(name, "li") == 0) {
         if(num_args != 2) {
           return 0;
@@ -35,234 +85,415 @@ unsigned write_pass_one(FILE* output, const char* name, char** args, int num_arg
         int result = translate_num(&immediate, args[1], -2147483648, 4294967295);
         if (result == -1)
           return 0;
-        if ((immediate <= 65535 && immediate >= 0) || 
-          (immediate >= -32768 && immediate <= 32767)) {
-          char* instr = "addiu";
-          char* zero_reg = "$zero";
-          fprintf(output, "%s %s %s %ld\n", instr, args[0], zero_reg, immediate);
+        long int value = (int32_t) (uint32_t) immediate;
+        if (value >= -32768 && value <= 32767) {
+          set_expansion(&out[0], "addiu", 3, args[0], "$zero", out[0].num_buf);
+          sprintf(out[0].num_buf, "%ld", value);
+          return 1;
+        } else if (immediate >= 0 && immediate <= 65535) {
+          set_expansion(&out[0], "ori", 3, args[0], "$zero", out[0].num_buf);
+          sprintf(out[0].num_buf, "%ld", immediate);
+          return 1;
+        } else if ((immediate & 0xffff) == 0) {
+          set_expansion(&out[0], "lui", 2, args[0], out[0].num_buf, NULL);
+          sprintf(out[0].num_buf, "%ld", immediate >> 16);
+          return 1;
         } else {
-          char* loadUpper = "lui";
-          char* loadLower = "ori";
-          long int topBits = immediate >> 16; 
-          fprintf(output, "%s %s %ld\n",loadUpper, args[0], topBits);
+          long int topBits = immediate >> 16;
+          set_expansion(&out[0], "lui", 2, args[0], out[0].num_buf, NULL);
+          sprintf(out[0].num_buf, "%ld", topBits);
           long int lowBits = immediate & 0xffff;
-          fprintf(output, "%s %s %s %ld\n", loadLower, args[0], args[0], lowBits);
+          set_expansion(&out[1], "ori", 3, args[0], args[0], out[1].num_buf);
+          sprintf(out[1].num_buf, "%ld", lowBits);
+          return 2;
         }
+    } else if (strcmp(name, "la") == 0) {
+        if (num_args != 2 || !is_valid_label(args[1])) {
+          return 0;
+        }
+        set_expansion(&out[0], "lui", 2, args[0], args[1], NULL);
+        set_expansion(&out[1], "ori", 3, args[0], args[0], args[1]);
         return 2;
+    } else if (strcmp(name, "jalr") == 0 && num_args == 1) {
+        set_expansion(&out[0], "jalr", 2, "$ra", args[0], NULL);
+        return 1;
     } else if (strcmp(name, "blt") == 0) {
         if(num_args != 3) {
           return 0;
         }
-        fprintf(output, "%s %s %s %s\n", "slt","$at", args[0], args[1]);
-        fprintf(output, "%s %s %s %s\n","bne", "$at", "$zero", args[2]);
+        set_expansion(&out[0], "slt", 3, "$at", args[0], args[1]);
+        set_expansion(&out[1], "bne", 3, "$at", "$zero", args[2]);
         return 2;
     } else {
-        write_inst_string(output, name, args, num_args);
+        set_expansion(&out[0], name, num_args, NULL, NULL, NULL);
+        for (int i = 0; i < num_args; i++) {
+          out[0].args[i] = args[i];
+        }
         return 1;
     }
 }
 
+/* Writes instructions during the assembler's first pass to OUTPUT, using
+   expand_pass_one() to translate pseudoinstructions.
+   Returns the number of instructions written (so 0 if there were any
+   errors).
+ */
+unsigned write_pass_one(FILE* output, const char* name, char** args, int num_args) {
+    ExpandedInst insts[MAX_EXPANSION];
+    if (num_args < 0 || num_args > MAX_EXPANDED_ARGS) {
+        return 0;
+    }
+    unsigned count = expand_pass_one(insts, name, args, num_args);
+    for (unsigned i = 0; i < count; i++) {
+        write_inst_string(output, insts[i].name, insts[i].args, insts[i].num_args);
+    }
+    return count;
+}
+
+/* Returns the mnemonic of instruction ID, or NULL if there is none. */
+const char* inst_name(uint8_t id) {
+    return id < NUM_INSTS ? inst_table[id].name : NULL;
+}
+
+/* Returns the encoding properties of format FMT, or NULL if there is none. */
+const FormatInfo* format_info(uint8_t fmt) {
+    return fmt < NUM_FORMATS ? &format_table[fmt] : NULL;
+}
+
+static const char* const CLASS_NAMES[NUM_CLASSES] = {
+    "alu", "multiply/divide", "load", "store", "branch", "jump", "trap", "system",
+};
+
+/* Returns the InstClass of instruction ID. */
+int inst_class(uint8_t id) {
+    Instr inst;
+    init_inst(&inst, id);
+    const FormatInfo* info = format_info(inst.fmt);
+    switch (inst.fmt) {
+        case FMT_MEM:    return inst.opcode & 0x08 ? CLASS_STORE : CLASS_LOAD;
+        case FMT_TRAPI:  return CLASS_TRAP;
+        case FMT_NONE:   return CLASS_SYSTEM;
+        case FMT_MFHI:   return CLASS_MULDIV;
+        case FMT_JALR:   return CLASS_JUMP;
+        case FMT_JR:     return id == INST_JR ? CLASS_JUMP : CLASS_MULDIV;
+        case FMT_MULDIV: return inst.opcode == 0 && inst.funct >= 0x30 ? CLASS_TRAP : CLASS_MULDIV;
+        default:
+            if (info->label == LABEL_BRANCH) {
+                return CLASS_BRANCH;
+            }
+            if (info->label == LABEL_JUMP) {
+                return CLASS_JUMP;
+            }
+            return id == INST_MUL ? CLASS_MULDIV : CLASS_ALU;
+    }
+}
+
+/* Returns the name of instruction class CLS for reports. */
+const char* inst_class_name(int cls) {
+    return cls >= 0 && cls < NUM_CLASSES ? CLASS_NAMES[cls] : NULL;
+}
+
+/* Clears INST and fills in the format, opcode and funct of instruction ID. */
+void init_inst(Instr* inst, uint8_t id) {
+    memset(inst, 0, sizeof(Instr));
+    inst->id = id;
+    if (id < NUM_INSTS) {
+        inst->fmt = inst_table[id].fmt;
+        inst->opcode = inst_table[id].opcode;
+        inst->funct = inst_table[id].funct;
+        inst->rt = inst_table[id].rt;
+    }
+}
+
+/*******************************
+ * Operand decoders
+ *******************************/
+
+/* One decoder per operand kind. Each stores ARG in INST and returns 0, or
+   returns -1 if ARG is not valid for it. LABELS is set if the format lets an
+   immediate operand be a label instead. */
+
+static int operand_NONE(Instr* inst, const char* arg, int labels) {
+  return 0;
+}
+
+static int operand_RD(Instr* inst, const char* arg, int labels) {
+  int reg = translate_reg(arg);
+  inst->rd = reg;
+  return reg == -1 ? -1 : 0;
+}
+
+static int operand_RS(Instr* inst, const char* arg, int labels) {
+  int reg = translate_reg(arg);
+  inst->rs = reg;
+  return reg == -1 ? -1 : 0;
+}
+
+static int operand_RT(Instr* inst, const char* arg, int labels) {
+  int reg = translate_reg(arg);
+  inst->rt = reg;
+  return reg == -1 ? -1 : 0;
+}
+
+/* clz and clo must name their destination in both rd and rt. */
+static int operand_RDT(Instr* inst, const char* arg, int labels) {
+  int reg = translate_reg(arg);
+  inst->rd = inst->rt = reg;
+  return reg == -1 ? -1 : 0;
+}
+
+/* Branch and jump targets are only looked up in pass two. */
+static int operand_LABEL(Instr* inst, const char* arg, int labels) {
+  inst->label = arg;
+  return 0;
+}
+
+/* Decodes the immediate STR into INST. If LABELS is set, STR may instead
+   name a label whose address is filled in by a relocation. */
+static int decode_imm_or_label(Instr* inst, const char* str, long int lower,
+    long int upper, int labels) {
+  long int immediate;
+  if (translate_num(&immediate, str, lower, upper) == 0) {
+    inst->imm = immediate;
+    return 0;
+  }
+  if (labels && is_valid_label(str)) {
+    inst->label = str;
+    return 0;
+  }
+  return -1;
+}
+
+#define X(kind, lower, upper) \
+static int operand_##kind(Instr* inst, const char* arg, int labels) { \
+  return decode_imm_or_label(inst, arg, lower, upper, labels); \
+}
+ISA_IMMEDIATES(X)
+#undef X
+
+/* One decoder per format, checking the operand count and then decoding each
+   operand in turn. */
+#define X(fmt, op1, op2, op3, label) \
+static int decode_##fmt(Instr* inst, char** args, size_t num_args) { \
+  int labels = LABEL_##label != LABEL_NONE; \
+  if (num_args != format_table[FMT_##fmt].num_operands) \
+    return -1; \
+  if (operand_##op1(inst, num_args > 0 ? args[0] : NULL, labels) != 0 \
+      || operand_##op2(inst, num_args > 1 ? args[1] : NULL, labels) != 0 \
+      || operand_##op3(inst, num_args > 2 ? args[2] : NULL, labels) != 0) \
+    return -1; \
+  return 0; \
+}
+ISA_FORMATS(X)
+#undef X
+
+/* Validates the operands of INST (whose format is already set) and stores
+   them in INST. Returns 0 on success and -1 on error. */
+static int decode_operands(Instr* inst, char** args, size_t num_args) {
+    switch (inst->fmt) {
+#define X(fmt, op1, op2, op3, label) \
+        case FMT_##fmt: return decode_##fmt(inst, args, num_args);
+        ISA_FORMATS(X)
+#undef X
+        default: return -1;
+    }
+}
+
+/* inst_table's IDs in strcmp order of their names, for decode_inst()'s
+   binary search. Built once from the table, since the IDs follow
+   ISA_INSTRUCTIONS order and cannot be sorted at compile time. */
+static uint8_t sorted_ids[NUM_INSTS];
+static pthread_once_t sorted_once = PTHREAD_ONCE_INIT;
+
+static int compare_inst_names(const void* a, const void* b) {
+    return strcmp(inst_table[*(const uint8_t*) a].name, inst_table[*(const uint8_t*) b].name);
+}
+
+static void sort_inst_ids(void) {
+    for (uint8_t id = 0; id < NUM_INSTS; id++) {
+        sorted_ids[id] = id;
+    }
+    qsort(sorted_ids, NUM_INSTS, sizeof(sorted_ids[0]), compare_inst_names);
+}
+
+/* Returns the ID of the instruction NAME, or NUM_INSTS if there is none. */
+static uint8_t find_inst(const char* name) {
+    pthread_once(&sorted_once, sort_inst_ids);
+    size_t low = 0, high = NUM_INSTS;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = strcmp(name, inst_table[sorted_ids[mid]].name);
+        if (cmp == 0) {
+            return sorted_ids[mid];
+        } else if (cmp < 0) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return NUM_INSTS;
+}
+
+/* Looks up the instruction NAME and decodes its arguments into INST. This
+   performs all of the error checking that does not need the symbol table.
+   Returns 0 on success and -1 if the instruction is invalid.
+ */
+int decode_inst(Instr* inst, const char* name, char** args, size_t num_args) {
+    uint8_t id = find_inst(name);
+    if (id == NUM_INSTS) {
+        return -1;
+    }
+    init_inst(inst, id);
+    return decode_operands(inst, args, num_args);
+}
+
+/* Packs the decoded instruction INST into WORD. ADDR is the byte offset of
+   the instruction. Branch targets are resolved with SYMTBL; jump targets and
+   labels used as lui/ori immediates are added to RELTBL with their type, and
+   their fields left as zeros.
+   Returns 0 on success and -1 on error.
+ */
+int encode_inst(uint32_t* word, const Instr* inst, uint32_t addr, SymbolTable* symtbl,
+    SymbolTable* reltbl) {
+    if (inst->fmt >= NUM_FORMATS) {
+        return -1;
+    }
+    const FormatInfo* info = &format_table[inst->fmt];
+    uint32_t imm = inst->imm;
+    if (inst->label) {
+        switch (info->label) {
+            case LABEL_BRANCH: {
+                int64_t checker = get_addr_for_symbol(symtbl, inst->label);
+                if (checker == -1) {
+                  return -1;
+                }
+                uint32_t exact_address = checker - addr - 4;
+                if (exact_address % 4 != 0)
+                  return -1;
+                int32_t distance = (int32_t) exact_address / 4;
+                if (distance < -32768 || distance > 32767)
+                  return -1;
+                imm = distance;
+                break;
+            }
+            case LABEL_JUMP:
+                if (!reltbl || add_reloc(reltbl, inst->label, addr, R_26) != 0) {
+                  return -1;
+                }
+                imm = 0;
+                break;
+            case LABEL_HI16:
+            case LABEL_LO16:
+                if (!reltbl || add_reloc(reltbl, inst->label, addr,
+                    info->label == LABEL_HI16 ? R_HI16 : R_LO16) != 0) {
+                  return -1;
+                }
+                imm = 0;
+                break;
+            default:
+                return -1;
+        }
+    }
+    *word = ((uint32_t) inst->opcode << 26) | ((uint32_t) inst->rs << 21)
+        | ((uint32_t) inst->rt << 16) | ((uint32_t) inst->rd << 11) | inst->funct
+        | (info->shamt ? (imm & 0x1F) << 6 : imm & 0xFFFF);
+    return 0;
+}
+
 /* Writes the instruction in hexadecimal format to OUTPUT during pass #2.
    NAME is the name of the instruction, ARGS is an array of the arguments, and
-   NUM_ARGS specifies the number of items in ARGS. 
+   NUM_ARGS specifies the number of items in ARGS.
    The symbol table (SYMTBL) is given for any symbols that need to be resolved
    at this step. If a symbol should be relocated, it should be added to the
    relocation table (RELTBL), and the fields for that symbol should be set to
-   all zeros. 
+   all zeros.
    This performs error checking on all instructions and make sure that their
-   arguments are valid. If an instruction is invalid, you should not write 
+   arguments are valid. If an instruction is invalid, you should not write
    anything to OUTPUT but simply return -1. MARS may be a useful resource for
    this step.
-   Returns 0 on success and -1 on error. 
+   Returns 0 on success and -1 on error.
  */
 int translate_inst(FILE* output, const char* name, char** args, size_t num_args, uint32_t addr,
     SymbolTable* symtbl, SymbolTable* reltbl) {
-    if (strcmp(name, "addu") == 0)       return write_rtype (0x21, output, args, num_args);
-    else if (strcmp(name, "or") == 0)    return write_rtype (0x25, output, args, num_args);
-    else if (strcmp(name, "slt") == 0)   return write_rtype (0x2a, output, args, num_args);
-    else if (strcmp(name, "sltu") == 0)  return write_rtype (0x2b, output, args, num_args);
-    else if (strcmp(name, "sll") == 0)   return write_shift (0x00, output, args, num_args);
-    else if (strcmp(name, "jr") == 0)     return write_jr (0x08, output, args, num_args);
-    else if (strcmp(name, "addiu") == 0)  return write_addiu (0x9, output, args, num_args);
-    else if (strcmp(name, "ori") == 0)    return write_ori (0xd, output, args, num_args);
-    else if (strcmp(name, "lui") == 0)    return write_lui (0xf, output, args, num_args);
-    else if (strcmp(name, "lb") == 0)    return write_mem (0x20, output, args, num_args);
-    else if (strcmp(name, "lbu") == 0)   return write_mem (0x24, output, args, num_args);
-    else if (strcmp(name, "lw") == 0)    return write_mem (0x23, output, args, num_args);
-    else if (strcmp(name, "sb") == 0)    return write_mem (0x28, output, args, num_args);
-    else if (strcmp(name, "sw") == 0)    return write_mem (0x2b, output, args, num_args);
-    else if (strcmp(name, "beq") == 0)    return write_branch(0x4, output, args, num_args, addr, symtbl);
-    else if (strcmp(name, "bne") == 0)    return write_branch(0x5, output, args, num_args, addr, symtbl);
-    else if (strcmp(name, "j") == 0)    return write_jump(0x2, output, args, num_args, addr, reltbl);
-    else if (strcmp(name, "jal") == 0)  return write_jump(0x03, output, args, num_args, addr, reltbl);
-    else                                 return -1;
+    Instr inst;
+    uint32_t word;
+    if (decode_inst(&inst, name, args, num_args) != 0
+        || encode_inst(&word, &inst, addr, symtbl, reltbl) != 0) {
+        return -1;
+    }
+    write_inst_hex(output, word);
+    return 0;
 }
+
+/* Decodes ARGS as an instruction of format FMT with the given OPCODE and
+   FUNCT, and writes it to OUTPUT. Shared by the write_*() helpers below. */
+static int write_format(uint8_t fmt, uint8_t opcode, uint8_t funct, FILE* output,
+    char** args, size_t num_args, uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl) {
+  Instr inst;
+  uint32_t word;
+  memset(&inst, 0, sizeof(Instr));
+  inst.fmt = fmt;
+  inst.opcode = opcode;
+  inst.funct = funct;
+  if (decode_operands(&inst, args, num_args) != 0
+      || encode_inst(&word, &inst, addr, symtbl, reltbl) != 0)
+    return -1;
+  write_inst_hex(output, word);
+  return 0;
+}
+
 /* A helper function for writing most R-type instructions. This uses
-   translate_reg() to parse registers and write_inst_hex() to write to 
+   translate_reg() to parse registers and write_inst_hex() to write to
    OUTPUT. Both are defined in translate_utils.h.
  */
 int write_rtype(uint8_t funct, FILE* output, char** args, size_t num_args) {
-  if (num_args != 3)
-    return -1;
-  int rd = translate_reg(args[0]);
-  int rs = translate_reg(args[1]);
-  int rt = translate_reg(args[2]);
-  if (rd == -1 || rs == -1 || rt == -1)
-    return -1;
-  uint32_t instruction = (0<<26) | (rs<<21) | (rt<<16) | (rd<<11) | (0 << 6) | funct;
-  write_inst_hex(output, instruction);
-  return 0;
+  return write_format(FMT_RTYPE, 0, funct, output, args, num_args, 0, NULL, NULL);
 }
 
-/* A helper function for writing shift instructions. You should use 
+/* A helper function for writing shift instructions. You should use
    translate_num() to parse numerical arguments. translate_num() is defined
    in translate_utils.h.
  */
 int write_shift(uint8_t funct, FILE* output, char** args, size_t num_args) {
-  if (num_args != 3)
-    return -1;
-  long int shamt;
-  int rd = translate_reg(args[0]);
-  int rt = translate_reg(args[1]);
-  int err = translate_num(&shamt, args[2], 0, 31);
-  if (rd == -1 || rt == -1 || err == -1)
-    return -1;
-  uint32_t instruction = (0 << 26) | (0 << 21) | (rt << 16) | (rd << 11) | (shamt << 6) | funct;
-  write_inst_hex(output, instruction);
-  return 0;
+  return write_format(FMT_SHIFT, 0, funct, output, args, num_args, 0, NULL, NULL);
 }
 
 /* A helper function for writing jump register instructions. */
 int write_jr(uint8_t funct, FILE* output, char** args, size_t num_args) {
-  if (num_args != 1)
-    return -1;
-  int rs = translate_reg(args[0]);
-  if (rs == -1)
-    return -1;
-  uint32_t instruction = (0<<26) | (rs<<21) | (0<<16) | (0<<11) | (0 << 6) | funct;
-  write_inst_hex(output, instruction);
-  return 0;
+  return write_format(FMT_JR, 0, funct, output, args, num_args, 0, NULL, NULL);
 }
 
 /* A helper function for writing add immediate unsigned
   register instructions.
 */
 int write_addiu(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-  if (num_args != 3) {
-    return -1;
-  }
-  int rs = translate_reg(args[0]);
-  int rt = translate_reg(args[1]);
-  if (rs == -1 || rt == -1)
-    return -1;
-  long int immediate;
-  int result = translate_num(&immediate, args[2], -32768, 32767);
-  if (result == -1) 
-    return -1;
-  uint32_t instruction;
-  if (immediate < 0 ) {
-    immediate = immediate & 0xFFFF;
-    instruction = (opcode<<26) | (rt<<21) | (rs<<16) | immediate;
-  } else {
-    instruction = (opcode<<26) | (rt<<21) | (rs<<16) | immediate;
-  }
-  write_inst_hex(output, instruction);
-  return 0;
+  return write_format(FMT_ADDIU, opcode, 0, output, args, num_args, 0, NULL, NULL);
 }
 
 /* A helper function for writing Or Immediate register instructions. */
 int write_ori(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-  if (num_args != 3) 
-    return -1;
-  int rt = translate_reg(args[0]);
-  int rs = translate_reg(args[1]);
-  if (rs == -1 || rt == -1)
-    return -1;
-  long int immediate;
-  int result = translate_num(&immediate, args[2], 0, 65535);
-  if (result == -1) 
-    return -1;
-  uint32_t instruction = (opcode<<26) | (rs<<21) | (rt<<16) | immediate;
-  write_inst_hex(output, instruction);
-  return 0;
+  return write_format(FMT_ORI, opcode, 0, output, args, num_args, 0, NULL, NULL);
 }
 
-/* A helper function for writing Or Immediate register instructions. */
+/* A helper function for writing Load Upper Immediate instructions. */
 int write_lui(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-  if (num_args != 2)
-    return -1;
-  int rt = translate_reg(args[0]);
-  if (rt == -1)
-    return -1;
-  long int immediate;
-  int result = translate_num(&immediate, args[1], -2147483648, 2147483647);
-  if (result == -1) 
-    return -1;
-  uint32_t instruction = (opcode<<26) | (0<<21) | (rt<<16) | immediate;
-  write_inst_hex(output, instruction);
-  return 0;
+  return write_format(FMT_LUI, opcode, 0, output, args, num_args, 0, NULL, NULL);
 }
 
 int write_mem(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-  if (num_args != 3) {
-    return -1;
-  }
-  int rs = translate_reg(args[0]);
-  int rt = translate_reg(args[2]);
-  if (rt == -1 || rs == -1)
-    return -1;
-  long int immediate;
-  int result = translate_num(&immediate, args[1], -32768, 32767);
-  if (result == -1) 
-    return -1;
-  uint32_t instruction; 
-  if (immediate < 0 ) {
-    immediate = immediate & 0xFFFF;
-    instruction = (opcode<<26) | (rt<<21) | (rs<<16) | immediate;
-  } else {
-    instruction = (opcode<<26) | (rt<<21) | (rs<<16) | immediate;
-  }
-  write_inst_hex(output, instruction);
-  return 0;
+  return write_format(FMT_MEM, opcode, 0, output, args, num_args, 0, NULL, NULL);
 }
 
 /* A helper function for writing Branch on Equal and Branch onNot Equal
-  register instruction. 
+  register instruction.
 */
-int write_branch(uint8_t opcode, FILE* output, char** args, size_t num_args, 
+int write_branch(uint8_t opcode, FILE* output, char** args, size_t num_args,
     uint32_t addr, SymbolTable* symtbl) {
-  if (num_args != 3)
-    return -1;
-  int rs = translate_reg(args[0]);
-  int rt = translate_reg(args[1]);
-  if (rt == -1 || rs == -1)
-    return -1;
-  char* name = args[2];
-  int64_t checker = get_addr_for_symbol(symtbl, name);
-  if (checker == -1) {
-    return -1;
-  }
-  uint32_t exact_address = checker - addr - 4;
-  if (exact_address % 4 != 0)
-    return -1;
-  else
-    exact_address = exact_address / 4;
-  
-  int final_distance = exact_address & 0xFFFF;
-  uint32_t instruction = (opcode<<26) | (rs<<21) | (rt<<16) | final_distance;
-  write_inst_hex(output, instruction);
-  return 0;
+  return write_format(FMT_BRANCH, opcode, 0, output, args, num_args, addr, symtbl, NULL);
 }
 
 
-int write_jump(uint8_t opcode, FILE* output, char** args, size_t num_args, 
+int write_jump(uint8_t opcode, FILE* output, char** args, size_t num_args,
     uint32_t addr, SymbolTable* reltbl) {
-  if (num_args != 1) {
-    return -1;
-  }
-  add_to_table(reltbl, args[0], addr);
-  uint32_t instruction = (opcode<<26);
-  write_inst_hex(output, instruction);
-
-  return 0;
+  return write_format(FMT_JUMP, opcode, 0, output, args, num_args, addr, NULL, reltbl);
 }
@@ -3,9 +3,107 @@
 
 #include <stdint.h>
 
+#include "isa.h"
+
+/* Instruction ids, one per ISA_INSTRUCTIONS row. These index the instruction
+   table in translate.c and are stored in binary intermediate files. */
+typedef enum {
+#define X(id, name, fmt, opcode, funct, rt) INST_##id,
+    ISA_INSTRUCTIONS(X)
+#undef X
+    NUM_INSTS,
+    INST_INVALID = 0xFF
+} InstId;
+
+/* Operand layouts, one per ISA_FORMATS row. */
+typedef enum {
+#define X(fmt, op1, op2, op3, label) FMT_##fmt,
+    ISA_FORMATS(X)
+#undef X
+    NUM_FORMATS
+} InstFormat;
+
+/* What a label operand of a format stands for: a branch target resolved in
+   pass two, a jump target, or the half of an address a lui or ori loads, all
+   three left to relocations. */
+typedef enum {
+    LABEL_NONE, LABEL_BRANCH, LABEL_JUMP, LABEL_HI16, LABEL_LO16
+} LabelUse;
+
+/* Operand kinds of ISA_FORMATS. */
+typedef enum {
+    OPERAND_NONE, OPERAND_RD, OPERAND_RS, OPERAND_RT, OPERAND_RDT, OPERAND_LABEL,
+#define X(kind, lower, upper) OPERAND_##kind,
+    ISA_IMMEDIATES(X)
+#undef X
+} OperandKind;
+
+/* Broad instruction classes, for instruction mix reports. */
+typedef enum {
+    CLASS_ALU, CLASS_MULDIV, CLASS_LOAD, CLASS_STORE, CLASS_BRANCH, CLASS_JUMP,
+    CLASS_TRAP, CLASS_SYSTEM, NUM_CLASSES
+} InstClass;
+
+/* Encoding properties of a format. OPERANDS holds its OperandKinds in source
+   order, padded with OPERAND_NONE. SHAMT is set if the immediate goes in the
+   shift amount field instead of the low 16 bits. */
+typedef struct {
+    uint8_t num_operands;
+    uint8_t operands[3];
+    uint8_t shamt;
+    uint8_t label;
+} FormatInfo;
+
+/* A decoded instruction. Register fields use the MIPS names, so for I-type
+   instructions RT is the destination; REGIMM instructions keep their fixed
+   rt. IMM holds the immediate, memory offset or shift amount. LABEL is the
+   branch or jump target, or the label a lui or ori loads half the address
+   of, and points into the argument strings the instruction was decoded
+   from. */
+typedef struct {
+    uint8_t id;
+    uint8_t fmt;
+    uint8_t opcode;
+    uint8_t funct;
+    uint8_t rs, rt, rd;
+    int32_t imm;
+    const char* label;
+} Instr;
+
+/* Maximum number of instructions a single pass one line expands into. */
+#define MAX_EXPANSION 2
+
+/* One instruction produced by expand_pass_one(). NUM_BUF holds the text of
+   any numeric argument the expansion had to generate. ARGS has room for one
+   argument more than any instruction takes so that lines with extra
+   arguments are passed through to pass two unchanged. */
+typedef struct {
+    const char* name;
+    char* args[4];
+    int num_args;
+    char num_buf[24];
+} ExpandedInst;
+
+unsigned expand_pass_one(ExpandedInst* out, const char* name, char** args, int num_args);
+
 unsigned write_pass_one(FILE* output, const char* name, char** args, int num_args);
 
-int translate_inst(FILE* output, const char* name, char** args, size_t num_args, 
+const char* inst_name(uint8_t id);
+
+const FormatInfo* format_info(uint8_t fmt);
+
+int inst_class(uint8_t id);
+
+const char* inst_class_name(int cls);
+
+void init_inst(Instr* inst, uint8_t id);
+
+int decode_inst(Instr* inst, const char* name, char** args, size_t num_args);
+
+int encode_inst(uint32_t* word, const Instr* inst, uint32_t addr, SymbolTable* symtbl,
+    SymbolTable* reltbl);
+
+int translate_inst(FILE* output, const char* name, char** args, size_t num_args,
     uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl);
 
 int write_rtype(uint8_t funct, FILE* output, char** args, size_t num_args);
@@ -22,10 +120,10 @@ int write_lui(uint8_t opcode, FILE* output, char** args, size_t num_args);
 
 int write_mem(uint8_t opcode, FILE* output, char** args, size_t num_args);
 
-int write_branch(uint8_t opcode, FILE* output, char** args, size_t num_args, 
+int write_branch(uint8_t opcode, FILE* output, char** args, size_t num_args,
     uint32_t addr, SymbolTable* symtbl);
 
-int write_jump(uint8_t opcode, FILE* output, char** args, size_t num_args, 
+int write_jump(uint8_t opcode, FILE* output, char** args, size_t num_args,
     uint32_t addr, SymbolTable* reltbl);
 
 #endif
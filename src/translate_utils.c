@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <errno.h>
 
 #include "translate_utils.h"
 
@@ -17,6 +19,28 @@ void write_inst_hex(FILE *output, uint32_t instruction) {
     fprintf(output, "%08x\n", instruction);
 }
 
+/* Instructions write_insts_hex() formats per fwrite() call. */
+#define HEX_CHUNK 512
+
+void write_insts_hex(FILE* output, const uint32_t* instructions, uint32_t n) {
+    static const char digits[] = "0123456789abcdef";
+    char buf[HEX_CHUNK * 9];
+    while (n) {
+        uint32_t count = n < HEX_CHUNK ? n : HEX_CHUNK;
+        char* p = buf;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t word = instructions[i];
+            for (int shift = 28; shift >= 0; shift -= 4) {
+                *p++ = digits[word >> shift & 0xF];
+            }
+            *p++ = '\n';
+        }
+        fwrite(buf, 1, p - buf, output);
+        instructions += count;
+        n -= count;
+    }
+}
+
 int is_valid_label(const char* str) {
     if (!str) {
         return 0;
@@ -38,6 +62,96 @@ int is_valid_label(const char* str) {
     return first ? 0 : 1;
 }
 
+/* Bytes of a word, for SWAR. */
+#define SWAR_ONES 0x0101010101010101ull
+#define SWAR_HIGH 0x8080808080808080ull
+
+/* Returns the value of the hexadecimal digit C, or -1. */
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/* Sets the high bit of every byte of X that lies in [LO, HI], for LO and HI
+   below 0x80. No addition carries into the next byte. */
+static uint64_t bytes_between(uint64_t x, uint8_t lo, uint8_t hi) {
+    uint64_t low7 = x & ~SWAR_HIGH;
+    return (low7 + (0x80 - lo) * SWAR_ONES) & ~(low7 + (0x7F - hi) * SWAR_ONES)
+        & ~x & SWAR_HIGH;
+}
+
+/* Converts the 8 hexadecimal digits at STR with a handful of word operations
+   instead of a loop. Returns 0 on success and -1 if any byte is not a digit.
+ */
+static int parse_hex8(uint32_t* output, const char* str) {
+    uint64_t x;
+    memcpy(&x, str, sizeof(x));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    x = __builtin_bswap64(x);
+#endif
+    uint64_t digits = bytes_between(x, '0', '9');
+    uint64_t letters = bytes_between(x | 0x20 * SWAR_ONES, 'a', 'f');
+    if ((digits | letters) != SWAR_HIGH) {
+        return -1;
+    }
+    /* One nibble per byte, the first digit in the lowest byte. */
+    uint64_t n = (x & 0x0F * SWAR_ONES) + (letters >> 7) * 9;
+    n = (n & 0x000F000F000F000Full) << 4 | (n >> 8 & 0x000F000F000F000Full);
+    n = (n & 0x000000FF000000FFull) << 8 | (n >> 16 & 0x000000FF000000FFull);
+    *output = (uint32_t) ((n & 0xFFFF) << 16 | (n >> 32 & 0xFFFF));
+    return 0;
+}
+
+/* Parses the unsigned number STR into OUTPUT: hexadecimal after 0x or 0X,
+   octal after a leading 0 (as strtol() reads it) and decimal otherwise.
+   Returns 0 on success and -1 if STR is not a number or does not fit in 64
+   bits.
+ */
+static int parse_unsigned(uint64_t* output, const char* str) {
+    uint64_t value = 0;
+    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+        str += 2;
+        size_t len = strlen(str);
+        if (len == 0) {
+            return -1;
+        }
+        for (; len >= 8; len -= 8, str += 8) {
+            uint32_t chunk;
+            if (value >> 32 || parse_hex8(&chunk, str) != 0) {
+                return -1;
+            }
+            value = value << 32 | chunk;
+        }
+        for (; *str; str++) {
+            int digit = hex_digit(*str);
+            if (digit < 0 || value >> 60) {
+                return -1;
+            }
+            value = value << 4 | digit;
+        }
+    } else {
+        unsigned base = str[0] == '0' ? 8 : 10;
+        if (*str == '\0') {
+            return -1;
+        }
+        for (; *str; str++) {
+            unsigned digit = (unsigned) (*str - '0');
+            if (digit >= base || value > (UINT64_MAX - digit) / base) {
+                return -1;
+            }
+            value = value * base + digit;
+        }
+    }
+    *output = value;
+    return 0;
+}
+
 /* Translate the input string into a signed number. The number is then 
    checked to be within the correct range (note bounds are INCLUSIVE)
    ie. NUM is valid if LOWER_BOUND <= NUM <= UPPER_BOUND. 
@@ -53,45 +167,218 @@ int translate_num(long int* output, const char* str, long int lower_bound,
     if (!str || !output) {
         return -1;
     }
-    char* pEnd;
-    long int result = strtol(str, &pEnd, 0);
-    if (*str == '0') {
-        *output = result;
-        return 0;
+    int negative = *str == '-';
+    if (*str == '-' || *str == '+') {
+        str++;
     }
-    if (*pEnd != '\0')
-      return -1;
-    else {
-      if (result != 0L && result >= lower_bound && result <= upper_bound) {
-        *output = result;
-        return 0;
-      }
-      else
+    uint64_t value;
+    if (parse_unsigned(&value, str) != 0 || value > (uint64_t) LONG_MAX + negative) {
+        return -1;
+    }
+    /* Negated this way so that LONG_MIN does not overflow. */
+    long int result = (long int) value;
+    if (negative && value) {
+        result = -(long int) (value - 1) - 1;
+    }
+    if (result < lower_bound || result > upper_bound) {
+        return -1;
+    }
+    *output = result;
+    return 0;
+}
+
+/* Loads the 8 bytes at STR with the first in the lowest byte. */
+static uint64_t load_swar(const char* str) {
+    uint64_t x;
+    memcpy(&x, str, sizeof(x));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    x = __builtin_bswap64(x);
+#endif
+    return x;
+}
+
+/* Converts the N decimal digits, 1 to 8, in the low bytes of X, the first
+   in the lowest byte: they are moved up so that the missing high digits
+   read as zeros, then combined in pairs, fours and eights. */
+static uint32_t decimal_swar(uint64_t x, unsigned n) {
+    uint64_t v = (x - '0' * SWAR_ONES) << (64 - 8 * n);
+    v = v * 10 + (v >> 8);
+    v = ((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32))
+        + (v >> 16 & 0x000000FF000000FFull) * (1 + (10000ull << 32))) >> 32;
+    return (uint32_t) v;
+}
+
+/* Reads the number at the start of STR, which ends at END and need not be
+   NUL-terminated, as translate_num() reads a whole string, and stores it in
+   OUTPUT if it lies in [LOWER_BOUND, UPPER_BOUND]. Decimal digits are found
+   and converted eight at a time while eight bytes remain before END, which
+   is what makes long lists of numbers cheap. Returns a pointer just past the
+   number, or NULL if there is none or it is out of range. The caller checks
+   what follows.
+ */
+const char* scan_num(long int* output, const char* str, const char* end,
+    long int lower_bound, long int upper_bound) {
+    const char* p = str;
+    int negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+        p++;
+    }
+    const char* digits = p;
+    uint64_t value = 0;
+    if (end - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x') {
+        digits = p += 2;
+        uint32_t chunk;
+        for (; end - p >= 8 && parse_hex8(&chunk, p) == 0; p += 8) {
+            if (value >> 32) {
+                return NULL;
+            }
+            value = value << 32 | chunk;
+        }
+        for (int digit; p < end && (digit = hex_digit(*p)) >= 0; p++) {
+            if (value >> 60) {
+                return NULL;
+            }
+            value = value << 4 | digit;
+        }
+    } else if (end - p > 1 && p[0] == '0' && p[1] >= '0' && p[1] <= '9') {
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            unsigned digit = *p - '0';
+            if (digit >= 8 || value >> 61) {
+                return NULL;
+            }
+            value = value << 3 | digit;
+        }
+    } else {
+        while (end - p >= 8) {
+            uint64_t x = load_swar(p);
+            uint64_t others = ~bytes_between(x, '0', '9') & SWAR_HIGH;
+            unsigned n = others ? __builtin_ctzll(others) / 8 : 8;
+            if (n == 0) {
+                break;
+            }
+            static const uint64_t scale[9] = { 1, 10, 100, 1000, 10000, 100000, 1000000,
+                10000000, 100000000 };
+            if (__builtin_mul_overflow(value, scale[n], &value)
+                || __builtin_add_overflow(value, decimal_swar(x, n), &value)) {
+                return NULL;
+            }
+            p += n;
+            if (n < 8) {
+                break;
+            }
+        }
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            unsigned digit = *p - '0';
+            if (value > (UINT64_MAX - digit) / 10) {
+                return NULL;
+            }
+            value = value * 10 + digit;
+        }
+    }
+    if (p == digits || value > (uint64_t) LONG_MAX + negative) {
+        return NULL;
+    }
+    long int result = (long int) value;
+    if (negative && value) {
+        result = -(long int) (value - 1) - 1;
+    }
+    if (result < lower_bound || result > upper_bound) {
+        return NULL;
+    }
+    *output = result;
+    return p;
+}
+
+/* Parses a count such as 4096, 0x1000, 512K or 64M into OUTPUT. A K, M or
+   G suffix, in either case, multiplies it by 2^10, 2^20 or 2^30. Returns 0
+   on success and -1 if STR is not a count or the count overflows.
+ */
+int parse_size(unsigned long long* output, const char* str) {
+    if (!isdigit((unsigned char) str[0])) {
         return -1;
     }
-  }
+    int base = str[0] == '0' && (str[1] == 'x' || str[1] == 'X') ? 16 : 10;
+    char* end;
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, base);
+    if (errno == ERANGE) {
+        return -1;
+    }
+    /* Each suffix falls through to the next smaller one, adding a shift. */
+    switch (*end) {
+        case 'G': case 'g':
+            if (value > ULLONG_MAX >> 10) {
+                return -1;
+            }
+            value <<= 10;
+            /* fall through */
+        case 'M': case 'm':
+            if (value > ULLONG_MAX >> 10) {
+                return -1;
+            }
+            value <<= 10;
+            /* fall through */
+        case 'K': case 'k':
+            if (value > ULLONG_MAX >> 10) {
+                return -1;
+            }
+            value <<= 10;
+            end++;
+            break;
+        default:
+            break;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *output = value;
+    return 0;
+}
+
+/* Indexed by register number. */
+static const char* const REG_NAMES[32] = {
+    "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+    "$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra",
+};
 
 /* Translates the register name to the corresponding register number.
+   Accepts the conventional names (with $s8 as another name for $fp) and the
+   numbers $0 to $31.
    Returns the register number of STR or -1 if the register name is invalid.
  */
 int translate_reg(const char* str) {
-    if (strcmp(str, "$zero") == 0)      return 0;
-    else if (strcmp(str, "$0") == 0)    return 0;
-    else if (strcmp(str, "$at") == 0)   return 1;
-    else if (strcmp(str, "$v0") == 0)   return 2;
-    else if (strcmp(str, "$a0") == 0)   return 4;
-    else if (strcmp(str, "$a1") == 0)   return 5;
-    else if (strcmp(str, "$a2") == 0)   return 6;
-    else if (strcmp(str, "$a3") == 0)   return 7;
-    else if (strcmp(str, "$t0") == 0)   return 8;
-    else if (strcmp(str, "$t1") == 0)   return 9;
-    else if (strcmp(str, "$t2") == 0)   return 10;
-    else if (strcmp(str, "$t3") == 0)   return 11;
-    else if (strcmp(str, "$s0") == 0)   return 16;
-    else if (strcmp(str, "$s1") == 0)   return 17;
-    else if (strcmp(str, "$s2") == 0)   return 18;
-    else if (strcmp(str, "$s3") == 0)   return 19;
-    else if (strcmp(str, "$sp") == 0)   return 29;
-    else if (strcmp(str, "$ra") == 0)   return 31;
-    else                                return -1;
+    if (str[0] != '$') {
+        return -1;
+    }
+    if (isdigit((unsigned char) str[1])) {
+        /* No leading zeros, so each register has one numeric spelling. */
+        if (str[1] == '0') {
+            return str[2] == '\0' ? 0 : -1;
+        }
+        if (str[2] == '\0') {
+            return str[1] - '0';
+        }
+        if (!isdigit((unsigned char) str[2]) || str[3] != '\0') {
+            return -1;
+        }
+        int reg = (str[1] - '0') * 10 + (str[2] - '0');
+        return reg < 32 ? reg : -1;
+    }
+    if (strcmp(str, "$s8") == 0) {
+        return 30;
+    }
+    for (int reg = 0; reg < 32; reg++) {
+        if (str[1] == REG_NAMES[reg][1] && strcmp(str, REG_NAMES[reg]) == 0) {
+            return reg;
+        }
+    }
+    return -1;
+}
+
+/* Returns the name translate_reg() accepts for register number REG, or NULL
+   if REG is not a register number. */
+const char* reg_name(int reg) {
+    return reg >= 0 && reg < 32 ? REG_NAMES[reg] : NULL;
 }
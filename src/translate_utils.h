@@ -12,6 +12,10 @@ void write_inst_string(FILE* output, const char* name, char** args, int num_args
 /* Writes the instruction to OUTPUT in hexadecimal format. */
 void write_inst_hex(FILE* output, uint32_t instruction);
 
+/* Writes N instructions as write_inst_hex() would, but formats them into a
+   buffer and writes them with one call per chunk instead of one per word. */
+void write_insts_hex(FILE* output, const uint32_t* instructions, uint32_t n);
+
 /* Returns 1 if the label is valid and 0 if it is invalid. A valid label is one
    where the first character is a character or underscore and the remaining 
    characters are either characters, digits, or underscores.
@@ -21,6 +25,13 @@ int is_valid_label(const char* str);
 int translate_num(long int* output, const char* str, long int lower_bound, 
 	long int upper_bound);
 
+const char* scan_num(long int* output, const char* str, const char* end,
+    long int lower_bound, long int upper_bound);
+
+int parse_size(unsigned long long* output, const char* str);
+
 int translate_reg(const char* str);
 
+const char* reg_name(int reg);
+
 #endif
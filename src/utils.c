@@ -3,8 +3,20 @@
 #include <stdarg.h>
 #include <unistd.h>
 
+#include "utils.h"
+
+#define LOG_LINE_SIZE 512
+
 static const char* output_file = NULL;
 
+/* A callback set with set_log_callback() takes precedence over the log file,
+   and only for the thread that set it. Text is gathered in LOG_LINE until a
+   newline completes it. */
+static __thread LogCallback log_callback = NULL;
+static __thread void* log_ctx = NULL;
+static __thread char log_line[LOG_LINE_SIZE];
+static __thread size_t log_len = 0;
+
 int is_log_file_set() {
     return output_file != NULL;
 }
@@ -18,10 +30,37 @@ void set_log_file(const char* filename) {
     }
 }
 
+/* Sends the calling thread's diagnostics to CALLBACK(CTX, ...) instead of the
+   log file, one line at a time, until it is called again with NULL. Lines
+   longer than LOG_LINE_SIZE are truncated. */
+void set_log_callback(LogCallback callback, void* ctx) {
+    log_callback = callback;
+    log_ctx = ctx;
+    log_len = 0;
+}
+
+static void append_to_line(const char* text) {
+    for (; *text; text++) {
+        if (*text == '\n') {
+            log_line[log_len] = '\0';
+            log_callback(log_ctx, log_line);
+            log_len = 0;
+        } else if (log_len < LOG_LINE_SIZE - 1) {
+            log_line[log_len++] = *text;
+        }
+    }
+}
+
 void write_to_log(char* fmt, ...) {
     va_list args;
 
-    if (output_file) {
+    if (log_callback) {
+        char text[LOG_LINE_SIZE];
+        va_start(args, fmt);
+        vsnprintf(text, sizeof(text), fmt, args);
+        va_end(args);
+        append_to_line(text);
+    } else if (output_file) {
         FILE* f = fopen(output_file, "a");
         if (!f) {
             return;
@@ -39,7 +78,14 @@ void write_to_log(char* fmt, ...) {
 }
 
 void log_inst(const char* name, char** args, int num_args) {
-    if (output_file) {
+    if (log_callback) {
+        append_to_line(name);
+        for (int i = 0; i < num_args; i++) {
+            append_to_line(" ");
+            append_to_line(args[i]);
+        }
+        append_to_line("\n");
+    } else if (output_file) {
         FILE* f = fopen(output_file, "a");
         if (!f) {
             return;
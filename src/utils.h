@@ -3,6 +3,11 @@ int is_log_file_set();
 
 void set_log_file(const char* filename);
 
+/* Receives one diagnostic line, without its newline. */
+typedef void (*LogCallback)(void* ctx, const char* message);
+
+void set_log_callback(LogCallback callback, void* ctx);
+
 void write_to_log(char* fmt, ...);
 
 void log_inst(const char* name, char** args, int num_args);
\ No newline at end of file
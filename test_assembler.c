@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <unistd.h>
 
 #include <CUnit/Basic.h>
@@ -8,6 +10,27 @@
 #include "src/tables.h"
 #include "src/translate_utils.h"
 #include "src/translate.h"
+#include "src/intermediate.h"
+#include "src/elf_writer.h"
+#include "src/object.h"
+#include "src/data.h"
+#include "src/link.h"
+#include "src/elf_reader.h"
+#include "src/reloc.h"
+#include "src/loader.h"
+#include "src/backpatch.h"
+#include "src/ir.h"
+#include "src/disasm.h"
+#include "src/sim.h"
+#include "src/jit.h"
+#include "src/program.h"
+#include "src/layout.h"
+#include "src/peephole.h"
+#include "src/schedule.h"
+#include "src/relax.h"
+#include "src/cfg.h"
+#include "src/jumps.h"
+#include "assembler.h"
 
 const char* TMP_FILE = "test_output.txt";
 const int BUF_SIZE = 1024;
@@ -62,9 +85,41 @@ void test_translate_reg() {
     CU_ASSERT_EQUAL(translate_reg("$t3"), 11);
     CU_ASSERT_EQUAL(translate_reg("$s0"), 16);
     CU_ASSERT_EQUAL(translate_reg("$s1"), 17);
-    CU_ASSERT_EQUAL(translate_reg("$3"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$v1"), 3);
+    CU_ASSERT_EQUAL(translate_reg("$t4"), 12);
+    CU_ASSERT_EQUAL(translate_reg("$t7"), 15);
+    CU_ASSERT_EQUAL(translate_reg("$s7"), 23);
+    CU_ASSERT_EQUAL(translate_reg("$t8"), 24);
+    CU_ASSERT_EQUAL(translate_reg("$t9"), 25);
+    CU_ASSERT_EQUAL(translate_reg("$k0"), 26);
+    CU_ASSERT_EQUAL(translate_reg("$k1"), 27);
+    CU_ASSERT_EQUAL(translate_reg("$gp"), 28);
+    CU_ASSERT_EQUAL(translate_reg("$fp"), 30);
+    CU_ASSERT_EQUAL(translate_reg("$s8"), 30);
+    CU_ASSERT_EQUAL(translate_reg("$3"), 3);
+    CU_ASSERT_EQUAL(translate_reg("$10"), 10);
+    CU_ASSERT_EQUAL(translate_reg("$31"), 31);
+    CU_ASSERT_EQUAL(translate_reg("$32"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$03"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$00"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$1x"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$100"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$s9"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$t10"), -1);
+    CU_ASSERT_EQUAL(translate_reg("t0"), -1);
     CU_ASSERT_EQUAL(translate_reg("asdf"), -1);
     CU_ASSERT_EQUAL(translate_reg("hey there"), -1);
+
+    /* Every register has a name that reads back as its number. */
+    for (int reg = 0; reg < 32; reg++) {
+        CU_ASSERT_PTR_NOT_NULL(reg_name(reg));
+        if (reg_name(reg)) {
+            CU_ASSERT_EQUAL(translate_reg(reg_name(reg)), reg);
+        }
+    }
+    CU_ASSERT_PTR_NULL(reg_name(32));
+    CU_ASSERT_PTR_NULL(reg_name(-1));
 }
 
 void test_translate_num() {
@@ -83,6 +138,84 @@ void test_translate_num() {
     CU_ASSERT_EQUAL(output, 72);
     CU_ASSERT_EQUAL(translate_num(&output, "72", 73, 150), -1);
     CU_ASSERT_EQUAL(translate_num(&output, "35x", -100, 100), -1);
+
+    /* Numbers starting with 0 are range checked like the rest. */
+    CU_ASSERT_EQUAL(translate_num(&output, "0", 0, 0), 0);
+    CU_ASSERT_EQUAL(output, 0);
+    CU_ASSERT_EQUAL(translate_num(&output, "0x80808080", -32768, 32767), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "0x8000", 0, 65535), 0);
+    CU_ASSERT_EQUAL(output, 32768);
+    CU_ASSERT_EQUAL(translate_num(&output, "0x20", 0, 31), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "017", 0, 31), 0);
+    CU_ASSERT_EQUAL(output, 15);
+    CU_ASSERT_EQUAL(translate_num(&output, "08", 0, 31), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "0x", 0, 31), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "", 0, 31), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "-", 0, 31), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "-0x8000", -32768, 32767), 0);
+    CU_ASSERT_EQUAL(output, -32768);
+    CU_ASSERT_EQUAL(translate_num(&output, "+12", 0, 31), 0);
+    CU_ASSERT_EQUAL(output, 12);
+
+    /* Eight hex digits at a time, and anything that overflows. */
+    CU_ASSERT_EQUAL(translate_num(&output, "0xDeadBeef", -2147483648, 4294967295), 0);
+    CU_ASSERT_EQUAL(output, 0xdeadbeef);
+    CU_ASSERT_EQUAL(translate_num(&output, "0x1234567890", 0, 0x1234567890), 0);
+    CU_ASSERT_EQUAL(output, 0x1234567890);
+    CU_ASSERT_EQUAL(translate_num(&output, "0x12345g78", 0, 4294967295), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "0x1234:678", 0, 4294967295), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "0x100000000", -2147483648, 4294967295), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "0x10000000000000000", LONG_MIN, LONG_MAX), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "99999999999999999999", LONG_MIN, LONG_MAX), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "-9223372036854775808", LONG_MIN, LONG_MAX), 0);
+    CU_ASSERT_EQUAL(output, LONG_MIN);
+
+    /* Agrees with strtol() wherever strtol() reads the whole string. */
+    char buf[32];
+    srand(7);
+    for (int i = 0; i < 2000; i++) {
+        long int value = (long int) rand() - RAND_MAX / 2;
+        snprintf(buf, sizeof(buf), i % 2 ? "%ld" : (value < 0 ? "-0x%lX" : "0x%lx"),
+            i % 2 || value >= 0 ? value : -value);
+        CU_ASSERT_EQUAL(translate_num(&output, buf, LONG_MIN, LONG_MAX), 0);
+        CU_ASSERT_EQUAL(output, strtol(buf, NULL, 0));
+    }
+}
+
+void test_parse_size() {
+    unsigned long long size;
+
+    CU_ASSERT_EQUAL(parse_size(&size, "4096"), 0);
+    CU_ASSERT_EQUAL(size, 4096);
+    CU_ASSERT_EQUAL(parse_size(&size, "0x1000"), 0);
+    CU_ASSERT_EQUAL(size, 4096);
+    CU_ASSERT_EQUAL(parse_size(&size, "512K"), 0);
+    CU_ASSERT_EQUAL(size, 512ULL << 10);
+    CU_ASSERT_EQUAL(parse_size(&size, "64m"), 0);
+    CU_ASSERT_EQUAL(size, 64ULL << 20);
+    CU_ASSERT_EQUAL(parse_size(&size, "3G"), 0);
+    CU_ASSERT_EQUAL(size, 3ULL << 30);
+    CU_ASSERT_EQUAL(parse_size(&size, "0"), 0);
+    CU_ASSERT_EQUAL(size, 0);
+
+    /* The largest counts that fit, and the first that do not. */
+    CU_ASSERT_EQUAL(parse_size(&size, "17179869183G"), 0);
+    CU_ASSERT_EQUAL(size, 17179869183ULL << 30);
+    CU_ASSERT_EQUAL(parse_size(&size, "18446744073709551615"), 0);
+    CU_ASSERT_EQUAL(size, ULLONG_MAX);
+
+    size = 7;
+    CU_ASSERT_EQUAL(parse_size(&size, "17179869184G"), -1);
+    CU_ASSERT_EQUAL(parse_size(&size, "99999999999G"), -1);
+    CU_ASSERT_EQUAL(parse_size(&size, "18014398509481984K"), -1);
+    CU_ASSERT_EQUAL(parse_size(&size, "18446744073709551616"), -1);
+    CU_ASSERT_EQUAL(parse_size(&size, ""), -1);
+    CU_ASSERT_EQUAL(parse_size(&size, "-1"), -1);
+    CU_ASSERT_EQUAL(parse_size(&size, " 5"), -1);
+    CU_ASSERT_EQUAL(parse_size(&size, "5KB"), -1);
+    CU_ASSERT_EQUAL(parse_size(&size, "K"), -1);
+    CU_ASSERT_EQUAL(parse_size(&size, "0x"), -1);
+    CU_ASSERT_EQUAL(size, 7);
 }
 
 /****************************************
@@ -148,8 +281,188 @@ void test_table_2() {
         retval = get_addr_for_symbol(tbl, buf);
         CU_ASSERT_EQUAL(retval, 4 * i);
     }
+    CU_ASSERT_EQUAL(get_addr_for_symbol(tbl, "100"), -1);
+    CU_ASSERT_EQUAL(add_to_table(tbl, "42", 0), -1);
+
+    /* Moving symbols works through the hash index as well as without it. */
+    SymbolTable* small = create_table(SYMTBL_UNIQUE_NAME);
+    add_to_table(small, "a", 0);
+    add_to_table(small, "b", 4);
+    CU_ASSERT_EQUAL(set_symbol_addr(small, "b", 8), 0);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(small, "b"), 8);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(small, "a"), 0);
+    CU_ASSERT_EQUAL(set_symbol_addr(small, "c", 8), -1);
+    free_table(small);
+    CU_ASSERT_EQUAL(set_symbol_addr(tbl, "42", 0x10000000), 0);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(tbl, "42"), 0x10000000);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(tbl, "43"), 4 * 43);
+    CU_ASSERT_EQUAL(set_symbol_addr(tbl, "100", 0), -1);
+
+    free_table(tbl);
+}
+
+void test_counting_allocator() {
+    CountingAllocator counter;
+    init_counting_allocator(&counter, NULL);
+
+    SymbolTable* tbl = create_table_with_allocator(SYMTBL_UNIQUE_NAME, &counter.base);
+    CU_ASSERT_PTR_NOT_NULL(tbl);
+    CU_ASSERT_EQUAL(counter.num_allocs, 2);
+
+    char buf[10];
+    for (int i = 0; i < 100; i++) {
+        sprintf(buf, "l%d", i);
+        CU_ASSERT_EQUAL(add_to_table(tbl, buf, 4 * i), 0);
+    }
+    CU_ASSERT(counter.live_bytes > 0);
+    CU_ASSERT(counter.peak_bytes >= counter.live_bytes);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(tbl, "l99"), 396);
+
+    free_table(tbl);
+    CU_ASSERT_EQUAL(counter.live_bytes, 0);
+    CU_ASSERT_EQUAL(counter.num_frees, counter.num_allocs - 4);
+}
+
+void test_allocator_limit() {
+    CountingAllocator counter;
+    init_counting_allocator(&counter, NULL);
+    counter.limit = 256;
+
+    Allocator* alloc = &counter.base;
+    void* a = alloc->alloc(alloc, 200);
+    CU_ASSERT_PTR_NOT_NULL(a);
+    CU_ASSERT_EQUAL(allocator_headroom(&counter), 56);
+    CU_ASSERT_PTR_NULL(alloc->alloc(alloc, 100));
+    CU_ASSERT_PTR_NULL(alloc->resize(alloc, a, 200, 300));
+    a = alloc->resize(alloc, a, 200, 64);
+    CU_ASSERT_PTR_NOT_NULL(a);
+    CU_ASSERT_EQUAL(counter.live_bytes, 64);
+    alloc->release(alloc, a, 64);
+    CU_ASSERT_EQUAL(counter.live_bytes, 0);
+    CU_ASSERT_EQUAL(counter.peak_bytes, 200);
+}
+
+void test_arena_allocator() {
+    ArenaAllocator arena;
+    CountingAllocator counter;
+    init_counting_allocator(&counter, NULL);
+    init_arena_allocator(&arena, &counter.base, 4096);
 
+    SymbolTable* tbl = create_table_with_allocator(SYMTBL_NON_UNIQUE, &arena.base);
+    char buf[10];
+    for (int i = 0; i < 200; i++) {
+        sprintf(buf, "%d", i);
+        CU_ASSERT_EQUAL(add_to_table(tbl, buf, 4 * i), 0);
+    }
+    for (int i = 0; i < 200; i++) {
+        sprintf(buf, "%d", i);
+        CU_ASSERT_EQUAL(get_addr_for_symbol(tbl, buf), 4 * i);
+    }
     free_table(tbl);
+    CU_ASSERT(counter.num_allocs < 10);
+
+    destroy_arena_allocator(&arena);
+    CU_ASSERT_EQUAL(counter.live_bytes, 0);
+}
+
+void test_table_image() {
+    SymbolTable* tbl = create_table(SYMTBL_UNIQUE_NAME);
+    char buf[10];
+    for (int i = 0; i < 100; i++) {
+        sprintf(buf, "s%d", i);
+        CU_ASSERT_EQUAL(add_to_table(tbl, buf, 4 * (i / 2)), 0);
+    }
+
+    FILE* image = tmpfile();
+    CU_ASSERT_EQUAL(write_table_image(tbl, image), 0);
+    fflush(image);
+    SymbolTable* mapped = map_table_image(image);
+    CU_ASSERT_PTR_NOT_NULL(mapped);
+    if (!mapped) {
+        return;
+    }
+    for (int i = 0; i < 100; i++) {
+        sprintf(buf, "s%d", i);
+        CU_ASSERT_EQUAL(get_addr_for_symbol(mapped, buf), 4 * (i / 2));
+    }
+    CU_ASSERT_EQUAL(get_addr_for_symbol(mapped, "s100"), -1);
+    CU_ASSERT_EQUAL(add_to_table(mapped, "new", 0), -1);
+
+    char expected[4096], actual[4096];
+    FILE* out = fmemopen(expected, sizeof(expected), "w");
+    write_table(tbl, out);
+    fclose(out);
+    out = fmemopen(actual, sizeof(actual), "w");
+    write_table(mapped, out);
+    fclose(out);
+    CU_ASSERT_STRING_EQUAL(expected, actual);
+    free_table(mapped);
+
+    /* An image whose entries point outside it is rejected. */
+    SymbolImageEntry entry;
+    long first = sizeof(SymbolImageHeader);
+    const struct {
+        size_t field;
+        uint32_t value;
+    } corrupt[] = {
+        { offsetof(SymbolImageEntry, name), 0x7fffffff },
+        { offsetof(SymbolImageEntry, next), 101 },
+        { offsetof(SymbolImageEntry, next), 1 },
+    };
+    for (size_t i = 0; i < sizeof(corrupt) / sizeof(corrupt[0]); i++) {
+        fseek(image, first, SEEK_SET);
+        CU_ASSERT_EQUAL(fread(&entry, sizeof(entry), 1, image), 1);
+        SymbolImageEntry bad = entry;
+        memcpy((char*) &bad + corrupt[i].field, &corrupt[i].value, sizeof(uint32_t));
+        fseek(image, first, SEEK_SET);
+        fwrite(&bad, sizeof(bad), 1, image);
+        fflush(image);
+        mapped = map_table_image(image);
+        CU_ASSERT_PTR_NULL(mapped);
+        if (mapped) {
+            free_table(mapped);
+        }
+        fseek(image, first, SEEK_SET);
+        fwrite(&entry, sizeof(entry), 1, image);
+        fflush(image);
+    }
+    mapped = map_table_image(image);
+    CU_ASSERT_PTR_NOT_NULL(mapped);
+    if (mapped) {
+        free_table(mapped);
+    }
+
+    free_table(tbl);
+    fclose(image);
+}
+
+/* The pass two loop must not touch the heap once the tables exist. */
+void test_pass_two_allocations() {
+    CountingAllocator counter;
+    init_counting_allocator(&counter, NULL);
+    set_table_allocator(&counter.base);
+
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    add_to_table(symtbl, "loop", 0);
+
+    FILE* input = tmpfile();
+    for (int i = 0; i < 1000; i++) {
+        fprintf(input, "addiu $t0 $t0 1\nlw $t1 4 $sp\nsll $t1 $t1 2\nbne $t0 $t1 loop\n");
+    }
+    rewind(input);
+    FILE* output = fopen("/dev/null", "w");
+
+    size_t before = counter.num_allocs;
+    CU_ASSERT_EQUAL(pass_two(input, output, symtbl, reltbl), 0);
+    CU_ASSERT_EQUAL(counter.num_allocs, before);
+
+    fclose(input);
+    fclose(output);
+    free_table(symtbl);
+    free_table(reltbl);
+    set_table_allocator(NULL);
+    CU_ASSERT_EQUAL(counter.live_bytes, 0);
 }
 
 
@@ -748,7 +1061,7 @@ void test_lb() {
     args3[1] = "100";
     int num_args3 = 2;
     unsigned answer3 =  write_pass_one(output3, name, args3, num_args3);
-    CU_ASSERT_EQUAL(answer3, 2);
+    CU_ASSERT_EQUAL(answer3, 1);
     fclose(output3);
     FILE* output4 = fopen("boo.txt", "w");
     char* args4[2];
@@ -805,9 +1118,2053 @@ void test_lb() {
  *  Add your test cases here
  ****************************************/
 
+static void count_error(void* num_errors, const char* message) {
+    (*(int*) num_errors)++;
+}
+
+/* Runs pass two over INTER (text or binary) and returns the output in a
+   freshly allocated string. */
+char* run_pass_two(FILE* inter, SymbolTable* symtbl) {
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    FILE* out = tmpfile();
+    rewind(inter);
+    if (is_binary_int(inter)) {
+        IntImage image;
+        CU_ASSERT_EQUAL(map_int_file(&image, inter), 0);
+        pass_two_binary(&image, out, symtbl, reltbl);
+        unmap_int_file(&image);
+    } else {
+        pass_two(inter, out, symtbl, reltbl);
+    }
+    write_table(reltbl, out);
+    free_table(reltbl);
+
+    long size = ftell(out);
+    char* text = calloc(size + 1, 1);
+    rewind(out);
+    CU_ASSERT_EQUAL(fread(text, 1, size, out), size);
+    fclose(out);
+    return text;
+}
+
+void test_binary_intermediate() {
+    FILE* src = tmpfile();
+    fprintf(src, "start: addiu $a0, $0, 0xABC\n"
+                 "li $v0, 0xABCDE\n"
+                 "lbu $t3, -3($s2)\n"
+                 "sll $t3, $t2, 31\n"
+                 "blt $t3, $t2, start\n"
+                 "jal start\n"
+                 "bne $t0, $t1, start\n");
+
+    DataSegment data;
+    init_data_segment(&data);
+    SymbolTable* text_symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    FILE* text_int = tmpfile();
+    rewind(src);
+    CU_ASSERT_EQUAL(pass_one(src, text_int, text_symtbl, &data), 0);
+
+    SymbolTable* bin_symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    FILE* bin_int = tmpfile();
+    rewind(src);
+    CU_ASSERT_EQUAL(pass_one_binary(src, bin_int, bin_symtbl, &data), 0);
+    CU_ASSERT(is_binary_int(bin_int));
+    CU_ASSERT(!is_binary_int(text_int));
+
+    char* expected = run_pass_two(text_int, text_symtbl);
+    char* actual = run_pass_two(bin_int, bin_symtbl);
+    CU_ASSERT_STRING_EQUAL(expected, actual);
+
+    /* Records whose strings lie outside the string table, or whose branch
+       text would, are rejected, as are unknown IDs. The last record is the
+       bne. */
+    IntHeader header;
+    rewind(bin_int);
+    CU_ASSERT_EQUAL(fread(&header, sizeof(header), 1, bin_int), 1);
+    long last = sizeof(IntHeader) + (long) (header.num_records - 1) * sizeof(IntRecord);
+    IntRecord record;
+    fseek(bin_int, last, SEEK_SET);
+    CU_ASSERT_EQUAL(fread(&record, sizeof(record), 1, bin_int), 1);
+    CU_ASSERT_EQUAL(record.id, INST_BNE);
+    IntRecord bad[3] = { record, record, record };
+    bad[0].sym = header.strtab_size;
+    bad[1].sym = header.strtab_size - 2;
+    bad[2].id = NUM_INSTS;
+    for (int i = 0; i < 3; i++) {
+        fseek(bin_int, last, SEEK_SET);
+        fwrite(&bad[i], sizeof(bad[i]), 1, bin_int);
+        fflush(bin_int);
+        IntImage image;
+        int num_errors = 0;
+        set_log_callback(count_error, &num_errors);
+        CU_ASSERT_EQUAL(map_int_file(&image, bin_int), -1);
+        set_log_callback(NULL, NULL);
+        CU_ASSERT_EQUAL(num_errors, 1);
+    }
+    fseek(bin_int, last, SEEK_SET);
+    fwrite(&record, sizeof(record), 1, bin_int);
+    fflush(bin_int);
+    IntImage image;
+    CU_ASSERT_EQUAL(map_int_file(&image, bin_int), 0);
+    unmap_int_file(&image);
+
+    free(expected);
+    free(actual);
+    fclose(src);
+    fclose(text_int);
+    fclose(bin_int);
+    free_table(text_symtbl);
+    free_table(bin_symtbl);
+    free_data_segment(&data);
+}
+
+/* Reads a big-endian halfword or word from an ELF image. */
+static uint32_t elf_get(const unsigned char* buf, int bytes) {
+    uint32_t val = 0;
+    for (int i = 0; i < bytes; i++) {
+        val = (val << 8) | buf[i];
+    }
+    return val;
+}
+
+void test_elf_object() {
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    add_to_table(symtbl, "start", 0);
+    add_to_table(reltbl, "start", 4);
+    add_to_table(reltbl, "printf", 8);
+    uint32_t text[] = { 0x24040abc, 0x0c000000, 0x0c000000 };
+
+    FILE* out = tmpfile();
+    CU_ASSERT_EQUAL(write_elf_object(out, text, 3, symtbl, reltbl), 0);
+    long size = ftell(out);
+    unsigned char* buf = malloc(size);
+    rewind(out);
+    CU_ASSERT_EQUAL(fread(buf, 1, size, out), size);
+
+    CU_ASSERT(memcmp(buf, "\177ELF", 4) == 0);
+    CU_ASSERT_EQUAL(buf[4], 1);                     /* ELFCLASS32 */
+    CU_ASSERT_EQUAL(buf[5], 2);                     /* ELFDATA2MSB */
+    CU_ASSERT_EQUAL(elf_get(buf + 16, 2), 1);       /* ET_REL */
+    CU_ASSERT_EQUAL(elf_get(buf + 18, 2), 8);       /* EM_MIPS */
+    uint32_t shoff = elf_get(buf + 32, 4);
+    CU_ASSERT_EQUAL(elf_get(buf + 48, 2), 6);       /* section count */
+    CU_ASSERT_EQUAL(elf_get(buf + 50, 2), 5);       /* .shstrtab */
+
+    /* .text holds the words in order, .rel.text one entry per relocation. */
+    const unsigned char* text_hdr = buf + shoff + 40;
+    CU_ASSERT_EQUAL(elf_get(text_hdr + 20, 4), 12);
+    CU_ASSERT_EQUAL(elf_get(buf + elf_get(text_hdr + 16, 4) + 4, 4), 0x0c000000);
+    const unsigned char* rel_hdr = buf + shoff + 80;
+    CU_ASSERT_EQUAL(elf_get(rel_hdr + 20, 4), 16);
+    const unsigned char* rel = buf + elf_get(rel_hdr + 16, 4);
+    CU_ASSERT_EQUAL(elf_get(rel, 4), 4);
+    CU_ASSERT_EQUAL(elf_get(rel + 8, 4), 8);
+    /* Both relocations are R_MIPS_26 against different symbols. */
+    CU_ASSERT_EQUAL(elf_get(rel + 4, 4) & 0xFF, 4);
+    CU_ASSERT_NOT_EQUAL(elf_get(rel + 4, 4) >> 8, elf_get(rel + 12, 4) >> 8);
+
+    free(buf);
+    fclose(out);
+    free_table(symtbl);
+    free_table(reltbl);
+}
+
+/* Writes TEXT to a temporary file and returns its name in NAME. */
+static void write_temp_object(char* name, const char* text) {
+    strcpy(name, "/tmp/test_objectXXXXXX");
+    int fd = mkstemp(name);
+    CU_ASSERT_NOT_EQUAL(fd, -1);
+    CU_ASSERT_EQUAL(write(fd, text, strlen(text)), strlen(text));
+    close(fd);
+}
+
+void test_link_objects() {
+    char first[32], second[32];
+    write_temp_object(first, ".text\n0c000000\n08000000\n\n"
+        ".symbol\n0\tmain\n\n.relocation\n0\tfunc\n4\tmain\n");
+    write_temp_object(second, ".text\n03e00008\n0c000000\n\n"
+        ".symbol\n0\tfunc\n4\tcall\n\n.relocation\n4\tmain\n");
+
+    LinkInput inputs[2];
+    inputs[0].name = first;
+    inputs[1].name = second;
+    CU_ASSERT_EQUAL(load_objects(inputs, 2, 2), 0);
+    CU_ASSERT_EQUAL(inputs[1].obj.text.len, 2);
+    CU_ASSERT_EQUAL(inputs[0].obj.reltbl->len, 2);
+
+    ObjectFile out;
+    CU_ASSERT_EQUAL(link_objects(&out, inputs, 2, 2), 0);
+    CU_ASSERT_EQUAL(out.text.len, 4);
+    CU_ASSERT_EQUAL(out.text.words[0], 0x0c000002);
+    CU_ASSERT_EQUAL(out.text.words[1], 0x08000000);
+    CU_ASSERT_EQUAL(out.text.words[2], 0x03e00008);
+    CU_ASSERT_EQUAL(out.text.words[3], 0x0c000000);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(out.symtbl, "func"), 8);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(out.symtbl, "call"), 12);
+    CU_ASSERT_EQUAL(out.reltbl->len, 3);
+    free_object(&out);
+    free_link_inputs(inputs, 2);
+
+    /* Linking the first object alone leaves func undefined, and linking it
+       twice defines main twice. */
+    CU_ASSERT_EQUAL(load_objects(inputs, 1, 1), 0);
+    CU_ASSERT_EQUAL(link_objects(&out, inputs, 1, 1), -1);
+    CU_ASSERT_PTR_NOT_NULL(inputs[0].missing);
+    CU_ASSERT_STRING_EQUAL(inputs[0].missing, "func");
+    free_object(&out);
+    free_link_inputs(inputs, 1);
+
+    inputs[1].name = first;
+    CU_ASSERT_EQUAL(load_objects(inputs, 2, 1), 0);
+    CU_ASSERT_EQUAL(link_objects(&out, inputs, 2, 1), -1);
+    free_object(&out);
+    free_link_inputs(inputs, 2);
+
+    unlink(first);
+    unlink(second);
+}
+
+void test_load_image() {
+    ObjectFile obj;
+    init_word_buffer(&obj.text);
+    init_word_buffer(&obj.data);
+    obj.symtbl = create_table(SYMTBL_NON_UNIQUE);
+    obj.reltbl = create_table(SYMTBL_NON_UNIQUE);
+    for (uint32_t i = 0; i < 100; i++) {
+        append_word(&obj.text, i % 2 ? 0x08000000 : 0x00884821);
+    }
+    add_to_table(obj.symtbl, "top", 0);
+    add_to_table(obj.symtbl, "end", 396);
+    /* Out of order, and more than an insertion sort handles. */
+    for (uint32_t i = 99; i < 100; i -= 2) {
+        add_to_table(obj.reltbl, i % 4 == 1 ? "top" : "end", i * 4);
+    }
+
+    RelocBatch batch;
+    uint32_t* targets;
+    pack_relocs(&batch, obj.reltbl);
+    CU_ASSERT_EQUAL(batch.len, 50);
+    CU_ASSERT_EQUAL(batch.num_names, 2);
+    CU_ASSERT_EQUAL(batch.start[R_HI16], 50);
+    CU_ASSERT_EQUAL(resolve_targets(&targets, &batch, &obj, 0x400000), 0);
+    CU_ASSERT_EQUAL(batch.records[0].offset, 396);
+    CU_ASSERT_EQUAL(targets[RELOC_SYM(batch.records[0].info)], 0x400000 + 396);
+    sort_relocs(batch.records, 50);
+    for (uint32_t i = 0; i < 50; i++) {
+        CU_ASSERT_EQUAL(batch.records[i].offset, (2 * i + 1) * 4);
+    }
+    free(targets);
+    free_relocs(&batch);
+
+    WordBuffer image;
+    init_word_buffer(&image);
+    CU_ASSERT_EQUAL(load_image(&image, &obj, 0x400000), 0);
+    CU_ASSERT_EQUAL(image.len, 100);
+    CU_ASSERT_EQUAL(image.words[0], 0x00884821);
+    CU_ASSERT_EQUAL(image.words[1], 0x08100000);
+    CU_ASSERT_EQUAL(image.words[3], 0x08100000 + 99);
+    CU_ASSERT_EQUAL(obj.text.words[1], 0x08000000);
+
+    /* Misaligned bases and jumps across a 256 MB boundary are refused. */
+    CU_ASSERT_EQUAL(load_image(&image, &obj, 0x400002), -1);
+    CU_ASSERT_EQUAL(load_image(&image, &obj, 0x0FFFFF00), -1);
+    add_to_table(obj.reltbl, "nowhere", 0);
+    CU_ASSERT_EQUAL(load_image(&image, &obj, 0), -1);
+
+    free_word_buffer(&image);
+    free_object(&obj);
+}
+
+void test_elf_round_trip() {
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    add_to_table(symtbl, "start", 0);
+    add_to_table(symtbl, "loop", 4);
+    add_to_table(reltbl, "loop", 4);
+    add_to_table(reltbl, "printf", 8);
+    uint32_t text[] = { 0x24040abc, 0x0c000000, 0x0c000000 };
+    FILE* out = tmpfile();
+    CU_ASSERT_EQUAL(write_elf_object(out, text, 3, symtbl, reltbl), 0);
+    CU_ASSERT(is_elf_object(out));
+
+    ObjectFile obj;
+    CU_ASSERT_EQUAL(read_object_file(&obj, out, "tmpfile"), 0);
+    CU_ASSERT_EQUAL(obj.text.len, 3);
+    CU_ASSERT_EQUAL(obj.text.words[0], 0x24040abc);
+    CU_ASSERT_EQUAL(obj.symtbl->len, 2);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(obj.symtbl, "loop"), 4);
+    CU_ASSERT_EQUAL(obj.reltbl->len, 2);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(obj.reltbl, "printf"), 8);
+    free_object(&obj);
+
+    /* Each lui/ori pair is written as lui/addiu with its R_MIPS_HI16 right
+       before its R_MIPS_LO16, so that the address comes out right, carry
+       included, for other linkers and, read back, for ours. */
+    const char* source = "la $a0, far\njal far\nla $a1, far\nfar: jr $ra\n";
+    CU_ASSERT_EQUAL(assemble_buffer(&obj, source, strlen(source), NULL, NULL), 0);
+    FILE* elf = tmpfile();
+    CU_ASSERT_EQUAL(write_elf_object(elf, obj.text.words, obj.text.len, obj.symtbl,
+        obj.reltbl), 0);
+    free_object(&obj);
+    long size = ftell(elf);
+    unsigned char* buf = malloc(size);
+    rewind(elf);
+    CU_ASSERT_EQUAL(fread(buf, 1, size, elf), size);
+    uint32_t shoff = elf_get(buf + 32, 4);
+    const unsigned char* rel_hdr = buf + shoff + 80;
+    CU_ASSERT_EQUAL(elf_get(rel_hdr + 20, 4), 40);
+    const unsigned char* rel = buf + elf_get(rel_hdr + 16, 4);
+    /* R_MIPS_HI16 is 5, R_MIPS_LO16 6 and R_MIPS_26 4. */
+    uint8_t types[5] = { 5, 6, 4, 5, 6 };
+    for (int i = 0; i < 5; i++) {
+        CU_ASSERT_EQUAL(elf_get(rel + 8 * i, 4), 4 * i);
+        CU_ASSERT_EQUAL(elf_get(rel + 8 * i + 4, 4) & 0xFF, types[i]);
+    }
+    const unsigned char* text_start = buf + elf_get(buf + shoff + 40 + 16, 4);
+    CU_ASSERT_EQUAL(elf_get(text_start + 4, 4), 0x24840000);
+    CU_ASSERT_EQUAL(elf_get(text_start + 16, 4), 0x24a50000);
+    free(buf);
+
+    CU_ASSERT_EQUAL(read_object_file(&obj, elf, "tmpfile"), 0);
+    CU_ASSERT_EQUAL(get_reloc_type(obj.reltbl, 0), R_AHI16);
+    WordBuffer image;
+    init_word_buffer(&image);
+    CU_ASSERT_EQUAL(load_image(&image, &obj, 0x00407ff0), 0);
+    CU_ASSERT_EQUAL(image.words[0], 0x3c040041);
+    CU_ASSERT_EQUAL(image.words[1], 0x24848004);
+    free_word_buffer(&image);
+    free_object(&obj);
+    fclose(elf);
+
+    /* An upper half without its low half cannot be written. */
+    source = "lui $t0, far\nfar: jr $ra\n";
+    CU_ASSERT_EQUAL(assemble_buffer(&obj, source, strlen(source), NULL, NULL), 0);
+    elf = tmpfile();
+    CU_ASSERT_EQUAL(write_elf_object(elf, obj.text.words, obj.text.len, obj.symtbl,
+        obj.reltbl), -1);
+    free_object(&obj);
+    fclose(elf);
+
+    /* A truncated object is rejected. */
+    CU_ASSERT_EQUAL(ftruncate(fileno(out), 60), 0);
+    CU_ASSERT_EQUAL(read_object_file(&obj, out, "tmpfile"), -1);
+
+    fclose(out);
+    free_table(symtbl);
+    free_table(reltbl);
+}
+
+void test_typed_relocations() {
+    FILE* src = tmpfile();
+    fprintf(src, "start: la $t0, data\n"
+                 "jal start\n"
+                 "data: ori $t1, $t1, start\n");
+    rewind(src);
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    FILE* inter = tmpfile();
+    FILE* out = tmpfile();
+    DataSegment data;
+    init_data_segment(&data);
+    CU_ASSERT_EQUAL(pass_one(src, inter, symtbl, &data), 0);
+    free_data_segment(&data);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(symtbl, "data"), 12);
+    rewind(inter);
+    CU_ASSERT_EQUAL(pass_two(inter, out, symtbl, reltbl), 0);
+    CU_ASSERT_EQUAL(reltbl->len, 4);
+    CU_ASSERT_EQUAL(get_reloc_type(reltbl, 0), R_HI16);
+    CU_ASSERT_EQUAL(get_reloc_type(reltbl, 1), R_LO16);
+    CU_ASSERT_EQUAL(get_reloc_type(reltbl, 2), R_26);
+    CU_ASSERT_EQUAL(get_reloc_type(reltbl, 3), R_LO16);
+
+    /* Records come out grouped by type, each group in table order. */
+    RelocBatch batch;
+    pack_relocs(&batch, reltbl);
+    CU_ASSERT_EQUAL(batch.start[R_HI16], 1);
+    CU_ASSERT_EQUAL(batch.start[R_LO16], 2);
+    CU_ASSERT_EQUAL(batch.start[R_PC16], 4);
+    CU_ASSERT_EQUAL(batch.num_names, 2);
+    CU_ASSERT_EQUAL(batch.records[0].offset, 8);
+    CU_ASSERT_EQUAL(RELOC_TYPE(batch.records[3].info), R_LO16);
+    CU_ASSERT_STRING_EQUAL(batch.names[RELOC_SYM(batch.records[3].info)], "start");
+
+    uint32_t text[4] = { 0x3c080000, 0x35080000, 0x0c000000, 0x35290000 };
+    uint32_t targets[2];
+    targets[RELOC_SYM(batch.records[1].info)] = 0x1234800c;
+    targets[RELOC_SYM(batch.records[0].info)] = 0x12348000;
+    for (int type = 0; type < NUM_RELOC_TYPES; type++) {
+        CU_ASSERT_EQUAL(patch_relocs(text, 0x12348000, type, batch.records + batch.start[type],
+            batch.start[type + 1] - batch.start[type], targets), 0);
+    }
+    CU_ASSERT_EQUAL(text[0], 0x3c081234);
+    CU_ASSERT_EQUAL(text[1], 0x3508800c);
+    CU_ASSERT_EQUAL(text[2], 0x0c8d2000);
+    CU_ASSERT_EQUAL(text[3], 0x35298000);
+    free_relocs(&batch);
+
+    /* The text form keeps the types. */
+    FILE* obj_file = tmpfile();
+    fprintf(obj_file, ".text\n");
+    for (int i = 0; i < 4; i++) {
+        fprintf(obj_file, "%08x\n", 0);
+    }
+    fprintf(obj_file, "\n.symbol\n");
+    write_table(symtbl, obj_file);
+    fprintf(obj_file, "\n.relocation\n");
+    write_relocs(reltbl, obj_file);
+    rewind(obj_file);
+    ObjectFile obj;
+    CU_ASSERT_EQUAL(read_object(&obj, obj_file, "tmpfile"), 0);
+    CU_ASSERT_EQUAL(obj.reltbl->len, 4);
+    CU_ASSERT_EQUAL(get_reloc_type(obj.reltbl, 0), R_26);
+    CU_ASSERT_EQUAL(get_reloc_type(obj.reltbl, 1), R_HI16);
+    CU_ASSERT_EQUAL(get_reloc_type(obj.reltbl, 3), R_LO16);
+    free_object(&obj);
+
+    /* la needs a label, and a label only works where a relocation can be
+       recorded. */
+    char* args[3] = { "$t0", "5", NULL };
+    ExpandedInst insts[MAX_EXPANSION];
+    CU_ASSERT_EQUAL(expand_pass_one(insts, "la", args, 2), 0);
+    args[1] = "$t0";
+    args[2] = "label";
+    CU_ASSERT_EQUAL(translate_inst(out, "ori", args, 3, 0, symtbl, NULL), -1);
+    CU_ASSERT_EQUAL(translate_inst(out, "addiu", args, 3, 0, symtbl, reltbl), -1);
+
+    fclose(src);
+    fclose(inter);
+    fclose(out);
+    fclose(obj_file);
+    free_table(symtbl);
+    free_table(reltbl);
+}
+
+/* Collects flushed words into a WordBuffer. */
+static void collect_words(void* ctx, const uint32_t* words, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        append_word(ctx, words[i]);
+    }
+}
+
+void test_stream_mode() {
+    FILE* src = tmpfile();
+    fprintf(src, "start: beq $t0, $t1, end\n"
+                 "bne $t0, $t1, end\n"
+                 "la $a0, start\n"
+                 "li $v0, 0x12345\n"
+                 "jal ext\n"
+                 "blt $t3, $t2, start\n"
+                 "end: bne $t0, $t1, start\n");
+    for (int i = 0; i < 8; i++) {
+        fprintf(src, "addiu $t0, $t0, 1\n");
+    }
+
+    /* The object matches the one the two passes write. */
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    FILE* inter = tmpfile();
+    FILE* expected = tmpfile();
+    DataSegment data;
+    init_data_segment(&data);
+    rewind(src);
+    CU_ASSERT_EQUAL(pass_one(src, inter, symtbl, &data), 0);
+    fprintf(expected, ".text\n");
+    rewind(inter);
+    CU_ASSERT_EQUAL(pass_two(inter, expected, symtbl, reltbl), 0);
+    fprintf(expected, "\n.symbol\n");
+    write_table(symtbl, expected);
+    fprintf(expected, "\n.relocation\n");
+    write_relocs(reltbl, expected);
+
+    FILE* actual = tmpfile();
+    rewind(src);
+    CU_ASSERT_EQUAL(assemble_stream(src, actual), 0);
+    CU_ASSERT_EQUAL(ftell(actual), ftell(expected));
+    rewind(expected);
+    rewind(actual);
+    int c;
+    while ((c = fgetc(expected)) != EOF && c == fgetc(actual)) {
+    }
+    CU_ASSERT_EQUAL(c, EOF);
+
+    /* A small window flushes as it goes and gives the same words. */
+    SymbolTable* one_symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* one_reltbl = create_table(SYMTBL_NON_UNIQUE);
+    WordBuffer words;
+    init_word_buffer(&words);
+    rewind(src);
+    CU_ASSERT_EQUAL(one_pass(src, 16, collect_words, &words, one_symtbl, one_reltbl, &data), 0);
+    CU_ASSERT_EQUAL(words.len, 18);
+    CU_ASSERT_EQUAL(words.words[0], 0x11090008);
+    CU_ASSERT_EQUAL(words.words[1], 0x15090007);
+    CU_ASSERT_EQUAL(words.words[9], 0x1509fff6);
+    CU_ASSERT_EQUAL(one_reltbl->len, 3);
+    free_word_buffer(&words);
+    free_table(one_symtbl);
+    free_table(one_reltbl);
+
+    /* A branch flushed while still pending, or never resolved, fails. */
+    FILE* bad = tmpfile();
+    fprintf(bad, "beq $t0, $t1, far\n");
+    for (int i = 0; i < 8; i++) {
+        fprintf(bad, "addiu $t0, $t0, 1\n");
+    }
+    fprintf(bad, "far: bne $t0, $t1, nowhere\n");
+    SymbolTable* bad_symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* bad_reltbl = create_table(SYMTBL_NON_UNIQUE);
+    init_word_buffer(&words);
+    rewind(bad);
+    CU_ASSERT_EQUAL(one_pass(bad, 4, collect_words, &words, bad_symtbl, bad_reltbl, &data), -1);
+    CU_ASSERT_EQUAL(words.len, 10);
+    free_word_buffer(&words);
+    free_table(bad_symtbl);
+    free_table(bad_reltbl);
+
+    /* A seekable input with more than BRANCH_REACH bytes of .text is not
+       read into memory again to be relaxed: the heap stays within the
+       window, and the branch back to the top is out of range. */
+    FILE* big = tmpfile();
+    fprintf(big, "top: addu $t0, $t0, $t0\n");
+    for (int i = 0; i < 100000; i++) {
+        fprintf(big, "addu $t0, $t0, $t1\n");
+    }
+    fprintf(big, "beq $t0, $t1, top\n");
+    rewind(big);
+    FILE* big_out = fopen("/dev/null", "w");
+    CountingAllocator counter;
+    init_counting_allocator(&counter, NULL);
+    set_table_allocator(&counter.base);
+    int num_errors = 0;
+    set_log_callback(count_error, &num_errors);
+    CU_ASSERT_EQUAL(assemble_stream(big, big_out), -1);
+    set_log_callback(NULL, NULL);
+    set_table_allocator(NULL);
+    CU_ASSERT_EQUAL(num_errors, 2);
+    CU_ASSERT(counter.peak_bytes < BACKPATCH_WINDOW * 4 + 64 * 1024);
+    CU_ASSERT_EQUAL(counter.live_bytes, 0);
+    fclose(big);
+    fclose(big_out);
+
+    fclose(src);
+    fclose(inter);
+    fclose(expected);
+    fclose(actual);
+    fclose(bad);
+    free_table(symtbl);
+    free_table(reltbl);
+    free_data_segment(&data);
+}
+
+/* Returns the contents of the file NAME in a freshly allocated string. */
+static char* read_file(const char* name) {
+    FILE* f = fopen(name, "r");
+    CU_ASSERT_PTR_NOT_NULL(f);
+    if (!f) {
+        return calloc(1, 1);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    char* text = calloc(size + 1, 1);
+    rewind(f);
+    CU_ASSERT_EQUAL(fread(text, 1, size, f), size);
+    fclose(f);
+    return text;
+}
+
+void test_one_pass() {
+    const char* inputs[] = { "input/simple.s", "input/combined.s", "input/comments.s",
+        "input/imm.s", "input/labels.s", "input/pseudo.s" };
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        CU_ASSERT_EQUAL(assemble(inputs[i], "two_pass.int", "two_pass.out"), 0);
+        CU_ASSERT_EQUAL(assemble_one_pass(inputs[i], "one_pass.out"), 0);
+        char* expected = read_file("two_pass.out");
+        char* actual = read_file("one_pass.out");
+        CU_ASSERT_STRING_EQUAL(expected, actual);
+        free(expected);
+        free(actual);
+    }
+
+    /* Branches to labels that never appear are reported at the end. */
+    FILE* src = fopen("one_pass.s", "w");
+    fprintf(src, "beq $0, $0, done\nbne $0, $0, missing\ndone: jr $ra\n");
+    fclose(src);
+    CU_ASSERT_NOT_EQUAL(assemble_one_pass("one_pass.s", "one_pass.out"), 0);
+
+    remove("two_pass.int");
+    remove("two_pass.out");
+    remove("one_pass.out");
+    remove("one_pass.s");
+}
+
+typedef struct {
+    const char* source;
+    int err[8];
+    uint32_t len[8];
+    uint32_t last_word[8];
+    int num_errors[8];
+} BufferJobs;
+
+/* Assembles the source with an error added on odd jobs. */
+static void assemble_job(void* ctx, uint32_t i) {
+    BufferJobs* jobs = ctx;
+    char source[256];
+    snprintf(source, sizeof(source), "%s%s", jobs->source, i % 2 ? "bne $0, $0, nowhere\n" : "");
+    ObjectFile obj;
+    jobs->num_errors[i] = 0;
+    jobs->err[i] = assemble_buffer(&obj, source, strlen(source), count_error,
+        &jobs->num_errors[i]);
+    jobs->len[i] = obj.text.len;
+    jobs->last_word[i] = obj.text.len ? obj.text.words[obj.text.len - 1] : 0;
+    free_object(&obj);
+}
+
+static void count_item(void* count, uint32_t i) {
+    __atomic_fetch_add((uint32_t*) count, 1, __ATOMIC_RELAXED);
+}
+
+void test_assemble_buffer() {
+    const char* source = "start: beq $t0, $t1, end\n"
+                         "la $a0, start\n"
+                         "jal ext\n"
+                         "end: bne $0, $0, start";
+    ObjectFile obj;
+    CU_ASSERT_EQUAL(assemble_buffer(&obj, source, strlen(source), NULL, NULL), 0);
+    CU_ASSERT_EQUAL(obj.text.len, 5);
+    CU_ASSERT_EQUAL(obj.text.words[0], 0x11090003);
+    CU_ASSERT_EQUAL(obj.text.words[4], 0x1400fffb);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(obj.symtbl, "end"), 16);
+    CU_ASSERT_EQUAL(obj.reltbl->len, 3);
+    free_object(&obj);
+
+    /* Only as much of the buffer as LEN says is read. */
+    CU_ASSERT_EQUAL(assemble_buffer(&obj, source, 0, NULL, NULL), 0);
+    CU_ASSERT_EQUAL(obj.text.len, 0);
+    free_object(&obj);
+
+    /* Each thread's diagnostics go to its own callback. */
+    BufferJobs jobs;
+    jobs.source = "start: beq $t0, $t1, end\n"
+                  "jal ext\n"
+                  "end: bne $0, $0, start\n";
+    run_parallel(assemble_job, &jobs, 8, 4);
+    for (int i = 0; i < 8; i++) {
+        CU_ASSERT_EQUAL(jobs.err[i], i % 2 ? -1 : 0);
+        CU_ASSERT_EQUAL(jobs.num_errors[i], i % 2);
+        CU_ASSERT_EQUAL(jobs.len[i], i % 2 ? 4 : 3);
+        CU_ASSERT_EQUAL(jobs.last_word[i], i % 2 ? 0x14000000 : 0x1400fffd);
+    }
+
+    /* The thread handles come from the table allocator. */
+    CountingAllocator counter;
+    init_counting_allocator(&counter, NULL);
+    set_table_allocator(&counter.base);
+    uint32_t count = 0;
+    run_parallel(count_item, &count, 100, 4);
+    set_table_allocator(NULL);
+    CU_ASSERT_EQUAL(count, 100);
+    CU_ASSERT_EQUAL(counter.num_allocs, 1);
+    CU_ASSERT_EQUAL(counter.live_bytes, 0);
+}
+
+void test_encode_block() {
+    const char* source[][4] = {
+        { "addu", "$t0", "$t1", "$t2" }, { "sll", "$t3", "$t2", "31" },
+        { "jr", "$ra" }, { "addiu", "$a0", "$0", "-5" }, { "ori", "$t1", "$t1", "0xFFFF" },
+        { "lui", "$t0", "data" }, { "lbu", "$t3", "-3", "$s2" }, { "beq", "$t0", "$t1", "start" },
+        { "bne", "$t0", "$t1", "nowhere" }, { "jal", "start" }, { "ori", "$t0", "$t0", "data" },
+    };
+    uint32_t n = sizeof(source) / sizeof(source[0]);
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* block_reltbl = create_table(SYMTBL_NON_UNIQUE);
+    SymbolTable* inst_reltbl = create_table(SYMTBL_NON_UNIQUE);
+    add_to_table(symtbl, "start", 0);
+    add_to_table(symtbl, "data", 40);
+
+    /* Block by block, each word matches encode_inst() and the relocations come
+       out in the same order. */
+    InstBlock* block = create_block();
+    uint32_t words[IR_BLOCK_SIZE];
+    uint8_t bad[IR_BLOCK_SIZE];
+    for (uint32_t i = 0; i < n; i++) {
+        Instr inst;
+        uint32_t num_args = source[i][3] ? 3 : source[i][2] ? 2 : 1;
+        CU_ASSERT_EQUAL(decode_inst(&inst, source[i][0], (char**) source[i] + 1, num_args), 0);
+        add_to_block(block, &inst);
+    }
+    add_invalid_to_block(block);
+    CU_ASSERT_EQUAL(encode_block(block, 0, words, bad, symtbl, block_reltbl), 2);
+    for (uint32_t i = 0; i < n; i++) {
+        Instr inst;
+        uint32_t word;
+        uint32_t num_args = source[i][3] ? 3 : source[i][2] ? 2 : 1;
+        decode_inst(&inst, source[i][0], (char**) source[i] + 1, num_args);
+        int err = encode_inst(&word, &inst, i * 4, symtbl, inst_reltbl);
+        CU_ASSERT_EQUAL(bad[i], err != 0);
+        if (!err) {
+            CU_ASSERT_EQUAL(words[i], word);
+        }
+    }
+    CU_ASSERT(bad[8]);
+    CU_ASSERT(bad[n]);
+    CU_ASSERT_EQUAL(block_reltbl->len, inst_reltbl->len);
+    for (uint32_t i = 0; i < block_reltbl->len; i++) {
+        CU_ASSERT_STRING_EQUAL(block_reltbl->tbl[i].name, inst_reltbl->tbl[i].name);
+        CU_ASSERT_EQUAL(block_reltbl->tbl[i].addr, inst_reltbl->tbl[i].addr);
+        CU_ASSERT_EQUAL(get_reloc_type(block_reltbl, i), get_reloc_type(inst_reltbl, i));
+    }
+
+    /* Branch offsets are checked against the 16-bit field. */
+    Instr inst;
+    char* args[3] = { "$t0", "$t1", "start" };
+    decode_inst(&inst, "beq", args, 3);
+    block->len = 0;
+    add_to_block(block, &inst);
+    CU_ASSERT_EQUAL(encode_block(block, 0x1fffc, words, bad, symtbl, block_reltbl), 0);
+    CU_ASSERT_EQUAL(words[0], 0x11098000);
+    CU_ASSERT_EQUAL(encode_block(block, 0x20000, words, bad, symtbl, block_reltbl), 1);
+
+    /* So are jumps that have no relocation table to go in. */
+    char* jump[1] = { "start" };
+    decode_inst(&inst, "j", jump, 1);
+    block->len = 0;
+    add_to_block(block, &inst);
+    CU_ASSERT_EQUAL(encode_block(block, 0, words, bad, symtbl, NULL), 1);
+    CU_ASSERT(bad[0]);
+
+    /* The block formatter writes what write_inst_hex() does. */
+    FILE* one = tmpfile();
+    FILE* all = tmpfile();
+    for (uint32_t i = 0; i < 600; i++) {
+        words[i] = i * 0x9E3779B9u;
+        write_inst_hex(one, words[i]);
+    }
+    write_insts_hex(all, words, 600);
+    CU_ASSERT_EQUAL(ftell(one), ftell(all));
+    rewind(one);
+    rewind(all);
+    int c;
+    while ((c = fgetc(one)) != EOF && c == fgetc(all)) {
+    }
+    CU_ASSERT_EQUAL(c, EOF);
+
+    fclose(one);
+    fclose(all);
+    free_block(block);
+    free_table(symtbl);
+    free_table(block_reltbl);
+    free_table(inst_reltbl);
+}
+
+void test_isa_table() {
+    /* Every instruction decodes from its own name, with the right number of
+       operands and no other. */
+    for (uint8_t id = 0; id < NUM_INSTS; id++) {
+        char* args[4] = { "$t0", "$t0", "$t0", "$t0" };
+        Instr inst;
+        init_inst(&inst, id);
+        const FormatInfo* info = format_info(inst.fmt);
+        CU_ASSERT_PTR_NOT_NULL(inst_name(id));
+        CU_ASSERT_PTR_NOT_NULL(info);
+        if (!info) {
+            continue;
+        }
+        CU_ASSERT_EQUAL(decode_inst(&inst, inst_name(id), args, info->num_operands + 1), -1);
+        if (info->num_operands == 0) {
+            CU_ASSERT_EQUAL(decode_inst(&inst, inst_name(id), args, 0), 0);
+            CU_ASSERT_EQUAL(inst.id, id);
+        }
+        if (info->num_operands > 0) {
+            CU_ASSERT_EQUAL(decode_inst(&inst, inst_name(id), args, info->num_operands - 1), -1);
+        }
+    }
+    CU_ASSERT_PTR_NULL(inst_name(NUM_INSTS));
+    CU_ASSERT_PTR_NULL(format_info(NUM_FORMATS));
+
+    /* Names before, between and after the sorted mnemonics are unknown. */
+    const char* unknown[] = { "", "a", "aaa", "addv", "bgezall", "jj", "zzz", "ADDU" };
+    for (size_t i = 0; i < sizeof(unknown) / sizeof(unknown[0]); i++) {
+        Instr inst;
+        CU_ASSERT_EQUAL(decode_inst(&inst, unknown[i], NULL, 0), -1);
+    }
+
+    /* Encodings checked against a reference assembler. */
+    const struct {
+        const char* args[4];
+        uint32_t word;
+    } cases[] = {
+        { { "add", "$t0", "$t1", "$t2" }, 0x012a4020 },
+        { { "sub", "$t0", "$t1", "$t2" }, 0x012a4022 },
+        { { "subu", "$t0", "$t1", "$t2" }, 0x012a4023 },
+        { { "and", "$t0", "$t1", "$t2" }, 0x012a4024 },
+        { { "xor", "$t0", "$t1", "$t2" }, 0x012a4026 },
+        { { "nor", "$t0", "$t1", "$t2" }, 0x012a4027 },
+        { { "movz", "$t0", "$t1", "$t2" }, 0x012a400a },
+        { { "movn", "$t0", "$t1", "$t2" }, 0x012a400b },
+        { { "mul", "$t0", "$t1", "$t2" }, 0x712a4002 },
+        { { "srl", "$t0", "$t1", "31" }, 0x000947c2 },
+        { { "sra", "$t0", "$t1", "1" }, 0x00094043 },
+        { { "sllv", "$t0", "$t1", "$t2" }, 0x01494004 },
+        { { "srlv", "$t0", "$t1", "$t2" }, 0x01494006 },
+        { { "srav", "$t0", "$t1", "$t2" }, 0x01494007 },
+        { { "jalr", "$t0", "$t1" }, 0x01204009 },
+        { { "mfhi", "$t0" }, 0x00004010 },
+        { { "mflo", "$t0" }, 0x00004012 },
+        { { "mthi", "$t0" }, 0x01000011 },
+        { { "mtlo", "$t0" }, 0x01000013 },
+        { { "mult", "$t0", "$t1" }, 0x01090018 },
+        { { "multu", "$t0", "$t1" }, 0x01090019 },
+        { { "div", "$t0", "$t1" }, 0x0109001a },
+        { { "divu", "$t0", "$t1" }, 0x0109001b },
+        { { "madd", "$t0", "$t1" }, 0x71090000 },
+        { { "maddu", "$t0", "$t1" }, 0x71090001 },
+        { { "msub", "$t0", "$t1" }, 0x71090004 },
+        { { "msubu", "$t0", "$t1" }, 0x71090005 },
+        { { "teq", "$t0", "$t1" }, 0x01090034 },
+        { { "tne", "$t0", "$t1" }, 0x01090036 },
+        { { "tge", "$t0", "$t1" }, 0x01090030 },
+        { { "tgeu", "$t0", "$t1" }, 0x01090031 },
+        { { "tlt", "$t0", "$t1" }, 0x01090032 },
+        { { "tltu", "$t0", "$t1" }, 0x01090033 },
+        { { "clz", "$t0", "$t1" }, 0x71284020 },
+        { { "clo", "$t0", "$t1" }, 0x71284021 },
+        { { "syscall" }, 0x0000000c },
+        { { "break" }, 0x0000000d },
+        { { "sync" }, 0x0000000f },
+        { { "addi", "$t0", "$t1", "-1" }, 0x2128ffff },
+        { { "slti", "$t0", "$t1", "-5" }, 0x2928fffb },
+        { { "sltiu", "$t0", "$t1", "-5" }, 0x2d28fffb },
+        { { "andi", "$t0", "$t1", "0xffff" }, 0x3128ffff },
+        { { "xori", "$t0", "$t1", "7" }, 0x39280007 },
+        { { "lh", "$t0", "-4", "$t1" }, 0x8528fffc },
+        { { "lhu", "$t0", "4", "$t1" }, 0x95280004 },
+        { { "lwl", "$t0", "1", "$t1" }, 0x89280001 },
+        { { "lwr", "$t0", "1", "$t1" }, 0x99280001 },
+        { { "sh", "$t0", "2", "$t1" }, 0xa5280002 },
+        { { "swl", "$t0", "2", "$t1" }, 0xa9280002 },
+        { { "swr", "$t0", "2", "$t1" }, 0xb9280002 },
+        { { "ll", "$t0", "0", "$t1" }, 0xc1280000 },
+        { { "sc", "$t0", "0", "$t1" }, 0xe1280000 },
+        { { "teqi", "$t0", "5" }, 0x050c0005 },
+        { { "tnei", "$t0", "-1" }, 0x050effff },
+        { { "tgei", "$t0", "5" }, 0x05080005 },
+        { { "tgeiu", "$t0", "5" }, 0x05090005 },
+        { { "tlti", "$t0", "5" }, 0x050a0005 },
+        { { "tltiu", "$t0", "5" }, 0x050b0005 },
+        { { "blez", "$t0", "back" }, 0x1900fffe },
+        { { "bgtz", "$t0", "back" }, 0x1d00fffe },
+        { { "bltz", "$t0", "back" }, 0x0500fffe },
+        { { "bgez", "$t0", "back" }, 0x0501fffe },
+        { { "bltzal", "$t0", "back" }, 0x0510fffe },
+        { { "bgezal", "$t0", "back" }, 0x0511fffe },
+        /* Registers outside the original eighteen, by name and number. */
+        { { "mult", "$t9", "$k0" }, 0x033a0018 },
+        { { "mflo", "$v1" }, 0x00001812 },
+        { { "subu", "$s7", "$fp", "$31" }, 0x03dfb823 },
+        { { "sllv", "$t4", "$t5", "$s8" }, 0x03cd6004 },
+        { { "clz", "$gp", "$k1" }, 0x737ce020 },
+        { { "lhu", "$t8", "8", "$s6" }, 0x96d80008 },
+        { { "teqi", "$s4", "5" }, 0x068c0005 },
+        { { "addi", "$t6", "$1", "-1" }, 0x202effff },
+        { { "jalr", "$t7", "$v1" }, 0x00607809 },
+    };
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    add_to_table(symtbl, "back", 0);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        Instr inst;
+        uint32_t word = 0;
+        uint32_t num_args = cases[i].args[3] ? 3 : cases[i].args[2] ? 2 : cases[i].args[1] ? 1 : 0;
+        CU_ASSERT_EQUAL(decode_inst(&inst, cases[i].args[0], (char**) cases[i].args + 1,
+            num_args), 0);
+        CU_ASSERT_EQUAL(encode_inst(&word, &inst, 4, symtbl, NULL), 0);
+        CU_ASSERT_EQUAL(word, cases[i].word);
+    }
+
+    /* Immediates are checked against the field they go in. */
+    char* andi[3] = { "$t0", "$t1", "-1" };
+    char* slti[3] = { "$t0", "$t1", "32768" };
+    char* sra[3] = { "$t0", "$t1", "32" };
+    Instr inst;
+    CU_ASSERT_EQUAL(decode_inst(&inst, "andi", andi, 3), -1);
+    CU_ASSERT_EQUAL(decode_inst(&inst, "slti", slti, 3), -1);
+    CU_ASSERT_EQUAL(decode_inst(&inst, "sra", sra, 3), -1);
+
+    /* A jump fails unless its relocation is recorded. */
+    char* target[1] = { "back" };
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    uint32_t word = 0;
+    CU_ASSERT_EQUAL(decode_inst(&inst, "jal", target, 1), 0);
+    CU_ASSERT_EQUAL(encode_inst(&word, &inst, 8, symtbl, NULL), -1);
+    CU_ASSERT_EQUAL(encode_inst(&word, &inst, 8, symtbl, reltbl), 0);
+    CU_ASSERT_EQUAL(word, 0x0c000000);
+    CU_ASSERT_EQUAL(reltbl->len, 1);
+    free_table(reltbl);
+    free_table(symtbl);
+}
+
+/* Disassembles OBJ into BUF, which holds SIZE bytes. Returns the length. */
+static size_t disassemble_to_buffer(const ObjectFile* obj, char* buf, size_t size) {
+    FILE* f = tmpfile();
+    CU_ASSERT_EQUAL(disassemble_object(f, obj), 0);
+    rewind(f);
+    size_t len = fread(buf, 1, size - 1, f);
+    buf[len] = '\0';
+    fclose(f);
+    return len;
+}
+
+void test_disassembler() {
+    const char* source = "start: beq $t0, $t1, end\n"
+                         "la $a0, start\n"
+                         "jal ext\n"
+                         "sll $t3, $t2, 31\n"
+                         "lh $t0, -4($t1)\n"
+                         "loop: bgezal $t0, loop\n"
+                         "clz $s0, $s1\n"
+                         "andi $t0, $t1, 0xffff\n"
+                         "li $t2, -70000\n"
+                         "end: bne $0, $0, start\n"
+                         "syscall\n";
+    ObjectFile obj;
+    CU_ASSERT_EQUAL(assemble_buffer(&obj, source, strlen(source), NULL, NULL), 0);
+
+    /* The disassembly assembles back into the same object. */
+    char text[4096];
+    size_t len = disassemble_to_buffer(&obj, text, sizeof(text));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "\tlui $a0, start\n\tori $a0, $a0, start\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "\tlh $t0, -4($t1)\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "loop:\n\tbgezal $t0, loop\n"));
+    ObjectFile again;
+    CU_ASSERT_EQUAL(assemble_buffer(&again, text, len, NULL, NULL), 0);
+    CU_ASSERT_EQUAL(again.text.len, obj.text.len);
+    if (again.text.len == obj.text.len) {
+        CU_ASSERT_EQUAL(memcmp(again.text.words, obj.text.words, obj.text.len * 4), 0);
+    }
+    CU_ASSERT_EQUAL(again.symtbl->len, obj.symtbl->len);
+    CU_ASSERT_EQUAL(again.reltbl->len, obj.reltbl->len);
+    free_object(&again);
+
+    /* Without .symbol, branch targets get made-up labels. */
+    free_table(obj.symtbl);
+    obj.symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    len = disassemble_to_buffer(&obj, text, sizeof(text));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "_L0:\n\tbeq $t0, $t1, _L44\n"));
+    CU_ASSERT_EQUAL(assemble_buffer(&again, text, len, NULL, NULL), 0);
+    CU_ASSERT_EQUAL(again.text.len, obj.text.len);
+    if (again.text.len == obj.text.len) {
+        CU_ASSERT_EQUAL(memcmp(again.text.words, obj.text.words, obj.text.len * 4), 0);
+    }
+    free_object(&again);
+
+    /* Words that are not canonical encodings, and branches out of .text,
+       are printed as data. */
+    uint32_t odd[] = { 0xffffffff, 0x012a4060, 0x71294020, 0x1000fff0, 0x00000000 };
+    resize_word_buffer(&obj.text, 5);
+    memcpy(obj.text.words, odd, sizeof(odd));
+    free_table(obj.reltbl);
+    obj.reltbl = create_table(SYMTBL_NON_UNIQUE);
+    disassemble_to_buffer(&obj, text, sizeof(text));
+    CU_ASSERT_STRING_EQUAL(text, "\t.word 0xffffffff\n\t.word 0x012a4060\n"
+        "\t.word 0x71294020\n\t.word 0x1000fff0\n\tsll $zero, $zero, 0\n");
+    free_object(&obj);
+
+    /* Every instruction decodes back from its own encoding. */
+    Disassembler dis;
+    init_disassembler(&dis);
+    for (uint8_t id = 0; id < NUM_INSTS; id++) {
+        uint8_t decoded;
+        decode_words(&dis, &dis.fixed_bits[id], 1, &decoded);
+        CU_ASSERT_EQUAL(decoded, id);
+    }
+}
+
+/* Assembles SOURCE and runs it in SIM, with output going to OUTPUT. Returns
+   the status, or -1 if it could not be started. */
+static int simulate(Simulator* sim, ObjectFile* obj, const char* source, FILE* output,
+    uint64_t max_jumps) {
+    if (assemble_buffer(obj, source, strlen(source), NULL, NULL) != 0) {
+        return -1;
+    }
+    if (init_simulator(sim, obj, 4096) != 0) {
+        free_object(obj);
+        return -1;
+    }
+    sim->output = output;
+    return run_simulator(sim, max_jumps);
+}
+
+void test_simulator() {
+    const char* source = "main: addiu $sp, $sp, -4\n"
+                         "sw $ra, 0($sp)\n"
+                         "addiu $a0, $zero, 10\n"
+                         "jal sum\n"
+                         "addu $a0, $v0, $zero\n"
+                         "addiu $v0, $zero, 1\n"
+                         "syscall\n"
+                         "lw $ra, 0($sp)\n"
+                         "addiu $sp, $sp, 4\n"
+                         "jr $ra\n"
+                         "sum: addu $v0, $zero, $zero\n"
+                         "loop: beq $a0, $zero, done\n"
+                         "addu $v0, $v0, $a0\n"
+                         "addiu $a0, $a0, -1\n"
+                         "j loop\n"
+                         "done: jr $ra\n";
+    Simulator sim;
+    ObjectFile obj;
+    FILE* output = tmpfile();
+    CU_ASSERT_EQUAL(simulate(&sim, &obj, source, output, 0), SIM_EXITED);
+    rewind(output);
+    char buf[BUF_SIZE];
+    CU_ASSERT_PTR_NOT_NULL(fgets(buf, sizeof(buf), output));
+    CU_ASSERT_STRING_EQUAL(buf, "55");
+    fclose(output);
+    CU_ASSERT_EQUAL(sim.regs[29], 4096);
+    CU_ASSERT_EQUAL(sim_instructions(&sim), 53);
+    CU_ASSERT_EQUAL(sim.counts[get_addr_for_symbol(obj.symtbl, "loop") / 4], 11);
+    CU_ASSERT_EQUAL(sim.counts[get_addr_for_symbol(obj.symtbl, "done") / 4], 1);
+
+    /* The profile lists labels, instructions and the mix. */
+    FILE* profile = tmpfile();
+    write_profile(profile, &sim);
+    rewind(profile);
+    int labels = 0, mix = 0;
+    while (fgets(buf, sizeof(buf), profile)) {
+        labels |= strcmp(buf, "11\tloop\n") == 0;
+        mix |= strncmp(buf, "14\t", 3) == 0 && strstr(buf, "addiu") != NULL;
+    }
+    CU_ASSERT(labels);
+    CU_ASSERT(mix);
+    fclose(profile);
+    free_simulator(&sim);
+    free_object(&obj);
+
+    /* Only taken branches and jumps count against the limit, and a run
+       stopped there resumes where it left off. */
+    CU_ASSERT_EQUAL(simulate(&sim, &obj, source, NULL, 5), SIM_STEP_LIMIT);
+    CU_ASSERT_EQUAL(run_simulator(&sim, 0), SIM_EXITED);
+    CU_ASSERT_EQUAL(sim_instructions(&sim), 53);
+    free_simulator(&sim);
+    free_object(&obj);
+
+    /* Instructions beyond the original subset. */
+    const char* ops = "lui $t0, 0x1234\n"
+                      "ori $t0, $t0, 0x5678\n"
+                      "sw $t0, 8($zero)\n"
+                      "addiu $t1, $zero, -1\n"
+                      "lwl $t1, 9($zero)\n"
+                      "addiu $t2, $zero, -1\n"
+                      "lwr $t2, 9($zero)\n"
+                      "lh $t3, 8($zero)\n"
+                      "lbu $s0, 11($zero)\n"
+                      "addiu $a0, $zero, -7\n"
+                      "addiu $a1, $zero, 2\n"
+                      "div $a0, $a1\n"
+                      "mflo $s1\n"
+                      "mfhi $s2\n"
+                      "mult $a0, $a0\n"
+                      "madd $a1, $a1\n"
+                      "mflo $s3\n"
+                      "clz $a2, $a1\n"
+                      "sra $a3, $a0, 1\n"
+                      "srl $v0, $a0, 28\n"
+                      "movn $at, $a1, $a0\n"
+                      "bltzal $a0, there\n"
+                      "break\n"
+                      "there: sltiu $sp, $a0, 5\n"
+                      "teqi $sp, 0\n"
+                      "addiu $v0, $zero, 17\n"
+                      "addiu $a0, $zero, 3\n"
+                      "syscall\n";
+    CU_ASSERT_EQUAL(simulate(&sim, &obj, ops, NULL, 0), SIM_TRAP);
+    CU_ASSERT_EQUAL(sim.regs[9], 0x345678ff);
+    CU_ASSERT_EQUAL(sim.regs[10], 0xffff1234);
+    CU_ASSERT_EQUAL(sim.regs[11], 0x1234);
+    CU_ASSERT_EQUAL(sim.regs[16], 0x78);
+    CU_ASSERT_EQUAL(sim.regs[17], (uint32_t) -3);
+    CU_ASSERT_EQUAL(sim.regs[18], (uint32_t) -1);
+    CU_ASSERT_EQUAL(sim.regs[19], 53);
+    CU_ASSERT_EQUAL(sim.regs[6], 30);
+    CU_ASSERT_EQUAL(sim.regs[7], (uint32_t) -4);
+    CU_ASSERT_EQUAL(sim.regs[1], 2);
+    CU_ASSERT_EQUAL(sim.regs[31], 22 * 4);
+    CU_ASSERT_EQUAL(sim.regs[29], 0);
+    CU_ASSERT_EQUAL(sim.pc, 24);
+    free_simulator(&sim);
+    free_object(&obj);
+
+    /* Faults stop at the instruction that caused them. */
+    CU_ASSERT_EQUAL(simulate(&sim, &obj, "addiu $t0, $zero, 2\nlw $t1, 0($t0)\n", NULL, 0),
+        SIM_BAD_ADDRESS);
+    CU_ASSERT_EQUAL(sim.pc, 1);
+    free_simulator(&sim);
+    free_object(&obj);
+    CU_ASSERT_EQUAL(simulate(&sim, &obj, "addiu $t0, $zero, 6\njr $t0\n", NULL, 0),
+        SIM_BAD_TARGET);
+    free_simulator(&sim);
+    free_object(&obj);
+    CU_ASSERT_EQUAL(simulate(&sim, &obj, "addiu $v0, $zero, 17\naddiu $a0, $zero, 3\n"
+        "syscall\nbreak\n", NULL, 0), SIM_EXITED);
+    CU_ASSERT_EQUAL(sim.exit_code, 3);
+    free_simulator(&sim);
+    free_object(&obj);
+}
+
+/* Runs SOURCE interpreted and translated, resuming every MAX_JUMPS taken
+   branches and jumps if it is not 0, and checks that both stop in the same
+   state with the same profile. Returns the status. */
+static int check_jit(const char* source, uint64_t max_jumps) {
+    Simulator expected, sim;
+    ObjectFile obj;
+    int status = simulate(&expected, &obj, source, NULL, max_jumps);
+    while (status == SIM_STEP_LIMIT) {
+        status = run_simulator(&expected, max_jumps);
+    }
+    CU_ASSERT_EQUAL(init_simulator(&sim, &obj, 4096), 0);
+    sim.output = NULL;
+    Jit jit;
+    CU_ASSERT_EQUAL(init_jit(&jit, &sim), 0);
+    SimStatus jit_status;
+    do {
+        jit_status = run_jit(&jit, max_jumps);
+    } while (max_jumps && jit_status == SIM_STEP_LIMIT);
+    CU_ASSERT_EQUAL(jit_status, status);
+    CU_ASSERT_EQUAL(sim.pc, expected.pc);
+    CU_ASSERT(memcmp(sim.regs, expected.regs, 32 * sizeof(uint32_t)) == 0);
+    CU_ASSERT_EQUAL(sim.hi, expected.hi);
+    CU_ASSERT_EQUAL(sim.lo, expected.lo);
+    if (status == SIM_BAD_ADDRESS || status == SIM_BAD_TARGET) {
+        CU_ASSERT_EQUAL(sim.bad_addr, expected.bad_addr);
+    }
+    CU_ASSERT(memcmp(sim.counts, expected.counts, (sim.len + 2) * sizeof(uint64_t)) == 0);
+    CU_ASSERT(memcmp(sim.mem, expected.mem, sim.mem_size) == 0);
+    CU_ASSERT(jit.blocks > 0);
+    free_jit(&jit);
+    free_simulator(&sim);
+    free_simulator(&expected);
+    free_object(&obj);
+    return status;
+}
+
+void test_jit() {
+    /* Calls, returns, loops and the loads and stores of every size. */
+    const char* calls = "main: addiu $sp, $sp, -8\n"
+                        "sw $ra, 4($sp)\n"
+                        "addiu $a0, $zero, 10\n"
+                        "jal sum\n"
+                        "sw $v0, 0($sp)\n"
+                        "lb $t0, 3($sp)\n"
+                        "lbu $t1, 3($sp)\n"
+                        "sh $t0, 16($zero)\n"
+                        "sb $t1, 19($zero)\n"
+                        "lh $t2, 16($zero)\n"
+                        "lhu $t3, 16($zero)\n"
+                        "lw $a1, 16($zero)\n"
+                        "addiu $a2, $zero, 0\n"
+                        "addiu $a3, $zero, 4\n"
+                        "loop2: addiu $a3, $a3, -1\n"
+                        "sltiu $at, $a3, 2\n"
+                        "movn $a2, $a3, $at\n"
+                        "bgtz $a3, loop2\n"
+                        "lw $ra, 4($sp)\n"
+                        "addiu $sp, $sp, 8\n"
+                        "jr $ra\n"
+                        "sum: addu $v0, $zero, $zero\n"
+                        "loop: beq $a0, $zero, done\n"
+                        "addu $v0, $v0, $a0\n"
+                        "mult $v0, $a0\n"
+                        "mflo $s0\n"
+                        "mfhi $s1\n"
+                        "mul $s2, $v0, $v0\n"
+                        "sllv $s3, $s2, $a0\n"
+                        "srav $t0, $s2, $a0\n"
+                        "nor $t1, $s3, $t0\n"
+                        "slt $t2, $t1, $t0\n"
+                        "addiu $v0, $v0, 0x7f\n"
+                        "addiu $v0, $v0, -0x7f\n"
+                        "addiu $a0, $a0, -1\n"
+                        "j loop\n"
+                        "done: la $t3, ret\n"
+                        "jalr $s3, $t3\n"
+                        "jr $ra\n"
+                        "ret: divu $v0, $a1\n"
+                        "jr $s3\n";
+    CU_ASSERT_EQUAL(check_jit(calls, 0), SIM_EXITED);
+    CU_ASSERT_EQUAL(check_jit(calls, 1), SIM_EXITED);
+    CU_ASSERT_EQUAL(check_jit(calls, 7), SIM_EXITED);
+
+    /* A limit stops translated code at the same place as the interpreter. */
+    Simulator sim;
+    ObjectFile obj;
+    CU_ASSERT_EQUAL(simulate(&sim, &obj, calls, NULL, 0), SIM_EXITED);
+    free_simulator(&sim);
+    CU_ASSERT_EQUAL(init_simulator(&sim, &obj, 4096), 0);
+    Jit jit;
+    CU_ASSERT_EQUAL(init_jit(&jit, &sim), 0);
+    CU_ASSERT_EQUAL(run_jit(&jit, 5), SIM_STEP_LIMIT);
+    Simulator expected;
+    CU_ASSERT_EQUAL(init_simulator(&expected, &obj, 4096), 0);
+    CU_ASSERT_EQUAL(run_simulator(&expected, 5), SIM_STEP_LIMIT);
+    CU_ASSERT_EQUAL(sim.pc, expected.pc);
+    CU_ASSERT_EQUAL(sim_instructions(&sim), sim_instructions(&expected));
+    CU_ASSERT(jit.chained > 0 || jit.blocks > 0);
+    free_jit(&jit);
+    free_simulator(&expected);
+    free_simulator(&sim);
+    free_object(&obj);
+
+    /* Faults and traps in translated code are reported by the interpreter
+       at the instruction that caused them. */
+    CU_ASSERT_EQUAL(check_jit("addiu $t0, $zero, 2\naddiu $t1, $zero, 1\n"
+        "lw $t1, 0($t0)\n", 0), SIM_BAD_ADDRESS);
+    CU_ASSERT_EQUAL(check_jit("addiu $t0, $zero, 4093\nsb $t0, 0($t0)\n"
+        "sh $t0, 0($t0)\n", 0), SIM_BAD_ADDRESS);
+    CU_ASSERT_EQUAL(check_jit("addiu $t0, $zero, 6\naddiu $t1, $zero, 1\njr $t0\n", 0),
+        SIM_BAD_TARGET);
+    CU_ASSERT_EQUAL(check_jit("lui $t0, 0x7fff\naddiu $t1, $zero, 1\nadd $t2, $t0, $t1\n"
+        "addi $t3, $t1, 1\n", 0), SIM_EXITED);
+    CU_ASSERT_EQUAL(check_jit("lui $t0, 0x8000\naddiu $t1, $zero, 1\nadd $t2, $t0, $t0\n", 0),
+        SIM_TRAP);
+    CU_ASSERT_EQUAL(check_jit("lui $t0, 0x7fff\nori $t0, $t0, 0xffff\naddi $t1, $t0, 1\n", 0),
+        SIM_TRAP);
+    CU_ASSERT_EQUAL(check_jit("addiu $v0, $zero, 17\naddiu $a0, $zero, 3\n"
+        "syscall\nbreak\n", 0), SIM_EXITED);
+}
+
+/* Writes PROG back out as source, labels included. */
+static void write_program_source(const Program* prog, FILE* output) {
+    const ProgCode* code = &prog->code;
+    uint32_t l = 0;
+    for (uint32_t i = 0; i <= code->len; i++) {
+        for (; l < code->num_labels && code->labels[l].index == i; l++) {
+            fprintf(output, "%s:\n", code->labels[l].name);
+        }
+        if (i < code->len) {
+            write_prog_inst(output, &code->insts[i]);
+        }
+    }
+}
+
+/* Reads SOURCE into PROG as pass one would. */
+static void read_test_program(Program* prog, const char* source) {
+    init_program(prog);
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    FILE* input = fmemopen((void*) source, strlen(source), "r");
+    DataSegment data;
+    init_data_segment(&data);
+    CU_ASSERT_EQUAL(read_program(input, prog, symtbl, &data), 0);
+    fclose(input);
+    free_table(symtbl);
+    free_data_segment(&data);
+}
+
+/* Checks that PROG, rewritten from SOURCE, still computes the same
+   registers, except for return addresses. */
+static void check_same_registers(const Program* prog, const char* source) {
+    Simulator expected, sim;
+    ObjectFile obj;
+    CU_ASSERT_EQUAL(simulate(&expected, &obj, source, NULL, 0), SIM_EXITED);
+    free_object(&obj);
+
+    char rewritten[4096];
+    FILE* output = fmemopen(rewritten, sizeof(rewritten), "w");
+    write_program_source(prog, output);
+    fclose(output);
+    CU_ASSERT_EQUAL(simulate(&sim, &obj, rewritten, NULL, 0), SIM_EXITED);
+    CU_ASSERT(memcmp(sim.regs, expected.regs, 31 * sizeof(uint32_t)) == 0);
+    free_simulator(&sim);
+    free_simulator(&expected);
+    free_object(&obj);
+}
+
+/* Lays SOURCE out by PROFILE into PROG and checks that it still computes
+   the same registers. */
+static void check_layout(Program* prog, const char* source, const char* profile,
+    LayoutStats* stats) {
+    read_test_program(prog, source);
+    FILE* counts = fmemopen((void*) profile, strlen(profile), "r");
+    CU_ASSERT_EQUAL(layout_program(prog, counts, stats), 0);
+    fclose(counts);
+    check_same_registers(prog, source);
+}
+
+void test_layout() {
+    /* The common case is the taken branch, so it should become the
+       fallthrough, and the jumps around it should go. */
+    const char* loop = "addiu $t0, $zero, 100\n"
+                       "addiu $t1, $zero, 0\n"
+                       "loop: andi $t2, $t0, 7\n"
+                       "bne $t2, $zero, common\n"
+                       "addiu $t1, $t1, 5\n"
+                       "back: addiu $t0, $t0, -1\n"
+                       "bne $t0, $zero, loop\n"
+                       "j done\n"
+                       "common: addiu $t1, $t1, 1\n"
+                       "j back\n"
+                       "done: jr $ra\n";
+    Program prog;
+    LayoutStats stats;
+    check_layout(&prog, loop, ".labels\n100\tloop\n100\tback\n88\tcommon\n1\tdone\n", &stats);
+    CU_ASSERT_EQUAL(stats.blocks, 7);
+    CU_ASSERT(stats.inverted >= 1);
+    CU_ASSERT(stats.jumps_removed >= 1);
+    CU_ASSERT(stats.taken_after < stats.taken_before);
+    uint32_t andi = 0;
+    while (andi + 2 < prog.code.len && prog.code.insts[andi].line != 3) {
+        andi++;
+    }
+    CU_ASSERT_EQUAL(prog.code.insts[andi + 1].inst.id, INST_BEQ);
+    CU_ASSERT_EQUAL(prog.code.insts[andi + 2].line, 9);
+    free_program(&prog);
+
+    /* Without counts the order stays as it was. */
+    check_layout(&prog, loop, "", &stats);
+    CU_ASSERT_EQUAL(stats.inverted, 0);
+    CU_ASSERT_EQUAL(stats.jumps_added, 0);
+    CU_ASSERT_EQUAL(stats.jumps_removed, 0);
+    CU_ASSERT_EQUAL(prog.code.len, 11);
+    free_program(&prog);
+
+    /* The instruction after a jal stays behind it, however cold. */
+    const char* call = "main: addiu $sp, $sp, -4\n"
+                       "sw $ra, 0($sp)\n"
+                       "addiu $a0, $zero, 5\n"
+                       "jal f\n"
+                       "addu $s0, $v0, $zero\n"
+                       "lw $ra, 0($sp)\n"
+                       "addiu $sp, $sp, 4\n"
+                       "jr $ra\n"
+                       "f: addu $v0, $zero, $zero\n"
+                       "top: addu $v0, $v0, $a0\n"
+                       "addiu $a0, $a0, -1\n"
+                       "bgtz $a0, top\n"
+                       "jr $ra\n";
+    check_layout(&prog, call, "top 5\nf 1\n", &stats);
+    for (uint32_t i = 0; i + 1 < prog.code.len; i++) {
+        if (prog.code.insts[i].inst.id == INST_JAL) {
+            CU_ASSERT_EQUAL(prog.code.insts[i + 1].line, prog.code.insts[i].line + 1);
+        }
+    }
+    free_program(&prog);
+
+    /* Malformed profiles are errors. */
+    read_test_program(&prog, loop);
+    const char* bad = "loop 100 extra\n";
+    FILE* counts = fmemopen((void*) bad, strlen(bad), "r");
+    CU_ASSERT_EQUAL(layout_program(&prog, counts, &stats), -1);
+    fclose(counts);
+    free_program(&prog);
+}
+
+void test_peephole() {
+    const char* source = "main: addiu $t0, $t0, 0\n"
+                         "sll $zero, $zero, 0\n"
+                         "li $t1, 0x12345678\n"
+                         "li $t1, 0x23456789\n"
+                         "lui $t2, 0\n"
+                         "ori $t2, $t2, 77\n"
+                         "li $t3, 0x50001\n"
+                         "addu $t3, $t2, $zero\n"
+                         "lui $s0, 1\n"
+                         "lui $s0, 2\n"
+                         "loop: addiu $t0, $t0, 1\n"
+                         "addu $s1, $t0, $t2\n"
+                         "or $s1, $s1, $zero\n"
+                         "bne $t0, $t3, loop\n"
+                         "jr $ra\n";
+    Program prog;
+    PeepholeStats stats;
+    read_test_program(&prog, source);
+    peephole_program(&prog, &stats);
+    CU_ASSERT_EQUAL(stats.removed[PEEP_SELF_MOVE], 2);
+    CU_ASSERT_EQUAL(stats.removed[PEEP_ZERO_WRITE], 1);
+    CU_ASSERT_EQUAL(stats.removed[PEEP_LUI_PAIR], 2);
+    CU_ASSERT_EQUAL(stats.removed[PEEP_DEAD_CONSTANT], 3);
+    CU_ASSERT_EQUAL(stats.removed[PEEP_DEAD_WRITE], 0);
+    CU_ASSERT_EQUAL(stats.removed[PEEP_FOLDED_LUI], 1);
+    CU_ASSERT_EQUAL(stats.total, 9);
+    CU_ASSERT_EQUAL(prog.code.len, 9);
+    CU_ASSERT_EQUAL(prog.code.insts[2].inst.id, INST_ORI);
+    CU_ASSERT_EQUAL(prog.code.insts[2].inst.rs, 0);
+    /* The labels follow the instructions they named. */
+    CU_ASSERT_EQUAL(prog.code.labels[0].index, 0);
+    CU_ASSERT_EQUAL(prog.code.labels[1].index, 5);
+    check_same_registers(&prog, source);
+    free_program(&prog);
+
+    /* Labels are barriers: the first li may be read by a jump to skip, and
+       registers are live at the end of a block. */
+    const char* barrier = "li $t0, 1\n"
+                          "skip: li $t0, 2\n"
+                          "addiu $t1, $zero, 3\n"
+                          "bne $t0, $zero, out\n"
+                          "li $t1, 4\n"
+                          "out: jr $ra\n";
+    read_test_program(&prog, barrier);
+    peephole_program(&prog, &stats);
+    CU_ASSERT_EQUAL(stats.total, 0);
+    CU_ASSERT_EQUAL(prog.code.len, 6);
+    free_program(&prog);
+
+    /* Loads, traps and stores stay even when their result is dead. */
+    const char* effects = "addiu $sp, $sp, -4\n"
+                          "lw $t0, 0($sp)\n"
+                          "add $t1, $t0, $t0\n"
+                          "sw $t0, 0($sp)\n"
+                          "addiu $t0, $zero, 1\n"
+                          "addiu $t1, $zero, 2\n"
+                          "addiu $sp, $sp, 4\n"
+                          "jr $ra\n";
+    read_test_program(&prog, effects);
+    peephole_program(&prog, &stats);
+    CU_ASSERT_EQUAL(stats.total, 0);
+    free_program(&prog);
+
+    /* A dead computation that is not a constant. */
+    read_test_program(&prog, "addu $t0, $a0, $a1\nsll $t0, $a0, 2\njr $ra\n");
+    peephole_program(&prog, &stats);
+    CU_ASSERT_EQUAL(stats.removed[PEEP_DEAD_WRITE], 1);
+    CU_ASSERT_EQUAL(prog.code.len, 2);
+    free_program(&prog);
+}
+
+void test_schedule() {
+    /* Loads move away from their uses, stores keep their order. */
+    const char* loads = "addiu $sp, $sp, -8\n"
+                        "addiu $t0, $zero, 7\n"
+                        "sw $t0, 0($sp)\n"
+                        "sw $t0, 4($sp)\n"
+                        "lw $t1, 0($sp)\n"
+                        "addu $t2, $t1, $t1\n"
+                        "addiu $t3, $zero, 3\n"
+                        "lw $t1, 4($sp)\n"
+                        "addu $s0, $t1, $t3\n"
+                        "addiu $s1, $zero, 5\n"
+                        "addiu $sp, $sp, 8\n"
+                        "jr $ra\n";
+    Program prog;
+    ScheduleStats stats;
+    read_test_program(&prog, loads);
+    schedule_program(&prog, 0, &stats);
+    CU_ASSERT_EQUAL(stats.stalls_before, 2);
+    CU_ASSERT_EQUAL(stats.stalls_after, 0);
+    CU_ASSERT_EQUAL(stats.cycles_saved, 2);
+    CU_ASSERT_EQUAL(stats.delay_slots, 0);
+    CU_ASSERT_EQUAL(prog.code.len, 12);
+    CU_ASSERT_EQUAL(prog.code.insts[11].inst.id, INST_JR);
+    static const uint32_t MEM_LINES[] = { 3, 4, 5, 8 };
+    uint32_t order = 0;
+    for (uint32_t i = 0; i < prog.code.len && order < 4; i++) {
+        const Instr* inst = &prog.code.insts[i].inst;
+        if (inst->fmt == FMT_MEM) {
+            /* sw, sw, lw, lw, as in the source. */
+            CU_ASSERT_EQUAL(prog.code.insts[i].line, MEM_LINES[order]);
+            order++;
+        }
+    }
+    CU_ASSERT_EQUAL(order, 4);
+    check_same_registers(&prog, loads);
+    free_program(&prog);
+
+    /* Delay slots: the epilogue's addiu goes after jr, and a branch that
+       depends on everything before it gets a nop. */
+    const char* slots = "main: addiu $t0, $zero, 2\n"
+                        "loop: addiu $t0, $t0, -1\n"
+                        "bne $t0, $zero, loop\n"
+                        "lw $ra, 4($sp)\n"
+                        "addiu $t1, $zero, 1\n"
+                        "addiu $sp, $sp, 8\n"
+                        "jr $ra\n";
+    read_test_program(&prog, slots);
+    schedule_program(&prog, 1, &stats);
+    CU_ASSERT_EQUAL(stats.delay_slots, 2);
+    CU_ASSERT_EQUAL(stats.slots_filled, 1);
+    CU_ASSERT_EQUAL(prog.code.len, 8);
+    CU_ASSERT_EQUAL(prog.code.insts[2].inst.id, INST_BNE);
+    CU_ASSERT_EQUAL(prog.code.insts[3].inst.id, INST_SLL);
+    CU_ASSERT_EQUAL(prog.code.insts[3].inst.rd, 0);
+    CU_ASSERT_EQUAL(prog.code.insts[6].inst.id, INST_JR);
+    CU_ASSERT_EQUAL(prog.code.insts[7].inst.id, INST_ADDIU);
+    CU_ASSERT_EQUAL(prog.code.insts[7].line, 6);
+    /* The lw is not left right before the jr that reads $ra. */
+    CU_ASSERT_NOT_EQUAL(prog.code.insts[5].inst.id, INST_LW);
+    CU_ASSERT_EQUAL(prog.code.labels[1].index, 1);
+    free_program(&prog);
+
+    /* jal writes $ra before its slot runs, so nothing reading $ra moves
+       into it. */
+    read_test_program(&prog, "addu $a0, $ra, $zero\njal f\nf: jr $ra\n");
+    schedule_program(&prog, 1, &stats);
+    CU_ASSERT_EQUAL(stats.slots_filled, 0);
+    CU_ASSERT_EQUAL(prog.code.insts[0].inst.id, INST_ADDU);
+    CU_ASSERT_EQUAL(prog.code.insts[2].inst.id, INST_SLL);
+    free_program(&prog);
+}
+
+void test_li_synthesis() {
+    static const struct {
+        const char* value;
+        const char* first;
+        unsigned count;
+        uint32_t loaded;
+    } CASES[] = {
+        { "-2147483648", "lui", 1, 0x80000000 },
+        { "-2147483647", "lui", 2, 0x80000001 },
+        { "-65537", "lui", 2, 0xFFFEFFFF },
+        { "-65536", "lui", 1, 0xFFFF0000 },
+        { "-65535", "lui", 2, 0xFFFF0001 },
+        { "-32769", "lui", 2, 0xFFFF7FFF },
+        { "-32768", "addiu", 1, 0xFFFF8000 },
+        { "-1", "addiu", 1, 0xFFFFFFFF },
+        { "0", "addiu", 1, 0 },
+        { "32767", "addiu", 1, 0x7FFF },
+        { "32768", "ori", 1, 0x8000 },
+        { "65535", "ori", 1, 0xFFFF },
+        { "65536", "lui", 1, 0x10000 },
+        { "65537", "lui", 2, 0x10001 },
+        { "0x7FFF0000", "lui", 1, 0x7FFF0000 },
+        { "0x7FFFFFFF", "lui", 2, 0x7FFFFFFF },
+        { "0x80000000", "lui", 1, 0x80000000 },
+        { "0xFFFF0000", "lui", 1, 0xFFFF0000 },
+        { "0xFFFF7FFF", "lui", 2, 0xFFFF7FFF },
+        { "0xFFFF8000", "addiu", 1, 0xFFFF8000 },
+        { "0xFFFFFFFF", "addiu", 1, 0xFFFFFFFF },
+    };
+    for (size_t i = 0; i < sizeof(CASES) / sizeof(CASES[0]); i++) {
+        char* args[2] = { "$t0", (char*) CASES[i].value };
+        ExpandedInst insts[MAX_EXPANSION];
+        unsigned count = expand_pass_one(insts, "li", args, 2);
+        CU_ASSERT_EQUAL(count, CASES[i].count);
+        CU_ASSERT_STRING_EQUAL(insts[0].name, CASES[i].first);
+        for (unsigned j = 0; j < count; j++) {
+            Instr inst;
+            CU_ASSERT_EQUAL(decode_inst(&inst, insts[j].name, insts[j].args,
+                insts[j].num_args), 0);
+        }
+
+        /* The value is loaded, and a label after it gets the address the
+           instruction count says. */
+        char source[128];
+        snprintf(source, sizeof(source), "li $t0, %s\nafter: jr $ra\n", CASES[i].value);
+        Simulator sim;
+        ObjectFile obj;
+        CU_ASSERT_EQUAL(simulate(&sim, &obj, source, NULL, 0), SIM_EXITED);
+        CU_ASSERT_EQUAL(sim.regs[8], CASES[i].loaded);
+        CU_ASSERT_EQUAL(get_addr_for_symbol(obj.symtbl, "after"), (int64_t) count * 4);
+        free_simulator(&sim);
+        free_object(&obj);
+    }
+
+    char* out_of_range[2] = { "$t0", "4294967296" };
+    ExpandedInst insts[MAX_EXPANSION];
+    CU_ASSERT_EQUAL(expand_pass_one(insts, "li", out_of_range, 2), 0);
+    out_of_range[1] = "-2147483649";
+    CU_ASSERT_EQUAL(expand_pass_one(insts, "li", out_of_range, 2), 0);
+}
+
+void test_relax() {
+    /* B (the bne of the blt) and C are out of range from the start. A
+       reaches mid with nothing to spare, and only goes out of range once
+       B grows. */
+    char* source;
+    size_t size;
+    FILE* output = open_memstream(&source, &size);
+    fprintf(output, "addiu $t0, $zero, 3\naddiu $t1, $zero, 5\n");
+    fprintf(output, "bne $t0, $t0, mid\n");
+    fprintf(output, "blt $t0, $t1, far\n");
+    fprintf(output, "addiu $s0, $zero, 1\n");
+    fprintf(output, "back: addiu $s1, $s1, 1\n");
+    for (int i = 0; i < 32766; i++) {
+        fprintf(output, "%ssll $zero, $zero, 0\n", i == 32763 ? "mid: " : "");
+    }
+    fprintf(output, "far: addiu $s2, $s2, 1\n");
+    fprintf(output, "beq $s1, $zero, back\n");
+    fprintf(output, "beq $s1, $zero, far\n");
+    fclose(output);
+
+    Program prog;
+    read_test_program(&prog, source);
+    uint32_t len = prog.code.len;
+    RelaxStats stats;
+    relax_program(&prog, 0, &stats);
+    CU_ASSERT_EQUAL(stats.relaxed, 3);
+    CU_ASSERT_EQUAL(stats.watched, 3);
+    CU_ASSERT_EQUAL(stats.checks, 3);
+    CU_ASSERT_EQUAL(prog.code.len, len + 3);
+    CU_ASSERT_EQUAL(prog.code.insts[2].inst.id, INST_BEQ);
+    CU_ASSERT_EQUAL(prog.code.insts[3].inst.id, INST_J);
+    CU_ASSERT_STRING_EQUAL(prog.code.insts[3].inst.label, "mid");
+    CU_ASSERT_EQUAL(prog.code.insts[5].inst.id, INST_BEQ);
+    CU_ASSERT_EQUAL(prog.code.insts[6].inst.id, INST_J);
+    CU_ASSERT_EQUAL(prog.code.insts[len].inst.id, INST_BNE);
+    CU_ASSERT_EQUAL(prog.code.insts[len + 1].inst.id, INST_J);
+    CU_ASSERT_EQUAL(prog.code.insts[len + 2].inst.id, INST_BEQ);
+
+    /* The result assembles and takes the same paths: blt to far, back once
+       through C, and on past everything. */
+    char* rewritten;
+    output = open_memstream(&rewritten, &size);
+    write_program_source(&prog, output);
+    fclose(output);
+    Simulator sim;
+    ObjectFile obj;
+    CU_ASSERT_EQUAL(simulate(&sim, &obj, rewritten, NULL, 0), SIM_EXITED);
+    CU_ASSERT_EQUAL(sim.regs[16], 0);
+    CU_ASSERT_EQUAL(sim.regs[17], 1);
+    CU_ASSERT_EQUAL(sim.regs[18], 2);
+    free_simulator(&sim);
+    free_object(&obj);
+    free(rewritten);
+
+    /* Relaxing again finds nothing. */
+    relax_program(&prog, 0, &stats);
+    CU_ASSERT_EQUAL(stats.relaxed, 0);
+    free_program(&prog);
+
+    /* Counting delay slots only ever relaxes more. */
+    read_test_program(&prog, source);
+    relax_program(&prog, 1, &stats);
+    CU_ASSERT(stats.relaxed >= 3);
+    free_program(&prog);
+
+    /* One pass reads the source again to relax it, so it writes the same
+       object as the two passes. */
+    CU_ASSERT_EQUAL(assemble_buffer(&obj, source, strlen(source), NULL, NULL), 0);
+    CU_ASSERT_EQUAL(obj.text.len, len + 3);
+    free_object(&obj);
+    FILE* file = fopen("relax.s", "w");
+    fputs(source, file);
+    fclose(file);
+    CU_ASSERT_EQUAL(assemble("relax.s", "relax.int", "two_pass.out"), 0);
+    CU_ASSERT_EQUAL(assemble_one_pass("relax.s", "one_pass.out"), 0);
+    char* expected = read_file("two_pass.out");
+    char* actual = read_file("one_pass.out");
+    CU_ASSERT_STRING_EQUAL(expected, actual);
+    free(actual);
+    free(expected);
+
+    /* Stream mode keeps its memory bounded and does not, even from a file:
+       B and C fail, and a note says why. */
+    int num_errors = 0;
+    file = fopen("relax.s", "r");
+    output = open_memstream(&actual, &size);
+    set_log_callback(count_error, &num_errors);
+    CU_ASSERT_EQUAL(assemble_stream(file, output), -1);
+    set_log_callback(NULL, NULL);
+    CU_ASSERT_EQUAL(num_errors, 3);
+    fclose(output);
+    fclose(file);
+    free(actual);
+
+    /* With a small window words are flushed before the program is known to
+       need relaxing, so A, still pending when flushed, B and C fail. */
+    num_errors = 0;
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    DataSegment data;
+    init_data_segment(&data);
+    WordBuffer words;
+    init_word_buffer(&words);
+    FILE* input = fmemopen(source, strlen(source), "r");
+    set_log_callback(count_error, &num_errors);
+    CU_ASSERT_EQUAL(one_pass(input, 16, collect_words, &words, symtbl, reltbl, &data), -1);
+    set_log_callback(NULL, NULL);
+    CU_ASSERT_EQUAL(num_errors, 4);
+    CU_ASSERT_EQUAL(words.len, len);
+    fclose(input);
+    free_word_buffer(&words);
+    free_data_segment(&data);
+    free_table(symtbl);
+    free_table(reltbl);
+    free(source);
+    remove("relax.s");
+    remove("relax.int");
+    remove("two_pass.out");
+    remove("one_pass.out");
+}
+
+void test_cfg() {
+    const char* source = "main: addiu $t0, $zero, 3\n"
+                         "outer: addiu $t1, $zero, 4\n"
+                         "inner: lw $t2, 0($sp)\n"
+                         "addu $t3, $t2, $t2\n"
+                         "addiu $t1, $t1, -1\n"
+                         "bne $t1, $zero, inner\n"
+                         "addiu $t0, $t0, -1\n"
+                         "blt $zero, $t0, outer\n"
+                         "jal func\n"
+                         "jr $ra\n"
+                         "func: addiu $v0, $zero, 1\n"
+                         "loop: beq $v0, $zero, done\n"
+                         "addiu $v0, $v0, -1\n"
+                         "j loop\n"
+                         "done: jr $ra\n";
+    Program prog;
+    read_test_program(&prog, source);
+    Cfg cfg;
+    build_cfg(&cfg, &prog);
+    CU_ASSERT_EQUAL(cfg.blocks.num_blocks, 10);
+    CU_ASSERT_EQUAL(cfg.num_edges, 11);
+    CU_ASSERT_EQUAL(cfg.num_calls, 1);
+    CU_ASSERT_EQUAL(cfg.callee[4], 6);
+    CU_ASSERT_EQUAL(cfg.num_loops, 3);
+
+    /* outer holds inner, and func's loop stands alone. */
+    CU_ASSERT_EQUAL(cfg.loops[0].header, 1);
+    CU_ASSERT_EQUAL(cfg.loops[0].parent, PROG_NONE);
+    CU_ASSERT_EQUAL(cfg.loops[0].num_blocks, 3);
+    CU_ASSERT_EQUAL(cfg.loops[0].num_insts, 8);
+    CU_ASSERT_EQUAL(cfg.loops[1].header, 2);
+    CU_ASSERT_EQUAL(cfg.loops[1].parent, 0);
+    CU_ASSERT_EQUAL(cfg.loops[1].depth, 2);
+    CU_ASSERT_EQUAL(cfg.loops[2].header, 7);
+    CU_ASSERT_EQUAL(cfg.loops[2].depth, 1);
+    CU_ASSERT_EQUAL(cfg.loop_of[0], PROG_NONE);
+    CU_ASSERT_EQUAL(cfg.loop_of[3], 0);
+    CU_ASSERT_EQUAL(cfg.loop_of[8], 2);
+
+    /* inner: four instructions, a load-use stall and the branch back;
+       outer adds its own four instructions and branch back. */
+    CU_ASSERT_EQUAL(cfg.loops[1].cycles, 6);
+    CU_ASSERT_EQUAL(cfg.loops[0].cycles, 11);
+    CU_ASSERT(!cfg.loops[0].irreducible);
+
+    char buf[4096];
+    FILE* output = fmemopen(buf, sizeof(buf), "w");
+    write_cfg_report(output, &cfg, &prog);
+    fclose(output);
+    CU_ASSERT_PTR_NOT_NULL(strstr(buf, "loops\t3\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(buf, "B3\t24\t3\t1\tB1 B4\t\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(buf, "B4\t36\t1\t0\tB5 call B6\t\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(buf, "\n  B2\tdepth 2\t1 blocks\t4 instructions\t6 cycles\tinner\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(buf, "6\t 37.5%\taddiu"));
+
+    output = fmemopen(buf, sizeof(buf), "w");
+    write_cfg_dot(output, &cfg, &prog);
+    fclose(output);
+    const char* outer = strstr(buf, "subgraph cluster_L0 {");
+    const char* inner = strstr(buf, "subgraph cluster_L1 {");
+    CU_ASSERT(outer && inner && outer < inner);
+    CU_ASSERT_PTR_NOT_NULL(strstr(buf, "B4 -> B6 [style=dotted];"));
+    free_cfg(&cfg);
+    free_program(&prog);
+
+    /* A loop entered at both a and b. */
+    read_test_program(&prog, "beq $t0, $zero, b\n"
+                             "a: addiu $t1, $t1, 1\n"
+                             "b: addiu $t2, $t2, 1\n"
+                             "bne $t2, $t3, a\n");
+    build_cfg(&cfg, &prog);
+    CU_ASSERT_EQUAL(cfg.num_loops, 1);
+    CU_ASSERT(cfg.loops[0].irreducible);
+    CU_ASSERT_EQUAL(cfg.loops[0].num_blocks, 2);
+    free_cfg(&cfg);
+    free_program(&prog);
+}
+
+/* Runs SOURCE and returns how many branches and jumps it executed, storing
+   its registers in REGS. */
+static uint64_t count_transfers(const char* source, uint32_t* regs) {
+    Simulator sim;
+    ObjectFile obj;
+    CU_ASSERT_EQUAL(simulate(&sim, &obj, source, NULL, 0), SIM_EXITED);
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < sim.len; i++) {
+        int cls = inst_class(sim.code[i].op);
+        count += cls == CLASS_BRANCH || cls == CLASS_JUMP ? sim.counts[i] : 0;
+    }
+    memcpy(regs, sim.regs, 31 * sizeof(uint32_t));
+    free_simulator(&sim);
+    free_object(&obj);
+    return count;
+}
+
+void test_jumps() {
+    const char* source = "main: addiu $t0, $zero, 3\n"
+                         "addiu $s0, $zero, 0\n"
+                         "top: beq $t0, $zero, L1\n"
+                         "addiu $s0, $s0, 2\n"
+                         "addiu $t0, $t0, -1\n"
+                         "j top\n"
+                         "addiu $s1, $s1, 99\n"
+                         "addiu $s1, $s1, 98\n"
+                         "L1: j L2\n"
+                         "addiu $s2, $s2, 1\n"
+                         "L2: beq $zero, $zero, L3\n"
+                         "L3: j end\n"
+                         "jr $ra\n"
+                         "end: addiu $s3, $zero, 7\n"
+                         "j out\n"
+                         "out: jr $ra\n";
+    Program prog;
+    JumpStats stats;
+    read_test_program(&prog, source);
+    thread_jumps(&prog, &stats);
+    /* top's beq, L1 and L2 all lead to end. */
+    CU_ASSERT_EQUAL(stats.retargeted, 3);
+    CU_ASSERT_STRING_EQUAL(prog.code.insts[2].inst.label, "end");
+    /* The two addius after j top, the one after L1 and the jr after L3. */
+    CU_ASSERT_EQUAL(stats.blocks_removed, 3);
+    CU_ASSERT_EQUAL(stats.insts_removed, 4);
+    /* L1, L2, L3 and j out now go where control falls anyway. */
+    CU_ASSERT_EQUAL(stats.jumps_removed, 4);
+    CU_ASSERT_EQUAL(prog.code.len, 8);
+    check_same_registers(&prog, source);
+
+    /* Fewer branches and jumps run, and the labels still name the
+       instructions control reaches through them. */
+    char rewritten[4096];
+    FILE* output = fmemopen(rewritten, sizeof(rewritten), "w");
+    write_program_source(&prog, output);
+    fclose(output);
+    uint32_t before[31], after[31];
+    CU_ASSERT_EQUAL(count_transfers(source, before), 12);
+    CU_ASSERT_EQUAL(count_transfers(rewritten, after), 8);
+    SymbolTable* symtbl = program_symbols(&prog);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(symtbl, "L1"), 24);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(symtbl, "L3"), 24);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(symtbl, "out"), 28);
+    free_table(symtbl);
+
+    /* Running it again finds nothing. */
+    thread_jumps(&prog, &stats);
+    CU_ASSERT_EQUAL(stats.retargeted + stats.jumps_removed + stats.insts_removed, 0);
+    free_program(&prog);
+
+    /* Cycles of jumps stay apart from the jump to the next instruction,
+       and labeled blocks are kept even when dead. */
+    read_test_program(&prog, "a: j b\n"
+                             "b: j a\n"
+                             "kept: addiu $t0, $t0, 1\n"
+                             "jr $ra\n");
+    thread_jumps(&prog, &stats);
+    CU_ASSERT_EQUAL(stats.retargeted, 0);
+    CU_ASSERT_EQUAL(stats.insts_removed, 0);
+    CU_ASSERT_EQUAL(stats.jumps_removed, 1);
+    CU_ASSERT_EQUAL(prog.code.len, 3);
+    free_program(&prog);
+}
+
+/* Assembles SOURCE into OBJ and returns how many errors it logged. */
+static int count_data_errors(const char* source) {
+    ObjectFile obj;
+    int num_errors = 0;
+    CU_ASSERT_EQUAL(assemble_buffer(&obj, source, strlen(source), count_error, &num_errors), -1);
+    free_object(&obj);
+    return num_errors;
+}
+
+void test_data() {
+    /* Values are packed big-endian, each aligned to its size, and a label
+       waiting for a directive names the aligned address. */
+    DataSegment data;
+    init_data_segment(&data);
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    char bytes[] = "1, -1 0x7f ";
+    CU_ASSERT_EQUAL(add_data(&data, symtbl, ".byte", bytes, 1), 0);
+    CU_ASSERT_EQUAL(data.len, 3);
+    add_to_table(symtbl, "w", DATA_BASE + data.len);
+    char word[] = "0x12345678";
+    CU_ASSERT_EQUAL(add_data(&data, symtbl, ".word", word, 2), 0);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(symtbl, "w"), DATA_BASE + 4);
+    char half[] = "-2";
+    CU_ASSERT_EQUAL(add_data(&data, symtbl, ".half", half, 3), 0);
+    char strings[] = "\"a#\\n\\\"\", \"\"";
+    CU_ASSERT_EQUAL(add_data(&data, symtbl, ".asciiz", strings, 4), 0);
+    CU_ASSERT_EQUAL(data.len, 16);
+    char space[] = "3";
+    CU_ASSERT_EQUAL(add_data(&data, symtbl, ".space", space, 5), 0);
+    char align[] = "2";
+    CU_ASSERT_EQUAL(add_data(&data, symtbl, ".align", align, 6), 0);
+    CU_ASSERT_EQUAL(data.len, 20);
+    CU_ASSERT_EQUAL(data.words.len, 5);
+    CU_ASSERT_EQUAL(data.words.words[0], 0x01ff7f00);
+    CU_ASSERT_EQUAL(data.words.words[1], 0x12345678);
+    CU_ASSERT_EQUAL(data.words.words[2], 0xfffe6123);
+    CU_ASSERT_EQUAL(data.words.words[3], 0x0a220000);
+    CU_ASSERT_EQUAL(data.words.words[4], 0);
+
+    /* Out of range, malformed or missing operands are rejected. */
+    const char* bad[][2] = { { ".byte", "256" }, { ".half", "1x" }, { ".word", "" },
+        { ".align", "3" }, { ".space", "-1" }, { ".asciiz", "\"\\q\"" }, { ".asciiz", "x" },
+        { ".word", "4294967296" }, { ".ascii", "\"x\"" } };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        char operands[32];
+        strcpy(operands, bad[i][1]);
+        CU_ASSERT_EQUAL(add_data(&data, symtbl, bad[i][0], operands, 7), -1);
+    }
+    free_data_segment(&data);
+    free_table(symtbl);
+
+    /* A long line is parsed in one go. */
+    size_t size;
+    char* source;
+    FILE* output = open_memstream(&source, &size);
+    fprintf(output, ".data\ntable: .word 0");
+    for (int i = 1; i < 10000; i++) {
+        fprintf(output, ", %d", i * 123457);
+    }
+    fprintf(output, "\n");
+    fclose(output);
+    ObjectFile obj;
+    CU_ASSERT_EQUAL(assemble_buffer(&obj, source, strlen(source), NULL, NULL), 0);
+    CU_ASSERT_EQUAL(obj.text.len, 0);
+    CU_ASSERT_EQUAL(obj.data.len, 10000);
+    if (obj.data.len == 10000) {
+        CU_ASSERT_EQUAL(obj.data.words[9999], 9999u * 123457);
+    }
+    CU_ASSERT_EQUAL(get_addr_for_symbol(obj.symtbl, "table"), DATA_BASE);
+    free_object(&obj);
+    free(source);
+
+    /* Numbers are read as translate_num() reads them. */
+    const char* nums[] = { "123456789012,", "0xdeadBEEF", "-2147483648", "012", "99999999 " };
+    long int values[] = { 123456789012, 0xdeadbeef, -2147483648l, 10, 99999999 };
+    size_t lens[] = { 12, 10, 11, 3, 8 };
+    for (size_t i = 0; i < 5; i++) {
+        long int value = 0;
+        const char* end = nums[i] + strlen(nums[i]);
+        const char* next = scan_num(&value, nums[i], end, LONG_MIN, LONG_MAX);
+        CU_ASSERT(next == nums[i] + lens[i]);
+        CU_ASSERT_EQUAL(value, values[i]);
+    }
+    const char* bad_nums[] = { "4294967296", "09", "x1", "-" };
+    for (size_t i = 0; i < 4; i++) {
+        long int value;
+        const char* end = bad_nums[i] + strlen(bad_nums[i]);
+        CU_ASSERT_PTR_NULL(scan_num(&value, bad_nums[i], end, 0, UINT32_MAX));
+    }
+
+    /* Segments are switched by .text and .data, and each only takes its
+       own kind of line. */
+    CU_ASSERT_EQUAL(count_data_errors(".data\naddiu $t0, $t0, 1\n"), 1);
+    CU_ASSERT_EQUAL(count_data_errors(".text\n.word 1\n"), 1);
+    CU_ASSERT_EQUAL(count_data_errors(".data 4\n"), 1);
+    CU_ASSERT_EQUAL(count_data_errors(".data\n.byte 1, 2, 300\n.half 70000\n"), 2);
+
+    /* Data goes after .text when loaded, and la finds it there. */
+    const char* first = "main: la $a0, msg\n"
+                        "la $a1, val\n"
+                        ".data\n"
+                        "msg: .asciiz \"hey # there\\n\"\n"
+                        ".text\n"
+                        "addiu $v0, $zero, 4\n"
+                        "syscall\n"
+                        "lw $t0, 0($a1)\n"
+                        "addiu $v0, $zero, 10\n"
+                        "syscall\n";
+    const char* second = ".data\n"
+                         "val: .word 42\n"
+                         ".text\n"
+                         "helper: jr $ra\n";
+    char combined[512];
+    strcpy(combined, first);
+    strcat(combined, second);
+    Simulator sim;
+    output = tmpfile();
+    CU_ASSERT_EQUAL(simulate(&sim, &obj, combined, output, 0), SIM_EXITED);
+    CU_ASSERT_EQUAL(obj.text.len, 10);
+    CU_ASSERT_EQUAL(obj.data.len, 5);
+    CU_ASSERT_EQUAL(sim.regs[8], 42);
+    char printed[32] = { 0 };
+    rewind(output);
+    CU_ASSERT_EQUAL(fread(printed, 1, sizeof(printed) - 1, output), 12);
+    CU_ASSERT_STRING_EQUAL(printed, "hey # there\n");
+    free_simulator(&sim);
+    free_object(&obj);
+    fclose(output);
+
+    /* The object's .data section reads back, and the disassembly
+       assembles back into the same words. */
+    CU_ASSERT_EQUAL(assemble_buffer(&obj, first, strlen(first), NULL, NULL), 0);
+    FILE* file = tmpfile();
+    CU_ASSERT_EQUAL(write_object(file, &obj), 0);
+    rewind(file);
+    char text[4096];
+    size_t len = fread(text, 1, sizeof(text) - 1, file);
+    text[len] = '\0';
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "\n.data\n68657920\n23207468\n6572650a\n00000000\n\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "268435456\tmsg\n"));
+    rewind(file);
+    ObjectFile again;
+    CU_ASSERT_EQUAL(read_object(&again, file, "tmpfile"), 0);
+    CU_ASSERT_EQUAL(again.data.len, 4);
+    CU_ASSERT_EQUAL(again.data.words[3], 0);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(again.symtbl, "msg"), DATA_BASE);
+    free_object(&again);
+    fclose(file);
+
+    len = disassemble_to_buffer(&obj, text, sizeof(text));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "\t.data\nmsg:\n\t.word 0x68657920\n"));
+    CU_ASSERT_EQUAL(assemble_buffer(&again, text, len, NULL, NULL), 0);
+    CU_ASSERT_EQUAL(again.data.len, obj.data.len);
+    if (again.data.len == obj.data.len) {
+        CU_ASSERT_EQUAL(memcmp(again.data.words, obj.data.words, obj.data.len * 4), 0);
+    }
+    free_object(&again);
+
+    /* A label inside a word is shown between its bytes. */
+    const char* inside = ".data\n.byte 1\nb: .byte 2\n";
+    CU_ASSERT_EQUAL(assemble_buffer(&again, inside, strlen(inside), NULL, NULL), 0);
+    disassemble_to_buffer(&again, text, sizeof(text));
+    CU_ASSERT_STRING_EQUAL(text, "\t.data\n\t.byte 0x01\nb:\n\t.byte 0x02\n"
+        "\t.byte 0x00\n\t.byte 0x00\n");
+    free_object(&again);
+
+    /* Linking appends each object's .data in order, word aligned. */
+    char first_name[32], second_name[32];
+    file = tmpfile();
+    CU_ASSERT_EQUAL(write_object(file, &obj), 0);
+    rewind(file);
+    len = fread(text, 1, sizeof(text) - 1, file);
+    text[len] = '\0';
+    write_temp_object(first_name, text);
+    fclose(file);
+    free_object(&obj);
+    CU_ASSERT_EQUAL(assemble_buffer(&obj, second, strlen(second), NULL, NULL), 0);
+    file = tmpfile();
+    CU_ASSERT_EQUAL(write_object(file, &obj), 0);
+    rewind(file);
+    len = fread(text, 1, sizeof(text) - 1, file);
+    text[len] = '\0';
+    write_temp_object(second_name, text);
+    fclose(file);
+    free_object(&obj);
+
+    LinkInput inputs[2];
+    inputs[0].name = first_name;
+    inputs[1].name = second_name;
+    CU_ASSERT_EQUAL(load_objects(inputs, 2, 2), 0);
+    ObjectFile out;
+    CU_ASSERT_EQUAL(link_objects(&out, inputs, 2, 2), 0);
+    CU_ASSERT_EQUAL(out.text.len, 10);
+    CU_ASSERT_EQUAL(out.data.len, 5);
+    CU_ASSERT_EQUAL(out.data.words[4], 42);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(out.symtbl, "val"), DATA_BASE + 16);
+    WordBuffer image;
+    init_word_buffer(&image);
+    CU_ASSERT_EQUAL(load_image(&image, &out, 0x400000), 0);
+    CU_ASSERT_EQUAL(image.len, 15);
+    /* la $a1, val loads 0x400000 + 40 + 16. */
+    CU_ASSERT_EQUAL(image.words[2], 0x3c050040);
+    CU_ASSERT_EQUAL(image.words[3], 0x34a50038);
+    CU_ASSERT_EQUAL(image.words[14], 42);
+    free_word_buffer(&image);
+    CU_ASSERT_EQUAL(init_simulator(&sim, &out, 4096), 0);
+    sim.output = NULL;
+    CU_ASSERT_EQUAL(run_simulator(&sim, 0), SIM_EXITED);
+    CU_ASSERT_EQUAL(sim.regs[8], 42);
+    free_simulator(&sim);
+    free_object(&out);
+    free_link_inputs(inputs, 2);
+    unlink(first_name);
+    unlink(second_name);
+}
+
 int main(int argc, char** argv) {
     CU_pSuite pSuite1 = NULL, pSuite2 = NULL;
     CU_pSuite pSuite3 = NULL, pSuite4 = NULL;
+    CU_pSuite pSuite5 = NULL;
 
 
 
@@ -826,6 +3183,9 @@ int main(int argc, char** argv) {
     if (!CU_add_test(pSuite1, "test_translate_num", test_translate_num)) {
         goto exit;
     }
+    if (!CU_add_test(pSuite1, "test_parse_size", test_parse_size)) {
+        goto exit;
+    }
 
     /* Suite 2 */
     pSuite2 = CU_add_suite("Testing tables.c", init_log_file, NULL);
@@ -838,6 +3198,21 @@ int main(int argc, char** argv) {
     if (!CU_add_test(pSuite2, "test_table_2", test_table_2)) {
         goto exit;
     }
+    if (!CU_add_test(pSuite2, "test_table_image", test_table_image)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite2, "test_counting_allocator", test_counting_allocator)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite2, "test_allocator_limit", test_allocator_limit)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite2, "test_arena_allocator", test_arena_allocator)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite2, "test_pass_two_allocations", test_pass_two_allocations)) {
+        goto exit;
+    }
 
    /* Suite 3 */
     pSuite3 = CU_add_suite("Testing translate.c: PART N1", NULL, NULL);
@@ -896,6 +3271,78 @@ int main(int argc, char** argv) {
         goto exit;
     }
 
+    /* Suite 5 */
+    pSuite5 = CU_add_suite("Testing assembler.c", NULL, NULL);
+    if (!pSuite5) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "binary intermediate", test_binary_intermediate)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "ELF object", test_elf_object)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "linking objects", test_link_objects)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "loading images", test_load_image)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "ELF round trip", test_elf_round_trip)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "typed relocations", test_typed_relocations)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "stream mode", test_stream_mode)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "one-pass mode", test_one_pass)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "in-memory buffers", test_assemble_buffer)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "batched encoder", test_encode_block)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "instruction table", test_isa_table)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "disassembler", test_disassembler)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "simulator", test_simulator)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "jit", test_jit)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "block layout", test_layout)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "peephole", test_peephole)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "scheduler", test_schedule)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "li synthesis", test_li_synthesis)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "branch relaxation", test_relax)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "control-flow graph", test_cfg)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "jump threading", test_jumps)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, ".data segment", test_data)) {
+        goto exit;
+    }
+
     CU_basic_set_mode(CU_BRM_VERBOSE);
     CU_basic_run_tests();
 